@@ -20,6 +20,9 @@
 
 # Debug message behaviour: Edit `INIT_DBG_MODES` in kernel/util/debug.c to set
 # which messages are shown.
+# With DBG_SYSCALLS=0, the DBG_SYSCALL messages logged on every system call
+# are compiled out altogether instead of only being hidden.
+    DBG_SYSCALLS=1
 
 # Switches for non-required components. If you wish to try implementing
 # some extra features in Weenix, there are some pre-designed features
@@ -34,13 +37,13 @@
 # first, and make sure to make a copy of your working Weenix before you
 # go breaking it, which we promise you will happen.
 
-         SHADOWD=0 # shadow page cleanup
+         SHADOWD=1 # shadow page cleanup
         MOUNTING=0 # be able to mount multiple file systems
           GETCWD=0 # getcwd(3) syscall-like functionality
         UPREEMPT=0 # userland preemption
         KPREEMPT=0 # kernel space preemption
              MTP=0 # multiple kernel threads per process
-           PIPES=0 # pipe(2) functionality
+           PIPES=1 # pipe(2) functionality
           VGABUF=0 # Use a rudimentary VGA buffers instead of VT support.
 	KPREEMPT=0
         RENAMEDIR=0
@@ -48,8 +51,22 @@
 # Set the number of terminals that we should be launching.
         NTERMS=3
 
-# Set the number of disks that we should be launching with
+# Set the number of disks that we should be launching with. With more than
+# one, the last disk is used as swap space for anonymous memory, which only
+# exists once VM is enabled.
+ifeq ($(strip $(VM)),1)
+        NDISKS=2
+else
         NDISKS=1
+endif
+
+# Size of the swap disk (disk1.img) in blocks, one page each
+        SWAP_BLOCKS=8192
+
+# Number of RAM disks (/dev/ramdisk0, ...) and the size of each in blocks,
+# one page each. Pages are only allocated for blocks that have been written.
+        RAMDISKS=1
+        RAMDISK_BLOCKS=4096
 
 # terminal binary to use when opening a second terminal for gdb
         GDB_TERM=xterm
@@ -67,6 +84,6 @@
 
 # Boolean options specified in this specified in this file that should be
 # included as definitions at compile time
-        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC MOUNTING MTP GETCWD RENAMEDIR UPREEMPT PIPES KPREEMPT"
+        COMPILE_CONFIG_BOOLS=" DRIVERS VFS S5FS VM FI DYNAMIC SHADOWD MOUNTING MTP GETCWD RENAMEDIR UPREEMPT PIPES KPREEMPT DBG_SYSCALLS "
 # As above, but not booleans
-        COMPILE_CONFIG_DEFS=" NTERMS NDISKS DBG DISK_SIZE "
+        COMPILE_CONFIG_DEFS=" NTERMS NDISKS SWAP_BLOCKS RAMDISKS RAMDISK_BLOCKS DBG DISK_SIZE "
@@ -7,6 +7,9 @@
 
 #include "mm/kmalloc.h"
 #include "mm/mman.h"
+#include "mm/page.h"
+
+#include "vm/vmmap.h"
 
 #include "api/access.h"
 #include "api/syscall.h"
@@ -16,36 +19,62 @@ static inline long userland_address(const void *addr)
     return addr >= (void *)USER_MEM_LOW && addr < (void *)USER_MEM_HIGH;
 }
 
+static inline long userland_range(const void *addr, size_t nbytes)
+{
+    return addr >= (void *)USER_MEM_LOW &&
+           nbytes <= USER_MEM_HIGH - (uintptr_t)addr;
+}
+
 /*
- * Check for permissions on [uaddr, uaddr + nbytes), then
- * copy nbytes from userland address uaddr to kernel address kaddr.
- * Do not access the userland virtual addresses directly; instead,
- * use vmmap_read.
+ * Copy nbytes from src to dst, one of which is in the current address space.
+ * A page fault on the user side is handled like the process's own would be;
+ * if that fails, _pt_fault_handler() resumes at the fixup label listed in the
+ * exception table and the copy stops early. Returns the number of bytes not
+ * copied.
+ */
+static size_t user_copy(void *dst, const void *src, size_t nbytes)
+{
+    __asm__ volatile("cld\n"
+                     "1: rep movsb\n"
+                     "2:\n"
+                     ".pushsection .ex_table, \"a\"\n"
+                     ".balign 8\n"
+                     ".quad 1b, 2b\n"
+                     ".popsection\n"
+                     : "+D"(dst), "+S"(src), "+c"(nbytes)
+                     :
+                     : "memory");
+    return nbytes;
+}
+
+/*
+ * Copy nbytes from userland address uaddr to kernel address kaddr. The
+ * process's permissions on the pages are checked when they fault in, so
+ * nothing is looked up when they are already mapped.
  */
 long copy_from_user(void *kaddr, const void *uaddr, size_t nbytes)
 {
-    if (!range_perm(curproc, uaddr, nbytes, PROT_READ))
+    if (!userland_range(uaddr, nbytes))
     {
         return -EFAULT;
     }
-    KASSERT(userland_address(uaddr) && !userland_address(kaddr));
-    return vmmap_read(curproc->p_vmmap, uaddr, kaddr, nbytes);
+    KASSERT(!userland_address(kaddr));
+    return user_copy(kaddr, uaddr, nbytes) ? -EFAULT : 0;
 }
 
 /*
- * Check for permissions on [uaddr, uaddr + nbytes), then
- * copy nbytes from kernel address kaddr to userland address uaddr.
- * Do not access the userland virtual addresses directly; instead,
- * use vmmap_write.
+ * Copy nbytes from kernel address kaddr to userland address uaddr. Pages
+ * that are mapped read-only, such as copy-on-write ones, fault like user
+ * writes do because the kernel runs with CR0.WP set.
  */
 long copy_to_user(void *uaddr, const void *kaddr, size_t nbytes)
 {
-    if (!range_perm(curproc, uaddr, nbytes, PROT_WRITE))
+    if (!userland_range(uaddr, nbytes))
     {
         return -EFAULT;
     }
-    KASSERT(userland_address(uaddr) && !userland_address(kaddr));
-    return vmmap_write(curproc->p_vmmap, uaddr, kaddr, nbytes);
+    KASSERT(!userland_address(kaddr));
+    return user_copy(uaddr, kaddr, nbytes) ? -EFAULT : 0;
 }
 
 /*
@@ -116,8 +145,8 @@ long user_vecdup(argvec_t *uvec, char ***kvecp)
  */
 long addr_perm(proc_t *p, const void *vaddr, int perm)
 {
-    NOT_YET_IMPLEMENTED("VM: addr_perm");
-    return 0;
+    vmarea_t *vma = vmmap_lookup(p->p_vmmap, ADDR_TO_PN(vaddr));
+    return vma && (vma->vma_prot & perm) == perm;
 }
 
 /*
@@ -131,6 +160,16 @@ long addr_perm(proc_t *p, const void *vaddr, int perm)
  */
 long range_perm(proc_t *p, const void *vaddr, size_t len, int perm)
 {
-    NOT_YET_IMPLEMENTED("VM: range_perm");
-    return 0;
+    size_t vfn = ADDR_TO_PN(vaddr);
+    size_t end = ADDR_TO_PN(PAGE_ALIGN_UP((uintptr_t)vaddr + len));
+    while (vfn < end)
+    {
+        vmarea_t *vma = vmmap_lookup(p->p_vmmap, vfn);
+        if (!vma || (vma->vma_prot & perm) != perm)
+        {
+            return 0;
+        }
+        vfn = vma->vma_end;
+    }
+    return 1;
 }
@@ -178,7 +178,12 @@ static long _elf64_map_segment(vmmap_t *map, vnode_t *file, int64_t memoff,
             if (!buf)
                 return -ENOMEM;
 
-            vlock(file);
+            /*
+             * Keep the file from changing until its bytes are in place. The
+             * write below only needs the file's object, which a shared lock
+             * leaves unlocked (see vnode_t's vn_rwlock).
+             */
+            vlock_shared(file);
             ret = file->vn_ops->read(file,
                                      (size_t)PAGE_ALIGN_DOWN(off + filesz - 1),
                                      buf, PAGE_OFFSET(addr + filesz));
@@ -188,7 +193,7 @@ static long _elf64_map_segment(vmmap_t *map, vnode_t *file, int64_t memoff,
                 ret = vmmap_write(map, PAGE_ALIGN_DOWN(addr + filesz - 1), buf,
                                   PAGE_OFFSET(addr + filesz));
             }
-            vunlock(file);
+            vunlock_shared(file);
             page_free(buf);
             return ret;
         }
@@ -3,16 +3,24 @@
 #include "kernel.h"
 #include <fs/vfs.h>
 #include <util/time.h>
+#include "util/bits.h"
 
 #include "main/inits.h"
 #include "main/interrupt.h"
 
 #include "mm/kmalloc.h"
 #include "mm/mman.h"
+#include "mm/page.h"
 
+#include "fs/epoll.h"
+#include "fs/fcntl.h"
+#include "fs/file.h"
+#include "fs/uio.h"
 #include "fs/vfs_syscall.h"
 #include "fs/vnode.h"
 
+#include "proc/futex.h"
+
 #include "drivers/tty/tty.h"
 #include "test/kshell/kshell.h"
 
@@ -30,7 +38,22 @@ static long syscall_dispatch(size_t sysnum, uintptr_t args, regs_t *regs);
 
 extern size_t active_tty;
 
-static const char *syscall_strings[49] = {
+/*
+ * dbg(DBG_SYSCALL, ...) for the messages logged on every system call. With
+ * DBG_SYSCALLS=0 in Config.mk, these compile to nothing, and so do
+ * syscall_strings and syscall_name().
+ */
+#ifdef __DBG_SYSCALLS__
+#define dbg_syscall(...) dbg(DBG_SYSCALL, __VA_ARGS__)
+#else
+#define dbg_syscall(...) \
+    do                   \
+    {                    \
+    } while (0)
+#endif
+
+#ifdef __DBG_SYSCALLS__
+static const char *syscall_strings[] = {
     "syscall", "exit", "fork", "read", "write", "open",
     "close", "waitpid", "link", "unlink", "execve", "chdir",
     "sleep", "unknown", "lseek", "sync", "nuke", "dup",
@@ -38,7 +61,13 @@ static const char *syscall_strings[49] = {
     "mmap", "mprotect", "munmap", "rename", "uname", "thr_create",
     "thr_cancel", "thr_exit", "thr_yield", "thr_join", "gettid", "getpid",
     "unknown", "unkown", "unknown", "errno", "halt", "get_free_mem",
-    "set_errno", "dup2", "brk", "mount", "umount", "stat", "usleep"};
+    "set_errno", "dup2", "brk", "mount", "umount", "stat",
+    "time", "usleep", "madvise", "fadvise", "clock_gettime", "futex",
+    "pread", "pwrite", "readv", "writev", "preadv", "pwritev",
+    "sendfile", "splice", "epoll_create", "epoll_ctl", "epoll_wait",
+    "ring_enter", "multicall", "openat", "fstatat", "mkdirat", "unlinkat",
+    "renameat", "clone_file_range"};
+#endif
 
 void syscall_init(void) { intr_register(INTR_SYSCALL, syscall_handler); }
 
@@ -53,6 +82,28 @@ void syscall_init(void) { intr_register(INTR_SYSCALL, syscall_handler); }
 // if ret < 0, set errno to -ret and return -1
 #define ERROR_OUT_RET(ret) ERROR_OUT(ret < 0, -ret)
 
+/* most pages sys_read() and sys_write() stage data through at once */
+#define SYSCALL_BUF_PAGES 16
+
+/*
+ * Allocate the kernel buffer read(2) and write(2) copy data through, big
+ * enough for nbytes if possible. Falls back to a single page when memory is
+ * fragmented. Free it with page_free_n(buf, *npagesp).
+ */
+static void *syscall_buf_alloc(size_t nbytes, size_t *npagesp)
+{
+    size_t npages = ADDR_TO_PN(PAGE_ALIGN_UP(nbytes));
+    npages = MAX(1, MIN(npages, SYSCALL_BUF_PAGES));
+    void *buf = page_alloc_n(npages);
+    if (!buf && npages > 1)
+    {
+        npages = 1;
+        buf = page_alloc_n(npages);
+    }
+    *npagesp = npages;
+    return buf;
+}
+
 /*
  * Be sure to look at other examples of implemented system calls to see how
  * this should be done - the general outline is as follows.
@@ -69,8 +120,68 @@ void syscall_init(void) { intr_register(INTR_SYSCALL, syscall_handler); }
  */
 static long sys_read(read_args_t *args)
 {
-    NOT_YET_IMPLEMENTED("VM: sys_read");
-    return -1;
+    read_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    /* a larger read returns short, which read(2) is allowed to do */
+    size_t npages;
+    void *kbuf = syscall_buf_alloc(kargs.nbytes, &npages);
+    ERROR_OUT(!kbuf, ENOMEM);
+
+    ret = do_read(kargs.fd, kbuf, MIN(kargs.nbytes, npages * PAGE_SIZE));
+    if (ret > 0 && copy_to_user(kargs.buf, kbuf, (size_t)ret))
+    {
+        ret = -EFAULT;
+    }
+    page_free_n(kbuf, npages);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+/*
+ * Write the whole pages at the start of a large write(2), each copied into a
+ * page of its own which is then handed to the file (see do_write_page()), so
+ * that a pipe does not copy the data a second time. For a file that does not
+ * take pages, this writes nothing, and the caller stages the data as usual.
+ * Returns the number of bytes written, or -errno if none were.
+ */
+static long sys_write_pages(int fd, const char *buf, size_t nbytes)
+{
+    file_t *file = fget_light(fd);
+    long takes_pages = file && file->f_vnode->vn_ops->write_page;
+    if (file)
+    {
+        fput_light(&file);
+    }
+    if (!takes_pages)
+    {
+        return 0;
+    }
+
+    size_t total = 0;
+    long ret = 0;
+    while (nbytes - total >= PAGE_SIZE)
+    {
+        void *page = page_alloc();
+        if (!page)
+        {
+            break;
+        }
+        ret = copy_from_user(page, buf + total, PAGE_SIZE);
+        if (!ret)
+        {
+            ret = do_write_page(fd, page, PAGE_SIZE);
+        }
+        if (ret < 0)
+        {
+            page_free(page);
+            break;
+        }
+        total += ret;
+    }
+    return total ? (long)total : ret;
 }
 
 /*
@@ -80,12 +191,449 @@ static long sys_read(read_args_t *args)
  * This function is very similar to sys_read - see above comments. You'll need
  * to use the functions copy_from_user() and do_write(). Make sure to
  * allocate a new temporary buffer for the data that is being written. This
- * is to ensure that pagefaults within kernel mode do not happen. 
+ * is to ensure that user pages are not faulted in while the vnode is locked.
  */
 static long sys_write(write_args_t *args)
 {
-    NOT_YET_IMPLEMENTED("VM: sys_write");
-    return -1;
+    write_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    size_t total = 0;
+    if (kargs.nbytes >= PAGE_SIZE)
+    {
+        ret = sys_write_pages(kargs.fd, kargs.buf, kargs.nbytes);
+        ERROR_OUT_RET(ret);
+        total = ret;
+        if (total == kargs.nbytes || total % PAGE_SIZE)
+        {
+            return total;
+        }
+    }
+
+    size_t npages;
+    void *kbuf = syscall_buf_alloc(kargs.nbytes - total, &npages);
+    if (!kbuf && total)
+    {
+        return total;
+    }
+    ERROR_OUT(!kbuf, ENOMEM);
+
+    do
+    {
+        size_t n = MIN(kargs.nbytes - total, npages * PAGE_SIZE);
+        ret = copy_from_user(kbuf, (char *)kargs.buf + total, n);
+        if (!ret)
+        {
+            ret = do_write(kargs.fd, kbuf, n);
+        }
+        if (ret < 0)
+        {
+            break;
+        }
+        total += ret;
+        if ((size_t)ret < n)
+        {
+            break;
+        }
+    } while (total < kargs.nbytes);
+    page_free_n(kbuf, npages);
+
+    if (total)
+    {
+        return total;
+    }
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+/*
+ * The common part of the pread(2), pwrite(2) and readv(2) families: like
+ * sys_read() and sys_write(), stage the user buffers iov (already copied into
+ * the kernel) through a kernel buffer, but with the file locked across the
+ * whole vector however many buffer-fulls it takes (see do_prwv_user()).
+ * offset is -1 to use the file position.
+ */
+static long sys_rw_iov(int fd, const struct iovec *iov, int iovcnt,
+                       off_t offset, int write)
+{
+    /* the total must fit in the ssize_t returned */
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        ERROR_OUT(iov[i].iov_len > ((size_t)-1 >> 1) - total, EINVAL);
+        total += iov[i].iov_len;
+    }
+
+    size_t npages;
+    void *kbuf = syscall_buf_alloc(total, &npages);
+    ERROR_OUT(!kbuf, ENOMEM);
+
+    long ret = do_prwv_user(fd, iov, iovcnt, offset, write, kbuf,
+                            npages * PAGE_SIZE);
+    page_free_n(kbuf, npages);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_pread(pread_args_t *args)
+{
+    pread_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.offset < 0, EINVAL);
+
+    struct iovec iov = {.iov_base = kargs.buf, .iov_len = kargs.nbytes};
+    return sys_rw_iov(kargs.fd, &iov, 1, kargs.offset, 0);
+}
+
+static long sys_pwrite(pwrite_args_t *args)
+{
+    pwrite_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.offset < 0, EINVAL);
+
+    struct iovec iov = {.iov_base = kargs.buf, .iov_len = kargs.nbytes};
+    return sys_rw_iov(kargs.fd, &iov, 1, kargs.offset, 1);
+}
+
+/*
+ * readv(2), writev(2), preadv(2) and pwritev(2). positional is set for the
+ * latter two, which take kargs.offset.
+ */
+static long sys_rwv(iov_args_t *args, int positional, int write)
+{
+    iov_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.iovcnt < 0 || kargs.iovcnt > IOV_MAX, EINVAL);
+    ERROR_OUT(positional && kargs.offset < 0, EINVAL);
+    if (!kargs.iovcnt)
+    {
+        return 0;
+    }
+
+    struct iovec *iov = kmalloc(kargs.iovcnt * sizeof(struct iovec));
+    ERROR_OUT(!iov, ENOMEM);
+    ret = copy_from_user(iov, kargs.iov, kargs.iovcnt * sizeof(struct iovec));
+    if (!ret)
+    {
+        ret = sys_rw_iov(kargs.fd, iov, kargs.iovcnt,
+                         positional ? kargs.offset : -1, write);
+    }
+    else
+    {
+        curthr->kt_errno = -ret;
+        ret = -1;
+    }
+    kfree(iov);
+    return ret;
+}
+
+/*
+ * Move data between two files with do_splice(). in_off and out_off are user
+ * pointers to the offsets to use instead of the file positions, or NULL, and
+ * are advanced past the bytes moved.
+ */
+static long sys_splice_common(int in_fd, off_t *in_off, int out_fd,
+                              off_t *out_off, size_t count)
+{
+    off_t kin_off = 0, kout_off = 0;
+    long ret;
+    if (in_off)
+    {
+        ret = copy_from_user(&kin_off, in_off, sizeof(off_t));
+        ERROR_OUT_RET(ret);
+        ERROR_OUT(kin_off < 0, EINVAL);
+    }
+    if (out_off)
+    {
+        ret = copy_from_user(&kout_off, out_off, sizeof(off_t));
+        ERROR_OUT_RET(ret);
+        ERROR_OUT(kout_off < 0, EINVAL);
+    }
+
+    ret = do_splice(in_fd, in_off ? &kin_off : NULL, out_fd,
+                    out_off ? &kout_off : NULL, count);
+    if (ret > 0 && in_off && copy_to_user(in_off, &kin_off, sizeof(off_t)))
+    {
+        ret = -EFAULT;
+    }
+    if (ret > 0 && out_off && copy_to_user(out_off, &kout_off, sizeof(off_t)))
+    {
+        ret = -EFAULT;
+    }
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_sendfile(sendfile_args_t *args)
+{
+    sendfile_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    return sys_splice_common(kargs.in_fd, kargs.offset, kargs.out_fd, NULL,
+                             kargs.count);
+}
+
+static long sys_splice(splice_args_t *args)
+{
+    splice_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    return sys_splice_common(kargs.fd_in, kargs.off_in, kargs.fd_out,
+                             kargs.off_out, kargs.len);
+}
+
+static long sys_epoll_create(void)
+{
+    long ret = do_epoll_create();
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_epoll_ctl(epoll_ctl_args_t *args)
+{
+    epoll_ctl_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    struct epoll_event kevent;
+    if (kargs.op != EPOLL_CTL_DEL)
+    {
+        ret = copy_from_user(&kevent, kargs.event, sizeof(kevent));
+        ERROR_OUT_RET(ret);
+    }
+
+    ret = do_epoll_ctl(kargs.epfd, kargs.op, kargs.fd, &kevent);
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_epoll_wait(epoll_wait_args_t *args)
+{
+    epoll_wait_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.maxevents <= 0, EINVAL);
+
+    int maxevents = MIN(kargs.maxevents, EPOLL_MAX_EVENTS);
+    struct epoll_event *kevents = kmalloc(maxevents * sizeof(*kevents));
+    ERROR_OUT(!kevents, ENOMEM);
+
+    ret = do_epoll_wait(kargs.epfd, kevents, maxevents, kargs.timeout);
+    if (ret > 0)
+    {
+        long err = copy_to_user(kargs.events, kevents, ret * sizeof(*kevents));
+        if (err)
+        {
+            ret = err;
+        }
+    }
+    kfree(kevents);
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+/* most ring entries sys_ring_enter() copies in or out at once */
+#define RING_BATCH 16
+
+/*
+ * IORING_OP_READ and IORING_OP_WRITE: like sys_read() and sys_write(), stage
+ * the data through a kernel buffer, which is allocated on first use and then
+ * kept for the rest of the batch in *kbufp (*npagesp pages long).
+ */
+static long ring_rw(io_sqe_t *sqe, void **kbufp, size_t *npagesp)
+{
+    if (sqe->off < -1 || sqe->len > ((size_t)-1 >> 1))
+    {
+        return -EINVAL;
+    }
+    if (!*kbufp &&
+        !(*kbufp = syscall_buf_alloc(SYSCALL_BUF_PAGES * PAGE_SIZE, npagesp)))
+    {
+        return -ENOMEM;
+    }
+
+    size_t done = 0;
+    long ret = 0;
+    while (done < sqe->len)
+    {
+        size_t n = MIN(sqe->len - done, *npagesp * PAGE_SIZE);
+        struct iovec kiov = {.iov_base = *kbufp, .iov_len = n};
+        off_t pos = sqe->off < 0 ? -1 : sqe->off + (off_t)done;
+        if (sqe->opcode == IORING_OP_WRITE)
+        {
+            ret = copy_from_user(*kbufp, (char *)sqe->addr + done, n);
+            if (!ret)
+            {
+                ret = do_pwritev(sqe->fd, &kiov, 1, pos);
+            }
+        }
+        else
+        {
+            ret = do_preadv(sqe->fd, &kiov, 1, pos);
+            if (ret > 0 &&
+                copy_to_user((char *)sqe->addr + done, *kbufp, (size_t)ret))
+            {
+                ret = -EFAULT;
+            }
+        }
+        if (ret < 0)
+        {
+            break;
+        }
+        done += ret;
+        if ((size_t)ret < n)
+        {
+            break;
+        }
+    }
+    return done ? (long)done : ret;
+}
+
+/*
+ * Run one submission queue entry. Returns what the matching system call
+ * would, or -errno.
+ */
+static long ring_run(io_sqe_t *sqe, void **kbufp, size_t *npagesp)
+{
+    argstr_t path = {.as_str = sqe->addr, .as_len = sqe->len};
+    char *kpath;
+    stat_t stat_buf;
+    long ret;
+    switch (sqe->opcode)
+    {
+    case IORING_OP_NOP:
+        return 0;
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+        return ring_rw(sqe, kbufp, npagesp);
+    case IORING_OP_FSYNC:
+    {
+        /* there is no writing back a single file, so sync them all */
+        file_t *file = fget(sqe->fd);
+        if (!file)
+        {
+            return -EBADF;
+        }
+        fput(&file);
+        do_sync();
+        return 0;
+    }
+    case IORING_OP_OPEN:
+        if ((ret = user_strdup(&path, &kpath)))
+        {
+            return ret;
+        }
+        ret = do_open(kpath, sqe->flags);
+        kfree(kpath);
+        return ret;
+    case IORING_OP_CLOSE:
+        return do_close(sqe->fd);
+    case IORING_OP_STAT:
+        if ((ret = user_strdup(&path, &kpath)))
+        {
+            return ret;
+        }
+        ret = do_stat(kpath, &stat_buf);
+        kfree(kpath);
+        if (!ret)
+        {
+            ret = copy_to_user(sqe->buf, &stat_buf, sizeof(stat_buf));
+        }
+        return ret;
+    default:
+        return -EINVAL;
+    }
+}
+
+/*
+ * Run up to to_submit entries of the ring's submission queue, in order, and
+ * post a completion for each. This is a batched system call interface, not
+ * asynchronous I/O: the entries run one after the other in this thread, and
+ * every completion is posted by the time this returns. What the ring saves is
+ * a trap per call, and copying entries in and out by the batch. Stops early
+ * when the submission queue runs dry or the completion queue fills up. An
+ * entry that ran is consumed even if its completion could not be copied out,
+ * so that it is never run twice. Returns the number of entries consumed.
+ */
+static long sys_ring_enter(ring_enter_args_t *args)
+{
+    ring_enter_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    io_ring_t ring;
+    ret = copy_from_user(&ring, kargs.ring, sizeof(ring));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(!ring.sq_entries || !IS_POW_2(ring.sq_entries), EINVAL);
+    ERROR_OUT(!ring.cq_entries || !IS_POW_2(ring.cq_entries), EINVAL);
+    ERROR_OUT(ring.sq_tail - ring.sq_head > ring.sq_entries, EINVAL);
+    ERROR_OUT(ring.cq_tail - ring.cq_head > ring.cq_entries, EINVAL);
+
+    io_sqe_t sqes[RING_BATCH];
+    io_cqe_t cqes[RING_BATCH];
+    void *kbuf = NULL;
+    size_t npages = 0;
+    uint32_t done = 0;
+    while (done < kargs.to_submit)
+    {
+        uint32_t sq_idx = MOD_POW_2(ring.sq_head, ring.sq_entries);
+        uint32_t cq_idx = MOD_POW_2(ring.cq_tail, ring.cq_entries);
+        uint32_t n = MIN(kargs.to_submit - done, ring.sq_tail - ring.sq_head);
+        n = MIN(n, ring.cq_entries - (ring.cq_tail - ring.cq_head));
+        n = MIN(n, RING_BATCH);
+        /* a batch never wraps around the end of either queue */
+        n = MIN(n, ring.sq_entries - sq_idx);
+        n = MIN(n, ring.cq_entries - cq_idx);
+        if (!n)
+        {
+            break;
+        }
+
+        ret = copy_from_user(sqes, ring.sqes + sq_idx, n * sizeof(io_sqe_t));
+        if (ret)
+        {
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            cqes[i].user_data = sqes[i].user_data;
+            cqes[i].res = ring_run(&sqes[i], &kbuf, &npages);
+        }
+        ret = copy_to_user(ring.cqes + cq_idx, cqes, n * sizeof(io_cqe_t));
+        ring.sq_head += n;
+        ring.cq_tail += n;
+        done += n;
+        if (ret)
+        {
+            break;
+        }
+    }
+    if (kbuf)
+    {
+        page_free_n(kbuf, npages);
+    }
+
+    if (done)
+    {
+        long err = copy_to_user(&kargs.ring->sq_head, &ring.sq_head,
+                                sizeof(ring.sq_head));
+        if (!err)
+        {
+            err = copy_to_user(&kargs.ring->cq_tail, &ring.cq_tail,
+                               sizeof(ring.cq_tail));
+        }
+        ERROR_OUT_RET(err);
+        return done;
+    }
+    ERROR_OUT_RET(ret);
+    return ret;
 }
 
 /*
@@ -100,8 +648,34 @@ static long sys_write(write_args_t *args)
  */
 static long sys_getdents(getdents_args_t *args)
 {
-    NOT_YET_IMPLEMENTED("VM: sys_getdents");
-    return -1;
+    getdents_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.count < sizeof(dirent_t), EINVAL);
+
+    size_t nread = 0;
+    for (size_t i = 0; i < kargs.count / sizeof(dirent_t); i++)
+    {
+        dirent_t dirent;
+        ret = do_getdent(kargs.fd, &dirent);
+        if (ret <= 0)
+        {
+            break;
+        }
+        ret = copy_to_user(kargs.dirp + i, &dirent, sizeof(dirent));
+        if (ret)
+        {
+            break;
+        }
+        nread += sizeof(dirent);
+    }
+
+    if (nread)
+    {
+        return nread;
+    }
+    ERROR_OUT_RET(ret);
+    return 0;
 }
 
 #ifdef __MOUNTING__
@@ -305,6 +879,127 @@ static long sys_rename(rename_args_t *args)
     return ret;
 }
 
+/*
+ * The *at() system calls take paths relative to a directory file descriptor,
+ * or AT_FDCWD for the current working directory, like their older versions.
+ */
+static long sys_openat(openat_args_t *args)
+{
+    openat_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    char *path;
+    ret = user_strdup(&kargs.filename, &path);
+    ERROR_OUT_RET(ret);
+
+    ret = do_openat(kargs.dirfd, path, kargs.flags);
+    kfree(path);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_fstatat(fstatat_args_t *args)
+{
+    fstatat_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.flags & ~AT_SYMLINK_NOFOLLOW, EINVAL);
+
+    char *path;
+    ret = user_strdup(&kargs.path, &path);
+    ERROR_OUT_RET(ret);
+
+    stat_t stat_buf;
+    ret = do_fstatat(kargs.dirfd, path, &stat_buf);
+    kfree(path);
+    ERROR_OUT_RET(ret);
+
+    ret = copy_to_user(kargs.buf, &stat_buf, sizeof(stat_buf));
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_mkdirat(mkdirat_args_t *args)
+{
+    mkdirat_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    char *path;
+    ret = user_strdup(&kargs.path, &path);
+    ERROR_OUT_RET(ret);
+
+    ret = do_mkdirat(kargs.dirfd, path);
+    kfree(path);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_unlinkat(unlinkat_args_t *args)
+{
+    unlinkat_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.flags & ~AT_REMOVEDIR, EINVAL);
+
+    char *path;
+    ret = user_strdup(&kargs.path, &path);
+    ERROR_OUT_RET(ret);
+
+    if (kargs.flags & AT_REMOVEDIR)
+    {
+        ret = do_rmdirat(kargs.dirfd, path);
+    }
+    else
+    {
+        ret = do_unlinkat(kargs.dirfd, path);
+    }
+    kfree(path);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_renameat(renameat_args_t *args)
+{
+    renameat_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    char *oldpath, *newpath;
+    ret = user_strdup(&kargs.oldpath, &oldpath);
+    ERROR_OUT_RET(ret);
+
+    ret = user_strdup(&kargs.newpath, &newpath);
+    if (ret)
+    {
+        kfree(oldpath);
+        ERROR_OUT_RET(ret);
+    }
+
+    ret = do_renameat(kargs.olddirfd, oldpath, kargs.newdirfd, newpath);
+    kfree(oldpath);
+    kfree(newpath);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_clone_file_range(clone_file_range_args_t *args)
+{
+    clone_file_range_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    ret = do_clone_file_range(kargs.src_fd, kargs.src_off, kargs.dst_fd,
+                              kargs.dst_off, kargs.len);
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
 static long sys_chdir(argstr_t *args)
 {
     argstr_t kargs;
@@ -334,6 +1029,18 @@ static long sys_lseek(lseek_args_t *args)
     return ret;
 }
 
+static long sys_fadvise(fadvise_args_t *args)
+{
+    fadvise_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    ret = do_fadvise(kargs.fd, kargs.offset, kargs.len, kargs.advice);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
 static long sys_open(open_args_t *args)
 {
     open_args_t kargs;
@@ -363,6 +1070,18 @@ static long sys_munmap(munmap_args_t *args)
     return ret;
 }
 
+static long sys_madvise(madvise_args_t *args)
+{
+    madvise_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    ret = do_madvise(kargs.addr, kargs.len, kargs.advice);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
 static void *sys_mmap(mmap_args_t *arg)
 {
     mmap_args_t kargs;
@@ -484,6 +1203,33 @@ static long sys_time(time_t *utloc)
     return time;
 }
 
+static long sys_clock_gettime(clock_gettime_args_t *args)
+{
+    clock_gettime_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    struct timespec ts;
+    ret = do_clock_gettime(kargs.clock, &ts);
+    ERROR_OUT_RET(ret);
+
+    ret = copy_to_user(kargs.tp, &ts, sizeof(ts));
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
+static long sys_futex(futex_args_t *args)
+{
+    futex_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+
+    ret = do_futex(kargs.uaddr, kargs.op, kargs.val, kargs.uaddr2, kargs.val2);
+
+    ERROR_OUT_RET(ret);
+    return ret;
+}
+
 static long sys_fork(regs_t *regs)
 {
     long ret = do_fork(regs);
@@ -583,43 +1329,119 @@ static inline void check_curthr_cancelled()
     }
 }
 
-static long syscall_handler(regs_t *regs)
+#ifdef __DBG_SYSCALLS__
+static const char *syscall_name(size_t sysnum)
 {
-    size_t sysnum = (size_t)regs->r_rax;
-    uintptr_t args = (uintptr_t)regs->r_rdx;
+    if (sysnum < sizeof(syscall_strings) / sizeof(syscall_strings[0]))
+    {
+        return syscall_strings[sysnum];
+    }
+    else if (sysnum == 9001)
+    {
+        return "debug";
+    }
+    else if (sysnum == 9002)
+    {
+        return "kshell";
+    }
+    return "unknown";
+}
+#endif
+
+/*
+ * Run up to MULTICALL_MAX system calls in one trap: calls[i].sysnum with
+ * calls[i].args, in order, filling in calls[i].ret. Unless MULTICALL_CONTINUE
+ * is set, stops after the first call that fails. Calls that do not return to
+ * the caller the usual way (exit, fork, execve, ...) cannot be batched.
+ * A cancelled thread stops before the next call. Returns the number of calls
+ * run, including a failed one; errno is left as the last failed call set it.
+ */
+static long sys_multicall(multicall_args_t *args, regs_t *regs)
+{
+    multicall_args_t kargs;
+    long ret = copy_from_user(&kargs, args, sizeof(kargs));
+    ERROR_OUT_RET(ret);
+    ERROR_OUT(kargs.ncalls < 0 || kargs.ncalls > MULTICALL_MAX, EINVAL);
+    ERROR_OUT(kargs.flags & ~MULTICALL_CONTINUE, EINVAL);
+    if (!kargs.ncalls)
+    {
+        return 0;
+    }
 
-    const char *syscall_string;
-    if (sysnum <= 47)
+    size_t size = kargs.ncalls * sizeof(multicall_entry_t);
+    multicall_entry_t *calls = kmalloc(size);
+    ERROR_OUT(!calls, ENOMEM);
+    ret = copy_from_user(calls, kargs.calls, size);
+    if (ret)
     {
-        syscall_string = syscall_strings[sysnum];
+        kfree(calls);
+        ERROR_OUT_RET(ret);
     }
-    else
+
+    /*
+     * A call has failed iff it returned -1, setting errno. errno is left alone
+     * otherwise, so that SYS_errno reports the last failure before it.
+     */
+    int i = 0;
+    while (i < kargs.ncalls)
     {
-        if (sysnum == 9001)
+        /* stop at a cancellation point; syscall_handler() then exits */
+        if (curthr->kt_cancelled)
         {
-            syscall_string = "debug";
+            break;
         }
-        else if (sysnum == 9002)
+        multicall_entry_t *call = &calls[i++];
+        switch (call->sysnum)
         {
-            syscall_string = "kshell";
+        case SYS_exit:
+        case SYS_thr_exit:
+        case SYS_fork:
+        case SYS_execve:
+        case SYS_multicall:
+            curthr->kt_errno = EINVAL;
+            call->ret = -1;
+            break;
+        default:
+            call->ret = syscall_dispatch((size_t)call->sysnum,
+                                         (uintptr_t)call->args, regs);
+            dbg_syscall("-- pid %d, call %d: %s, returned: %lu (%#lx)\n",
+                        curproc->p_pid, i - 1,
+                        syscall_name((size_t)call->sysnum), call->ret,
+                        call->ret);
         }
-        else
+        if (call->ret == -1)
         {
-            syscall_string = "unknown";
+            call->ret = -curthr->kt_errno;
+            if (!(kargs.flags & MULTICALL_CONTINUE))
+            {
+                break;
+            }
         }
     }
 
+    ret = copy_to_user(kargs.calls, calls, i * sizeof(multicall_entry_t));
+    kfree(calls);
+    ERROR_OUT_RET(ret);
+    return i;
+}
+
+static long syscall_handler(regs_t *regs)
+{
+    size_t sysnum = (size_t)regs->r_rax;
+    uintptr_t args = (uintptr_t)regs->r_rdx;
+
     if (sysnum != SYS_errno)
-        dbg(DBG_SYSCALL, ">> pid %d, sysnum: %lu (%s), arg: %lu (0x%p)\n",
-            curproc->p_pid, sysnum, syscall_string, args, (void *)args);
+        dbg_syscall(">> pid %d, sysnum: %lu (%s), arg: %lu (0x%p)\n",
+                    curproc->p_pid, sysnum, syscall_name(sysnum), args,
+                    (void *)args);
 
     check_curthr_cancelled();
     long ret = syscall_dispatch(sysnum, args, regs);
     check_curthr_cancelled();
 
     if (sysnum != SYS_errno)
-        dbg(DBG_SYSCALL, "<< pid %d, sysnum: %lu (%s), returned: %lu (%#lx)\n",
-            curproc->p_pid, sysnum, syscall_string, ret, ret);
+        dbg_syscall("<< pid %d, sysnum: %lu (%s), returned: %lu (%#lx)\n",
+                    curproc->p_pid, sysnum, syscall_name(sysnum), ret, ret);
 
     regs->r_rax = (uint64_t)ret;
     return 0;
@@ -748,6 +1570,75 @@ static long syscall_dispatch(size_t sysnum, uintptr_t args, regs_t *regs)
     case SYS_usleep:
         return sys_usleep((usleep_args_t *)args);
 
+    case SYS_madvise:
+        return sys_madvise((madvise_args_t *)args);
+
+    case SYS_fadvise:
+        return sys_fadvise((fadvise_args_t *)args);
+
+    case SYS_clock_gettime:
+        return sys_clock_gettime((clock_gettime_args_t *)args);
+
+    case SYS_futex:
+        return sys_futex((futex_args_t *)args);
+
+    case SYS_pread:
+        return sys_pread((pread_args_t *)args);
+
+    case SYS_pwrite:
+        return sys_pwrite((pwrite_args_t *)args);
+
+    case SYS_readv:
+        return sys_rwv((iov_args_t *)args, 0, 0);
+
+    case SYS_writev:
+        return sys_rwv((iov_args_t *)args, 0, 1);
+
+    case SYS_preadv:
+        return sys_rwv((iov_args_t *)args, 1, 0);
+
+    case SYS_pwritev:
+        return sys_rwv((iov_args_t *)args, 1, 1);
+
+    case SYS_sendfile:
+        return sys_sendfile((sendfile_args_t *)args);
+
+    case SYS_splice:
+        return sys_splice((splice_args_t *)args);
+
+    case SYS_epoll_create:
+        return sys_epoll_create();
+
+    case SYS_epoll_ctl:
+        return sys_epoll_ctl((epoll_ctl_args_t *)args);
+
+    case SYS_epoll_wait:
+        return sys_epoll_wait((epoll_wait_args_t *)args);
+
+    case SYS_ring_enter:
+        return sys_ring_enter((ring_enter_args_t *)args);
+
+    case SYS_multicall:
+        return sys_multicall((multicall_args_t *)args, regs);
+
+    case SYS_openat:
+        return sys_openat((openat_args_t *)args);
+
+    case SYS_fstatat:
+        return sys_fstatat((fstatat_args_t *)args);
+
+    case SYS_mkdirat:
+        return sys_mkdirat((mkdirat_args_t *)args);
+
+    case SYS_unlinkat:
+        return sys_unlinkat((unlinkat_args_t *)args);
+
+    case SYS_renameat:
+        return sys_renameat((renameat_args_t *)args);
+
+    case SYS_clone_file_range:
+        return sys_clone_file_range((clone_file_range_args_t *)args);
+
     default:
         dbg(DBG_ERROR, "ERROR: unknown system call: %lu (args: 0x%p)\n",
             sysnum, (void *)args);
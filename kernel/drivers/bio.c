@@ -0,0 +1,590 @@
+#include "drivers/bio.h"
+#include "errno.h"
+#include "globals.h"
+
+#include "drivers/dev.h"
+
+#include "mm/kmalloc.h"
+#include "mm/mobj.h"
+#include "mm/page.h"
+#include "mm/pframe.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/string.h"
+
+/* queues of all devices with an asynchronous interface */
+static list_t bio_queues = LIST_INITIALIZER(bio_queues);
+
+/* A thread servicing devices without bq_submit */
+typedef struct biod_worker
+{
+    ktqueue_t bw_waitq; /* where it sleeps */
+    size_t bw_home;     /* commands from the queues it is home to */
+    size_t bw_stolen;   /* commands from other threads' queues */
+} biod_worker_t;
+
+static biod_worker_t biod_workers[BIOD_THREADS];
+static size_t biod_nthreads; /* those still running */
+static size_t bio_nsync;     /* queues registered without bq_submit */
+
+void bio_init()
+{
+    for (long i = 0; i < BIOD_THREADS; i++)
+    {
+        sched_queue_init(&biod_workers[i].bw_waitq);
+    }
+
+    for (long i = 0; i < __NDISKS__; i++)
+    {
+        blockdev_t *bdev = blockdev_lookup(MKDEVID(DISK_MAJOR, i));
+        if (!bdev)
+        {
+            continue;
+        }
+        blockdev_queue_t *bq = kmalloc(sizeof(blockdev_queue_t));
+        KASSERT(bq);
+        bq->bq_bdev = bdev;
+        bq->bq_submit = NULL;
+        bq->bq_rw_pages = NULL;
+        blockdev_queue_register(bq);
+    }
+}
+
+void blockdev_queue_register(blockdev_queue_t *bq)
+{
+    list_init(&bq->bq_pending);
+    bq->bq_npending = 0;
+    bq->bq_head = 0;
+    bq->bq_inflight = 0;
+    bq->bq_depth = BIO_QUEUE_DEPTH;
+    bq->bq_worker = bq->bq_submit ? 0 : bio_nsync++ % BIOD_THREADS;
+    bq->bq_submitted = bq->bq_merged = 0;
+    bq->bq_dispatched = bq->bq_blocks = bq->bq_maxdepth = 0;
+    bq->bq_maxflight = 0;
+    list_link_init(&bq->bq_link);
+    list_insert_tail(&bio_queues, &bq->bq_link);
+    dbg(DBG_DISK, "registered queue for device 0x%x\n", bq->bq_bdev->bd_id);
+}
+
+static blockdev_queue_t *blockdev_queue(blockdev_t *bdev)
+{
+    list_iterate(&bio_queues, bq, blockdev_queue_t, bq_link)
+    {
+        if (bq->bq_bdev == bdev)
+        {
+            return bq;
+        }
+    }
+    return NULL;
+}
+
+void bio_init_request(bio_t *bio, blockdev_t *bdev, int dir, blocknum_t loc,
+                      size_t count, void **pages)
+{
+    KASSERT(dir == BIO_READ || dir == BIO_WRITE);
+    KASSERT(count && pages);
+    bio->bio_bdev = bdev;
+    bio->bio_dir = dir;
+    bio->bio_loc = loc;
+    bio->bio_count = count;
+    bio->bio_pages = pages;
+    bio->bio_done = NULL;
+    bio->bio_private = NULL;
+    bio->bio_error = 0;
+    bio->bio_complete = 0;
+    sched_queue_init(&bio->bio_waitq);
+    list_link_init(&bio->bio_link);
+}
+
+/*
+ * Carry out a request with the device's synchronous operations: a single
+ * vectored call if the device has one, otherwise one call per run of pages
+ * that are contiguous in memory.
+ */
+static long bio_do_sync(blockdev_queue_t *bq, bio_t *bio)
+{
+    blockdev_t *bdev = bio->bio_bdev;
+    if (bq && bq->bq_rw_pages)
+    {
+        return bq->bq_rw_pages(bdev, bio->bio_dir, bio->bio_loc,
+                               bio->bio_pages, bio->bio_count);
+    }
+
+    size_t i = 0;
+    while (i < bio->bio_count)
+    {
+        size_t n = 1;
+        while (i + n < bio->bio_count &&
+               (char *)bio->bio_pages[i + n] ==
+                   (char *)bio->bio_pages[i] + n * BLOCK_SIZE)
+        {
+            n++;
+        }
+
+        long ret;
+        if (bio->bio_dir == BIO_READ)
+        {
+            ret = bdev->bd_ops->read_block(bdev, bio->bio_pages[i],
+                                           bio->bio_loc + i, n);
+        }
+        else
+        {
+            ret = bdev->bd_ops->write_block(bdev, bio->bio_pages[i],
+                                            bio->bio_loc + i, n);
+        }
+        if (ret)
+        {
+            return ret;
+        }
+        i += n;
+    }
+    return 0;
+}
+
+/*
+ * Adds a request to its device's pending list, keeping it sorted by block.
+ * Requests for the same block stay in the order they were submitted.
+ */
+static void bq_insert(blockdev_queue_t *bq, bio_t *bio)
+{
+    list_link_t *before = &bq->bq_pending;
+    list_iterate_reverse(&bq->bq_pending, pending, bio_t, bio_link)
+    {
+        if (pending->bio_loc <= bio->bio_loc)
+        {
+            break;
+        }
+        before = &pending->bio_link;
+    }
+    list_insert_before(before, &bio->bio_link);
+
+    bq->bq_submitted++;
+    if (++bq->bq_npending > bq->bq_maxdepth)
+    {
+        bq->bq_maxdepth = bq->bq_npending;
+    }
+}
+
+/*
+ * Takes the next command's worth of requests off a queue in elevator order:
+ * the first request at or after bq_head (wrapping around to the lowest block
+ * if there is none), followed by the requests that continue it on disk in the
+ * same direction, up to BIO_MAX_MERGE blocks in all.
+ */
+static size_t bq_next_run(blockdev_queue_t *bq, bio_t **run)
+{
+    KASSERT(!list_empty(&bq->bq_pending));
+
+    bio_t *bio = list_head(&bq->bq_pending, bio_t, bio_link);
+    list_iterate(&bq->bq_pending, pending, bio_t, bio_link)
+    {
+        if (pending->bio_loc >= bq->bq_head)
+        {
+            bio = pending;
+            break;
+        }
+    }
+
+    size_t n = 0;
+    size_t blocks = 0;
+    while (1)
+    {
+        run[n++] = bio;
+        blocks += bio->bio_count;
+        list_link_t *next = bio->bio_link.l_next;
+        list_remove(&bio->bio_link);
+        bq->bq_npending--;
+
+        if (next == &bq->bq_pending)
+        {
+            break;
+        }
+        bio_t *nbio = list_item(next, bio_t, bio_link);
+        if (nbio->bio_dir != bio->bio_dir ||
+            nbio->bio_loc != bio->bio_loc + bio->bio_count ||
+            blocks + nbio->bio_count > BIO_MAX_MERGE)
+        {
+            break;
+        }
+        bio = nbio;
+    }
+    bq->bq_merged += n - 1;
+    return n;
+}
+
+/*
+ * Carries out a run of requests for consecutive blocks as a single command.
+ * If their pages are not contiguous in memory and the device has no vectored
+ * operation, the transfer goes through a staging buffer; when one cannot be
+ * allocated, each request is carried out by itself.
+ */
+static long bq_do_run(blockdev_queue_t *bq, bio_t **run, size_t n)
+{
+    if (n == 1)
+    {
+        return bio_do_sync(bq, run[0]);
+    }
+
+    void *pages[BIO_MAX_MERGE];
+    size_t blocks = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        for (size_t j = 0; j < run[i]->bio_count; j++)
+        {
+            pages[blocks++] = run[i]->bio_pages[j];
+        }
+    }
+
+    bio_t merged;
+    bio_init_request(&merged, bq->bq_bdev, run[0]->bio_dir, run[0]->bio_loc,
+                     blocks, pages);
+    if (bq->bq_rw_pages)
+    {
+        return bio_do_sync(bq, &merged);
+    }
+
+    size_t i;
+    for (i = 1; i < blocks; i++)
+    {
+        if ((char *)pages[i] != (char *)pages[0] + i * BLOCK_SIZE)
+        {
+            break;
+        }
+    }
+    if (i == blocks)
+    {
+        return bio_do_sync(bq, &merged);
+    }
+
+    char *stage = page_alloc_n(blocks);
+    if (!stage)
+    {
+        long ret = 0;
+        for (i = 0; i < n && !ret; i++)
+        {
+            ret = bio_do_sync(bq, run[i]);
+        }
+        return ret;
+    }
+
+    if (merged.bio_dir == BIO_WRITE)
+    {
+        for (i = 0; i < blocks; i++)
+        {
+            memcpy(stage + i * BLOCK_SIZE, pages[i], BLOCK_SIZE);
+        }
+    }
+    void *stage_pages[BIO_MAX_MERGE];
+    for (i = 0; i < blocks; i++)
+    {
+        stage_pages[i] = stage + i * BLOCK_SIZE;
+    }
+    merged.bio_pages = stage_pages;
+    long ret = bio_do_sync(bq, &merged);
+    if (!ret && merged.bio_dir == BIO_READ)
+    {
+        for (i = 0; i < blocks; i++)
+        {
+            memcpy(pages[i], stage + i * BLOCK_SIZE, BLOCK_SIZE);
+        }
+    }
+    page_free_n(stage, blocks);
+    return ret;
+}
+
+/*
+ * Dispatches the next command of a queue and completes the requests that
+ * went into it. Other threads may dispatch from the queue while this one
+ * waits for the driver.
+ */
+static void bq_dispatch(blockdev_queue_t *bq)
+{
+    bio_t *run[BIO_MAX_MERGE];
+    size_t n = bq_next_run(bq, run);
+    bio_t *last = run[n - 1];
+    size_t blocks = last->bio_loc + last->bio_count - run[0]->bio_loc;
+
+    dbg(DBG_DISK, "device 0x%x: %s %lu blocks at %u (%lu requests)\n",
+        bq->bq_bdev->bd_id, run[0]->bio_dir == BIO_READ ? "read" : "write",
+        blocks, run[0]->bio_loc, n);
+    bq->bq_dispatched++;
+    bq->bq_blocks += blocks;
+    bq->bq_head = last->bio_loc + last->bio_count;
+    if (++bq->bq_inflight > bq->bq_maxflight)
+    {
+        bq->bq_maxflight = bq->bq_inflight;
+    }
+
+    long ret = bq_do_run(bq, run, n);
+    bq->bq_inflight--;
+    for (size_t i = 0; i < n; i++)
+    {
+        bio_end(run[i], ret);
+    }
+}
+
+/*
+ * Wakes the home thread of a queue with new requests, or any sleeping thread
+ * if that one is busy. If they all are, one of them finds the requests when
+ * it is done.
+ */
+static void biod_wake(blockdev_queue_t *bq)
+{
+    ktqueue_t *home = &biod_workers[bq->bq_worker].bw_waitq;
+    if (!sched_queue_empty(home))
+    {
+        sched_wakeup_on(home, NULL);
+        return;
+    }
+    for (long i = 0; i < BIOD_THREADS; i++)
+    {
+        if (!sched_queue_empty(&biod_workers[i].bw_waitq))
+        {
+            sched_wakeup_on(&biod_workers[i].bw_waitq, NULL);
+            return;
+        }
+    }
+}
+
+void bio_submit(bio_t *bio)
+{
+    KASSERT(!bio->bio_complete && !list_link_is_linked(&bio->bio_link));
+
+    blockdev_queue_t *bq = blockdev_queue(bio->bio_bdev);
+    if (!bq)
+    {
+        bio_end(bio, bio_do_sync(NULL, bio));
+    }
+    else if (bq->bq_submit)
+    {
+        bq->bq_submitted++;
+        bq->bq_dispatched++;
+        bq->bq_blocks += bio->bio_count;
+        bq->bq_submit(bio->bio_bdev, bio);
+    }
+    else
+    {
+        bq_insert(bq, bio);
+        if (biod_nthreads)
+        {
+            biod_wake(bq);
+        }
+    }
+}
+
+long bio_wait(bio_t *bio)
+{
+    while (!bio->bio_complete)
+    {
+        /* With no biod, whoever waits on a queued request dispatches it */
+        if (!biod_nthreads && list_link_is_linked(&bio->bio_link))
+        {
+            bq_dispatch(blockdev_queue(bio->bio_bdev));
+            continue;
+        }
+        sched_sleep_on(&bio->bio_waitq);
+    }
+    return bio->bio_error;
+}
+
+void bio_end(bio_t *bio, long error)
+{
+    KASSERT(!bio->bio_complete);
+    bio->bio_error = error;
+    bio->bio_complete = 1;
+    sched_broadcast_on(&bio->bio_waitq);
+    if (bio->bio_done)
+    {
+        bio->bio_done(bio);
+    }
+}
+
+/* pframes bio_writeback() submits before waiting for them */
+#define BIO_WRITEBACK_BATCH 128
+
+long bio_writeback(blockdev_t *bdev, mobj_t *o)
+{
+    KASSERT(kmutex_owns_mutex(&o->mo_mutex));
+
+    bio_t *bios = kmalloc(BIO_WRITEBACK_BATCH * sizeof(bio_t));
+    pframe_t **pfs = kmalloc(BIO_WRITEBACK_BATCH * sizeof(pframe_t *));
+    if (!bios || !pfs)
+    {
+        kfree(bios);
+        kfree(pfs);
+        return -ENOMEM;
+    }
+
+    long ret = 0;
+    pframe_t *pf = list_head(&o->mo_pframes, pframe_t, pf_link);
+    while (&pf->pf_link != &o->mo_pframes)
+    {
+        size_t n = 0;
+        for (; &pf->pf_link != &o->mo_pframes && n < BIO_WRITEBACK_BATCH;
+             pf = list_next(pf, pframe_t, pf_link))
+        {
+            kmutex_lock(&pf->pf_mutex);
+            if (!pf->pf_addr || !pf->pf_dirty)
+            {
+                kmutex_unlock(&pf->pf_mutex);
+                continue;
+            }
+            pfs[n] = pf;
+            bio_init_request(&bios[n], bdev, BIO_WRITE, (blocknum_t)pf->pf_loc,
+                             1, &pf->pf_addr);
+            n++;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            bio_submit(&bios[i]);
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            long err = bio_wait(&bios[i]);
+            if (err)
+            {
+                ret = err;
+            }
+            else
+            {
+                pfs[i]->pf_dirty = 0;
+            }
+            pframe_release(&pfs[i]);
+        }
+    }
+
+    kfree(bios);
+    kfree(pfs);
+    return ret;
+}
+
+size_t bio_info(const void *arg, char *buf, size_t osize)
+{
+    KASSERT(0 < osize);
+    KASSERT(NULL != buf);
+
+    size_t len = 0;
+    buf[0] = '\0';
+    list_iterate(&bio_queues, bq, blockdev_queue_t, bq_link)
+    {
+        if (len >= osize - 1)
+        {
+            break;
+        }
+        len += snprintf(buf + len, osize - len,
+                        "device 0x%x: %lu requests, %lu merged, %lu commands, "
+                        "%lu blocks, %lu pending (max %lu), %lu in flight "
+                        "(max %lu)\n",
+                        bq->bq_bdev->bd_id, bq->bq_submitted, bq->bq_merged,
+                        bq->bq_dispatched, bq->bq_blocks, bq->bq_npending,
+                        bq->bq_maxdepth, bq->bq_inflight, bq->bq_maxflight);
+    }
+    for (long i = 0; i < BIOD_THREADS && len < osize - 1; i++)
+    {
+        len += snprintf(buf + len, osize - len,
+                        "biod%ld: %lu commands from its queues, %lu stolen\n",
+                        i, biod_workers[i].bw_home, biod_workers[i].bw_stolen);
+    }
+    return MIN(len, osize - 1);
+}
+
+static inline long bq_ready(blockdev_queue_t *bq)
+{
+    return !list_empty(&bq->bq_pending) && bq->bq_inflight < bq->bq_depth;
+}
+
+/*
+ * Returns a queue with pending requests and room for another command for
+ * thread self: one of its own if it can, otherwise the next one after the
+ * queue stolen from last, so that a busy device cannot starve the others.
+ */
+static blockdev_queue_t *biod_next(long self)
+{
+    list_iterate(&bio_queues, bq, blockdev_queue_t, bq_link)
+    {
+        if (bq_ready(bq) && bq->bq_worker == (size_t)self)
+        {
+            biod_workers[self].bw_home++;
+            return bq;
+        }
+    }
+
+    static blockdev_queue_t *last;
+    blockdev_queue_t *found = NULL;
+    int past_last = last == NULL;
+    list_iterate(&bio_queues, bq, blockdev_queue_t, bq_link)
+    {
+        if (bq_ready(bq) && (past_last || !found))
+        {
+            found = bq;
+            if (past_last)
+            {
+                break;
+            }
+        }
+        if (bq == last)
+        {
+            past_last = 1;
+        }
+    }
+    last = found;
+    if (found)
+    {
+        biod_workers[self].bw_stolen++;
+    }
+    return found;
+}
+
+/*
+ * biod carries out requests to devices whose drivers only have synchronous
+ * operations, so that submitters can keep going while the disk works and so
+ * that requests pile up where they can be sorted and merged. Each of its
+ * threads has at most one command in flight. When cancelled (e.g. by
+ * proc_kill_all()), they finish what is pending and exit, and later requests
+ * are dispatched by the threads waiting for them. A thread that finds every
+ * pending queue full on the way out leaves those requests to the threads
+ * whose commands fill them.
+ */
+static void *biod_run(long self, void *arg2)
+{
+    while (1)
+    {
+        blockdev_queue_t *bq = biod_next(self);
+        if (bq)
+        {
+            bq_dispatch(bq);
+            continue;
+        }
+        if (sched_cancellable_sleep_on(&biod_workers[self].bw_waitq))
+        {
+            break;
+        }
+    }
+
+    biod_nthreads--;
+    for (blockdev_queue_t *bq; (bq = biod_next(self));)
+    {
+        bq_dispatch(bq);
+    }
+    return NULL;
+}
+
+void biod_init()
+{
+    for (long i = 0; i < BIOD_THREADS; i++)
+    {
+        char name[8];
+        snprintf(name, sizeof(name), "biod%ld", i);
+        proc_t *proc = proc_create(name);
+        KASSERT(proc);
+        kthread_t *thread = kthread_create(proc, biod_run, i, NULL);
+        KASSERT(thread);
+        sched_make_runnable(thread);
+        biod_nthreads++;
+    }
+}
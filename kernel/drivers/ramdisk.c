@@ -0,0 +1,148 @@
+#include "drivers/ramdisk.h"
+#include "errno.h"
+#include "globals.h"
+
+#include "drivers/dev.h"
+
+#include "mm/kmalloc.h"
+#include "mm/page.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#define bdev_to_ramdisk(bd) CONTAINER_OF((bd), ramdisk_t, rd_bdev)
+
+static long ramdisk_read_block(blockdev_t *bdev, char *buf, blocknum_t loc,
+                               size_t block_count);
+static long ramdisk_write_block(blockdev_t *bdev, const char *buf,
+                                blocknum_t loc, size_t block_count);
+
+static blockdev_ops_t ramdisk_ops = {
+    .read_block = ramdisk_read_block,
+    .write_block = ramdisk_write_block,
+};
+
+/*
+ * Copies count blocks between the disk and one page per block. Writing a
+ * block for the first time allocates its page.
+ */
+static long ramdisk_rw_pages(blockdev_t *bdev, int dir, blocknum_t loc,
+                             void **pages, size_t count)
+{
+    ramdisk_t *rd = bdev_to_ramdisk(bdev);
+    if (loc >= rd->rd_nblocks || count > rd->rd_nblocks - loc)
+    {
+        return -EINVAL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        void **block = &rd->rd_pages[loc + i];
+        if (dir == BIO_READ)
+        {
+            if (*block)
+            {
+                memcpy(pages[i], *block, BLOCK_SIZE);
+            }
+            else
+            {
+                memset(pages[i], 0, BLOCK_SIZE);
+            }
+            continue;
+        }
+
+        if (!*block)
+        {
+            if (!(*block = page_alloc()))
+            {
+                return -ENOSPC;
+            }
+            rd->rd_nresident++;
+        }
+        memcpy(*block, pages[i], BLOCK_SIZE);
+    }
+    return 0;
+}
+
+/*
+ * Copying never sleeps, so requests are carried out as they are submitted.
+ */
+static void ramdisk_submit(blockdev_t *bdev, bio_t *bio)
+{
+    bio_end(bio, ramdisk_rw_pages(bdev, bio->bio_dir, bio->bio_loc,
+                                  bio->bio_pages, bio->bio_count));
+}
+
+/*
+ * The synchronous operations take one contiguous buffer; split it into
+ * blocks for ramdisk_rw_pages(), a batch at a time.
+ */
+static long ramdisk_rw_buf(blockdev_t *bdev, int dir, char *buf,
+                           blocknum_t loc, size_t block_count)
+{
+    void *pages[BIO_MAX_MERGE];
+    while (block_count)
+    {
+        size_t n = MIN(block_count, BIO_MAX_MERGE);
+        for (size_t i = 0; i < n; i++)
+        {
+            pages[i] = buf + i * BLOCK_SIZE;
+        }
+        long ret = ramdisk_rw_pages(bdev, dir, loc, pages, n);
+        if (ret)
+        {
+            return ret;
+        }
+        buf += n * BLOCK_SIZE;
+        loc += n;
+        block_count -= n;
+    }
+    return 0;
+}
+
+static long ramdisk_read_block(blockdev_t *bdev, char *buf, blocknum_t loc,
+                               size_t block_count)
+{
+    return ramdisk_rw_buf(bdev, BIO_READ, buf, loc, block_count);
+}
+
+static long ramdisk_write_block(blockdev_t *bdev, const char *buf,
+                                blocknum_t loc, size_t block_count)
+{
+    return ramdisk_rw_buf(bdev, BIO_WRITE, (char *)buf, loc, block_count);
+}
+
+void ramdisk_init()
+{
+    for (long i = 0; i < __RAMDISKS__; i++)
+    {
+        ramdisk_t *rd = kmalloc(sizeof(ramdisk_t));
+        KASSERT(rd);
+        rd->rd_nblocks = __RAMDISK_BLOCKS__;
+        rd->rd_nresident = 0;
+        rd->rd_pages = kmalloc(rd->rd_nblocks * sizeof(void *));
+        KASSERT(rd->rd_pages);
+        memset(rd->rd_pages, 0, rd->rd_nblocks * sizeof(void *));
+
+        rd->rd_bdev.bd_id = MKDEVID(RAMDISK_MAJOR, i);
+        rd->rd_bdev.bd_ops = &ramdisk_ops;
+        long ret = blockdev_register(&rd->rd_bdev);
+        KASSERT(!ret);
+
+        rd->rd_queue.bq_bdev = &rd->rd_bdev;
+        rd->rd_queue.bq_submit = ramdisk_submit;
+        rd->rd_queue.bq_rw_pages = ramdisk_rw_pages;
+        blockdev_queue_register(&rd->rd_queue);
+
+        dbg(DBG_DISK, "ramdisk%ld: %lu blocks\n", i, rd->rd_nblocks);
+    }
+}
+
+size_t ramdisk_nblocks(blockdev_t *bdev)
+{
+    if (MAJOR(bdev->bd_id) != RAMDISK_MAJOR)
+    {
+        return 0;
+    }
+    return bdev_to_ramdisk(bdev)->rd_nblocks;
+}
@@ -0,0 +1,408 @@
+/*
+ *  FILE: epoll.c
+ *  DESC: Implementation of the epoll(7) system calls: waiting for any of a
+ *        set of files to become ready.
+ */
+
+#include "errno.h"
+#include "globals.h"
+
+#include "fs/epoll.h"
+#include "fs/file.h"
+#include "fs/open.h"
+#include "fs/stat.h"
+#include "fs/vfs.h"
+#include "fs/vfs_syscall.h"
+#include "fs/vnode.h"
+
+#include "main/interrupt.h"
+
+#include "mm/slab.h"
+
+#include "proc/sched.h"
+
+#include "util/debug.h"
+#include "util/list.h"
+#include "util/string.h"
+#include "util/time.h"
+#include "util/timer.h"
+
+/*
+ * epoll_wait() sleeps on the instance's ep_waitq, which everything that can
+ * make a file in the interest list ready wakes up: vnode_poll_wakeup(),
+ * chardev_poll_wakeup() and the timeout. The latter two may run in interrupt
+ * context, so the interest lists and the list of instances are only changed,
+ * and epoll_wait() only checks for ready files before sleeping, with
+ * interrupts blocked.
+ */
+
+typedef struct eventpoll
+{
+    list_t ep_items;     /* epitem_t's, in the order they were added */
+    ktqueue_t ep_waitq;  /* threads in epoll_wait() */
+    list_link_t ep_link; /* on ep_instances */
+} eventpoll_t;
+
+/* An entry of an interest list */
+typedef struct epitem
+{
+    eventpoll_t *epi_ep;
+    int epi_fd;
+    vnode_t *epi_vnode; /* referenced */
+    struct epoll_event epi_event;
+    list_link_t epi_link;   /* on epi_ep->ep_items */
+    list_link_t epi_vnlink; /* on epi_vnode->vn_pollers */
+} epitem_t;
+
+static void epoll_read_vnode(fs_t *fs, vnode_t *vnode);
+
+static void epoll_delete_vnode(fs_t *fs, vnode_t *vnode);
+
+static fs_ops_t epoll_fsops = {.read_vnode = epoll_read_vnode,
+                               .delete_vnode = epoll_delete_vnode,
+                               .umount = NULL};
+
+static fs_t epoll_fs = {.fs_dev = "epoll",
+                        .fs_type = "epoll",
+                        .fs_ops = &epoll_fsops,
+                        .fs_root = NULL,
+                        .fs_i = NULL};
+
+static ssize_t epoll_read(vnode_t *vnode, size_t pos, void *buf, size_t count);
+
+static ssize_t epoll_write(vnode_t *vnode, size_t pos, const void *buf,
+                           size_t count);
+
+static long epoll_stat(vnode_t *vnode, stat_t *ss);
+
+static vnode_ops_t epoll_vops = {
+    .read = epoll_read,
+    .write = epoll_write,
+    .stat = epoll_stat,
+};
+
+#define VNODE_TO_EP(vn) ((eventpoll_t *)((vn)->vn_i))
+
+static slab_allocator_t *eventpoll_allocator = NULL;
+static slab_allocator_t *epitem_allocator = NULL;
+static int next_epno = 0;
+
+static list_t ep_instances = LIST_INITIALIZER(ep_instances);
+
+void epoll_init(void)
+{
+    eventpoll_allocator =
+        slab_allocator_create("eventpoll", sizeof(eventpoll_t));
+    epitem_allocator = slab_allocator_create("epitem", sizeof(epitem_t));
+    KASSERT(eventpoll_allocator && epitem_allocator);
+
+    epoll_fs.fs_vnode_allocator =
+        slab_allocator_create("epoll_vnode", sizeof(vnode_t));
+    KASSERT(epoll_fs.fs_vnode_allocator);
+    list_init(&epoll_fs.vnode_list);
+    kmutex_init(&epoll_fs.vnode_list_mutex);
+}
+
+static void epitem_free(epitem_t *epi)
+{
+    uint8_t ipl = intr_setipl(IPL_HIGH);
+    list_remove(&epi->epi_link);
+    list_remove(&epi->epi_vnlink);
+    intr_setipl(ipl);
+    vput(&epi->epi_vnode);
+    slab_obj_free(epitem_allocator, epi);
+}
+
+static void epoll_read_vnode(fs_t *fs, vnode_t *vnode)
+{
+    vnode->vn_ops = &epoll_vops;
+    vnode->vn_mode = 0;
+    vnode->vn_len = 0;
+    vnode->vn_i = NULL;
+}
+
+static void epoll_delete_vnode(fs_t *fs, vnode_t *vnode)
+{
+    eventpoll_t *ep = VNODE_TO_EP(vnode);
+    if (ep)
+    {
+        KASSERT(sched_queue_empty(&ep->ep_waitq));
+        uint8_t ipl = intr_setipl(IPL_HIGH);
+        list_remove(&ep->ep_link);
+        intr_setipl(ipl);
+        list_iterate(&ep->ep_items, epi, epitem_t, epi_link)
+        {
+            epitem_free(epi);
+        }
+        slab_obj_free(eventpoll_allocator, ep);
+    }
+}
+
+static ssize_t epoll_read(vnode_t *vnode, size_t pos, void *buf, size_t count)
+{
+    return -EINVAL;
+}
+
+static ssize_t epoll_write(vnode_t *vnode, size_t pos, const void *buf,
+                           size_t count)
+{
+    return -EINVAL;
+}
+
+static long epoll_stat(vnode_t *vnode, stat_t *ss)
+{
+    memset(ss, 0, sizeof(stat_t));
+    ss->st_mode = vnode->vn_mode;
+    ss->st_ino = vnode->vn_vno;
+    ss->st_nlink = 1;
+    return 0;
+}
+
+static void ep_timeout(uint64_t data)
+{
+    sched_broadcast_on(&((eventpoll_t *)data)->ep_waitq);
+}
+
+void vnode_poll_wakeup(vnode_t *vn)
+{
+    list_iterate(&vn->vn_pollers, epi, epitem_t, epi_vnlink)
+    {
+        sched_broadcast_on(&epi->epi_ep->ep_waitq);
+    }
+}
+
+void chardev_poll_wakeup(devid_t devid)
+{
+    list_iterate(&ep_instances, ep, eventpoll_t, ep_link)
+    {
+        list_iterate(&ep->ep_items, epi, epitem_t, epi_link)
+        {
+            vnode_t *vn = epi->epi_vnode;
+            if (S_ISCHR(vn->vn_mode) && vn->vn_devid == devid)
+            {
+                sched_broadcast_on(&ep->ep_waitq);
+                break;
+            }
+        }
+    }
+}
+
+/* Returns the eventpoll_t of the file, or NULL if it is not an instance */
+static eventpoll_t *ep_of_file(file_t *file)
+{
+    return file->f_vnode->vn_fs == &epoll_fs ? VNODE_TO_EP(file->f_vnode)
+                                             : NULL;
+}
+
+static epitem_t *ep_find(eventpoll_t *ep, int fd, vnode_t *vn)
+{
+    list_iterate(&ep->ep_items, epi, epitem_t, epi_link)
+    {
+        if (epi->epi_fd == fd && epi->epi_vnode == vn)
+        {
+            return epi;
+        }
+    }
+    return NULL;
+}
+
+long do_epoll_create(void)
+{
+    eventpoll_t *ep = slab_obj_alloc(eventpoll_allocator);
+    if (!ep)
+    {
+        return -ENOMEM;
+    }
+    list_init(&ep->ep_items);
+    sched_queue_init(&ep->ep_waitq);
+
+    int fd;
+    long ret = get_empty_fd(&fd);
+    if (ret)
+    {
+        slab_obj_free(eventpoll_allocator, ep);
+        return ret;
+    }
+
+    vnode_t *vnode = vget(&epoll_fs, next_epno++);
+    vnode->vn_i = ep;
+    uint8_t ipl = intr_setipl(IPL_HIGH);
+    list_insert_tail(&ep_instances, &ep->ep_link);
+    intr_setipl(ipl);
+    ret = fcreate(fd, vnode, FMODE_READ) ? fd : -ENOMEM;
+    vput(&vnode);
+    return ret;
+}
+
+long do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    file_t *epfile = fget(epfd);
+    if (!epfile)
+    {
+        return -EBADF;
+    }
+    file_t *file = fget(fd);
+    if (!file)
+    {
+        fput(&epfile);
+        return -EBADF;
+    }
+
+    long ret = 0;
+    eventpoll_t *ep = ep_of_file(epfile);
+    if (!ep || ep_of_file(file))
+    {
+        /* instances cannot watch each other, so they cannot form cycles */
+        ret = -EINVAL;
+        goto out;
+    }
+
+    vnode_t *vn = file->f_vnode;
+    epitem_t *epi = ep_find(ep, fd, vn);
+    switch (op)
+    {
+    case EPOLL_CTL_ADD:
+        if (epi)
+        {
+            ret = -EEXIST;
+            break;
+        }
+        if (!(epi = slab_obj_alloc(epitem_allocator)))
+        {
+            ret = -ENOMEM;
+            break;
+        }
+        epi->epi_ep = ep;
+        epi->epi_fd = fd;
+        epi->epi_event = *event;
+        vref(vn);
+        epi->epi_vnode = vn;
+        uint8_t ipl = intr_setipl(IPL_HIGH);
+        list_insert_tail(&ep->ep_items, &epi->epi_link);
+        list_insert_tail(&vn->vn_pollers, &epi->epi_vnlink);
+        intr_setipl(ipl);
+
+        /* a waiter may be interested in this file being ready already */
+        vnode_poll_wakeup(vn);
+        break;
+    case EPOLL_CTL_MOD:
+        if (!epi)
+        {
+            ret = -ENOENT;
+            break;
+        }
+        epi->epi_event = *event;
+        vnode_poll_wakeup(vn);
+        break;
+    case EPOLL_CTL_DEL:
+        if (!epi)
+        {
+            ret = -ENOENT;
+            break;
+        }
+        epitem_free(epi);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+out:
+    fput(&file);
+    fput(&epfile);
+    return ret;
+}
+
+/*
+ * Fill in events with the ready entries of the interest list, up to
+ * maxevents of them.
+ */
+static int ep_scan(eventpoll_t *ep, struct epoll_event *events, int maxevents)
+{
+    int n = 0;
+    list_iterate(&ep->ep_items, epi, epitem_t, epi_link)
+    {
+        vnode_t *vn = epi->epi_vnode;
+        uint32_t revents = vn->vn_ops->poll ? (uint32_t)vn->vn_ops->poll(vn)
+                                            : EPOLLIN | EPOLLOUT;
+        revents &= epi->epi_event.events | EPOLLERR | EPOLLHUP;
+        if (revents)
+        {
+            events[n].events = revents;
+            events[n].data = epi->epi_event.data;
+            if (++n == maxevents)
+            {
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+static uint64_t ep_jiffies_from_now(uint64_t ns)
+{
+    return (time_now_ns() + ns + NSEC_PER_JIFFY - 1) / NSEC_PER_JIFFY;
+}
+
+long do_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+                   long timeout)
+{
+    if (maxevents <= 0)
+    {
+        return -EINVAL;
+    }
+    file_t *file = fget(epfd);
+    if (!file)
+    {
+        return -EBADF;
+    }
+    eventpoll_t *ep = ep_of_file(file);
+    if (!ep)
+    {
+        fput(&file);
+        return -EINVAL;
+    }
+
+    uint64_t deadline = (uint64_t)-1;
+    if (timeout > 0)
+    {
+        deadline = ep_jiffies_from_now(timeout * NSEC_PER_MSEC);
+    }
+
+    timer_t timer;
+    timer_init(&timer);
+    timer.function = ep_timeout;
+    timer.data = (uint64_t)ep;
+    timer.expires = deadline;
+
+    /* a wakeup between scanning and going to sleep must not be missed */
+    uint8_t ipl = intr_setipl(IPL_HIGH);
+    long ret;
+    while (1)
+    {
+        ret = ep_scan(ep, events, maxevents);
+        if (ret || !timeout ||
+            (timeout > 0 && ep_jiffies_from_now(0) >= deadline))
+        {
+            break;
+        }
+
+        if (deadline != (uint64_t)-1)
+        {
+            timer_add(&timer);
+        }
+        ret = sched_cancellable_sleep_on(&ep->ep_waitq);
+        if (deadline != (uint64_t)-1)
+        {
+            timer_del(&timer);
+        }
+        if (ret)
+        {
+            break;
+        }
+    }
+    intr_setipl(ipl);
+
+    fput(&file);
+    return ret;
+}
@@ -1,4 +1,5 @@
 #include "fs/file.h"
+#include "fs/open.h"
 #include "fs/vfs.h"
 #include "fs/vnode.h"
 #include "kernel.h"
@@ -52,7 +53,7 @@ file_t *fcreate(int fd, vnode_t *vnode, unsigned int mode)
     if (vnode->vn_ops->acquire)
         vnode->vn_ops->acquire(vnode, file);
 
-    curproc->p_files[fd] = file;
+    fd_install(fd, file);
     fref(file);
     return file;
 }
@@ -71,6 +72,27 @@ file_t *fget(int fd)
     return file;
 }
 
+file_t *fget_light(int fd)
+{
+#ifdef __MTP__
+    return fget(fd);
+#else
+    if (fd < 0 || fd >= NFILES)
+        return NULL;
+    return curproc->p_files[fd];
+#endif
+}
+
+void fput_light(file_t **filep)
+{
+#ifdef __MTP__
+    fput(filep);
+#else
+    KASSERT(*filep && (*filep)->f_refcount > 0);
+    *filep = NULL;
+#endif
+}
+
 /*
  * Decrement the refcount, and set *filep to NULL.
  *
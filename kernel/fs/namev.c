@@ -2,6 +2,7 @@
 
 #include "errno.h"
 #include "fs/fcntl.h"
+#include "fs/file.h"
 #include "fs/stat.h"
 #include "fs/vfs.h"
 #include "fs/vnode.h"
@@ -178,9 +179,9 @@ long namev_dir(vnode_t *base, const char *path, vnode_t **res_vnode,
     if (!token || !token_len || !search || !*search) {
       break;
     }
-    vlock(cur);
+    vlock_shared(cur);
     long ret = namev_lookup(cur, token, token_len, &next);
-    vunlock(cur);
+    vunlock_shared(cur);
     if (ret < 0) {
       vput(&cur);
       return ret;
@@ -249,28 +250,29 @@ long namev_open(vnode_t *base, const char *path, int oflags, int mode,
     return -ENAMETOOLONG;
   }
 
-  vlock(dir);
-  ret = namev_lookup(dir, name, namelen, res_vnode);
-
-  if (ret == 0) {
-    vunlock(dir);
-    vput(&dir);
-    if (S_ISREG((*res_vnode)->vn_mode) && name[namelen] == '/') {
-      vput(res_vnode);
-      return -ENOTDIR;
+  // only a lookup that may create the file needs dir exclusively
+  if (!(oflags & O_CREAT)) {
+    vlock_shared(dir);
+    ret = namev_lookup(dir, name, namelen, res_vnode);
+    vunlock_shared(dir);
+  } else {
+    vlock(dir);
+    ret = namev_lookup(dir, name, namelen, res_vnode);
+    if (ret == -ENOENT) {
+      if (dir->vn_ops->mknod) {
+        ret = dir->vn_ops->mknod(dir, name, namelen, mode, devid, res_vnode);
+      } else {
+        ret = -ENOTSUP;
+      }
     }
-    return 0;
+    vunlock(dir);
   }
+  vput(&dir);
 
-  if ((oflags & O_CREAT) && ret == -ENOENT) {
-    if (dir->vn_ops->mknod) {
-      ret = dir->vn_ops->mknod(dir, name, namelen, mode, devid, res_vnode);
-    } else {
-      ret = -ENOTSUP;
-    }
+  if (ret == 0 && S_ISREG((*res_vnode)->vn_mode) && name[namelen] == '/') {
+    vput(res_vnode);
+    return -ENOTDIR;
   }
-  vunlock(dir);
-  vput(&dir);
   return ret;
 }
 
@@ -281,13 +283,44 @@ long namev_resolve(vnode_t *base, const char *path, vnode_t **res_vnode) {
   return namev_open(base, path, O_RDONLY, 0, 0, res_vnode);
 }
 
+/*
+ * Get the vnode a lookup of path relative to dirfd starts from, as the *at()
+ * system calls take it: the current working directory for AT_FDCWD, or else
+ * the directory open at dirfd. Absolute paths ignore dirfd and get the
+ * current working directory, which namev_dir() then skips. Returns it via
+ * base, with an added reference.
+ *
+ * Return 0 on success, or:
+ *  - EBADF: dirfd is neither AT_FDCWD nor an open file descriptor
+ *  - ENOTDIR: dirfd does not refer to a directory
+ */
+long namev_base(int dirfd, const char *path, vnode_t **base) {
+  if (dirfd == AT_FDCWD || (path && *path == '/')) {
+    KASSERT(curproc && curproc->p_cwd);
+    vref(*base = curproc->p_cwd);
+    return 0;
+  }
+
+  file_t *file = fget_light(dirfd);
+  if (!file) {
+    return -EBADF;
+  }
+  long ret = -ENOTDIR;
+  if (S_ISDIR(file->f_vnode->vn_mode)) {
+    vref(*base = file->f_vnode);
+    ret = 0;
+  }
+  fput_light(&file);
+  return ret;
+}
+
 /*
  * Get the parent of a directory. dir must not be locked.
  */
 long namev_get_parent(vnode_t *dir, vnode_t **out) {
-  vlock(dir);
+  vlock_shared(dir);
   long ret = namev_lookup(dir, "..", 2, out);
-  vunlock(dir);
+  vunlock_shared(dir);
   return ret;
 }
 
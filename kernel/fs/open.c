@@ -3,27 +3,65 @@
 #include "errno.h"
 #include "fs/fcntl.h"
 #include "fs/file.h"
+#include "fs/open.h"
 #include "fs/vfs.h"
 #include "fs/vfs_syscall.h"
 #include "fs/vnode.h"
 #include "globals.h"
 #include "util/debug.h"
 
+#if NFILES > 32
+#error "fd_used has one 32-bit word per process"
+#endif
+
+/*
+ * Free-slot bitmap of every process's descriptor table, indexed by pid: a
+ * bit is set while its descriptor is in use. Descriptors are put in p_files
+ * by fd_install() and taken out by do_close(), which the precompiled
+ * proc_cleanup() also uses, so a set bit is always right. The precompiled
+ * fork copies p_files without going through fd_install(), so a clear bit is
+ * only a hint, and get_empty_fd() checks it against p_files.
+ */
+static uint32_t fd_used[PROC_MAX_COUNT];
+
+static uint32_t *fd_bitmap() {
+  KASSERT(curproc->p_pid >= 0 && curproc->p_pid < PROC_MAX_COUNT);
+  return &fd_used[curproc->p_pid];
+}
+
+void fd_install(int fd, file_t *file) {
+  curproc->p_files[fd] = file;
+  *fd_bitmap() |= 1U << fd;
+}
+
+void fd_release(int fd) {
+  KASSERT(!curproc->p_files[fd]);
+  *fd_bitmap() &= ~(1U << fd);
+}
+
 // NOTE: IF DOING MULTI-THREADED PROCS, NEED TO SYNCHRONIZE ACCESS TO FILE
 // DESCRIPTORS, AND, MORE GENERALLY SPEAKING, p_files, IN PARTICULAR IN THIS
 // FUNCTION AND ITS CALLERS.
 /*
- * Go through curproc->p_files and find the first null entry.
- * If one exists, set fd to that index and return 0.
+ * Find the lowest free entry of curproc->p_files, using the lowest clear bit
+ * of the process's fd_used word. If one exists, set fd to that index and
+ * return 0.
  *
  * Error cases get_empty_fd is responsible for generating:
  *  - EMFILE: no empty file descriptor
  */
 long get_empty_fd(int *fd) {
-  for (*fd = 0; *fd < NFILES; (*fd)++) {
+  uint32_t *used = fd_bitmap();
+  while (~*used) {
+    *fd = __builtin_ctz(~*used);
+    if (*fd >= NFILES) {
+      break;
+    }
     if (!curproc->p_files[*fd]) {
       return 0;
     }
+    /* inherited across fork, see fd_used */
+    *used |= 1U << *fd;
   }
   *fd = -1;
   return -EMFILE;
@@ -61,9 +99,12 @@ long get_empty_fd(int *fd) {
  * device but the device pointed to by the union is NULL then return ENXIO.
  *
  * Keep in mind that O_RDONLY is 0 and FMODE_READ is 1 to avoid confusion.
+ *
+ * A relative path starts from the directory open at dirfd, or from the
+ * current working directory if dirfd is AT_FDCWD.
  */
-long do_open(const char *filename, int oflags) {
-  struct vnode *res_vnode = NULL;
+long do_openat(int dirfd, const char *filename, int oflags) {
+  struct vnode *base, *res_vnode = NULL;
   int nfd;
   // invalid oflags
   if (((oflags & O_WRONLY) && (oflags & O_RDWR)) ||
@@ -76,7 +117,12 @@ long do_open(const char *filename, int oflags) {
     return ret;
   }
 
-  ret = namev_open(curproc->p_cwd, filename, oflags, S_IFREG, 0, &res_vnode);
+  ret = namev_base(dirfd, filename, &base);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = namev_open(base, filename, oflags, S_IFREG, 0, &res_vnode);
+  vput(&base);
   if (ret < 0) {
     return ret;
   }
@@ -124,3 +170,7 @@ long do_open(const char *filename, int oflags) {
   vput(&res_vnode);
   return nfd;
 }
+
+long do_open(const char *filename, int oflags) {
+  return do_openat(AT_FDCWD, filename, oflags);
+}
@@ -8,7 +8,9 @@
 #include "errno.h"
 #include "globals.h"
 
+#include "fs/epoll.h"
 #include "fs/file.h"
+#include "fs/open.h"
 #include "fs/pipe.h"
 #include "fs/stat.h"
 #include "fs/vfs.h"
@@ -16,12 +18,16 @@
 #include "fs/vnode.h"
 
 #include "mm/kmalloc.h"
+#include "mm/page.h"
 #include "mm/slab.h"
 
+#include "proc/sched.h"
+
 #include "util/debug.h"
 #include "util/string.h"
 
-#define PIPE_BUF_SIZE 4096
+/* Number of page-sized buffers in a pipe's ring */
+#define PIPE_NBUFS 16
 
 static void pipe_read_vnode(fs_t *fs, vnode_t *vnode);
 
@@ -48,6 +54,10 @@ static long pipe_acquire(vnode_t *vnode, file_t *file);
 
 static long pipe_release(vnode_t *vnode, file_t *file);
 
+static ssize_t pipe_write_page(vnode_t *vnode, void *page, size_t len);
+
+static long pipe_poll(vnode_t *vnode);
+
 static vnode_ops_t pipe_vops = {
     .read = pipe_read,
     .write = pipe_write,
@@ -65,21 +75,37 @@ static vnode_ops_t pipe_vops = {
     .get_pframe = NULL,
     .fill_pframe = NULL,
     .flush_pframe = NULL,
+    .write_page = pipe_write_page,
+    .poll = pipe_poll,
 };
 
+/* One page of data in a pipe: pb_len bytes starting pb_off into pb_page. */
+typedef struct pipe_buf
+{
+    void *pb_page;
+    size_t pb_off;
+    size_t pb_len;
+} pipe_buf_t;
+
 /* struct pipe defines some data specific to pipes. One of these
    should be present in the vn_i field of each pipe vnode. */
 typedef struct pipe
 {
-    /* Buffer for data in the pipe, which has been written but not yet read. */
-    char *pv_buf;
     /*
-     * Position of the head and number of characters in the buffer. You can
-     * write in characters at position head so long as size does not grow beyond
-     * the pipe buffer size.
+     * Ring of buffers holding data which has been written but not yet read.
+     * The buffers in use are pv_bufs[pv_head % PIPE_NBUFS] up to (but not
+     * including) pv_bufs[pv_tail % PIPE_NBUFS]. Only the reader advances
+     * pv_head and only the writer advances pv_tail, so that each side only
+     * needs its own lock below. The writer fills the last buffer before
+     * starting a new one.
      */
-    off_t pv_head;
+    pipe_buf_t pv_bufs[PIPE_NBUFS];
+    size_t pv_head;
+    size_t pv_tail;
+    /* Number of bytes in the ring */
     size_t pv_size;
+    /* A page the reader emptied, kept for the writer's next buffer */
+    void *pv_spare;
     /* Number of file descriptors using this pipe for read and write. */
     int pv_readers;
     int pv_writers;
@@ -92,10 +118,10 @@ typedef struct pipe
     kmutex_t pv_rdlock;
     kmutex_t pv_wrlock;
     /*
-     * Waitqueues for threads attempting to read from an empty buffer, or
-     * write to a full buffer. When the pipe becomes non-empty (or non-full)
-     * then the corresponding waitq should be broadcasted on to make sure all
-     * of the threads get a chance to go.
+     * Waitqueues for the reader waiting on an empty ring, and the writer
+     * waiting on a full one. Since the locks above let only one thread of
+     * each side in at a time, each queue has at most one thread on it, which
+     * the other side wakes up only when the ring stops being empty (or full).
      */
     ktqueue_t pv_read_waitq;
     ktqueue_t pv_write_waitq;
@@ -103,6 +129,9 @@ typedef struct pipe
 
 #define VNODE_TO_PIPE(vn) ((pipe_t *)((vn)->vn_i))
 
+#define PIPE_EMPTY(p) ((p)->pv_head == (p)->pv_tail)
+#define PIPE_FULL(p) ((p)->pv_tail - (p)->pv_head == PIPE_NBUFS)
+
 static slab_allocator_t *pipe_allocator = NULL;
 static int next_pno = 0;
 
@@ -110,6 +139,12 @@ void pipe_init(void)
 {
     pipe_allocator = slab_allocator_create("pipe", sizeof(pipe_t));
     KASSERT(pipe_allocator);
+
+    pipe_fs.fs_vnode_allocator =
+        slab_allocator_create("pipe_vnode", sizeof(vnode_t));
+    KASSERT(pipe_fs.fs_vnode_allocator);
+    list_init(&pipe_fs.vnode_list);
+    kmutex_init(&pipe_fs.vnode_list_mutex);
 }
 
 /*
@@ -120,8 +155,17 @@ void pipe_init(void)
  */
 static pipe_t *pipe_create(void)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_create");
-    return NULL;
+    pipe_t *pipe = slab_obj_alloc(pipe_allocator);
+    if (!pipe)
+    {
+        return NULL;
+    }
+    memset(pipe, 0, sizeof(pipe_t));
+    kmutex_init(&pipe->pv_rdlock);
+    kmutex_init(&pipe->pv_wrlock);
+    sched_queue_init(&pipe->pv_read_waitq);
+    sched_queue_init(&pipe->pv_write_waitq);
+    return pipe;
 }
 
 /*
@@ -129,7 +173,16 @@ static pipe_t *pipe_create(void)
  */
 static void pipe_destroy(pipe_t *pipe)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_destroy");
+    KASSERT(!pipe->pv_readers && !pipe->pv_writers);
+    for (; !PIPE_EMPTY(pipe); pipe->pv_head++)
+    {
+        page_free(pipe->pv_bufs[pipe->pv_head % PIPE_NBUFS].pb_page);
+    }
+    if (pipe->pv_spare)
+    {
+        page_free(pipe->pv_spare);
+    }
+    slab_obj_free(pipe_allocator, pipe);
 }
 
 /* pipefs vnode operations */
@@ -162,8 +215,14 @@ static void pipe_delete_vnode(fs_t *fs, vnode_t *vnode)
  */
 static vnode_t *pget(void)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pget");
-    return NULL;
+    vnode_t *vnode = vget(&pipe_fs, next_pno++);
+    vnode->vn_i = pipe_create();
+    if (!vnode->vn_i)
+    {
+        vput(&vnode);
+        return NULL;
+    }
+    return vnode;
 }
 
 /*
@@ -179,8 +238,82 @@ static vnode_t *pget(void)
  */
 int do_pipe(int pipefd[2])
 {
-    NOT_YET_IMPLEMENTED("PIPES: do_pipe");
-    return -ENOTSUP;
+    vnode_t *vnode = pget();
+    if (!vnode)
+    {
+        return -ENOMEM;
+    }
+
+    int rfd, wfd;
+    long ret = get_empty_fd(&rfd);
+    if (ret)
+    {
+        vput(&vnode);
+        return ret;
+    }
+    if (!fcreate(rfd, vnode, FMODE_READ))
+    {
+        vput(&vnode);
+        return -ENOMEM;
+    }
+
+    ret = get_empty_fd(&wfd);
+    if (!ret && !fcreate(wfd, vnode, FMODE_WRITE))
+    {
+        ret = -ENOMEM;
+    }
+    if (ret)
+    {
+        do_close(rfd);
+        vput(&vnode);
+        return ret;
+    }
+
+    /* the files hold their own references */
+    vput(&vnode);
+    pipefd[0] = rfd;
+    pipefd[1] = wfd;
+    return 0;
+}
+
+/*
+ * Append the next buffer to the ring: the pipe must not be full. Wakes up
+ * the reader, and any epoll_wait() on the pipe, if the ring was empty.
+ */
+static void pipe_push(vnode_t *vnode, void *page, size_t len)
+{
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+    KASSERT(!PIPE_FULL(pipe));
+    pipe_buf_t *pb = &pipe->pv_bufs[pipe->pv_tail % PIPE_NBUFS];
+    pb->pb_page = page;
+    pb->pb_off = 0;
+    pb->pb_len = len;
+    pipe->pv_size += len;
+    if (PIPE_EMPTY(pipe))
+    {
+        sched_wakeup_on(&pipe->pv_read_waitq, NULL);
+        vnode_poll_wakeup(vnode);
+    }
+    pipe->pv_tail++;
+}
+
+/*
+ * Wait until the ring has room for another buffer, holding pv_wrlock.
+ * Returns 0 once it does, or:
+ *  - EPIPE: there are no readers left
+ *  - EINTR: the thread was cancelled while waiting
+ */
+static long pipe_wait_room(pipe_t *pipe)
+{
+    while (pipe->pv_readers && PIPE_FULL(pipe))
+    {
+        long ret = sched_cancellable_sleep_on(&pipe->pv_write_waitq);
+        if (ret)
+        {
+            return ret;
+        }
+    }
+    return pipe->pv_readers ? 0 : -EPIPE;
 }
 
 /*
@@ -196,11 +329,60 @@ int do_pipe(int pipefd[2])
  * for writing again so no more writers will ever put characters in the pipe.
  * The reader should just take as much as it needs (or barring that, as much as
  * it can get) and return with a partial buffer.
+ *
+ * Here a read returns as soon as it has taken anything out of the ring, and
+ * only blocks while the ring is empty. Emptying a buffer of a full ring wakes
+ * up the writer.
  */
 static long pipe_read(vnode_t *vnode, size_t pos, void *buf, size_t count)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_read");
-    return -EINVAL;
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+    long ret = 0;
+
+    /* the vnode would keep out writers (see do_write) while we wait */
+    vunlock_shared(vnode);
+    kmutex_lock(&pipe->pv_rdlock);
+    while (PIPE_EMPTY(pipe) && pipe->pv_writers && count)
+    {
+        if ((ret = sched_cancellable_sleep_on(&pipe->pv_read_waitq)))
+        {
+            break;
+        }
+    }
+
+    size_t nread = 0;
+    while (!ret && nread < count && !PIPE_EMPTY(pipe))
+    {
+        pipe_buf_t *pb = &pipe->pv_bufs[pipe->pv_head % PIPE_NBUFS];
+        size_t n = MIN(count - nread, pb->pb_len);
+        memcpy((char *)buf + nread, (char *)pb->pb_page + pb->pb_off, n);
+        pb->pb_off += n;
+        pb->pb_len -= n;
+        pipe->pv_size -= n;
+        nread += n;
+        if (pb->pb_len)
+        {
+            break;
+        }
+
+        if (pipe->pv_spare)
+        {
+            page_free(pb->pb_page);
+        }
+        else
+        {
+            pipe->pv_spare = pb->pb_page;
+        }
+        if (PIPE_FULL(pipe))
+        {
+            sched_wakeup_on(&pipe->pv_write_waitq, NULL);
+            vnode_poll_wakeup(vnode);
+        }
+        pipe->pv_head++;
+    }
+    kmutex_unlock(&pipe->pv_rdlock);
+    vlock_shared(vnode);
+    return nread ? (long)nread : ret;
 }
 
 /*
@@ -211,12 +393,82 @@ static long pipe_read(vnode_t *vnode, size_t pos, void *buf, size_t count)
  *
  * If there are no more readers, we have a broken pipe, and should fail with
  * the EPIPE error number.
+ *
+ * Data goes into the room left in the last buffer of the ring, then into new
+ * pages. Only starting a buffer in an empty ring wakes up the reader.
  */
 static long pipe_write(vnode_t *vnode, size_t pos, const void *buf,
                        size_t count)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_write");
-    return -EINVAL;
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+    long ret = 0;
+
+    vunlock(vnode);
+    kmutex_lock(&pipe->pv_wrlock);
+    size_t nwritten = 0;
+    while (nwritten < count)
+    {
+        if (!pipe->pv_readers)
+        {
+            ret = -EPIPE;
+            break;
+        }
+
+        if (!PIPE_EMPTY(pipe))
+        {
+            pipe_buf_t *pb = &pipe->pv_bufs[(pipe->pv_tail - 1) % PIPE_NBUFS];
+            size_t end = pb->pb_off + pb->pb_len;
+            size_t n = MIN(count - nwritten, PAGE_SIZE - end);
+            if (n)
+            {
+                memcpy((char *)pb->pb_page + end, (char *)buf + nwritten, n);
+                pb->pb_len += n;
+                pipe->pv_size += n;
+                nwritten += n;
+                continue;
+            }
+        }
+
+        if ((ret = pipe_wait_room(pipe)))
+        {
+            break;
+        }
+        void *page = pipe->pv_spare;
+        pipe->pv_spare = NULL;
+        if (!page && !(page = page_alloc()))
+        {
+            ret = -ENOMEM;
+            break;
+        }
+        size_t n = MIN(count - nwritten, PAGE_SIZE);
+        memcpy(page, (char *)buf + nwritten, n);
+        pipe_push(vnode, page, n);
+        nwritten += n;
+    }
+    kmutex_unlock(&pipe->pv_wrlock);
+    vlock(vnode);
+    return nwritten ? (long)nwritten : ret;
+}
+
+/*
+ * Hands the page itself to the ring as its next buffer instead of copying it,
+ * once there is room for it.
+ */
+static ssize_t pipe_write_page(vnode_t *vnode, void *page, size_t len)
+{
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+
+    vunlock(vnode);
+    kmutex_lock(&pipe->pv_wrlock);
+    long ret = pipe_wait_room(pipe);
+    if (!ret)
+    {
+        pipe_push(vnode, page, len);
+        ret = len;
+    }
+    kmutex_unlock(&pipe->pv_wrlock);
+    vlock(vnode);
+    return ret;
 }
 
 /*
@@ -227,8 +479,13 @@ static long pipe_write(vnode_t *vnode, size_t pos, const void *buf,
  */
 static long pipe_stat(vnode_t *vnode, stat_t *ss)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_stat");
-    return -EINVAL;
+    memset(ss, 0, sizeof(stat_t));
+    ss->st_mode = vnode->vn_mode;
+    ss->st_ino = vnode->vn_vno;
+    ss->st_nlink = 1;
+    ss->st_size = VNODE_TO_PIPE(vnode)->pv_size;
+    ss->st_blksize = PAGE_SIZE;
+    return 0;
 }
 
 /*
@@ -239,7 +496,15 @@ static long pipe_stat(vnode_t *vnode, stat_t *ss)
  */
 static long pipe_acquire(vnode_t *vnode, file_t *file)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_acquire");
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+    if (file->f_mode & FMODE_READ)
+    {
+        pipe->pv_readers++;
+    }
+    if (file->f_mode & FMODE_WRITE)
+    {
+        pipe->pv_writers++;
+    }
     return 0;
 }
 
@@ -251,6 +516,43 @@ static long pipe_acquire(vnode_t *vnode, file_t *file)
  */
 static long pipe_release(vnode_t *vnode, file_t *file)
 {
-    NOT_YET_IMPLEMENTED("PIPES: pipe_release");
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+    if ((file->f_mode & FMODE_READ) && !--pipe->pv_readers)
+    {
+        sched_broadcast_on(&pipe->pv_write_waitq);
+        vnode_poll_wakeup(vnode);
+    }
+    if ((file->f_mode & FMODE_WRITE) && !--pipe->pv_writers)
+    {
+        sched_broadcast_on(&pipe->pv_read_waitq);
+        vnode_poll_wakeup(vnode);
+    }
     return 0;
 }
+
+/*
+ * A pipe is readable when the ring has data, and writable when it has room
+ * for another buffer. Every change of either calls vnode_poll_wakeup().
+ */
+static long pipe_poll(vnode_t *vnode)
+{
+    pipe_t *pipe = VNODE_TO_PIPE(vnode);
+    long events = 0;
+    if (!PIPE_EMPTY(pipe))
+    {
+        events |= EPOLLIN;
+    }
+    if (!pipe->pv_writers)
+    {
+        events |= EPOLLHUP;
+    }
+    if (!pipe->pv_readers)
+    {
+        events |= EPOLLERR;
+    }
+    else if (!PIPE_FULL(pipe))
+    {
+        events |= EPOLLOUT;
+    }
+    return events;
+}
@@ -13,6 +13,8 @@
 
 #include "proc/kmutex.h"
 
+#include "drivers/bio.h"
+#include "drivers/ramdisk.h"
 #include "fs/dirent.h"
 #include "fs/file.h"
 #include "fs/s5fs/s5fs.h"
@@ -20,9 +22,12 @@
 #include "fs/stat.h"
 
 #include "mm/kmalloc.h"
+#include "vm/vmmap.h"
 
 static long s5_check_super(s5_super_t *super);
 
+static long s5fs_mkfs(blockdev_t *dev, size_t nblocks);
+
 static long s5fs_check_refcounts(fs_t *fs);
 
 static void s5fs_read_vnode(fs_t *fs, vnode_t *vn);
@@ -38,6 +43,12 @@ static ssize_t s5fs_read(vnode_t *vnode, size_t pos, void *buf, size_t len);
 static ssize_t s5fs_write(vnode_t *vnode, size_t pos, const void *buf,
                           size_t len);
 
+static ssize_t s5fs_readv(vnode_t *vnode, size_t pos, const struct iovec *iov,
+                          int iovcnt);
+
+static ssize_t s5fs_writev(vnode_t *vnode, size_t pos,
+                           const struct iovec *iov, int iovcnt);
+
 static long s5fs_mmap(vnode_t *file, mobj_t **ret);
 
 static long s5fs_mknod(struct vnode *dir, const char *name, size_t namelen,
@@ -75,6 +86,11 @@ static long s5fs_fill_pframe(vnode_t *vnode, pframe_t *pf);
 
 static long s5fs_flush_pframe(vnode_t *vnode, pframe_t *pf);
 
+static long s5fs_clone_range(vnode_t *dst, size_t dst_pos, vnode_t *src,
+                             size_t src_pos, size_t len);
+
+static void s5fs_readahead(vnode_t *vnode, size_t pagenum, size_t npages);
+
 fs_ops_t s5fs_fsops = {.read_vnode = s5fs_read_vnode,
                        .delete_vnode = s5fs_delete_vnode,
                        .umount = s5fs_umount,
@@ -97,7 +113,9 @@ static vnode_ops_t s5fs_dir_vops = {.read = NULL,
                                     .get_pframe = s5fs_get_pframe,
                                     .fill_pframe = s5fs_fill_pframe,
                                     .flush_pframe = s5fs_flush_pframe,
-                                    .truncate_file = NULL};
+                                    .truncate_file = NULL,
+                                    .readv = NULL,
+                                    .writev = NULL};
 
 static vnode_ops_t s5fs_file_vops = {.read = s5fs_read,
                                      .write = s5fs_write,
@@ -115,7 +133,11 @@ static vnode_ops_t s5fs_file_vops = {.read = s5fs_read,
                                      .get_pframe = s5fs_get_pframe,
                                      .fill_pframe = s5fs_fill_pframe,
                                      .flush_pframe = s5fs_flush_pframe,
-                                     .truncate_file = s5fs_truncate_file};
+                                     .truncate_file = s5fs_truncate_file,
+                                     .readv = s5fs_readv,
+                                     .writev = s5fs_writev,
+                                     .clone_range = s5fs_clone_range,
+                                     .readahead = s5fs_readahead};
 
 static mobj_ops_t s5fs_mobj_ops = {.get_pframe = NULL,
                                    .fill_pframe = blockdev_fill_pframe,
@@ -135,14 +157,25 @@ long s5fs_mount(fs_t *fs) {
 
   KASSERT(fs);
 
-  if (sscanf(fs->fs_dev, "disk%d", &num) != 1) {
+  blockdev_t *dev;
+  if (sscanf(fs->fs_dev, "disk%d", &num) == 1) {
+    dev = blockdev_lookup(MKDEVID(DISK_MAJOR, num));
+  } else if (sscanf(fs->fs_dev, "ramdisk%d", &num) == 1) {
+    dev = blockdev_lookup(MKDEVID(RAMDISK_MAJOR, num));
+  } else {
     return -EINVAL;
   }
-
-  blockdev_t *dev = blockdev_lookup(MKDEVID(DISK_MAJOR, num));
   if (!dev)
     return -EINVAL;
 
+  /* RAM disks start out blank; they get a file system when first mounted */
+  size_t nblocks = ramdisk_nblocks(dev);
+  if (nblocks) {
+    long ret = s5fs_mkfs(dev, nblocks);
+    if (ret)
+      return ret;
+  }
+
   slab_allocator_t *allocator =
       slab_allocator_create("s5_node", sizeof(s5_node_t));
   fs->fs_vnode_allocator = allocator;
@@ -222,7 +255,10 @@ static void s5fs_sync(fs_t *fs) {
   memcpy(pf->pf_addr, &s5fs->s5f_super, sizeof(s5_super_t));
   s5_release_disk_block(&pf);
 
+  /* Write the dirty blocks through the block I/O queue first, so that they
+   * go out sorted and merged; mobj_flush then has nothing left to write. */
   mobj_lock(&s5fs->s5f_mobj);
+  bio_writeback(s5fs->s5f_bdev, mobj);
   mobj_flush(mobj);
   mobj_unlock(&s5fs->s5f_mobj);
 }
@@ -346,12 +382,27 @@ static ssize_t s5fs_write(vnode_t *vnode, size_t pos, const void *buf,
   return s5_write_file(VNODE_TO_S5NODE(vnode), pos, buf, len);
 }
 
+/* Wrapper around s5_read_filev. */
+static ssize_t s5fs_readv(vnode_t *vnode, size_t pos, const struct iovec *iov,
+                          int iovcnt) {
+  KASSERT(!S_ISDIR(vnode->vn_mode) && "should be handled at the VFS level");
+  return s5_read_filev(VNODE_TO_S5NODE(vnode), pos, iov, iovcnt);
+}
+
+/* Wrapper around s5_write_filev. */
+static ssize_t s5fs_writev(vnode_t *vnode, size_t pos,
+                           const struct iovec *iov, int iovcnt) {
+  KASSERT(!S_ISDIR(vnode->vn_mode) && "should be handled at the VFS level");
+  return s5_write_filev(VNODE_TO_S5NODE(vnode), pos, iov, iovcnt);
+}
+
 /*
  * Any error handling should have been done before this function was called.
  * Simply add a reference to the underlying mobj and return it through ret.
  */
 static long s5fs_mmap(vnode_t *file, mobj_t **ret) {
-  NOT_YET_IMPLEMENTED("VM: s5fs_mmap");
+  mobj_ref(&file->vn_mobj);
+  *ret = &file->vn_mobj;
   return 0;
 }
 
@@ -877,6 +928,24 @@ static inline void s5_get_file_disk_block(vnode_t *vnode, uint64_t blocknum,
  */
 inline void s5_release_disk_block(pframe_t **pfp) { pframe_release(pfp); }
 
+/*
+ * Mark pf, a page of vnode about to be written to, dirty. If its block is
+ * shared with other files, it moves to a block of its own first, so that the
+ * write does not show through them. On failure, pf is released.
+ */
+static long s5fs_dirty_pframe(vnode_t *vnode, pframe_t **pfp) {
+  // dirty pages are never shared: s5fs_clone_range writes them back first
+  if ((*pfp)->pf_dirty)
+    return 0;
+  long ret = s5_unshare_block(VNODE_TO_S5NODE(vnode), *pfp);
+  if (ret) {
+    pframe_release(pfp);
+    return ret;
+  }
+  (*pfp)->pf_dirty = 1;
+  return 0;
+}
+
 /*
  * This is where the abstraction of vnode file block/page --> disk block is
  * finally implemented. Check that the requested page lies within vnode->vn_len.
@@ -885,15 +954,25 @@ inline void s5_release_disk_block(pframe_t **pfp) { pframe_release(pfp); }
  * to what the forwrite argument to s5fs_get_pframe means for the alloc argument
  * in s5_file_block_to_disk_block.
  *
- * If the disk block for the corresponding file block is sparse, you should use
- * mobj_default_get_pframe on the vnode's own memory object. This will trickle
- * down to s5fs_fill_pframe if the pframe is not already resident.
+ * If the disk block for the corresponding file block is sparse, the page is
+ * cached in the vnode's own memory object backed by the shared zero page, so
+ * reading a hole neither allocates nor clears a page. Such a pframe is dropped
+ * as soon as the page is requested for writing, and a real block takes its
+ * place. Private mappings may still map the zero page, so they are unmapped
+ * and fault the new page in.
+ *
+ * Every page of the file is cached in vnode->vn_mobj and nowhere else, and
+ * that is also the object s5fs_mmap hands out: read, write and shared mappings
+ * all work on the same pframes, so there is nothing to keep coherent.
  *
  * Otherwise, if the disk block is NOT sparse, you will want to simply use
  * s5_get_disk_block. NOTE: in this case, you also need to make sure you free
  * the pframe that resides in the vnode itself for the requested pagenum. To
  * do so, you will want to use mobj_find_pframe and mobj_free_pframe.
  *
+ * A block shared with other files (see s5fs_clone_range) gets a block of its
+ * own when its page is requested for writing, whether it was cached or not.
+ *
  * Given the above design, we s5fs itself does not need to implement
  * flush_pframe. Any pframe that will be written to (forwrite = 1) should always
  * have a disk block backing it on successful return. Thus, the page frame will
@@ -907,9 +986,14 @@ static long s5fs_get_pframe(vnode_t *vnode, uint64_t pagenum, long forwrite,
     return -EINVAL;
   mobj_find_pframe(&vnode->vn_mobj, pagenum, pfp);
   if (*pfp) {
-    // block is cached
-    (*pfp)->pf_dirty |= forwrite;
-    return 0;
+    if (!forwrite || !pframe_is_zero_page(*pfp)) {
+      // block is cached
+      return forwrite ? s5fs_dirty_pframe(vnode, pfp) : 0;
+    }
+    // a hole is about to be written, back it with a real block instead
+    vmmap_unmap_object(&vnode->vn_mobj, pagenum, 1);
+    long ret = mobj_free_pframe(&vnode->vn_mobj, pfp);
+    KASSERT(!ret);
   }
   int new;
   long loc = s5_file_block_to_disk_block(VNODE_TO_S5NODE(vnode), pagenum,
@@ -924,22 +1008,28 @@ static long s5fs_get_pframe(vnode_t *vnode, uint64_t pagenum, long forwrite,
       *pfp = s5_cache_and_clear_block(&vnode->vn_mobj, pagenum, loc);
     } else {
       // block must be read from disk
-      s5_get_file_disk_block(vnode, pagenum, loc, forwrite, pfp);
+      s5_get_file_disk_block(vnode, pagenum, loc, 0, pfp);
+      if (forwrite) {
+        return s5fs_dirty_pframe(vnode, pfp);
+      }
     }
     return 0;
   } else {
-    // block is in a sparse region of the file
-    // so read from the vnode's memory object that call memset pframe's content
-    // to all zeor. avoid write back to disk.
+    // block is in a sparse region of the file, so its contents are all
+    // zeroes. avoid write back to disk.
     KASSERT(!forwrite);
-    return mobj_default_get_pframe(&vnode->vn_mobj, pagenum, forwrite, pfp);
+    mobj_create_pframe(&vnode->vn_mobj, pagenum, 0, pfp);
+    if (!*pfp)
+      return -ENOMEM;
+    (*pfp)->pf_addr = pframe_zero_page;
+    return 0;
   }
 }
 
 /*
- * According the documentation for s5fs_get_pframe, this only gets called when
- * the file block for a given page number is sparse. In other words, pf
- * corresponds to a sparse block.
+ * s5fs_get_pframe hands out the shared zero page for sparse blocks, so this is
+ * only reached if the vnode's memory object is asked to fill a page directly.
+ * In that case pf corresponds to a sparse block.
  */
 static long s5fs_fill_pframe(vnode_t *vnode, pframe_t *pf) {
   memset(pf->pf_addr, 0, PAGE_SIZE);
@@ -950,6 +1040,104 @@ static long s5fs_flush_pframe(vnode_t *vnode, pframe_t *pf) {
   return blockdev_flush_pframe(&VNODE_TO_S5FS(vnode)->s5f_mobj, pf);
 }
 
+/*
+ * Submit a read for each block among the given pages that is neither cached
+ * nor sparse, into a new pframe that keeps the request in pf_bio, and return
+ * without waiting: biod sorts and merges the requests, and whoever asks for
+ * one of the pages waits for its read in vnode_get_pframe(). Stops at the
+ * first error, since read-ahead is only a hint.
+ */
+static void s5fs_readahead(vnode_t *vnode, size_t pagenum, size_t npages) {
+  s5fs_t *s5fs = VNODE_TO_S5FS(vnode);
+  for (size_t end = pagenum + npages; pagenum < end; pagenum++) {
+    pframe_t *pf;
+    mobj_find_pframe(&vnode->vn_mobj, pagenum, &pf);
+    if (pf) {
+      pframe_release(&pf);
+      continue;
+    }
+    int new;
+    long loc = s5_file_block_to_disk_block(VNODE_TO_S5NODE(vnode), pagenum, 0,
+                                           &new);
+    if (loc < 0)
+      return;
+    if (!loc)
+      continue;
+
+    bio_t *bio = kmalloc(sizeof(bio_t));
+    void *page = bio ? page_alloc() : NULL;
+    if (page)
+      mobj_create_pframe(&vnode->vn_mobj, pagenum, loc, &pf);
+    if (!pf) {
+      if (page)
+        page_free(page);
+      if (bio)
+        kfree(bio);
+      return;
+    }
+    pf->pf_addr = page;
+    pf->pf_bio = bio;
+    bio_init_request(bio, s5fs->s5f_bdev, BIO_READ, loc, 1, &pf->pf_addr);
+    bio_submit(bio);
+    pframe_release(&pf);
+  }
+}
+
+/*
+ * Make dst share src's disk blocks for the range (see s5_clone_blocks), so
+ * that cloning costs a few metadata blocks rather than a copy of the data.
+ *
+ * Both files' pages in the range are unmapped, so that writes through shared
+ * mappings fault and go through s5fs_get_pframe again. src's dirty pages are
+ * written back, so that the blocks hold what dst is supposed to see, and dst's
+ * pages are dropped, since their blocks are about to be replaced. The memory
+ * objects stay locked until the blocks are shared, to keep page faults out.
+ *
+ * Return 0 on success, or:
+ *  - EFBIG: dst would grow beyond S5_MAX_FILE_SIZE
+ *  - Propagate errors from s5_clone_blocks
+ */
+static long s5fs_clone_range(vnode_t *dst, size_t dst_pos, vnode_t *src,
+                             size_t src_pos, size_t len) {
+  if (dst_pos + len > S5_MAX_FILE_SIZE)
+    return -EFBIG;
+  size_t dst_block = S5_DATA_BLOCK(dst_pos);
+  size_t src_block = S5_DATA_BLOCK(src_pos);
+  size_t nblocks = S5_DATA_BLOCK(len + S5_BLOCK_SIZE - 1);
+
+  mobj_lock(&dst->vn_mobj);
+  if (src != dst)
+    mobj_lock(&src->vn_mobj);
+  vmmap_unmap_object(&dst->vn_mobj, dst_block, nblocks);
+  vmmap_unmap_object(&src->vn_mobj, src_block, nblocks);
+  long ret = 0;
+  for (size_t i = 0; i < nblocks; i++) {
+    mobj_delete_pframe(&dst->vn_mobj, dst_block + i);
+    pframe_t *pf;
+    mobj_find_pframe(&src->vn_mobj, src_block + i, &pf);
+    if (pf) {
+      ret = mobj_flush_pframe(&src->vn_mobj, pf);
+      pframe_release(&pf);
+      if (ret)
+        break;
+    }
+  }
+  if (!ret)
+    ret = s5_clone_blocks(VNODE_TO_S5NODE(dst), dst_block, VNODE_TO_S5NODE(src),
+                          src_block, nblocks);
+  if (src != dst)
+    mobj_unlock(&src->vn_mobj);
+  mobj_unlock(&dst->vn_mobj);
+
+  if (!ret && dst_pos + len > dst->vn_len) {
+    s5_node_t *sn = VNODE_TO_S5NODE(dst);
+    dst->vn_len = dst_pos + len;
+    sn->inode.s5_un.s5_size = dst->vn_len;
+    sn->dirtied_inode = 1;
+  }
+  return ret;
+}
+
 /*
  * Verify the superblock. 0 on success; -1 on failure.
  */
@@ -970,6 +1158,86 @@ static long s5_check_super(s5_super_t *super) {
   return 0;
 }
 
+/*
+ * Lay out an empty file system on dev, unless it already holds one. Like
+ * tools/fsmaker, this writes one inode for every eight blocks, a root
+ * directory with "." and "..", and a free list holding the remaining blocks
+ * (every S5_NBLKS_PER_FNODE-th of which is used as a free list node).
+ */
+static long s5fs_mkfs(blockdev_t *dev, size_t nblocks) {
+  size_t iblocks = MAX(nblocks / 8 / S5_INODES_PER_BLOCK, 1);
+  if (iblocks + 2 >= nblocks)
+    return -ENOSPC;
+  uint32_t ninodes = iblocks * S5_INODES_PER_BLOCK;
+  uint32_t rootblock = iblocks + 1;
+
+  char *buf = page_alloc();
+  if (!buf)
+    return -ENOMEM;
+
+  long ret = dev->bd_ops->read_block(dev, buf, S5_SUPER_BLOCK, 1);
+  if (ret || ((s5_super_t *)buf)->s5s_magic == S5_MAGIC)
+    goto out;
+  dbg(DBG_S5FS, "formatting device 0x%x: %lu blocks, %u inodes\n", dev->bd_id,
+      nblocks, ninodes);
+
+  for (size_t b = 0; b < iblocks; b++) {
+    memset(buf, 0, S5_BLOCK_SIZE);
+    s5_inode_t *inode = (s5_inode_t *)buf;
+    for (uint32_t i = 0; i < S5_INODES_PER_BLOCK; i++, inode++) {
+      uint32_t ino = b * S5_INODES_PER_BLOCK + i;
+      inode->s5_number = ino;
+      if (ino == 0) {
+        inode->s5_type = S5_TYPE_DIR;
+        inode->s5_linkcount = 2;
+        inode->s5_un.s5_size = 2 * sizeof(s5_dirent_t);
+        inode->s5_direct_blocks[0] = rootblock;
+      } else {
+        inode->s5_type = S5_TYPE_FREE;
+        inode->s5_un.s5_next_free = ino + 1 < ninodes ? ino + 1 : (uint32_t)-1;
+      }
+    }
+    if ((ret = dev->bd_ops->write_block(dev, buf, S5_INODE_BLOCK(0) + b, 1)))
+      goto out;
+  }
+
+  memset(buf, 0, S5_BLOCK_SIZE);
+  s5_dirent_t *dirent = (s5_dirent_t *)buf;
+  strcpy(dirent[0].s5d_name, ".");
+  strcpy(dirent[1].s5d_name, "..");
+  if ((ret = dev->bd_ops->write_block(dev, buf, rootblock, 1)))
+    goto out;
+
+  s5_super_t super;
+  memset(&super, 0, sizeof(super));
+  super.s5s_free_blocks[S5_NBLKS_PER_FNODE - 1] = (uint32_t)-1;
+  for (uint32_t num = rootblock + 1; num < nblocks; num++) {
+    if (super.s5s_nfree < S5_NBLKS_PER_FNODE - 1) {
+      super.s5s_free_blocks[super.s5s_nfree++] = num;
+      continue;
+    }
+    memset(buf, 0, S5_BLOCK_SIZE);
+    memcpy(buf, super.s5s_free_blocks, sizeof(super.s5s_free_blocks));
+    if ((ret = dev->bd_ops->write_block(dev, buf, num, 1)))
+      goto out;
+    super.s5s_free_blocks[S5_NBLKS_PER_FNODE - 1] = num;
+    super.s5s_nfree = 0;
+  }
+
+  super.s5s_magic = S5_MAGIC;
+  super.s5s_free_inode = ninodes > 1 ? 1 : (uint32_t)-1;
+  super.s5s_root_inode = 0;
+  super.s5s_num_inodes = ninodes;
+  super.s5s_version = S5_CURRENT_VERSION;
+  memset(buf, 0, S5_BLOCK_SIZE);
+  memcpy(buf, &super, sizeof(super));
+  ret = dev->bd_ops->write_block(dev, buf, S5_SUPER_BLOCK, 1);
+
+out:
+  page_free(buf);
+  return ret;
+}
+
 /*
  * Calculate refcounts on the filesystem.
  */
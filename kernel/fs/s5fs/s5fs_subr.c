@@ -12,6 +12,7 @@
 #include "types.h"
 #include "util/debug.h"
 #include "util/string.h"
+#include "vm/vmmap.h"
 #include <fs/s5fs/s5fs.h>
 
 static void s5_free_block(s5fs_t *s5fs, blocknum_t block);
@@ -87,6 +88,30 @@ static inline void s5_release_file_block(pframe_t **pfp) {
   pframe_release(pfp);
 }
 
+/* Allocate the indirect block of sn, which has none yet, with all 0s.
+ *
+ * Return 0 on success, or:
+ *  - Propagate errors from s5_alloc_block.
+ */
+static long s5_alloc_indirect_block(s5_node_t *sn) {
+  s5fs_t *s5_fs = VNODE_TO_S5FS(&sn->vnode);
+  KASSERT(!sn->inode.s5_indirect_block);
+  long new_block = s5_alloc_block(s5_fs);
+  if (new_block < 0) {
+    return new_block;
+  }
+  sn->inode.s5_indirect_block = new_block;
+  sn->dirtied_inode = 1;
+
+  mobj_lock(&s5_fs->s5f_mobj);
+  pframe_t *pf =
+      s5_cache_and_clear_block(&s5_fs->s5f_mobj, new_block, new_block);
+  KASSERT(kmutex_owns_mutex(&pf->pf_mutex));
+  kmutex_unlock(&pf->pf_mutex);
+  mobj_unlock(&s5_fs->s5f_mobj);
+  return 0;
+}
+
 /* Given a file and a file block number, return the disk block number of the
  * desired file block.
  *
@@ -155,21 +180,10 @@ long s5_file_block_to_disk_block(s5_node_t *sn, size_t file_blocknum, int alloc,
     if (!alloc) {
       return 0;
     }
-    long new_block = s5_alloc_block(VNODE_TO_S5FS(&sn->vnode));
-    if (new_block < 0) {
-      return new_block;
+    long ret = s5_alloc_indirect_block(sn);
+    if (ret < 0) {
+      return ret;
     }
-    inode->s5_indirect_block = new_block;
-    sn->dirtied_inode = 1;
-
-    // Allocate the indirect block with all 0s
-    s5fs_t *s5_fs = VNODE_TO_S5FS(&sn->vnode);
-    mobj_lock(&s5_fs->s5f_mobj);
-    pframe_t *pf =
-        s5_cache_and_clear_block(&s5_fs->s5f_mobj, new_block, new_block);
-    KASSERT(kmutex_owns_mutex(&pf->pf_mutex));
-    kmutex_unlock(&pf->pf_mutex);
-    mobj_unlock(&s5_fs->s5f_mobj);
   }
 
   pframe_t *pf;
@@ -191,6 +205,45 @@ long s5_file_block_to_disk_block(s5_node_t *sn, size_t file_blocknum, int alloc,
   return result;
 }
 
+/* Point file block file_blocknum of sn at disk block loc, or make it sparse if
+ * loc is 0, allocating the indirect block if need be. The block it pointed at
+ * before is not freed.
+ *
+ * Return the disk block it pointed at before (0 if it was sparse), or:
+ *  - Propagate errors from s5_alloc_block.
+ */
+static long s5_set_file_block(s5_node_t *sn, size_t file_blocknum,
+                              blocknum_t loc) {
+  s5_inode_t *inode = &sn->inode;
+  KASSERT(file_blocknum < S5_MAX_FILE_BLOCKS);
+  long old;
+  if (file_blocknum < S5_NDIRECT_BLOCKS) {
+    old = inode->s5_direct_blocks[file_blocknum];
+    inode->s5_direct_blocks[file_blocknum] = loc;
+    sn->dirtied_inode = 1;
+    return old;
+  }
+
+  file_blocknum -= S5_NDIRECT_BLOCKS;
+  if (inode->s5_indirect_block == 0) {
+    if (!loc) {
+      return 0;
+    }
+    long ret = s5_alloc_indirect_block(sn);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  pframe_t *pf;
+  s5_get_meta_disk_block(VNODE_TO_S5FS(&sn->vnode), inode->s5_indirect_block, 1,
+                         &pf);
+  uint32_t *indirect_blocks = (uint32_t *)pf->pf_addr;
+  old = indirect_blocks[file_blocknum];
+  indirect_blocks[file_blocknum] = loc;
+  s5_release_disk_block(&pf);
+  return old;
+}
+
 /* Given a mobj and a block, clear any data in the block and store a newly
  * created page frame in the mobj's cache
  *
@@ -212,6 +265,30 @@ pframe_t *s5_cache_and_clear_block(mobj_t *mo, long block, long loc) {
   return pf;
 }
 
+/* Copy n bytes between block and the buffers of iov, continuing from buffer
+ * *segp at offset *offp and advancing them past the bytes copied. Copies into
+ * the buffers if out is set, and out of them otherwise.
+ */
+static void s5_iov_copy(const struct iovec *iov, int *segp, size_t *offp,
+                        char *block, size_t n, int out) {
+  while (n > 0) {
+    const struct iovec *seg = &iov[*segp];
+    size_t copy = MIN(n, seg->iov_len - *offp);
+    if (out) {
+      memcpy((char *)seg->iov_base + *offp, block, copy);
+    } else {
+      memcpy(block, (char *)seg->iov_base + *offp, copy);
+    }
+    block += copy;
+    n -= copy;
+    *offp += copy;
+    if (*offp == seg->iov_len) {
+      (*segp)++;
+      *offp = 0;
+    }
+  }
+}
+
 /* Read from a file.
  *
  *  sn  - The s5_node representing the file to read from
@@ -236,8 +313,21 @@ pframe_t *s5_cache_and_clear_block(mobj_t *mo, long block, long loc) {
  * blocks
  */
 ssize_t s5_read_file(s5_node_t *sn, size_t pos, char *buf, size_t len) {
+  struct iovec iov = {.iov_base = buf, .iov_len = len};
+  return s5_read_filev(sn, pos, &iov, 1);
+}
+
+/* Read from a file into the iovcnt buffers of iov in turn, like
+ * s5_read_file. Each block of the file is looked up once, however many of the
+ * buffers it is copied into.
+ */
+ssize_t s5_read_filev(s5_node_t *sn, size_t pos, const struct iovec *iov,
+                      int iovcnt) {
   size_t length;
+  size_t len = iov_length(iov, iovcnt);
   ssize_t total_readed = 0;
+  int seg = 0;
+  size_t segoff = 0;
   pframe_t *pf;
 
   KASSERT(sn->inode.s5_number == sn->vnode.vn_vno);
@@ -250,8 +340,17 @@ ssize_t s5_read_file(s5_node_t *sn, size_t pos, char *buf, size_t len) {
     length = len;
   }
 
+  // Under vlock_shared() the memory object is not locked, so lock it just
+  // while looking up each block. The pframe stays locked until it is copied.
+  long locked = kmutex_owns_mutex(&sn->vnode.vn_mobj.mo_mutex);
   do {
+    if (!locked) {
+      mobj_lock(&sn->vnode.vn_mobj);
+    }
     long ret = s5_get_file_block(sn, pos / S5_BLOCK_SIZE, 0, &pf);
+    if (!locked) {
+      mobj_unlock(&sn->vnode.vn_mobj);
+    }
     if (ret < 0) {
       s5_release_file_block(&pf);
       return ret;
@@ -259,10 +358,10 @@ ssize_t s5_read_file(s5_node_t *sn, size_t pos, char *buf, size_t len) {
     size_t readed = (pos % S5_BLOCK_SIZE + length > S5_BLOCK_SIZE)
                         ? S5_BLOCK_SIZE - pos % S5_BLOCK_SIZE
                         : length;
-    memcpy(buf, ((char *)pf->pf_addr + pos % S5_BLOCK_SIZE), readed);
+    s5_iov_copy(iov, &seg, &segoff,
+                (char *)pf->pf_addr + pos % S5_BLOCK_SIZE, readed, 1);
     s5_release_file_block(&pf);
 
-    buf += readed;
     length -= readed;
     pos += readed;
     total_readed += readed;
@@ -304,8 +403,21 @@ ssize_t s5_read_file(s5_node_t *sn, size_t pos, char *buf, size_t len) {
  * the inode to be the same.
  */
 ssize_t s5_write_file(s5_node_t *sn, size_t pos, const char *buf, size_t len) {
+  struct iovec iov = {.iov_base = (char *)buf, .iov_len = len};
+  return s5_write_filev(sn, pos, &iov, 1);
+}
+
+/* Write to a file from the iovcnt buffers of iov in turn, like s5_write_file.
+ * Each block of the file is looked up once, however many of the buffers are
+ * copied into it.
+ */
+ssize_t s5_write_filev(s5_node_t *sn, size_t pos, const struct iovec *iov,
+                       int iovcnt) {
   ssize_t ret;
+  size_t len = iov_length(iov, iovcnt);
   size_t total_writed = 0;
+  int seg = 0;
+  size_t segoff = 0;
   pframe_t *pf;
   do {
     // only pos is invalid, we can return error `EFBIG'
@@ -335,10 +447,10 @@ ssize_t s5_write_file(s5_node_t *sn, size_t pos, const char *buf, size_t len) {
       sn->inode.s5_un.s5_size = sn->vnode.vn_len = undo_len;
       return ret;
     }
-    memcpy(((char *)pf->pf_addr + pos % S5_BLOCK_SIZE), buf, writed);
+    s5_iov_copy(iov, &seg, &segoff,
+                (char *)pf->pf_addr + pos % S5_BLOCK_SIZE, writed, 0);
     s5_release_disk_block(&pf);
     len -= writed;
-    buf += writed;
     pos += writed;
     total_writed += writed;
   } while (len > 0);
@@ -390,6 +502,69 @@ static long s5_alloc_block(s5fs_t *s5fs) {
   return blockno;
 }
 
+/*
+ * Get the refcount block that holds the count of block (see s5fs.h) in *pfp.
+ * If it is not allocated yet, it is allocated with all 0s if alloc is set,
+ * and *pfp is set to NULL otherwise.
+ *
+ * Return 0 on success, or:
+ *  - ENOSPC: alloc is set and block is too far into the disk to be shared, or
+ *    there is no free block for the refcount block
+ */
+static long s5_get_refcount_block(s5fs_t *s5fs, blocknum_t block, long alloc,
+                                  pframe_t **pfp) {
+  *pfp = NULL;
+  size_t index = block / S5_REFCOUNTS_PER_BLOCK;
+  if (index >= S5_REFCOUNT_NBLOCKS) {
+    return alloc ? -ENOSPC : 0;
+  }
+  uint32_t *loc = &s5fs->s5f_super.s5s_refcount_blocks[index];
+  if (*loc == 0 && alloc) {
+    long new_block = s5_alloc_block(s5fs);
+    if (new_block < 0) {
+      return new_block;
+    }
+    if (*loc) {
+      // allocated by someone else while s5_alloc_block was blocked
+      s5_free_block(s5fs, new_block);
+    } else {
+      mobj_lock(&s5fs->s5f_mobj);
+      *pfp = s5_cache_and_clear_block(&s5fs->s5f_mobj, new_block, new_block);
+      mobj_unlock(&s5fs->s5f_mobj);
+      *loc = new_block;
+      return 0;
+    }
+  }
+  if (*loc) {
+    s5_get_meta_disk_block(s5fs, *loc, 0, pfp);
+  }
+  return 0;
+}
+
+/*
+ * Add a reference to block, which another file is about to share.
+ *
+ * Return 0 on success, or:
+ *  - EMLINK: block already has S5_REFCOUNT_MAX extra references
+ *  - Propagate errors from s5_get_refcount_block
+ */
+static long s5_share_block(s5fs_t *s5fs, blocknum_t block) {
+  pframe_t *pf;
+  long ret = s5_get_refcount_block(s5fs, block, 1, &pf);
+  if (ret) {
+    return ret;
+  }
+  uint8_t *count = (uint8_t *)pf->pf_addr + block % S5_REFCOUNTS_PER_BLOCK;
+  if (*count == S5_REFCOUNT_MAX) {
+    ret = -EMLINK;
+  } else {
+    (*count)++;
+    pf->pf_dirty = 1;
+  }
+  s5_release_disk_block(&pf);
+  return ret;
+}
+
 /*
  * The exact opposite of s5_alloc_block: add blockno to the free list of the
  * filesystem. This should never fail. You may assert that any pframe calls
@@ -400,6 +575,24 @@ static long s5_alloc_block(s5fs_t *s5fs) {
  * more free blocks in its s5s_free_blocks array according to s5s_nfree.
  */
 static void s5_free_block(s5fs_t *s5fs, blocknum_t blockno) {
+  // a shared block only loses a reference, until the last file lets it go
+  pframe_t *refpf;
+  s5_get_refcount_block(s5fs, blockno, 0, &refpf);
+  if (refpf) {
+    uint8_t *count =
+        (uint8_t *)refpf->pf_addr + blockno % S5_REFCOUNTS_PER_BLOCK;
+    long shared = *count;
+    if (shared) {
+      (*count)--;
+      refpf->pf_dirty = 1;
+    }
+    s5_release_disk_block(&refpf);
+    if (shared) {
+      dbg(DBG_S5FS, "unsharing disk block %d\n", blockno);
+      return;
+    }
+  }
+
   s5_lock_super(s5fs);
   s5_super_t *s = &s5fs->s5f_super;
   dbg(DBG_S5FS, "freeing disk block %d\n", blockno);
@@ -764,6 +957,9 @@ void s5_remove_blocks(s5_node_t *sn) {
   s5fs_t *s5fs = VNODE_TO_S5FS(&sn->vnode);
   s5_inode_t *s5_inode = &sn->inode;
   mobj_t *o = &sn->vnode.vn_mobj;
+
+  // the pages go away with the blocks, so nothing may still map them
+  vmmap_unmap_object(o, 0, S5_MAX_FILE_BLOCKS);
   for (unsigned i = 0; i < S5_NDIRECT_BLOCKS; i++) {
     if (s5_inode->s5_direct_blocks[i]) {
       s5_free_block(s5fs, s5_inode->s5_direct_blocks[i]);
@@ -795,3 +991,81 @@ void s5_remove_blocks(s5_node_t *sn) {
     s5_inode->s5_indirect_block = 0;
   }
 }
+
+/*
+ * Give the block of sn that pf caches a disk block of its own before pf is
+ * written to, if it is shared with other files (see s5_clone_blocks). pf
+ * already holds the block's contents, so they are not copied: the new block
+ * just takes over pf, which is marked dirty, and the shared block loses a
+ * reference.
+ *
+ * Return 0 on success, or:
+ *  - Propagate errors from s5_alloc_block
+ */
+long s5_unshare_block(s5_node_t *sn, pframe_t *pf) {
+  s5fs_t *s5fs = VNODE_TO_S5FS(&sn->vnode);
+  pframe_t *refpf;
+  s5_get_refcount_block(s5fs, pf->pf_loc, 0, &refpf);
+  if (!refpf) {
+    return 0;
+  }
+  long shared =
+      ((uint8_t *)refpf->pf_addr)[pf->pf_loc % S5_REFCOUNTS_PER_BLOCK];
+  s5_release_disk_block(&refpf);
+  if (!shared) {
+    return 0;
+  }
+
+  long new_block = s5_alloc_block(s5fs);
+  if (new_block < 0) {
+    return new_block;
+  }
+  long old = s5_set_file_block(sn, pf->pf_pagenum, new_block);
+  KASSERT(old == (long)pf->pf_loc);
+  s5_free_block(s5fs, old);
+  pf->pf_loc = new_block;
+  pf->pf_dirty = 1;
+  return 0;
+}
+
+/*
+ * Make the nblocks blocks of dst from dst_block on share the disk blocks of
+ * src from src_block on instead of copying them, and free the blocks dst had
+ * there. Sparse blocks of src become sparse in dst. Neither file may have
+ * dirty pages in the range cached, nor dst any pages at all (see
+ * s5fs_clone_range).
+ *
+ * Return 0 on success, or, with the blocks before the one that failed already
+ * shared:
+ *  - EMLINK: a block of src is already shared by too many files
+ *  - ENOSPC: a block of src is too far into the disk to be shared, or there is
+ *    no free block for an indirect or refcount block
+ */
+long s5_clone_blocks(s5_node_t *dst, size_t dst_block, s5_node_t *src,
+                     size_t src_block, size_t nblocks) {
+  s5fs_t *s5fs = VNODE_TO_S5FS(&dst->vnode);
+  for (size_t i = 0; i < nblocks; i++) {
+    int new;
+    long loc = s5_file_block_to_disk_block(src, src_block + i, 0, &new);
+    if (loc < 0) {
+      return loc;
+    }
+    if (loc) {
+      long ret = s5_share_block(s5fs, loc);
+      if (ret) {
+        return ret;
+      }
+    }
+    long old = s5_set_file_block(dst, dst_block + i, loc);
+    if (old < 0) {
+      if (loc) {
+        s5_free_block(s5fs, loc);
+      }
+      return old;
+    }
+    if (old) {
+      s5_free_block(s5fs, old);
+    }
+  }
+  return 0;
+}
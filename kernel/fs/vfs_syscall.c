@@ -2,19 +2,69 @@
 
 #include <limits.h>
 
+#include "api/access.h"
 #include "errno.h"
 #include "fs/dirent.h"
 #include "fs/fcntl.h"
 #include "fs/file.h"
 #include "fs/lseek.h"
+#include "fs/open.h"
+#include "fs/uio.h"
 #include "fs/vfs.h"
 #include "fs/vnode.h"
 #include "globals.h"
 #include "kernel.h"
+#include "mm/page.h"
 #include "proc/kmutex.h"
 #include "util/debug.h"
 #include "util/string.h"
 
+#define READAHEAD_MIN_PAGES 4
+#define READAHEAD_MAX_PAGES 32
+
+/*
+ * Called by do_read() with the vnode locked shared and its memory object
+ * locked after len bytes were read at pos.
+ * A read that starts where the last one left off doubles the read-ahead
+ * window, up to READAHEAD_MAX_PAGES; any other read closes it. The window
+ * is refilled in one batch once less than half of it is left; its reads are
+ * only submitted, not waited for. Files advised POSIX_FADV_SEQUENTIAL always
+ * use the largest window, POSIX_FADV_RANDOM ones never read ahead, and
+ * POSIX_FADV_NOREUSE ones also drop the pages behind the reader so that
+ * streaming a file does not fill the page cache.
+ */
+static void do_readahead(file_t *file, size_t pos, size_t len) {
+  size_t first = ADDR_TO_PN(pos);
+  size_t next = ADDR_TO_PN(pos + len);
+
+  if (file->f_advice == POSIX_FADV_RANDOM) {
+    file->f_ra_window = 0;
+  } else if (file->f_advice == POSIX_FADV_SEQUENTIAL ||
+             file->f_advice == POSIX_FADV_NOREUSE) {
+    file->f_ra_window = READAHEAD_MAX_PAGES;
+  } else if (first == file->f_ra_next) {
+    file->f_ra_window = file->f_ra_window
+                            ? MIN(2 * file->f_ra_window, READAHEAD_MAX_PAGES)
+                            : READAHEAD_MIN_PAGES;
+  } else {
+    file->f_ra_window = 0;
+  }
+  if (first != file->f_ra_next) {
+    file->f_ra_end = 0;
+  }
+  file->f_ra_next = next;
+
+  if (file->f_ra_end < next + file->f_ra_window / 2) {
+    size_t start = MAX(next, file->f_ra_end);
+    vnode_prefetch(file->f_vnode, start, next + file->f_ra_window - start);
+    file->f_ra_end = next + file->f_ra_window;
+  }
+
+  if (file->f_advice == POSIX_FADV_NOREUSE && next > first) {
+    vnode_drop_pages(file->f_vnode, first, next - first);
+  }
+}
+
 /*
  * Read len bytes into buf from the fd's file using the file's vnode operation
  * read.
@@ -26,29 +76,36 @@
  *
  * Hints:
  *  - Be sure to update the file's position appropriately.
- *  - Lock/unlock the file's vnode when calling its read operation.
+ *  - Lock/unlock the file's vnode when calling its read operation. Reads only
+ *    need it shared, so that readers of the same file do not wait for each
+ *    other.
  */
 ssize_t do_read(int fd, void *buf, size_t len) {
   KASSERT(curproc);
-  struct file *file = fget(fd);
+  struct file *file = fget_light(fd);
   if (!file || (file->f_mode & FMODE_READ) == 0) {
     if (file) {
-      fput(&file);
+      fput_light(&file);
     }
     return -EBADF;
   }
   struct vnode *vnode = file->f_vnode;
   if (S_ISDIR(vnode->vn_mode)) {
-    fput(&file);
+    fput_light(&file);
     return -EISDIR;
   }
 
-  vlock(vnode);
+  vlock_shared(vnode);
   KASSERT(vnode->vn_ops->read);
   ssize_t ret = vnode->vn_ops->read(vnode, file->f_pos, buf, len);
-  vunlock(vnode);
+  if (ret > 0) {
+    mobj_lock(&vnode->vn_mobj);
+    do_readahead(file, file->f_pos, ret);
+    mobj_unlock(&vnode->vn_mobj);
+  }
+  vunlock_shared(vnode);
   file->f_pos += ret;
-  fput(&file);
+  fput_light(&file);
   return ret;
 }
 
@@ -69,10 +126,10 @@ ssize_t do_read(int fd, void *buf, size_t len) {
 ssize_t do_write(int fd, const void *buf, size_t len) {
   KASSERT(curproc);
 
-  struct file *file = fget(fd);
+  struct file *file = fget_light(fd);
   if (!file || (file->f_mode & FMODE_WRITE) == 0) {
     if (file) {
-      fput(&file);
+      fput_light(&file);
     }
     return -EBADF;
   }
@@ -88,7 +145,484 @@ ssize_t do_write(int fd, const void *buf, size_t len) {
   ssize_t ret = vnode->vn_ops->write(vnode, file->f_pos, buf, len);
   vunlock(vnode);
   file->f_pos += ret;
-  fput(&file);
+  fput_light(&file);
+  return ret;
+}
+
+/*
+ * Write the first len bytes of page, a page from page_alloc(), to the fd's
+ * file by handing the page itself to the vnode operation write_page, so that
+ * the data is not copied again.
+ *
+ * Return len on success, in which case the page belongs to the file, or:
+ *  - EBADF: fd is invalid or is not open for writing
+ *  - ENOTSUP: the file cannot take pages (the caller should use do_write)
+ *  - Propagate errors from the vnode operation write_page
+ */
+ssize_t do_write_page(int fd, void *page, size_t len) {
+  struct file *file = fget_light(fd);
+  if (!file || (file->f_mode & FMODE_WRITE) == 0) {
+    if (file) {
+      fput_light(&file);
+    }
+    return -EBADF;
+  }
+
+  struct vnode *vnode = file->f_vnode;
+  ssize_t ret = -ENOTSUP;
+  if (vnode->vn_ops->write_page) {
+    vlock(vnode);
+    ret = vnode->vn_ops->write_page(vnode, page, len);
+    vunlock(vnode);
+  }
+  fput_light(&file);
+  return ret;
+}
+
+/*
+ * Read into the iovcnt buffers of iov in turn from the fd's file, starting at
+ * offset, or at the file's position if offset is -1 (which then advances).
+ * The vnode is locked once for the whole vector, which is passed to its readv
+ * operation if it has one, or else to read one buffer at a time.
+ *
+ * Return the number of bytes read on success, or:
+ *  - EBADF: fd is invalid or is not open for reading
+ *  - EISDIR: fd refers to a directory
+ *  - ESPIPE: offset is not -1 and fd refers to a pipe
+ *  - Propagate errors from the vnode operation readv or read, unless some
+ *    bytes were read before them
+ */
+ssize_t do_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  struct file *file = fget_light(fd);
+  if (!file || (file->f_mode & FMODE_READ) == 0) {
+    if (file) {
+      fput_light(&file);
+    }
+    return -EBADF;
+  }
+  struct vnode *vnode = file->f_vnode;
+  if (S_ISDIR(vnode->vn_mode)) {
+    fput_light(&file);
+    return -EISDIR;
+  }
+  if (offset >= 0 && S_ISFIFO(vnode->vn_mode)) {
+    fput_light(&file);
+    return -ESPIPE;
+  }
+
+  size_t pos = offset >= 0 ? (size_t)offset : file->f_pos;
+  ssize_t ret = 0;
+  vlock_shared(vnode);
+  if (vnode->vn_ops->readv) {
+    ret = vnode->vn_ops->readv(vnode, pos, iov, iovcnt);
+  } else {
+    KASSERT(vnode->vn_ops->read);
+    for (int i = 0; i < iovcnt; i++) {
+      ssize_t n = vnode->vn_ops->read(vnode, pos + ret, iov[i].iov_base,
+                                      iov[i].iov_len);
+      if (n < 0) {
+        ret = ret ? ret : n;
+        break;
+      }
+      ret += n;
+      if ((size_t)n < iov[i].iov_len) {
+        break;
+      }
+    }
+  }
+  if (ret > 0) {
+    mobj_lock(&vnode->vn_mobj);
+    do_readahead(file, pos, ret);
+    mobj_unlock(&vnode->vn_mobj);
+  }
+  vunlock_shared(vnode);
+  if (offset < 0 && ret > 0) {
+    file->f_pos += ret;
+  }
+  fput_light(&file);
+  return ret;
+}
+
+/*
+ * Write the iovcnt buffers of iov in turn to the fd's file, starting at
+ * offset, or at the file's position if offset is -1 (which then advances, and
+ * starts at the end of the file for FMODE_APPEND). The vnode is locked once
+ * for the whole vector, so the buffers are written contiguously.
+ *
+ * Return the number of bytes written on success, or:
+ *  - EBADF: fd is invalid or is not open for writing
+ *  - ESPIPE: offset is not -1 and fd refers to a pipe
+ *  - Propagate errors from the vnode operation writev or write, unless some
+ *    bytes were written before them
+ */
+ssize_t do_pwritev(int fd, const struct iovec *iov, int iovcnt,
+                   off_t offset) {
+  struct file *file = fget_light(fd);
+  if (!file || (file->f_mode & FMODE_WRITE) == 0) {
+    if (file) {
+      fput_light(&file);
+    }
+    return -EBADF;
+  }
+  struct vnode *vnode = file->f_vnode;
+  if (offset >= 0 && S_ISFIFO(vnode->vn_mode)) {
+    fput_light(&file);
+    return -ESPIPE;
+  }
+
+  ssize_t ret = 0;
+  vlock(vnode);
+  if (offset < 0 && (file->f_mode & FMODE_APPEND)) {
+    file->f_pos = vnode->vn_len;
+  }
+  size_t pos = offset >= 0 ? (size_t)offset : file->f_pos;
+  if (vnode->vn_ops->writev) {
+    ret = vnode->vn_ops->writev(vnode, pos, iov, iovcnt);
+  } else {
+    KASSERT(vnode->vn_ops->write);
+    for (int i = 0; i < iovcnt; i++) {
+      ssize_t n = vnode->vn_ops->write(vnode, pos + ret, iov[i].iov_base,
+                                       iov[i].iov_len);
+      if (n < 0) {
+        ret = ret ? ret : n;
+        break;
+      }
+      ret += n;
+      if ((size_t)n < iov[i].iov_len) {
+        break;
+      }
+    }
+  }
+  vunlock(vnode);
+  if (offset < 0 && ret > 0) {
+    file->f_pos += ret;
+  }
+  fput_light(&file);
+  return ret;
+}
+
+/*
+ * Read into (or, if write is set, write from) the iovcnt buffers of uiov in
+ * userland, as do_preadv() (or do_pwritev()) does for buffers in the kernel.
+ * The user buffers go through the kernel buffer kbuf of size bytes a piece
+ * at a time, but the vnode stays locked across the whole vector, so it is
+ * read or written as one however many pieces that takes. Only vn_rwlock is
+ * held while user memory is copied, and vn_mobj just while a piece goes in or
+ * out of the file, so faulting the buffers in, even from a mapping of this
+ * file, does not deadlock.
+ *
+ * Return as do_preadv() or do_pwritev() do, or:
+ *  - EFAULT: a user buffer is bad and nothing was moved before it
+ */
+ssize_t do_prwv_user(int fd, const struct iovec *uiov, int iovcnt,
+                     off_t offset, int write, void *kbuf, size_t size) {
+  struct file *file = fget_light(fd);
+  int fmode = write ? FMODE_WRITE : FMODE_READ;
+  if (!file || (file->f_mode & fmode) == 0) {
+    if (file) {
+      fput_light(&file);
+    }
+    return -EBADF;
+  }
+  struct vnode *vnode = file->f_vnode;
+  if (!write && S_ISDIR(vnode->vn_mode)) {
+    fput_light(&file);
+    return -EISDIR;
+  }
+  if (offset >= 0 && S_ISFIFO(vnode->vn_mode)) {
+    fput_light(&file);
+    return -ESPIPE;
+  }
+
+  if (write) {
+    vlock(vnode);
+    mobj_unlock(&vnode->vn_mobj);
+    if (offset < 0 && (file->f_mode & FMODE_APPEND)) {
+      file->f_pos = vnode->vn_len;
+    }
+  } else {
+    vlock_shared(vnode);
+  }
+  size_t pos = offset >= 0 ? (size_t)offset : file->f_pos;
+  size_t done = 0;
+  ssize_t ret = 0;
+  long stop = 0;
+  for (int i = 0; i < iovcnt && !stop; i++) {
+    for (size_t off = 0; off < uiov[i].iov_len && !stop;) {
+      size_t n = MIN(uiov[i].iov_len - off, size);
+      char *ubuf = (char *)uiov[i].iov_base + off;
+      ssize_t moved;
+      if (write) {
+        if ((ret = copy_from_user(kbuf, ubuf, n))) {
+          stop = 1;
+          break;
+        }
+        KASSERT(vnode->vn_ops->write);
+        mobj_lock(&vnode->vn_mobj);
+        moved = vnode->vn_ops->write(vnode, pos + done, kbuf, n);
+        mobj_unlock(&vnode->vn_mobj);
+      } else {
+        KASSERT(vnode->vn_ops->read);
+        moved = vnode->vn_ops->read(vnode, pos + done, kbuf, n);
+        if (moved > 0 && copy_to_user(ubuf, kbuf, moved)) {
+          ret = -EFAULT;
+          stop = 1;
+          break;
+        }
+      }
+      if (moved < 0) {
+        ret = moved;
+      } else {
+        done += moved;
+        off += moved;
+      }
+      /* an error, the end of the file, a full disk, or all a pipe had */
+      stop = moved < 0 || (size_t)moved < n;
+    }
+  }
+
+  if (write) {
+    mobj_lock(&vnode->vn_mobj);
+    vunlock(vnode);
+  } else {
+    if (done) {
+      mobj_lock(&vnode->vn_mobj);
+      do_readahead(file, pos, done);
+      mobj_unlock(&vnode->vn_mobj);
+    }
+    vunlock_shared(vnode);
+  }
+  if (offset < 0) {
+    file->f_pos += done;
+  }
+  fput_light(&file);
+  return done ? (ssize_t)done : ret;
+}
+
+/*
+ * Write count bytes from buf to out, at *out_off or at its position (the end
+ * of the file if it is FMODE_APPEND), and advance that. out's vnode must be
+ * locked. Returns the number of bytes written, which is count unless writing
+ * fails, or -errno if none were.
+ */
+static ssize_t do_splice_write(file_t *out, off_t *out_off, const char *buf,
+                               size_t count) {
+  vnode_t *vn = out->f_vnode;
+  KASSERT(vn->vn_ops->write);
+  if (!out_off && (out->f_mode & FMODE_APPEND)) {
+    out->f_pos = vn->vn_len;
+  }
+  size_t pos = out_off ? (size_t)*out_off : out->f_pos;
+  size_t done = 0;
+  ssize_t ret = 0;
+  while (done < count) {
+    ret = vn->vn_ops->write(vn, pos + done, buf + done, count - done);
+    if (ret <= 0) {
+      break;
+    }
+    done += ret;
+  }
+  *(out_off ? (size_t *)out_off : &out->f_pos) += done;
+  return done ? (ssize_t)done : ret;
+}
+
+/*
+ * Move the next at most count bytes of in to out, without copying them
+ * through userland, and advance the positions (see do_splice).
+ *
+ * If cached is set, in caches its pages in its memory object, and the bytes
+ * are written to out straight from in's pframe: both vnodes are locked (in
+ * the order of vlock_in_order) and the pframe is held until the write is
+ * done. Otherwise (pipes, terminals) nothing can be held across the write,
+ * so the bytes are read into the staging page buf under in's lock, which is
+ * dropped before out is locked to write them.
+ *
+ * All that is read is written out unless writing fails. Returns the number of
+ * bytes moved, 0 at the end of in, or -errno if none were.
+ */
+static ssize_t do_splice_page(file_t *in, off_t *in_off, file_t *out,
+                              off_t *out_off, size_t count, void *buf,
+                              int cached) {
+  vnode_t *vn = in->f_vnode;
+  vnode_t *outvn = out->f_vnode;
+  size_t pos = in_off ? (size_t)*in_off : in->f_pos;
+  ssize_t ret;
+
+  if (cached) {
+    vlock_in_order(vn, outvn);
+    if (pos >= vn->vn_len) {
+      vunlock_in_order(vn, outvn);
+      return 0;
+    }
+    count = MIN(count, MIN(PAGE_SIZE - PAGE_OFFSET(pos), vn->vn_len - pos));
+    pframe_t *pf;
+    ret = mobj_get_pframe(&vn->vn_mobj, ADDR_TO_PN(pos), 0, &pf);
+    if (!ret) {
+      ret = do_splice_write(out, out_off,
+                            (char *)pf->pf_addr + PAGE_OFFSET(pos), count);
+      pframe_release(&pf);
+    }
+    if (ret > 0) {
+      do_readahead(in, pos, ret);
+    }
+    vunlock_in_order(vn, outvn);
+  } else {
+    vlock_shared(vn);
+    KASSERT(vn->vn_ops->read);
+    ret = vn->vn_ops->read(vn, pos, buf, MIN(count, PAGE_SIZE));
+    vunlock_shared(vn);
+    if (ret > 0) {
+      vlock(outvn);
+      ret = do_splice_write(out, out_off, buf, ret);
+      vunlock(outvn);
+    }
+  }
+
+  if (ret > 0) {
+    *(in_off ? (size_t *)in_off : &in->f_pos) += ret;
+  }
+  return ret;
+}
+
+/*
+ * Move at most count bytes from the in_fd's file to the out_fd's file inside
+ * the kernel, a page at a time (see do_splice_page). Each side starts at
+ * *in_off or *out_off, which are advanced, or at the file's position if they
+ * are NULL, which is advanced instead (the out_fd's file is appended to if it
+ * is FMODE_APPEND).
+ *
+ * Return the number of bytes moved, which is less than count at the end of a
+ * file, after a short write, or if in_fd is not a file, in which case only
+ * what one read of it returns is moved, or:
+ *  - EBADF: in_fd is not open for reading, or out_fd for writing
+ *  - EISDIR: in_fd refers to a directory
+ *  - ESPIPE: an offset is given for a pipe
+ *  - EINVAL: both refer to the same file
+ *  - ENOMEM: no staging page could be allocated for a source that is not
+ *    cached (see do_splice_page)
+ *  - Propagate errors from the vnode operations read and write, unless some
+ *    bytes were moved before them
+ */
+ssize_t do_splice(int in_fd, off_t *in_off, int out_fd, off_t *out_off,
+                  size_t count) {
+  file_t *in = fget_light(in_fd);
+  file_t *out = fget_light(out_fd);
+  ssize_t ret = 0;
+  if (!in || !out || !(in->f_mode & FMODE_READ) ||
+      !(out->f_mode & FMODE_WRITE)) {
+    ret = -EBADF;
+  } else if (S_ISDIR(in->f_vnode->vn_mode)) {
+    ret = -EISDIR;
+  } else if ((in_off && S_ISFIFO(in->f_vnode->vn_mode)) ||
+             (out_off && S_ISFIFO(out->f_vnode->vn_mode))) {
+    ret = -ESPIPE;
+  } else if (in->f_vnode == out->f_vnode) {
+    ret = -EINVAL;
+  }
+  void *buf = NULL;
+  int cached = 0;
+  if (!ret) {
+    cached = S_ISREG(in->f_vnode->vn_mode) && in->f_vnode->vn_ops->get_pframe;
+    if (!cached) {
+      buf = page_alloc();
+      ret = buf ? 0 : -ENOMEM;
+    }
+  }
+
+  size_t total = 0;
+  while (!ret && total < count) {
+    ret = do_splice_page(in, in_off, out, out_off, count - total, buf, cached);
+    if (ret <= 0) {
+      break;
+    }
+    total += ret;
+    ret = 0;
+    if (!cached) {
+      // like read(2), take just what a pipe or terminal has to give
+      break;
+    }
+  }
+
+  if (buf) {
+    page_free(buf);
+  }
+  if (in) {
+    fput_light(&in);
+  }
+  if (out) {
+    fput_light(&out);
+  }
+  return total ? (ssize_t)total : ret;
+}
+
+/*
+ * Make len bytes of dst_fd's file from dst_off on share the storage of the
+ * same bytes of src_fd's file from src_off on, instead of copying them (see
+ * the clone_range vnode operation), so that it takes time in the number of
+ * blocks, not bytes. A len of 0 stands for the rest of the source. The
+ * destination grows if the range ends beyond its end. Neither file position
+ * is used or changed.
+ *
+ * Return 0 on success, or:
+ *  - EBADF: src_fd is not open for reading, or dst_fd is not open for writing
+ *    or is open for appending
+ *  - EISDIR: src_fd refers to a directory
+ *  - EINVAL: either file is not a regular file, an offset is not a multiple of
+ *    PAGE_SIZE, nor is len while the range does not end at the end of the
+ *    source and at or beyond the end of the destination, the range goes
+ *    beyond the end of the source, or the two ranges overlap in one file
+ *  - EXDEV: the files are on different filesystems
+ *  - EOPNOTSUPP: the filesystem cannot share storage between files
+ *  - Propagate errors from the vnode operation clone_range
+ */
+long do_clone_file_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+                         size_t len) {
+  file_t *src = fget_light(src_fd);
+  file_t *dst = fget_light(dst_fd);
+  long ret = 0;
+  if (!src || !dst || !(src->f_mode & FMODE_READ) ||
+      !(dst->f_mode & FMODE_WRITE) || (dst->f_mode & FMODE_APPEND)) {
+    ret = -EBADF;
+  } else if (S_ISDIR(src->f_vnode->vn_mode)) {
+    ret = -EISDIR;
+  } else if (!S_ISREG(src->f_vnode->vn_mode) ||
+             !S_ISREG(dst->f_vnode->vn_mode) || src_off < 0 || dst_off < 0 ||
+             !PAGE_ALIGNED(src_off) || !PAGE_ALIGNED(dst_off)) {
+    ret = -EINVAL;
+  } else if (src->f_vnode->vn_fs != dst->f_vnode->vn_fs) {
+    ret = -EXDEV;
+  } else if (!dst->f_vnode->vn_ops->clone_range) {
+    ret = -EOPNOTSUPP;
+  }
+
+  if (!ret) {
+    vnode_t *svn = src->f_vnode;
+    vnode_t *dvn = dst->f_vnode;
+    vlock_in_order(svn, dvn);
+    size_t spos = (size_t)src_off;
+    size_t dpos = (size_t)dst_off;
+    if (!len && spos < svn->vn_len) {
+      len = svn->vn_len - spos;
+    }
+    if (spos + len < spos || spos + len > svn->vn_len) {
+      ret = -EINVAL;
+    } else if (!PAGE_ALIGNED(len) &&
+               (spos + len != svn->vn_len || dpos + len < dvn->vn_len)) {
+      ret = -EINVAL;
+    } else if (svn == dvn && spos < dpos + len && dpos < spos + len) {
+      ret = -EINVAL;
+    } else if (len) {
+      ret = dvn->vn_ops->clone_range(dvn, dpos, svn, spos, len);
+    }
+    vunlock_in_order(svn, dvn);
+  }
+
+  if (src) {
+    fput_light(&src);
+  }
+  if (dst) {
+    fput_light(&dst);
+  }
   return ret;
 }
 
@@ -112,6 +646,7 @@ long do_close(int fd) {
   //   vput(&curproc->p_files[fd]->f_vnode);
   // }
   fput(&curproc->p_files[fd]);
+  fd_release(fd);
   return 0;
 }
 
@@ -138,7 +673,7 @@ long do_dup(int fd) {
     return ret;
   }
   fref(file);
-  curproc->p_files[new_fd] = file;
+  fd_install(new_fd, file);
   fput(&file);
   return new_fd;
 }
@@ -174,7 +709,7 @@ long do_dup2(int ofd, int nfd) {
   }
 
   fref(file);
-  curproc->p_files[nfd] = file;
+  fd_install(nfd, file);
   fput(&file);
   return nfd;
 }
@@ -233,18 +768,26 @@ long do_mknod(const char *path, int mode, devid_t devid) {
  *    terminated.
  *  - Be careful about locking and refcounts after calling namev_dir() and
  *    namev_lookup().
+ *
+ * A relative path starts from the directory open at dirfd, or from the
+ * current working directory if dirfd is AT_FDCWD.
  */
-long do_mkdir(const char *path) {
+long do_mkdirat(int dirfd, const char *path) {
+  vnode_t *base;
   vnode_t *parent_vnode;
   vnode_t *result_vnode;
   vnode_t *dir_vnode;
   size_t namelen;
   const char *name;
-  int ret;
+  long ret;
 
   // Find the parent directory vnode
-  KASSERT(curproc && curproc->p_cwd);
-  ret = namev_dir(curproc->p_cwd, path, &parent_vnode, &name, &namelen);
+  ret = namev_base(dirfd, path, &base);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = namev_dir(base, path, &parent_vnode, &name, &namelen);
+  vput(&base);
   if (ret < 0) {
     return ret;
   }
@@ -290,6 +833,8 @@ long do_mkdir(const char *path) {
   return ret;
 }
 
+long do_mkdir(const char *path) { return do_mkdirat(AT_FDCWD, path); }
+
 /*
  * Delete a directory at path.
  *
@@ -305,12 +850,20 @@ long do_mkdir(const char *path) {
  *  - Be careful about refcounts from calling namev_dir().
  *  - Use the parent directory's rmdir operation to remove the directory.
  *  - Lock/unlock the vnode when calling its rmdir operation.
+ *
+ * A relative path starts from the directory open at dirfd, or from the
+ * current working directory if dirfd is AT_FDCWD.
  */
-long do_rmdir(const char *path) {
-  struct vnode *dir_vnode;
+long do_rmdirat(int dirfd, const char *path) {
+  struct vnode *base, *dir_vnode;
   const char *basename = NULL;
   size_t namelen = 0;
-  long ret = namev_dir(curproc->p_cwd, path, &dir_vnode, &basename, &namelen);
+  long ret = namev_base(dirfd, path, &base);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = namev_dir(base, path, &dir_vnode, &basename, &namelen);
+  vput(&base);
   if (ret < 0) {
     return ret;
   }
@@ -343,6 +896,8 @@ long do_rmdir(const char *path) {
   return ret;
 }
 
+long do_rmdir(const char *path) { return do_rmdirat(AT_FDCWD, path); }
+
 /*
  * Remove the link between path and the file it refers to.
  *
@@ -354,12 +909,20 @@ long do_rmdir(const char *path) {
  * Hints:
  *  - Use namev_dir() and be careful about refcounts.
  *  - Lock/unlock the parent directory when calling its unlink operation.
+ *
+ * A relative path starts from the directory open at dirfd, or from the
+ * current working directory if dirfd is AT_FDCWD.
  */
-long do_unlink(const char *path) {
-  struct vnode *dir_vnode, *vnode;
+long do_unlinkat(int dirfd, const char *path) {
+  struct vnode *base, *dir_vnode, *vnode;
   const char *basename = NULL;
   size_t namelen = 0;
-  long ret = namev_dir(curproc->p_cwd, path, &dir_vnode, &basename, &namelen);
+  long ret = namev_base(dirfd, path, &base);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = namev_dir(base, path, &dir_vnode, &basename, &namelen);
+  vput(&base);
   if (ret < 0) {
     return ret;
   }
@@ -400,6 +963,8 @@ long do_unlink(const char *path) {
   return ret;
 }
 
+long do_unlink(const char *path) { return do_unlinkat(AT_FDCWD, path); }
+
 /*
  * Create a hard link newpath that refers to the same file as oldpath.
  *
@@ -493,25 +1058,38 @@ long do_link(const char *oldpath, const char *newpath) {
  * 8. vput the olddir and newdir vnodes
  *
  * P.S. This scheme /probably/ works, but we're not 100% sure.
+ *
+ * Relative paths start from the directories open at olddirfd and newdirfd,
+ * or from the current working directory for AT_FDCWD.
  */
-long do_rename(const char *oldpath, const char *newpath) {
+long do_renameat(int olddirfd, const char *oldpath, int newdirfd,
+                 const char *newpath) {
   fs_t *fs;
-  struct vnode *old_dir_vnode, *new_dir_vnode;
+  struct vnode *base, *old_dir_vnode, *new_dir_vnode;
   const char *old_basename = NULL, *new_basename = NULL;
 
   size_t old_namelen = 0, new_namelen = 0;
   long ret;
 
   // Get the old directory vnode
-  ret = namev_dir(curproc->p_cwd, oldpath, &old_dir_vnode, &old_basename,
-                  &old_namelen);
+  ret = namev_base(olddirfd, oldpath, &base);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = namev_dir(base, oldpath, &old_dir_vnode, &old_basename, &old_namelen);
+  vput(&base);
   if (ret < 0) {
     return ret;
   }
 
   // Get the new directory vnode
-  ret = namev_dir(curproc->p_cwd, newpath, &new_dir_vnode, &new_basename,
-                  &new_namelen);
+  ret = namev_base(newdirfd, newpath, &base);
+  if (ret < 0) {
+    vput(&old_dir_vnode);
+    return ret;
+  }
+  ret = namev_dir(base, newpath, &new_dir_vnode, &new_basename, &new_namelen);
+  vput(&base);
   if (ret < 0) {
     vput(&old_dir_vnode);
     return ret;
@@ -554,6 +1132,10 @@ long do_rename(const char *oldpath, const char *newpath) {
   return ret;
 }
 
+long do_rename(const char *oldpath, const char *newpath) {
+  return do_renameat(AT_FDCWD, oldpath, AT_FDCWD, newpath);
+}
+
 /* Set the current working directory to the directory represented by path.
  *
  * Returns 0 on success, or:
@@ -603,23 +1185,23 @@ long do_chdir(const char *path) {
  *    sizeof(dirent_t).
  */
 ssize_t do_getdent(int fd, struct dirent *dirp) {
-  struct file *file = fget(fd);
+  struct file *file = fget_light(fd);
   if (!file) {
     return -EBADF;
   }
   struct vnode *vnode = file->f_vnode;
   if (!S_ISDIR(vnode->vn_mode)) {
-    fput(&file);
+    fput_light(&file);
     return -ENOTDIR;
   }
 
   memset((char *)(dirp), 0, sizeof(dirent_t));
-  vlock(vnode);
+  vlock_shared(vnode);
   KASSERT(vnode->vn_ops->readdir);
   ssize_t ret = vnode->vn_ops->readdir(vnode, file->f_pos, dirp);
-  vunlock(vnode);
+  vunlock_shared(vnode);
   file->f_pos += ret;
-  fput(&file);
+  fput_light(&file);
   return ret == 0 ? 0 : sizeof(struct dirent);
 }
 
@@ -637,7 +1219,7 @@ ssize_t do_getdent(int fd, struct dirent *dirp) {
  *  - Be sure to protect the vnode if you have to access its vn_len.
  */
 off_t do_lseek(int fd, off_t offset, int whence) {
-  struct file *file = fget(fd);
+  struct file *file = fget_light(fd);
   if (!file) {
     return -EBADF;
   }
@@ -650,34 +1232,93 @@ off_t do_lseek(int fd, off_t offset, int whence) {
     new_pos = file->f_pos + offset;
     break;
   case SEEK_END:
-    vlock(file->f_vnode);
+    vlock_shared(file->f_vnode);
     new_pos = file->f_vnode->vn_len + offset;
-    vunlock(file->f_vnode);
+    vunlock_shared(file->f_vnode);
     break;
   default:
-    fput(&file);
+    fput_light(&file);
     return -EINVAL;
   }
 
   if (new_pos < 0) {
-    fput(&file);
+    fput_light(&file);
     return -EINVAL;
   }
 
   file->f_pos = new_pos;
-  fput(&file);
+  fput_light(&file);
   return new_pos;
 }
 
+/*
+ * Advise the kernel how the file represented by fd will be read, for the
+ * bytes [offset, offset + len), or to the end of the file if len is 0.
+ *
+ *  POSIX_FADV_NORMAL, POSIX_FADV_RANDOM, POSIX_FADV_SEQUENTIAL,
+ *  POSIX_FADV_NOREUSE - Set how do_read() reads ahead on this open file.
+ *    The range is ignored.
+ *  POSIX_FADV_WILLNEED - Read the range into the page cache now.
+ *  POSIX_FADV_DONTNEED - Write back and evict the range from the page cache.
+ *
+ * Return 0 on success, or:
+ *  - EBADF: fd is invalid or is not open
+ *  - EINVAL: offset or len is negative, or advice is not one of the above
+ *  - ESPIPE: fd does not refer to a regular file
+ */
+long do_fadvise(int fd, off_t offset, off_t len, int advice) {
+  if (offset < 0 || len < 0 || advice < POSIX_FADV_NORMAL ||
+      advice > POSIX_FADV_NOREUSE) {
+    return -EINVAL;
+  }
+  struct file *file = fget(fd);
+  if (!file) {
+    return -EBADF;
+  }
+  struct vnode *vnode = file->f_vnode;
+  if (!S_ISREG(vnode->vn_mode)) {
+    fput(&file);
+    return -ESPIPE;
+  }
+
+  size_t lopage = ADDR_TO_PN(offset);
+  size_t npages = len ? ADDR_TO_PN(PAGE_ALIGN_UP(offset + len)) - lopage
+                      : (size_t)-1 - lopage;
+  vlock(vnode);
+  switch (advice) {
+  case POSIX_FADV_WILLNEED:
+    vnode_prefetch(vnode, lopage, npages);
+    break;
+  case POSIX_FADV_DONTNEED:
+    vnode_drop_pages(vnode, lopage, npages);
+    break;
+  default:
+    file->f_advice = advice;
+    file->f_ra_window = 0;
+    break;
+  }
+  vunlock(vnode);
+  fput(&file);
+  return 0;
+}
+
 /* Use buf to return the status of the file represented by path.
  *
  * Return 0 on success, or:
- *  - Propagate errors from namev_resolve() and the vnode operation stat.
+ *  - Propagate errors from namev_base(), namev_resolve() and the vnode
+ *    operation stat.
+ *
+ * A relative path starts from the directory open at dirfd, or from the
+ * current working directory if dirfd is AT_FDCWD.
  */
-long do_stat(const char *path, stat_t *buf) {
-  struct vnode *vnode = NULL;
-  KASSERT(curproc && curproc->p_cwd);
-  long ret = namev_resolve(curproc->p_cwd, path, &vnode);
+long do_fstatat(int dirfd, const char *path, stat_t *buf) {
+  struct vnode *base, *vnode = NULL;
+  long ret = namev_base(dirfd, path, &base);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = namev_resolve(base, path, &vnode);
+  vput(&base);
   if (ret < 0) {
     if (vnode) {
       vput(&vnode);
@@ -686,13 +1327,17 @@ long do_stat(const char *path, stat_t *buf) {
   }
 
   KASSERT(vnode && vnode->vn_ops->stat);
-  vlock(vnode);
+  vlock_shared(vnode);
   ret = vnode->vn_ops->stat(vnode, buf);
-  vunlock(vnode);
+  vunlock_shared(vnode);
   vput(&vnode);
   return ret;
 }
 
+long do_stat(const char *path, stat_t *buf) {
+  return do_fstatat(AT_FDCWD, path, buf);
+}
+
 #ifdef __MOUNTING__
 /*
  * Implementing this function is not required and strongly discouraged unless
@@ -3,9 +3,11 @@
 #include "fs/stat.h"
 #include "fs/vfs.h"
 #include "kernel.h"
+#include "mm/pframe.h"
 #include "mm/slab.h"
 #include "util/debug.h"
 #include "util/string.h"
+#include "vm/vmmap.h"
 #include <fs/vnode_specials.h>
 
 #define MOBJ_TO_VNODE(o) CONTAINER_OF((o), vnode_t, vn_mobj)
@@ -24,6 +26,8 @@ static mobj_ops_t vnode_mobj_ops = {.get_pframe = vnode_get_pframe,
 /**
  * locks the vnodes in the order of their inode number,
  * in the case that they are the same vnode, then only one vnode is locked.
+ * vnodes on different filesystems (e.g. a file and a pipe, see do_splice) are
+ * locked in the order of their filesystems' addresses instead.
  *
  * this scheme prevents the A->B/B->A locking problem, but it only
  * works only if the `vlock_in_order` function is used in all cases where 2
@@ -31,8 +35,20 @@ static mobj_ops_t vnode_mobj_ops = {.get_pframe = vnode_get_pframe,
  */
 void vlock_in_order(vnode_t *a, vnode_t *b)
 {
-    /* these vnode's must be on the same filesystem */
-    KASSERT(a->vn_fs == b->vn_fs);
+    if (a->vn_fs != b->vn_fs)
+    {
+        if ((uintptr_t)a->vn_fs < (uintptr_t)b->vn_fs)
+        {
+            vlock(a);
+            vlock(b);
+        }
+        else
+        {
+            vlock(b);
+            vlock(a);
+        }
+        return;
+    }
 
     if (a->vn_vno == b->vn_vno)
     {
@@ -80,7 +96,7 @@ void vlock_in_order(vnode_t *a, vnode_t *b)
 
 void vunlock_in_order(vnode_t *a, vnode_t *b)
 {
-    if (a->vn_vno == b->vn_vno)
+    if (a == b)
     {
         vunlock(a);
         return;
@@ -113,6 +129,8 @@ void vnode_init(vnode_t *vn, fs_t *fs, ino_t ino, int state)
     vn->vn_fs = fs;
     vn->vn_vno = ino;
     sched_queue_init(&vn->vn_waitq);
+    rwlock_init(&vn->vn_rwlock);
+    list_init(&vn->vn_pollers);
     mobj_init(&vn->vn_mobj, MOBJ_VNODE, &vnode_mobj_ops);
     KASSERT(vn->vn_mobj.mo_refcount);
 }
@@ -183,9 +201,21 @@ inline vnode_t *vget_locked(fs_t *fs, ino_t ino) { return __vget(fs, ino, 1); }
 
 inline void vref(vnode_t *vn) { mobj_ref(&vn->vn_mobj); }
 
-inline void vlock(vnode_t *vn) { mobj_lock(&vn->vn_mobj); }
+inline void vlock(vnode_t *vn)
+{
+    rwlock_lock_write(&vn->vn_rwlock);
+    mobj_lock(&vn->vn_mobj);
+}
+
+inline void vunlock(vnode_t *vn)
+{
+    mobj_unlock(&vn->vn_mobj);
+    rwlock_unlock_write(&vn->vn_rwlock);
+}
+
+inline void vlock_shared(vnode_t *vn) { rwlock_lock_read(&vn->vn_rwlock); }
 
-inline void vunlock(vnode_t *vn) { mobj_unlock(&vn->vn_mobj); }
+inline void vunlock_shared(vnode_t *vn) { rwlock_unlock_read(&vn->vn_rwlock); }
 
 inline void vput(struct vnode **vnp)
 {
@@ -201,11 +231,75 @@ inline void vput_locked(struct vnode **vnp)
     vput(vnp);
 }
 
+/*
+ * Start reading pages [pagenum, pagenum + npages) of a regular file into its
+ * memory object, up to the end of the file, without waiting for them: this is
+ * only done ahead of need, so nobody is waiting on the result. The vnode must
+ * be locked, and its memory object too if only shared.
+ */
+void vnode_prefetch(vnode_t *vn, size_t pagenum, size_t npages)
+{
+    KASSERT(kmutex_owns_mutex(&vn->vn_mobj.mo_mutex));
+    if (!S_ISREG(vn->vn_mode) || !vn->vn_ops->readahead)
+    {
+        return;
+    }
+
+    size_t end = MIN(pagenum + npages, ADDR_TO_PN(PAGE_ALIGN_UP(vn->vn_len)));
+    if (pagenum < end)
+    {
+        vn->vn_ops->readahead(vn, pagenum, end - pagenum);
+    }
+}
+
+/*
+ * Drop the cached pages [pagenum, pagenum + npages) of a regular file,
+ * removing any user mappings of them and writing back the dirty ones first.
+ * A page that cannot be written back stays cached. The vnode must be locked,
+ * and its memory object too if only shared.
+ */
+void vnode_drop_pages(vnode_t *vn, size_t pagenum, size_t npages)
+{
+    KASSERT(kmutex_owns_mutex(&vn->vn_mobj.mo_mutex));
+    if (!S_ISREG(vn->vn_mode))
+    {
+        return;
+    }
+
+    vmmap_unmap_object(&vn->vn_mobj, pagenum, npages);
+    list_iterate(&vn->vn_mobj.mo_pframes, pf, pframe_t, pf_link)
+    {
+        if (pf->pf_pagenum < pagenum || pf->pf_pagenum - pagenum >= npages)
+        {
+            continue;
+        }
+        kmutex_lock(&pf->pf_mutex);
+        if (mobj_free_pframe(&vn->vn_mobj, &pf))
+        {
+            pframe_release(&pf);
+        }
+    }
+}
+
 static long vnode_get_pframe(mobj_t *o, uint64_t pagenum, long forwrite,
                              pframe_t **pfp)
 {
     vnode_t *vnode = MOBJ_TO_VNODE(o);
     KASSERT(vnode->vn_ops->get_pframe);
+
+    /* a page still being read ahead is waited for here; if that read failed,
+     * drop the page so that it is read again below */
+    pframe_t *pf;
+    mobj_find_pframe(o, pagenum, &pf);
+    if (pf)
+    {
+        long ret = pframe_wait_io(pf);
+        pframe_release(&pf);
+        if (ret)
+        {
+            mobj_delete_pframe(o, pagenum);
+        }
+    }
     return vnode->vn_ops->get_pframe(vnode, pagenum, forwrite, pfp);
 }
 
@@ -1,4 +1,6 @@
+#include <drivers/tty/tty.h>
 #include <errno.h>
+#include <fs/epoll.h>
 #include <fs/stat.h>
 #include <fs/vfs.h>
 #include <fs/vnode.h>
@@ -18,6 +20,8 @@ static long chardev_file_fill_pframe(vnode_t *file, pframe_t *pf);
 
 static long chardev_file_flush_pframe(vnode_t *file, pframe_t *pf);
 
+static long chardev_file_poll(vnode_t *file);
+
 static vnode_ops_t chardev_spec_vops = {
     .read = chardev_file_read,
     .write = chardev_file_write,
@@ -33,6 +37,7 @@ static vnode_ops_t chardev_spec_vops = {
     .get_pframe = NULL,
     .fill_pframe = chardev_file_fill_pframe,
     .flush_pframe = chardev_file_flush_pframe,
+    .poll = chardev_file_poll,
 };
 
 static ssize_t blockdev_file_read(vnode_t *file, size_t pos, void *buf,
@@ -89,7 +94,7 @@ static long special_file_stat(vnode_t *file, stat_t *ss) {
  * Hint: Watch out! chardev_file_read and chardev_file_write are indirectly
  * called in do_read and do_write, respectively, as the read/write ops for
  * chardev-type vnodes. This means that the vnode file should be locked
- * upon entry to this function.
+ * upon entry to this function (only shared when reading).
  *
  * However, tty_read and tty_write, the read/write ops for the tty chardev,
  * are potentially blocking. To avoid deadlock, you should unlock the file
@@ -104,11 +109,11 @@ static long special_file_stat(vnode_t *file, stat_t *ss) {
  */
 static ssize_t chardev_file_read(vnode_t *file, size_t pos, void *buf,
                                  size_t count) {
-  vunlock(file);
+  vunlock_shared(file);
   chardev_t *dev = file->vn_dev.chardev;
   KASSERT(dev);
   int ret = dev->cd_ops->read(dev, pos, buf, count);
-  vlock(file);
+  vlock_shared(file);
   return ret;
 }
 
@@ -149,6 +154,37 @@ static long chardev_file_flush_pframe(vnode_t *file, pframe_t *pf) {
   return 0;
 }
 
+/* A tty is readable once its line discipline has a cooked line. */
+static inline long ldisc_readable(ldisc_t *ldisc) {
+  return ldisc->ldisc_tail != ldisc->ldisc_cooked || ldisc->ldisc_full;
+}
+
+void __real_ldisc_key_pressed(ldisc_t *ldisc, char c);
+
+/*
+ * The tty driver hands every key to the line discipline through this wrapper
+ * (the kernel is linked with --wrap=ldisc_key_pressed), which wakes up epoll
+ * waiters on the tty once the key completes a line.
+ */
+void __wrap_ldisc_key_pressed(ldisc_t *ldisc, char c) {
+  __real_ldisc_key_pressed(ldisc, c);
+  if (ldisc_readable(ldisc)) {
+    chardev_poll_wakeup(CONTAINER_OF(ldisc, tty_t, tty_ldisc)->tty_cdev.cd_id);
+  }
+}
+
+/*
+ * Other character devices than ttys never block, and a tty can always be
+ * written to.
+ */
+static long chardev_file_poll(vnode_t *file) {
+  if (!file->vn_dev.chardev || MAJOR(file->vn_devid) != TTY_MAJOR) {
+    return EPOLLIN | EPOLLOUT;
+  }
+  ldisc_t *ldisc = &cd_to_tty(file->vn_dev.chardev)->tty_ldisc;
+  return ldisc_readable(ldisc) ? EPOLLIN | EPOLLOUT : EPOLLOUT;
+}
+
 static ssize_t blockdev_file_read(vnode_t *file, size_t pos, void *buf,
                                   size_t count) {
   return -ENOTSUP;
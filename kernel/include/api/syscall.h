@@ -60,6 +60,29 @@
 #define SYS_stat 47
 #define SYS_time 48
 #define SYS_usleep 49
+#define SYS_madvise 50
+#define SYS_fadvise 51
+#define SYS_clock_gettime 52
+#define SYS_futex 53
+#define SYS_pread 54
+#define SYS_pwrite 55
+#define SYS_readv 56
+#define SYS_writev 57
+#define SYS_preadv 58
+#define SYS_pwritev 59
+#define SYS_sendfile 60
+#define SYS_splice 61
+#define SYS_epoll_create 62
+#define SYS_epoll_ctl 63
+#define SYS_epoll_wait 64
+#define SYS_ring_enter 65
+#define SYS_multicall 66
+#define SYS_openat 67
+#define SYS_fstatat 68
+#define SYS_mkdirat 69
+#define SYS_unlinkat 70
+#define SYS_renameat 71
+#define SYS_clone_file_range 72
 
 /*
  * ... what does the scouter say about his syscall?
@@ -69,6 +92,7 @@
 #define SYS_debug 9001
 #define SYS_kshell 9002
 
+struct iovec;
 struct regs;
 struct stat;
 
@@ -128,6 +152,139 @@ typedef struct write_args
     size_t nbytes;
 } write_args_t;
 
+typedef struct pread_args
+{
+    int fd;
+    void *buf;
+    size_t nbytes;
+    off_t offset;
+} pread_args_t;
+
+typedef struct pwrite_args
+{
+    int fd;
+    void *buf;
+    size_t nbytes;
+    off_t offset;
+} pwrite_args_t;
+
+/* for readv, writev, preadv and pwritev */
+typedef struct iov_args
+{
+    int fd;
+    const struct iovec *iov;
+    int iovcnt;
+    off_t offset; /* only for preadv and pwritev */
+} iov_args_t;
+
+typedef struct sendfile_args
+{
+    int out_fd;
+    int in_fd;
+    off_t *offset;
+    size_t count;
+} sendfile_args_t;
+
+typedef struct splice_args
+{
+    int fd_in;
+    off_t *off_in;
+    int fd_out;
+    off_t *off_out;
+    size_t len;
+} splice_args_t;
+
+struct epoll_event;
+
+typedef struct epoll_ctl_args
+{
+    int epfd;
+    int op;
+    int fd;
+    struct epoll_event *event;
+} epoll_ctl_args_t;
+
+typedef struct epoll_wait_args
+{
+    int epfd;
+    struct epoll_event *events;
+    int maxevents;
+    int timeout;
+} epoll_wait_args_t;
+
+/* operations of a submission queue entry of ring_enter(2) */
+#define IORING_OP_NOP 0
+#define IORING_OP_READ 1  /* read len bytes from fd at off into addr */
+#define IORING_OP_WRITE 2 /* write len bytes from addr to fd at off */
+#define IORING_OP_FSYNC 3 /* write fd's file system back to disk */
+#define IORING_OP_OPEN 4  /* open the path addr (len bytes) with flags */
+#define IORING_OP_CLOSE 5 /* close fd */
+#define IORING_OP_STAT 6  /* stat the path addr (len bytes) into buf */
+
+typedef struct io_sqe
+{
+    int opcode;
+    int fd;
+    off_t off; /* -1 to use and advance the file position */
+    void *addr;
+    size_t len;
+    void *buf;
+    int flags;
+    uint64_t user_data; /* handed back in the completion as is */
+} io_sqe_t;
+
+typedef struct io_cqe
+{
+    uint64_t user_data;
+    long res; /* what the matching system call returns, or -errno */
+} io_cqe_t;
+
+/*
+ * A submission and a completion queue in user memory, each with a power of
+ * two number of entries. Indices run freely and wrap modulo the number of
+ * entries. The process fills sqes[sq_tail] and advances sq_tail, and consumes
+ * cqes[cq_head] and advances cq_head; ring_enter(2) advances the other two.
+ * ring_enter(2) batches system calls rather than doing asynchronous I/O: the
+ * entries run in order before it returns.
+ */
+typedef struct io_ring
+{
+    uint32_t sq_head;
+    uint32_t sq_tail;
+    uint32_t sq_entries;
+    uint32_t cq_head;
+    uint32_t cq_tail;
+    uint32_t cq_entries;
+    io_sqe_t *sqes;
+    io_cqe_t *cqes;
+} io_ring_t;
+
+typedef struct ring_enter_args
+{
+    io_ring_t *ring;
+    unsigned int to_submit;
+} ring_enter_args_t;
+
+/* most calls multicall(2) runs at once */
+#define MULTICALL_MAX 64
+
+/* flags of multicall(2) */
+#define MULTICALL_CONTINUE 0x1 /* keep going after a call fails */
+
+typedef struct multicall_entry
+{
+    int sysnum;
+    void *args; /* what trapping into sysnum takes */
+    long ret;   /* filled in: the return value, or -errno if the call failed */
+} multicall_entry_t;
+
+typedef struct multicall_args
+{
+    multicall_entry_t *calls;
+    int ncalls;
+    int flags;
+} multicall_args_t;
+
 typedef struct mkdir_args
 {
     argstr_t path;
@@ -188,9 +345,91 @@ typedef struct stat_args
     struct stat *buf;
 } stat_args_t;
 
+typedef struct openat_args
+{
+    int dirfd;
+    argstr_t filename;
+    int flags;
+    int mode;
+} openat_args_t;
+
+typedef struct fstatat_args
+{
+    int dirfd;
+    argstr_t path;
+    struct stat *buf;
+    int flags;
+} fstatat_args_t;
+
+typedef struct mkdirat_args
+{
+    int dirfd;
+    argstr_t path;
+    int mode;
+} mkdirat_args_t;
+
+typedef struct unlinkat_args
+{
+    int dirfd;
+    argstr_t path;
+    int flags;
+} unlinkat_args_t;
+
+typedef struct renameat_args
+{
+    int olddirfd;
+    argstr_t oldpath;
+    int newdirfd;
+    argstr_t newpath;
+} renameat_args_t;
+
+typedef struct clone_file_range_args
+{
+    int src_fd;
+    off_t src_off;
+    int dst_fd;
+    off_t dst_off;
+    size_t len;
+} clone_file_range_args_t;
+
 typedef struct usleep_args
 {
     useconds_t usec;
 } usleep_args_t;
 
+typedef struct madvise_args
+{
+    void *addr;
+    size_t len;
+    int advice;
+} madvise_args_t;
+
+typedef struct fadvise_args
+{
+    int fd;
+    off_t offset;
+    off_t len;
+    int advice;
+} fadvise_args_t;
+
+typedef struct clock_gettime_args
+{
+    clockid_t clock;
+    struct timespec *tp;
+} clock_gettime_args_t;
+
+/* futex operations */
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+
+typedef struct futex_args
+{
+    int *uaddr;
+    int op;
+    int val;
+    int *uaddr2;
+    int val2;
+} futex_args_t;
+
 struct utsname;
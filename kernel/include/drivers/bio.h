@@ -0,0 +1,190 @@
+/*
+ *       FILE: bio.h
+ *      DESCR: asynchronous block I/O requests
+ */
+
+#pragma once
+
+#include "types.h"
+
+#include "drivers/blockdev.h"
+#include "proc/sched.h"
+#include "util/list.h"
+
+#define BIO_READ 0
+#define BIO_WRITE 1
+
+struct bio;
+
+typedef void (*bio_done_t)(struct bio *bio);
+
+/*
+ * A request to read or write bio_count consecutive blocks of a block device,
+ * starting at bio_loc. Each block is transferred to or from its own page in
+ * bio_pages (typically the pf_addr of the pframes being filled or written
+ * back), so the pages need not be contiguous.
+ */
+typedef struct bio
+{
+    /* Fields that should be initialized by the submitter (see bio_init): */
+    blockdev_t *bio_bdev;
+    int bio_dir;          /* BIO_READ or BIO_WRITE */
+    blocknum_t bio_loc;   /* first block */
+    size_t bio_count;     /* number of blocks */
+    void **bio_pages;     /* bio_count page-aligned buffers */
+    bio_done_t bio_done;  /* called on completion, may be NULL */
+    void *bio_private;    /* for bio_done */
+
+    /* Set on completion: */
+    long bio_error; /* 0 or -errno */
+    int bio_complete;
+    ktqueue_t bio_waitq; /* threads in bio_wait() */
+
+    /* Link on the device's queue while the request is pending */
+    list_link_t bio_link;
+} bio_t;
+
+/* most blocks biod merges into a single command */
+#define BIO_MAX_MERGE 16
+
+/* biod threads, and so most commands in flight across all devices */
+#define BIOD_THREADS 4
+
+/* default for bq_depth */
+#define BIO_QUEUE_DEPTH 4
+
+/*
+ * The per-device state of the asynchronous interface. A driver that can keep
+ * requests in flight by itself registers a queue with bq_submit set. Devices
+ * without one are serviced by the biod thread through bq_rw_pages, or through
+ * their read_block and write_block operations: it keeps their pending requests
+ * sorted by block, serves them in one-way elevator order starting at bq_head,
+ * and merges requests for adjacent blocks into commands of up to
+ * BIO_MAX_MERGE blocks. Up to bq_depth of those commands are handed to the
+ * driver at once, each by its own biod thread, so that the next one is
+ * already waiting when the driver finishes one. Each queue has a home thread,
+ * bq_worker, which is woken for its requests and serves it before any other;
+ * idle threads take commands from the other queues.
+ */
+typedef struct blockdev_queue
+{
+    blockdev_t *bq_bdev;
+
+    /**
+     * Starts a request. The driver calls bio_end() when it is done, possibly
+     * before bq_submit returns.
+     *
+     * @param bdev the block device
+     * @param bio the request
+     */
+    void (*bq_submit)(blockdev_t *bdev, bio_t *bio);
+
+    /**
+     * Optional vectored transfer, for drivers that can scatter a single
+     * command over separate pages. Without it, commands whose pages are not
+     * contiguous go through a staging buffer. This call will block.
+     *
+     * @param bdev the block device
+     * @param dir BIO_READ or BIO_WRITE
+     * @param loc the first block
+     * @param pages count page-aligned buffers, one per block
+     * @param count the number of blocks
+     * @return 0 on success, -errno on failure
+     */
+    long (*bq_rw_pages)(blockdev_t *bdev, int dir, blocknum_t loc,
+                        void **pages, size_t count);
+
+    /* Requests waiting for biod, sorted by bio_loc */
+    list_t bq_pending;
+    size_t bq_npending;
+
+    /* Where the elevator continues from */
+    blocknum_t bq_head;
+
+    /* Commands biod has handed to the driver, and how many it may at once */
+    size_t bq_inflight;
+    size_t bq_depth;
+
+    /* The biod thread that prefers this queue */
+    size_t bq_worker;
+
+    /* Statistics, see bio_info() */
+    size_t bq_submitted;  /* requests */
+    size_t bq_merged;     /* requests merged into the one before them */
+    size_t bq_dispatched; /* commands sent to the driver */
+    size_t bq_blocks;     /* blocks transferred by them */
+    size_t bq_maxdepth;   /* most requests ever pending */
+    size_t bq_maxflight;  /* most commands ever in flight */
+
+    /* Link on the list of queues */
+    list_link_t bq_link;
+} blockdev_queue_t;
+
+/**
+ * Sets up queues for the disks. Must be called after blockdev_init().
+ */
+void bio_init(void);
+
+/**
+ * Starts the biod threads. Must be called from the idle process's context.
+ * Until then, and after biod is cancelled, the requests queued for devices
+ * without bq_submit are dispatched by the threads waiting in bio_wait().
+ */
+void biod_init(void);
+
+/**
+ * Registers the asynchronous interface of a block device.
+ *
+ * @param bq the queue, with bq_bdev, bq_submit and bq_rw_pages set; bq_depth
+ * is set to BIO_QUEUE_DEPTH and may be lowered afterwards
+ */
+void blockdev_queue_register(blockdev_queue_t *bq);
+
+/**
+ * Initializes a request. bio_done and bio_private may be set afterwards.
+ */
+void bio_init_request(bio_t *bio, blockdev_t *bdev, int dir, blocknum_t loc,
+                      size_t count, void **pages);
+
+/**
+ * Starts a request without waiting for it. The pages must stay allocated
+ * until it completes.
+ *
+ * @param bio the request
+ */
+void bio_submit(bio_t *bio);
+
+/**
+ * Writes back the dirty resident pframes of a memory object whose pages are
+ * blocks of bdev (pf_loc is the block number), submitting them all before
+ * waiting so that they can be sorted and merged.
+ *
+ * @param bdev the block device
+ * @param o the memory object, which must be locked
+ * @return 0 on success, -errno if any write failed
+ */
+long bio_writeback(blockdev_t *bdev, mobj_t *o);
+
+/**
+ * Formats the queue statistics of every device into buf.
+ *
+ * @return the number of bytes written
+ */
+size_t bio_info(const void *arg, char *buf, size_t osize);
+
+/**
+ * Waits for a submitted request to complete.
+ *
+ * @param bio the request
+ * @return 0 on success, -errno on failure
+ */
+long bio_wait(bio_t *bio);
+
+/**
+ * Called by whoever carries out a request once it is complete: records
+ * the result, wakes up bio_wait() and calls bio_done.
+ *
+ * @param bio the request
+ * @param error 0 on success, -errno on failure
+ */
+void bio_end(bio_t *bio, long error);
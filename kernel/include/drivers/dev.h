@@ -29,6 +29,10 @@
  *         - minor 0:          first disk device
  *         - minor 1:          second disk device
  *         - and so on...
+ *
+ *     - block major 2:        RAM disks
+ *         - minor 0:          /dev/ramdisk0   First RAM disk
+ *         - and so on...
  */
 
 #define MINOR_BITS 8
@@ -43,6 +47,7 @@
 #define MEM_ZERO_DEVID (MKDEVID(1, 1))
 
 #define DISK_MAJOR 1
+#define RAMDISK_MAJOR 2
 
 #define MEM_MAJOR 1
 #define MEM_NULL_MINOR 0
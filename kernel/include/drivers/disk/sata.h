@@ -5,6 +5,20 @@
 #include <drivers/blockdev.h>
 #include <drivers/disk/ahci.h>
 
+/*
+ * The driver already issues READ/WRITE FPDMA QUEUED when the HBA advertises
+ * NCQ (CAP.SNCQ), picks a free command slot per port from PxSACT | PxCI and
+ * sleeps until ahci_interrupt_handler() wakes it on completion. It still
+ * holds a single driver-wide mutex from building a command until the command
+ * completes, because QEMU's AHCI emulation mishandles several outstanding
+ * queued commands, so the queue depth seen by the disk is one. biod keeps up
+ * to bq_depth commands waiting on that mutex (see drivers/bio.h), so the
+ * next one is issued as soon as the current one completes.
+ *
+ * Each command describes its buffer with a single PRD, so the disks have no
+ * bq_rw_pages (see drivers/bio.h) and merged requests over scattered pframes
+ * are staged through a contiguous buffer.
+ */
 void sata_init();
 
 typedef struct ata_disk
@@ -0,0 +1,37 @@
+/*
+ *       FILE: ramdisk.h
+ *      DESCR: block devices backed by memory
+ */
+
+#pragma once
+
+#include "types.h"
+
+#include "drivers/bio.h"
+#include "drivers/blockdev.h"
+
+/*
+ * A RAM disk of rd_nblocks blocks. Each block lives in its own page, which is
+ * only allocated when the block is first written; unwritten blocks read as
+ * zeroes.
+ */
+typedef struct ramdisk
+{
+    void **rd_pages;
+    size_t rd_nblocks;
+    size_t rd_nresident; /* blocks with a page */
+
+    blockdev_t rd_bdev;
+    blockdev_queue_t rd_queue;
+} ramdisk_t;
+
+/**
+ * Creates and registers __RAMDISKS__ RAM disks of __RAMDISK_BLOCKS__ blocks.
+ * Must be called after bio_init().
+ */
+void ramdisk_init(void);
+
+/**
+ * Returns the size of a RAM disk in blocks, or 0 if bdev is not a RAM disk.
+ */
+size_t ramdisk_nblocks(blockdev_t *bdev);
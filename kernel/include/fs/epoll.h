@@ -0,0 +1,86 @@
+#pragma once
+
+#include "types.h"
+
+struct vnode;
+
+/* Events, as returned by the poll vnode operation (see vnode.h) */
+#define EPOLLIN 0x001  /* can be read without blocking */
+#define EPOLLOUT 0x004 /* can be written without blocking */
+#define EPOLLERR 0x008 /* the other end is gone (writing fails) */
+#define EPOLLHUP 0x010 /* the other end is gone (reading hits the end) */
+
+/* Operations of epoll_ctl(2) */
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+/* most events epoll_wait(2) returns at once */
+#define EPOLL_MAX_EVENTS 64
+
+typedef union epoll_data {
+    void *ptr;
+    int fd;
+    uint32_t u32;
+    uint64_t u64;
+} epoll_data_t;
+
+struct epoll_event
+{
+    uint32_t events;
+    epoll_data_t data;
+};
+
+void epoll_init(void);
+
+/**
+ * Wakes up every epoll_wait(2) waiting on an epoll instance that has the
+ * vnode in its interest list. Files whose poll operation does not hand out a
+ * queue of their own call this whenever they may have become ready.
+ */
+void vnode_poll_wakeup(struct vnode *vn);
+
+/**
+ * Wakes up every epoll_wait(2) waiting on an epoll instance that has a vnode
+ * of the character device devid in its interest list. Drivers, which do not
+ * know the vnodes of their devices, call this whenever a device may have
+ * become ready, possibly from an interrupt handler.
+ */
+void chardev_poll_wakeup(devid_t devid);
+
+/**
+ * Creates a new epoll instance with an empty interest list.
+ *
+ * @return a file descriptor for the instance, or:
+ *  - EMFILE: no free file descriptor
+ *  - ENOMEM: not enough kernel memory
+ */
+long do_epoll_create(void);
+
+/**
+ * Adds fd to, removes it from, or changes its entry in the interest list of
+ * the epoll instance epfd. The entry holds a reference on fd's vnode until it
+ * is removed or the instance is closed.
+ *
+ * @return 0 on success, or:
+ *  - EBADF: epfd or fd is not a valid file descriptor
+ *  - EINVAL: epfd is not an epoll instance, fd is epfd, or op is unknown
+ *  - EEXIST: op is EPOLL_CTL_ADD and fd is already in the list
+ *  - ENOENT: op is EPOLL_CTL_DEL or EPOLL_CTL_MOD and fd is not in the list
+ *  - ENOMEM: not enough kernel memory
+ */
+long do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+
+/**
+ * Waits until at least one file in the interest list of epfd is ready for an
+ * event it was registered with (EPOLLERR and EPOLLHUP always count), or for
+ * timeout milliseconds: 0 returns at once, and -1 waits for as long as it
+ * takes. Fills events with at most maxevents entries.
+ *
+ * @return the number of entries filled in (0 on timeout), or:
+ *  - EBADF: epfd is not a valid file descriptor
+ *  - EINVAL: epfd is not an epoll instance, or maxevents is not positive
+ *  - EINTR: the thread was cancelled while waiting
+ */
+long do_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+                   long timeout);
@@ -16,3 +16,16 @@
 #define O_CREAT 0x100  /* Create file if non-existent. */
 #define O_TRUNC 0x200  /* Truncate to zero length. */
 #define O_APPEND 0x400 /* Append to file. */
+
+/* For the *at() functions. */
+#define AT_FDCWD -100              /* Paths are relative to the cwd. */
+#define AT_SYMLINK_NOFOLLOW 0x1000 /* fstatat(): no symlinks, so no effect. */
+#define AT_REMOVEDIR 0x2000        /* unlinkat(): remove a directory. */
+
+/* Advice for posix_fadvise(). */
+#define POSIX_FADV_NORMAL 0     /* No special treatment. */
+#define POSIX_FADV_RANDOM 1     /* Expect random reads, don't read ahead. */
+#define POSIX_FADV_SEQUENTIAL 2 /* Expect sequential reads, read ahead. */
+#define POSIX_FADV_WILLNEED 3   /* Bring the data into the cache now. */
+#define POSIX_FADV_DONTNEED 4   /* Drop the data from the cache now. */
+#define POSIX_FADV_NOREUSE 5    /* Data will be read once. */
@@ -35,6 +35,17 @@ typedef struct file
      * The vnode which corresponds to this file.
      */
     struct vnode *f_vnode;
+
+    /*
+     * Read-ahead state, see do_read(). f_advice is the last advice given
+     * with posix_fadvise(2), f_ra_next is the page a sequential read would
+     * start on, f_ra_end is the first page not yet read ahead, and
+     * f_ra_window is how many pages to keep read ahead of f_ra_next.
+     */
+    int f_advice;
+    size_t f_ra_next;
+    size_t f_ra_end;
+    size_t f_ra_window;
 } file_t;
 
 struct file *fcreate(int fd, struct vnode *vnode, unsigned int mode);
@@ -45,6 +56,17 @@ struct file *fcreate(int fd, struct vnode *vnode, unsigned int mode);
  */
 struct file *fget(int fd);
 
+/*
+ * fget_light() and fput_light() stand in for fget() and fput() around a file
+ * used only for the length of a system call. With one thread per process,
+ * nothing can close the current process's file descriptors meanwhile, so
+ * the descriptor table's own reference keeps the file alive, and these skip
+ * the reference count. With MTP, they are fget() and fput().
+ */
+struct file *fget_light(int fd);
+
+void fput_light(file_t **filep);
+
 /*
  * fref() increments the reference count on the given file.
  */
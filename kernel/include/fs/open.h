@@ -2,4 +2,19 @@
 
 long do_open(const char *filename, int flags);
 
+long do_openat(int dirfd, const char *filename, int flags);
+
+struct file;
+
 long get_empty_fd(int *fd);
+
+/*
+ * Put file in curproc->p_files[fd], and mark fd as used for get_empty_fd().
+ * Takes over the caller's reference to the file.
+ */
+void fd_install(int fd, struct file *file);
+
+/*
+ * Mark fd as free for get_empty_fd(), once curproc->p_files[fd] is NULL.
+ */
+void fd_release(int fd);
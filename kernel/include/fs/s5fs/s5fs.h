@@ -45,6 +45,18 @@
 /* Number of blocks stored in the indirect block */
 #define S5_NIDIRECT_BLOCKS (S5_BLOCK_SIZE / sizeof(uint32_t))
 
+/*
+ * Blocks shared by several files (see s5_clone_blocks) count their extra
+ * references in refcount blocks: the count of block b is byte
+ * b % S5_REFCOUNTS_PER_BLOCK of the refcount block
+ * s5s_refcount_blocks[b / S5_REFCOUNTS_PER_BLOCK], and 0 if that refcount
+ * block is not allocated. Refcount blocks are allocated when a block in their
+ * range is first shared, and never freed.
+ */
+#define S5_REFCOUNT_NBLOCKS 16
+#define S5_REFCOUNTS_PER_BLOCK S5_BLOCK_SIZE
+#define S5_REFCOUNT_MAX 0xff
+
 /* Given a file offset, returns the block number that it is in */
 #define S5_DATA_BLOCK(seekptr) ((seekptr) / S5_BLOCK_SIZE)
 
@@ -86,6 +98,9 @@ typedef struct s5_super {
   uint32_t s5s_root_inode; /* root inode */
   uint32_t s5s_num_inodes; /* number of inodes */
   uint32_t s5s_version;    /* version of this disk format */
+
+  /* refcount blocks (0 if not allocated), zero on disks that never shared */
+  uint32_t s5s_refcount_blocks[S5_REFCOUNT_NBLOCKS];
 } s5_super_t;
 
 /* The contents of an inode, as stored on disk. */
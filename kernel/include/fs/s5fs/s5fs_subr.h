@@ -7,6 +7,7 @@
 #pragma once
 
 #include "fs/s5fs/s5fs.h"
+#include "fs/uio.h"
 #include "mm/pframe.h"
 #include "types.h"
 
@@ -22,6 +23,12 @@ ssize_t s5_read_file(struct s5_node *sn, size_t pos, char *buf, size_t len);
 ssize_t s5_write_file(struct s5_node *sn, size_t pos, const char *buf,
                       size_t len);
 
+ssize_t s5_read_filev(struct s5_node *sn, size_t pos, const struct iovec *iov,
+                      int iovcnt);
+
+ssize_t s5_write_filev(struct s5_node *sn, size_t pos, const struct iovec *iov,
+                       int iovcnt);
+
 long s5_link(struct s5_node *dir, const char *name, size_t namelen,
              struct s5_node *child);
 
@@ -41,6 +48,11 @@ long s5_inode_blocks(struct s5_node *vnode);
 
 void s5_remove_blocks(struct s5_node *vnode);
 
+long s5_unshare_block(struct s5_node *sn, pframe_t *pf);
+
+long s5_clone_blocks(struct s5_node *dst, size_t dst_block,
+                     struct s5_node *src, size_t src_block, size_t nblocks);
+
 /* Converts a vnode_t* to the s5fs_t* (s5fs file system) struct */
 #define VNODE_TO_S5FS(vn) ((s5fs_t *)((vn)->vn_fs->fs_i))
 
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "types.h"
+
+/* most buffers readv(2) and friends take at once */
+#define IOV_MAX 64
+
+/* A buffer of a vectored read or write */
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
+
+/* The total length of the buffers */
+static inline size_t iov_length(const struct iovec *iov, int iovcnt)
+{
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
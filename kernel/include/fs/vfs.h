@@ -146,6 +146,8 @@ long namev_open(struct vnode *base, const char *path, int oflags, int mode,
 long namev_resolve(struct vnode *base, const char *path,
                    struct vnode **res_vnode);
 
+long namev_base(int dirfd, const char *path, struct vnode **base);
+
 long namev_get_child(struct vnode *dir, char *name, size_t namelen,
                      struct vnode **out);
 
@@ -8,12 +8,29 @@
 #include "fs/pipe.h"
 #include "fs/stat.h"
 
+struct iovec;
+
 long do_close(int fd);
 
 ssize_t do_read(int fd, void *buf, size_t len);
 
 ssize_t do_write(int fd, const void *buf, size_t len);
 
+ssize_t do_write_page(int fd, void *page, size_t len);
+
+ssize_t do_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+ssize_t do_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+ssize_t do_prwv_user(int fd, const struct iovec *uiov, int iovcnt,
+                     off_t offset, int write, void *kbuf, size_t size);
+
+ssize_t do_splice(int in_fd, off_t *in_off, int out_fd, off_t *out_off,
+                  size_t count);
+
+long do_clone_file_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+                         size_t len);
+
 long do_dup(int fd);
 
 long do_dup2(int ofd, int nfd);
@@ -22,18 +39,31 @@ long do_mknod(const char *path, int mode, devid_t devid);
 
 long do_mkdir(const char *path);
 
+long do_mkdirat(int dirfd, const char *path);
+
 long do_rmdir(const char *path);
 
+long do_rmdirat(int dirfd, const char *path);
+
 long do_unlink(const char *path);
 
+long do_unlinkat(int dirfd, const char *path);
+
 long do_link(const char *oldpath, const char *newpath);
 
 long do_rename(const char *oldpath, const char *newpath);
 
+long do_renameat(int olddirfd, const char *oldpath, int newdirfd,
+                 const char *newpath);
+
 long do_chdir(const char *path);
 
 ssize_t do_getdent(int fd, struct dirent *dirp);
 
 off_t do_lseek(int fd, off_t offset, int whence);
 
+long do_fadvise(int fd, off_t offset, off_t len, int advice);
+
 long do_stat(const char *path, struct stat *uf);
+
+long do_fstatat(int dirfd, const char *path, struct stat *uf);
@@ -14,12 +14,14 @@
 #include "mm/mobj.h"
 #include "mm/pframe.h"
 #include "proc/kmutex.h"
+#include "proc/rwlock.h"
 #include "util/list.h"
 
 struct fs;
 struct dirent;
 struct stat;
 struct file;
+struct iovec;
 struct vnode;
 struct kmutex;
 
@@ -170,6 +172,56 @@ typedef struct vnode_ops {
    * Should only be used on regular files, not directories.
    */
   void (*truncate_file)(struct vnode *vnode);
+
+  /*
+   * readv and writev are like read and write, but transfer to or from the
+   * iovcnt buffers of iov in turn. They are optional: without them, the VFS
+   * calls read or write once per buffer, under the same lock.
+   */
+  ssize_t (*readv)(struct vnode *file, size_t pos, const struct iovec *iov,
+                   int iovcnt);
+
+  ssize_t (*writev)(struct vnode *file, size_t pos, const struct iovec *iov,
+                    int iovcnt);
+
+  /*
+   * write_page appends the first len bytes of page, which came from
+   * page_alloc(), to the file by taking the page over instead of copying
+   * it. On success, it returns len and the page belongs to the file; on
+   * failure, the page still belongs to the caller. Optional: only files
+   * that do not need the data at a particular offset (pipes) have it.
+   */
+  ssize_t (*write_page)(struct vnode *file, void *page, size_t len);
+
+  /*
+   * poll returns which EPOLL* events (see fs/epoll.h) the file is ready for
+   * right now. Whatever may make the file ready calls vnode_poll_wakeup(), or
+   * chardev_poll_wakeup() for a device driver. Optional: files without it
+   * are always ready for reading and writing.
+   */
+  long (*poll)(struct vnode *file);
+
+  /*
+   * clone_range makes len bytes of dst from dst_pos on share the storage of
+   * the same bytes of src from src_pos on, instead of copying them; later
+   * writes to either file do not show through the other. Both files are
+   * regular files of the same filesystem and are locked, the ranges do not
+   * overlap, both positions are multiples of PAGE_SIZE, and so is len unless
+   * the range ends at the end of src. Optional: without it, files cannot be
+   * cloned.
+   */
+  long (*clone_range)(struct vnode *dst, size_t dst_pos, struct vnode *src,
+                      size_t src_pos, size_t len);
+
+  /*
+   * readahead starts reading those of pages [pagenum, pagenum + npages) of a
+   * regular file that are not resident yet, and returns without waiting for
+   * them: each such pframe keeps its request in pf_bio until
+   * vnode_get_pframe() or pframe_free_page() waits for it. The file's memory
+   * object is locked, and the range ends within the file. Optional: without
+   * it, files are not read ahead.
+   */
+  void (*readahead)(struct vnode *file, size_t pagenum, size_t npages);
 } vnode_ops_t;
 
 typedef struct vnode {
@@ -254,6 +306,18 @@ typedef struct vnode {
 
   /* Used (only) by the v{get,ref,put} facilities (vfs/vnode.c): */
   list_link_t vn_link; /* link on system vnode list */
+
+  /*
+   * Taken for writing by vlock() and for reading by vlock_shared(). The lock
+   * order is vn_rwlock, then vn_mobj's mutex, then its pframes' mutexes:
+   * read(2) and friends take vn_rwlock shared and lock vn_mobj around each
+   * page, write(2) and friends take both exclusively (vlock()), and so do
+   * page faults on a mapping of the file and mmap(2), shared.
+   */
+  rwlock_t vn_rwlock;
+
+  /* Entries of epoll interest lists watching this vnode (fs/epoll.c) */
+  list_t vn_pollers;
 } vnode_t;
 
 void init_special_vnode(vnode_t *vn);
@@ -274,10 +338,20 @@ void init_special_vnode(vnode_t *vn);
 struct vnode *vget(struct fs *fs, ino_t vnum);
 
 /*
- * Lock a vnode (locks vn_mobj).
+ * Lock a vnode exclusively (locks vn_rwlock for writing, then vn_mobj). This
+ * is needed to change the vnode: to write or truncate the file, or to change
+ * the directory's entries.
  */
 void vlock(vnode_t *vn);
 
+/*
+ * Lock a vnode shared with other readers (locks vn_rwlock for reading only).
+ * This is enough to read the file, list and look up the directory's entries,
+ * or stat the vnode, and it keeps vn_len and the file's blocks from changing.
+ * vn_mobj is not locked: its pframes must still be found under mobj_lock().
+ */
+void vlock_shared(vnode_t *vn);
+
 /*
  * Lock two vnodes in order! This prevents the A/B locking problem when locking
  * two directories or two files.
@@ -299,6 +373,11 @@ void vput_locked(struct vnode **vnp);
  */
 void vunlock(vnode_t *vn);
 
+/**
+ * Unlocks a vnode locked with vlock_shared()
+ */
+void vunlock_shared(vnode_t *vn);
+
 /**
  * Unlocks two vnodes (effectively just 2 unlocks)
  */
@@ -310,6 +389,19 @@ void vunlock_in_order(vnode_t *a, vnode_t *b);
  */
 void vref(vnode_t *vn);
 
+/*
+ * Reads pages [pagenum, pagenum + npages) of a regular file into the page
+ * cache ahead of need. The vnode must be locked (with vn_mobj, see
+ * vlock_shared).
+ */
+void vnode_prefetch(vnode_t *vn, size_t pagenum, size_t npages);
+
+/*
+ * Writes back and evicts the cached pages [pagenum, pagenum + npages) of a
+ * regular file. The vnode must be locked (with vn_mobj, see vlock_shared).
+ */
+void vnode_drop_pages(vnode_t *vn, size_t pagenum, size_t npages);
+
 /*
  * This function decrements the reference count on this vnode
  * (i.e. the refcount of vn_mobj).
@@ -39,6 +39,12 @@ void apic_enable_periodic_timer(uint32_t freq);
 /* Stops the APIC timer */
 void apic_disable_periodic_timer();
 
+/* Raises the timer interrupt once, ns nanoseconds from now */
+void apic_set_oneshot_timer(uint64_t ns);
+
+/* The TSC frequency in Hz, calibrated against the PIT */
+uint64_t apic_tsc_frequency();
+
 /* Sets the interrupt to raise when a spurious
  * interrupt occurs. */
 void apic_setspur(uint8_t intr);
@@ -3,6 +3,9 @@
 //#include "mm/mobj.h"
 #include "proc/kmutex.h"
 #include "types.h"
+#include "util/list.h"
+
+struct mobj;
 
 typedef struct pframe
 {
@@ -12,8 +15,27 @@ typedef struct pframe
     long pf_dirty;
     kmutex_t pf_mutex;
     list_link_t pf_link;
+    struct mobj *pf_obj;     /* the memory object this pframe belongs to */
+    list_link_t pf_lru_link; /* link on pframe_lru, if reclaimable */
+    struct bio *pf_bio;      /* read of pf_addr still in flight, or NULL */
+    long pf_zero_mapped;     /* pf_addr is the zero page and is mapped into
+                                some address space (see resolve_pagefault) */
 } pframe_t;
 
+/*
+ * A single pre-zeroed page shared by every pframe whose contents are known to
+ * be all zeroes (untouched anonymous memory, sparse file blocks). Such pframes
+ * are never dirty and are only ever mapped read-only into user space; a real
+ * page is allocated the first time one is requested for writing.
+ */
+extern void *pframe_zero_page;
+
+/*
+ * Resident pframes that the reclaimer may page out, most recently used first.
+ * See pframe_lru_touch() and vm/swap.c.
+ */
+extern list_t pframe_lru;
+
 void pframe_init();
 
 pframe_t *pframe_create();
@@ -21,3 +43,14 @@ pframe_t *pframe_create();
 void pframe_release(pframe_t **pfp);
 
 void pframe_free(pframe_t **pfp);
+
+void pframe_free_page(pframe_t *pf);
+
+long pframe_wait_io(pframe_t *pf);
+
+void pframe_lru_touch(pframe_t *pf);
+
+static inline long pframe_is_zero_page(pframe_t *pf)
+{
+    return pf->pf_addr == pframe_zero_page;
+}
@@ -9,6 +9,13 @@ typedef struct core
     long kc_id;
     context_t kc_ctx;
 
+    /*
+     * The queue that core_switch() puts the outgoing thread on once it has
+     * switched stacks (NULL if the thread is exiting). This is a hand-off
+     * slot, not a run queue. The run queue, kt_runq in proc/sched.c, is
+     * already core-specific data, but only the boot processor runs threads
+     * since smp_init() does not start the others.
+     */
     ktqueue_t *kc_queue;
 
     uintptr_t kc_csdpaddr;
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "api/syscall.h"
+
+/**
+ * Sets up the futex hash table.
+ */
+void futex_init(void);
+
+/**
+ * Waits for or wakes up threads on a user address, so that userland only
+ * needs to enter the kernel when a lock it implements is contended. Threads
+ * waiting on the same word are found by the memory it names: its address in
+ * the process for a private mapping, or its memory object and offset for a
+ * MAP_SHARED one (so that processes can share a lock in a shared mapping).
+ *
+ *  FUTEX_WAIT - If *uaddr is still val, sleep until woken up by FUTEX_WAKE
+ *    or FUTEX_REQUEUE on the same word. Returns 0 once woken up.
+ *  FUTEX_WAKE - Wake up at most val threads waiting on uaddr. Returns the
+ *    number woken up.
+ *  FUTEX_REQUEUE - Wake up at most val threads waiting on uaddr, and move at
+ *    most val2 of the remaining ones to wait on uaddr2 instead. Returns the
+ *    number woken up and moved.
+ *
+ * @return see above, or:
+ *  - EINVAL: uaddr or uaddr2 is not aligned, or op is not one of the above
+ *  - EFAULT: uaddr or uaddr2 is not mapped
+ *  - EAGAIN: FUTEX_WAIT found *uaddr != val
+ *  - EINTR: the thread was cancelled while waiting
+ */
+long do_futex(int *uaddr, int op, int val, int *uaddr2, int val2);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "proc/sched.h"
+
+/*===========
+ * Structures
+ *==========*/
+
+/*
+ * A sleeping reader-writer lock: any number of readers, or a single writer.
+ * Writers are preferred, so that a steady stream of readers cannot starve
+ * them: once a writer is waiting, new readers wait behind it.
+ */
+typedef struct rwlock
+{
+    ktqueue_t rw_waitq;         /* readers and writers waiting */
+    struct kthread *rw_writer;  /* current writer, or NULL */
+    size_t rw_readers;          /* number of current readers */
+    size_t rw_waiting_writers;  /* number of writers in rw_waitq */
+} rwlock_t;
+
+/*==========
+ * Functions
+ *=========*/
+
+/**
+ * Initializes a reader-writer lock.
+ *
+ * @param rw the lock
+ */
+void rwlock_init(rwlock_t *rw);
+
+/**
+ * Locks the lock for reading, sharing it with other readers.
+ *
+ * Note: This function may block.
+ *
+ * Note: These locks are not re-entrant
+ *
+ * @param rw the lock
+ */
+void rwlock_lock_read(rwlock_t *rw);
+
+/**
+ * Releases a read lock.
+ *
+ * @param rw the lock
+ */
+void rwlock_unlock_read(rwlock_t *rw);
+
+/**
+ * Locks the lock for writing, excluding readers and other writers.
+ *
+ * Note: This function may block.
+ *
+ * Note: These locks are not re-entrant
+ *
+ * @param rw the lock
+ */
+void rwlock_lock_write(rwlock_t *rw);
+
+/**
+ * Releases a write lock.
+ *
+ * @param rw the lock
+ */
+void rwlock_unlock_write(rwlock_t *rw);
+
+/**
+ * Indicates if curthr holds a lock for writing.
+ */
+long rwlock_owns_write(rwlock_t *rw);
@@ -115,6 +115,23 @@ ksyscall(close, (int fd), (fd))
     return numbytesread;
 }
 
+ksyscall(openat, (int dirfd, const char *filename, int flags),
+         (dirfd, filename, flags))
+
+ksyscall(mkdirat, (int dirfd, const char *path), (dirfd, path))
+
+ksyscall(rmdirat, (int dirfd, const char *path), (dirfd, path))
+
+ksyscall(unlinkat, (int dirfd, const char *path), (dirfd, path))
+
+ksyscall(renameat,
+         (int olddirfd, const char *oldpath, int newdirfd,
+          const char *newpath),
+         (olddirfd, oldpath, newdirfd, newpath))
+
+ksyscall(fstatat, (int dirfd, const char *path, struct stat *uf),
+         (dirfd, path, uf))
+
 /*
  * Redirect system calls to kernel system calls.
  */
@@ -135,6 +152,12 @@ ksyscall(close, (int fd), (fd))
 #define chdir ksys_chdir
 #define stat(a, b) ksys_stat(a, b)
 #define getdents(a, b, c) ksys_getdents(a, b, c)
+#define openat(a, b, c, d) ksys_openat(a, b, c)
+#define mkdirat(a, b, c) ksys_mkdirat(a, b)
+#define unlinkat(a, b, c) \
+    ((c)&AT_REMOVEDIR ? ksys_rmdirat(a, b) : ksys_unlinkat(a, b))
+#define renameat ksys_renameat
+#define fstatat(a, b, c, d) ksys_fstatat(a, b, c)
 #define exit(a) ksys_exit(a)
 
 /* Random numbers */
@@ -10,8 +10,29 @@ extern uint64_t not_preempted_count;
 extern uint64_t idle_count;
 extern volatile uint64_t jiffies;
 
+#define NSEC_PER_USEC 1000UL
+#define NSEC_PER_MSEC 1000000UL
+#define NSEC_PER_SEC 1000000000UL
+
+/* Timer expiries are in jiffies of this many nanoseconds */
+#define NSEC_PER_JIFFY (100 * NSEC_PER_USEC)
+
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+
 void time_init();
 
+/**
+ * Returns the time since boot in nanoseconds, from the TSC.
+ */
+uint64_t time_now_ns();
+
+/**
+ * Called by timer_mod() with interrupts masked: brings the current core's
+ * next timer interrupt forward if the timer expires before it.
+ */
+void time_timer_added(uint64_t expires);
+
 void time_spin(time_t ms);
 
 void time_sleep(time_t ms);
@@ -20,4 +41,6 @@ long do_usleep(useconds_t usec);
 
 time_t do_time();
 
+long do_clock_gettime(clockid_t clock, struct timespec *tp);
+
 size_t time_stats(char *buf, size_t len);
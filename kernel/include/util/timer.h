@@ -3,26 +3,62 @@
 
 #include "util/list.h"
 
+struct timer_wheel;
+
 typedef struct timer
 {
     void (*function)(uint64_t data);
     uint64_t data;
-    uint64_t expires;
-    list_link_t link;
+    uint64_t expires;          /* in jiffies */
+    list_link_t link;          /* link on a slot of the wheel */
+    struct timer_wheel *base;  /* the wheel the timer was last added to */
 } timer_t;
 
+/**
+ * Sets up the timing wheel of the current core. Called by time_init().
+ */
+void timer_wheel_init();
+
 void timer_init(timer_t *timer);
 
+/**
+ * Adds a timer to the current core's wheel, to fire at timer->expires.
+ */
 void timer_add(timer_t *timer);
 
+/**
+ * Removes a timer from its wheel.
+ *
+ * @return 1 if the timer was pending, 0 otherwise
+ */
 int timer_del(timer_t *timer);
 
-int timer_mod(timer_t *timer, int expires);
+/**
+ * Changes the expiry of a timer, (re)adding it to the current core's wheel.
+ *
+ * @return 1 if the timer was pending, 0 otherwise
+ */
+int timer_mod(timer_t *timer, uint64_t expires);
 
 int timer_pending(timer_t *timer);
 
+/**
+ * As timer_del(), but also waits for the timer's function to return if it
+ * is running on another core.
+ */
 int timer_del_sync(timer_t *timer);
 
+/**
+ * Returns the jiffy by which the current core next has to process its wheel,
+ * looking at most horizon jiffies ahead: when its next timer expires, or
+ * when a slot of later timers is cascaded. Returns -1 if there is nothing to
+ * do within the horizon.
+ */
+uint64_t timer_next_expiry(uint64_t horizon);
+
+/**
+ * Runs the functions of the current core's timers that expired by jiffies.
+ */
 void __timers_fire();
 
-#endif
\ No newline at end of file
+#endif
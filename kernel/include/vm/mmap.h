@@ -6,3 +6,5 @@ long do_munmap(void *addr, size_t len);
 
 long do_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off,
              void **ret);
+
+long do_madvise(void *addr, size_t len, int advice);
@@ -9,3 +9,5 @@
 #define FAULT_EXEC 0x10
 
 void handle_pagefault(uintptr_t vaddr, uintptr_t cause);
+
+long resolve_pagefault(uintptr_t vaddr, uintptr_t cause);
@@ -2,10 +2,25 @@
 
 #include "mm/mobj.h"
 
+/* fork collapses or flattens a chain rather than grow it past this depth */
+#define SHADOW_MAX_DEPTH 8
+
 void shadow_init();
 
 mobj_t *shadow_create(mobj_t *shadowed);
 
 void shadow_collapse(mobj_t *o);
 
+void shadow_collapse_all();
+
+long shadow_bound_depth(mobj_t *o);
+
+size_t shadow_depth(mobj_t *o);
+
+long shadow_chain_contains(mobj_t *o, mobj_t *target);
+
+mobj_t *shadow_bottom(mobj_t *o);
+
+size_t shadow_info(const void *arg, char *buf, size_t osize);
+
 extern int shadow_count;
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+
+struct mobj;
+struct pframe;
+
+/* pages swapd tries to free each time a page allocation fails */
+#define SWAP_RECLAIM_BATCH 32
+
+void swap_init();
+
+long swap_in(struct pframe *pf);
+
+long swap_out(struct pframe *pf);
+
+void swap_release(struct pframe *pf);
+
+void swap_discard(struct mobj *o);
+
+void swap_delete_pframe(struct mobj *o, size_t pagenum);
+
+size_t swap_wait_reclaim();
+
+void swapd_init();
+
+size_t swap_info(const void *arg, char *buf, size_t osize);
@@ -7,6 +7,9 @@
 #define VMMAP_DIR_LOHI 1
 #define VMMAP_DIR_HILO 2
 
+/* pages brought in ahead of a fault in an MADV_SEQUENTIAL area */
+#define VMMAP_READAHEAD_PAGES 16
+
 struct mobj;
 struct proc;
 struct vnode;
@@ -33,6 +36,8 @@ typedef struct vmarea
     int vma_flags; /* either MAP_SHARED or MAP_PRIVATE. It can also specify 
                       MAP_ANON and MAP_FIXED */
 
+    int vma_advice; /* MADV_NORMAL, MADV_RANDOM or MADV_SEQUENTIAL */
+
     struct vmmap *vma_vmmap; /* address space that this area belongs to */
     struct mobj *vma_obj;    /* the memory object that corresponds to this address region */
     list_link_t vma_plink;   /* link on process vmmap maps list */
@@ -68,4 +73,10 @@ size_t vmmap_mapping_info_helper(const void *map, char *buf, size_t size,
 
 size_t vmmap_mapping_info(const void *map, char *buf, size_t size);
 
-void vmmap_insert(vmmap_t *map, vmarea_t *new_vma);
\ No newline at end of file
+void vmmap_insert(vmmap_t *map, vmarea_t *new_vma);
+
+void vmarea_prefetch(vmarea_t *vma, size_t vfn, size_t npages);
+
+struct vnode *vmarea_vnode(vmarea_t *vma);
+
+void vmmap_unmap_object(struct mobj *o, size_t lopage, size_t npages);
\ No newline at end of file
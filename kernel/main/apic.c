@@ -314,9 +314,12 @@ void apic_disable_periodic_timer()
     LAPICTPR = 0;
 }
 
+static uint64_t tsc_freq = 0;
+
 /* get_cpu_bus_frequency - Uses PIT to determine APIC frequency in Hz (ticks per
- * second). NOTE: NOT SMP FRIENDLY! Note: For more info, visit the osdev wiki
- * page on the Programmable Interval Timer. */
+ * second), and measures the TSC frequency over the same interval. NOTE: NOT SMP
+ * FRIENDLY! Note: For more info, visit the osdev wiki page on the Programmable
+ * Interval Timer. */
 static uint32_t get_cpu_bus_frequency()
 {
     static uint32_t freq = 0;
@@ -348,15 +351,19 @@ static uint32_t get_cpu_bus_frequency()
         outb(0x61, (uint8_t)(tmp | 1));
         /* Reset APIC's initial countdown value. */
         LAPICTIC = 0xffffffff;
+        uint64_t tsc_start = rdtsc();
         /* PC speaker sets bit 5 when it hits 0. */
         while (!(inb(0x61) & 0x20))
             ;
+        uint64_t tsc_end = rdtsc();
         /* Stop the APIC timer */
         LAPICLVTTMR = LOCAL_APIC_DISABLE;
         /* Subtract current count from the initial count to get total ticks per
          * second. */
         freq = (LAPICTIC - LAPICTCC) * 100;
+        tsc_freq = (tsc_end - tsc_start) * 100;
         dbgq(DBG_CORE, "CPU Bus Freq: %u ticks per second\n", freq);
+        dbgq(DBG_CORE, "TSC Freq: %lu ticks per second\n", tsc_freq);
     }
     return freq;
 }
@@ -429,6 +436,28 @@ void apic_enable_periodic_timer(uint32_t freq)
     LAPICLVTTMR = LOCAL_APIC_TMR_PERIODIC | INTR_APICTIMER;
 }
 
+uint64_t apic_tsc_frequency()
+{
+    get_cpu_bus_frequency();
+    return tsc_freq;
+}
+
+/* apic_set_oneshot_timer - Raises INTR_APICTIMER once, ns nanoseconds from now
+ * (at most a second, or as far out as the 32-bit initial count allows),
+ * replacing whatever the timer was programmed to do. */
+void apic_set_oneshot_timer(uint64_t ns)
+{
+    ns = MIN(ns, 1000000000UL);
+    uint64_t count = ns * get_cpu_bus_frequency() / 1000000000;
+    count = MAX(MIN(count, 0xffffffff), 1);
+
+    /* Division by 1, see get_cpu_bus_frequency. */
+    LAPICTMRDIV = 0b1011;
+    LAPICLVTTMR = INTR_APICTIMER;
+    /* Writing the initial count starts the countdown. */
+    LAPICTIC = (uint32_t)count;
+}
+
 static void apic_disable_8259()
 {
     dbgq(DBG_CORE, "--- DISABLE 8259 PIC ---\n");
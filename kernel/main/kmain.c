@@ -9,11 +9,16 @@
 #include <util/time.h>
 #include <vm/anon.h>
 #include <vm/shadow.h>
+#include <vm/shadowd.h>
+#include <vm/swap.h>
 
 #include "api/syscall.h"
+#include "drivers/bio.h"
+#include "drivers/ramdisk.h"
 #include "drivers/dev.h"
 #include "drivers/pcie.h"
 #include "errno.h"
+#include "fs/epoll.h"
 #include "fs/fcntl.h"
 #include "fs/vfs.h"
 #include "fs/vfs_syscall.h"
@@ -22,6 +27,7 @@
 #include "main/acpi.h"
 #include "main/apic.h"
 #include "main/inits.h"
+#include "proc/futex.h"
 #include "test/driverstest.h"
 #include "types.h"
 #include "util/btree.h"
@@ -48,9 +54,13 @@ static init_func_t init_funcs[] = {
 #endif
     vmmap_init,         proc_init,     kthread_init,
 #ifdef __DRIVERS__
-    chardev_init,       blockdev_init,
+    chardev_init,       blockdev_init, bio_init,     ramdisk_init,
+#endif
+#if defined(__VM__) && defined(__DRIVERS__)
+    swap_init,
 #endif
     kshell_init,        file_init,     pipe_init,    syscall_init, elf64_init,
+    futex_init,         epoll_init,
 
     proc_idleproc_init, btree_init,
 };
@@ -99,6 +109,13 @@ static void make_devices() {
     status = do_mknod(path, S_IFBLK, MKDEVID(DISK_MAJOR, i));
     KASSERT(!status || status == -EEXIST);
   }
+
+  for (long i = 0; i < __RAMDISKS__; i++) {
+    snprintf(path, sizeof(path), "/dev/ramdisk%ld", i);
+    dbg(DBG_INIT, "Creating ramdisk mknod with path %s\n", path);
+    status = do_mknod(path, S_IFBLK, MKDEVID(RAMDISK_MAJOR, i));
+    KASSERT(!status || status == -EEXIST);
+  }
 }
 
 /*
@@ -197,6 +214,16 @@ void initproc_start() {
 
   sched_make_runnable(thread);
 
+#if defined(__VM__) && defined(__SHADOWD__)
+  shadowd_init();
+#endif
+#ifdef __DRIVERS__
+  biod_init();
+#endif
+#if defined(__VM__) && defined(__DRIVERS__)
+  swapd_init();
+#endif
+
   KASSERT(!intr_enabled());
   preemption_disable();
 
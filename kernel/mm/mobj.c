@@ -1,9 +1,12 @@
 #include "errno.h"
 
 #include "mm/mobj.h"
+#include "mm/page.h"
 #include "mm/pframe.h"
 
 #include "util/debug.h"
+#include "vm/swap.h"
+#include "vm/vmmap.h"
 #include <util/string.h>
 
 /*
@@ -109,6 +112,52 @@ void mobj_find_pframe(mobj_t *o, uint64_t pagenum, pframe_t **pfp)
     *pfp = NULL;
 }
 
+/*
+ * page_alloc(), waiting for swapd to page out anonymous memory when there is
+ * none left.
+ */
+static void *mobj_page_alloc()
+{
+    void *addr = page_alloc();
+    while (!addr && swap_wait_reclaim())
+    {
+        addr = page_alloc();
+    }
+    return addr;
+}
+
+/*
+ * Anonymous and shadow pages are the ones the reclaimer can page out to swap.
+ */
+static inline long mobj_swappable(mobj_t *o)
+{
+    return o->mo_type == MOBJ_ANON || o->mo_type == MOBJ_SHADOW;
+}
+
+/*
+ * Keep track of how recently swappable pages were used, for the reclaimer.
+ */
+static void mobj_lru_touch(pframe_t *pf)
+{
+    if (!pframe_is_zero_page(pf) && mobj_swappable(pf->pf_obj))
+    {
+        pframe_lru_touch(pf);
+    }
+}
+
+/*
+ * A swappable page dies with its pframe, so it is not written out, and its
+ * copy in swap, if any, is dropped.
+ */
+static void mobj_discard_swap(mobj_t *o, pframe_t *pf)
+{
+    if (mobj_swappable(o))
+    {
+        pf->pf_dirty = 0;
+        swap_release(pf);
+    }
+}
+
 /*
  * Wrapper around the memory object's get_pframe function
  * Assert a sane state of the world surrounding the call to get_pframe
@@ -120,6 +169,10 @@ long mobj_get_pframe(mobj_t *o, uint64_t pagenum, long forwrite,
     *pfp = NULL;
     long ret = o->mo_ops.get_pframe(o, pagenum, forwrite, pfp);
     KASSERT((!*pfp && ret) || kmutex_owns_mutex(&(*pfp)->pf_mutex));
+    if (!ret)
+    {
+        mobj_lru_touch(*pfp);
+    }
     return ret;
 }
 
@@ -137,6 +190,7 @@ void mobj_create_pframe(mobj_t *o, uint64_t pagenum, uint64_t loc, pframe_t **pf
 
         pf->pf_pagenum = pagenum;
         pf->pf_loc = loc;
+        pf->pf_obj = o;
         list_insert_tail(&o->mo_pframes, &pf->pf_link);
         btree_insert(&o->mo_btree, pagenum, (void *)pf);
     }
@@ -153,8 +207,10 @@ void mobj_create_pframe(mobj_t *o, uint64_t pagenum, uint64_t loc, pframe_t **pf
  * First, check if an pframe already exists in the mobj, creating one as
  * necessary. Then, ensure that the pframe's contents are loaded: i.e. that
  * pf->pf_addr is non-null. You will want to use page_alloc() and fill_pframe
- * function pointer of the mobj. Finally, if forwrite is true, mark the pframe
- * as dirtied. The resulting pframe should be set in *pfp.
+ * function pointer of the mobj. A pframe backed by the shared zero page gets a
+ * private page of its own when requested for writing, and the mappings of the
+ * zero page in its place, if the fault path ever made any, are removed. Finally, if forwrite is true, mark the
+ * pframe as dirtied. The resulting pframe should be set in *pfp.
  *
  * Note that upon failure, *pfp MUST be null. As always, make sure you cleanup
  * properly in all error cases (especially if fill_prame fails)
@@ -181,13 +237,33 @@ long mobj_default_get_pframe(mobj_t *o, uint64_t pagenum, long forwrite,
         return -ENOMEM;
     }
     KASSERT(kmutex_owns_mutex(&pf->pf_mutex));
-    if (!pf->pf_addr)
+    if (forwrite && pframe_is_zero_page(pf))
+    {
+        /* first write to a page that was only ever read as zeroes */
+        KASSERT(!pf->pf_dirty);
+        void *addr = mobj_page_alloc();
+        if (!addr)
+        {
+            kmutex_unlock(&pf->pf_mutex);
+            return -ENOMEM;
+        }
+        memset(addr, 0, PAGE_SIZE);
+        pf->pf_addr = addr;
+        /* mappings of the zero page elsewhere must fault the new page in */
+        if (pf->pf_zero_mapped)
+        {
+            pf->pf_zero_mapped = 0;
+            vmmap_unmap_object(o, pagenum, 1);
+        }
+    }
+    else if (!pf->pf_addr)
     {
         KASSERT(!pf->pf_dirty &&
                 "dirtied page doesn't have a physical address");
-        pf->pf_addr = page_alloc();
+        pf->pf_addr = mobj_page_alloc();
         if (!pf->pf_addr)
         {
+            kmutex_unlock(&pf->pf_mutex);
             return -ENOMEM;
         }
 
@@ -197,8 +273,7 @@ long mobj_default_get_pframe(mobj_t *o, uint64_t pagenum, long forwrite,
         long ret = o->mo_ops.fill_pframe(o, pf);
         if (ret)
         {
-            page_free(pf->pf_addr);
-            pf->pf_addr = NULL;
+            pframe_free_page(pf);
             kmutex_unlock(&pf->pf_mutex);
             return ret;
         }
@@ -258,7 +333,8 @@ long mobj_flush(mobj_t *o)
 /*
  * Attempt to flush the pframe. If the flush succeeds, then free the pframe's
  * contents (pf->pf_addr) using page_free, remove the pframe from the mobj's
- * list and call pframe_free.
+ * list and call pframe_free. Swappable pages are dropped instead of flushed
+ * (see mobj_discard_swap).
  *
  * Upon successful return, *pfp MUST be null. If the function returns an error
  * code, *pfp must be unchanged.
@@ -267,6 +343,7 @@ long mobj_free_pframe(mobj_t *o, pframe_t **pfp)
 {
     pframe_t *pf = *pfp;
 
+    mobj_discard_swap(o, pf);
     if (pf->pf_addr)
     {
         long ret = mobj_flush_pframe(o, pf);
@@ -276,11 +353,7 @@ long mobj_free_pframe(mobj_t *o, pframe_t **pfp)
         // [+] TODO REMOVE THIS SECTION WHEN FLUSH DOES IT (I.E. WHEN WE HAVE
         // SUPPORT FOR FREEING PFRAME'S IN USE BY UNMAPPING THEM FROM PAGE
         // TABLES THAT USE THEM)
-        if (pf->pf_addr)
-        {
-            page_free(pf->pf_addr);
-            pf->pf_addr = NULL;
-        }
+        pframe_free_page(pf);
     }
     *pfp = NULL;
     list_remove(&pf->pf_link);
@@ -297,14 +370,11 @@ void mobj_delete_pframe(mobj_t *o, size_t pagenum)
     if (pf)
     {
         kmutex_lock(&pf->pf_mutex);
+        mobj_discard_swap(o, pf);
         list_remove(&pf->pf_link);
         btree_delete(&o->mo_btree, pf->pf_pagenum);
         pf->pf_dirty = 0;
-        if (pf->pf_addr)
-        {
-            page_free(pf->pf_addr);
-            pf->pf_addr = NULL;
-        }
+        pframe_free_page(pf);
         pframe_free(&pf);
     }
 }
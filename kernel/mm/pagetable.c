@@ -397,6 +397,33 @@ long pt_map_range(pml4_t *pml4, uintptr_t paddr, uintptr_t vaddr,
     return 0;
 }
 
+/*
+ * The instructions in the kernel that are allowed to fault on user memory,
+ * and where each one continues if the fault cannot be resolved. The entries
+ * are emitted into the .ex_table section next to the instructions themselves
+ * (see user_copy() in api/access.c).
+ */
+typedef struct ex_table_entry
+{
+    uintptr_t ex_insn;
+    uintptr_t ex_fixup;
+} ex_table_entry_t;
+
+extern const ex_table_entry_t ex_table_start[];
+extern const ex_table_entry_t ex_table_end[];
+
+static uintptr_t ex_table_fixup(uintptr_t rip)
+{
+    for (const ex_table_entry_t *ex = ex_table_start; ex < ex_table_end; ex++)
+    {
+        if (ex->ex_insn == rip)
+        {
+            return ex->ex_fixup;
+        }
+    }
+    return 0;
+}
+
 static long _pt_fault_handler(regs_t *regs)
 {
     uintptr_t vaddr;
@@ -404,12 +431,25 @@ static long _pt_fault_handler(regs_t *regs)
     __asm__ volatile("movq %%cr2, %0"
                      : "=r"(vaddr));
     uintptr_t cause = regs->r_err;
+    uintptr_t fixup;
 
     /* Check if pagefault was in user space (otherwise, BAD!) */
     if (cause & FAULT_USER)
     {
         handle_pagefault(vaddr, cause);
     }
+    else if (vaddr >= USER_MEM_LOW && vaddr < USER_MEM_HIGH &&
+             (fixup = ex_table_fixup(regs->r_rip)))
+    {
+        /*
+         * The kernel touched user memory on the process's behalf. Map the
+         * page as if the process had, or give up on the access.
+         */
+        if (resolve_pagefault(vaddr, cause))
+        {
+            regs->r_rip = fixup;
+        }
+    }
     else
     {
         dump_registers(regs);
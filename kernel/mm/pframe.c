@@ -1,5 +1,9 @@
 #include "globals.h"
 
+#include "drivers/bio.h"
+
+#include "mm/kmalloc.h"
+#include "mm/page.h"
 #include "mm/pframe.h"
 #include "mm/slab.h"
 
@@ -8,10 +12,18 @@
 
 static slab_allocator_t *pframe_allocator;
 
+void *pframe_zero_page;
+
+list_t pframe_lru = LIST_INITIALIZER(pframe_lru);
+
 void pframe_init()
 {
     pframe_allocator = slab_allocator_create("pframe", sizeof(pframe_t));
     KASSERT(pframe_allocator);
+
+    pframe_zero_page = page_alloc();
+    KASSERT(pframe_zero_page);
+    memset(pframe_zero_page, 0, PAGE_SIZE);
 }
 
 /*
@@ -27,6 +39,7 @@ pframe_t *pframe_create()
     memset(pf, 0, sizeof(pframe_t));
     kmutex_init(&pf->pf_mutex);
     list_link_init(&pf->pf_link);
+    list_link_init(&pf->pf_lru_link);
     return pf;
 }
 
@@ -42,11 +55,65 @@ void pframe_free(pframe_t **pfp)
     KASSERT(!(*pfp)->pf_addr);
     KASSERT(!(*pfp)->pf_dirty);
     KASSERT(!list_link_is_linked(&(*pfp)->pf_link));
+    KASSERT(!list_link_is_linked(&(*pfp)->pf_lru_link));
     kmutex_unlock(&(*pfp)->pf_mutex);
     slab_obj_free(pframe_allocator, *pfp);
     *pfp = NULL;
 }
 
+/*
+ * Release the page backing the pframe's contents and set pf->pf_addr = NULL.
+ * The shared zero page is never freed, and a page still being read into is
+ * only freed once the read completes.
+ */
+void pframe_free_page(pframe_t *pf)
+{
+    pframe_wait_io(pf);
+    if (list_link_is_linked(&pf->pf_lru_link))
+    {
+        list_remove(&pf->pf_lru_link);
+    }
+    if (pf->pf_addr && !pframe_is_zero_page(pf))
+    {
+        page_free(pf->pf_addr);
+    }
+    pf->pf_addr = NULL;
+    pf->pf_zero_mapped = 0;
+}
+
+/*
+ * Wait for the read started into pf->pf_addr without waiting for it (see
+ * vnode_ops_t's readahead), if there is one, and free its request. The pframe
+ * must be locked.
+ *
+ * Returns 0 if the contents are in memory, or the read's -errno.
+ */
+long pframe_wait_io(pframe_t *pf)
+{
+    if (!pf->pf_bio)
+    {
+        return 0;
+    }
+    KASSERT(kmutex_owns_mutex(&pf->pf_mutex));
+    long ret = bio_wait(pf->pf_bio);
+    kfree(pf->pf_bio);
+    pf->pf_bio = NULL;
+    return ret;
+}
+
+/*
+ * Mark a resident pframe as the most recently used one on pframe_lru.
+ */
+void pframe_lru_touch(pframe_t *pf)
+{
+    KASSERT(pf->pf_addr && !pframe_is_zero_page(pf));
+    if (list_link_is_linked(&pf->pf_lru_link))
+    {
+        list_remove(&pf->pf_lru_link);
+    }
+    list_insert_head(&pframe_lru, &pf->pf_lru_link);
+}
+
 /*
  * Unlock the pframe and set *pfp = NULL
  */
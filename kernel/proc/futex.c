@@ -0,0 +1,212 @@
+#include "proc/futex.h"
+#include "api/access.h"
+#include "errno.h"
+#include "globals.h"
+#include "mm/mobj.h"
+#include "mm/mman.h"
+#include "mm/page.h"
+#include "proc/sched.h"
+#include "util/debug.h"
+#include "util/list.h"
+#include "vm/vmmap.h"
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SIZE (1UL << FUTEX_HASH_BITS)
+
+/*
+ * Identifies a futex word: the process's address space and the word's
+ * address for a private mapping, or the shared memory object and the word's
+ * byte offset in it. Keys of shared words hold a reference on the object.
+ */
+typedef struct futex_key
+{
+    void *fk_base;
+    uintptr_t fk_off;
+    int fk_shared;
+} futex_key_t;
+
+/*
+ * A thread in FUTEX_WAIT. Each sleeps on a queue of its own, so that a wake
+ * up can pick exactly which threads of a hash bucket to wake.
+ */
+typedef struct futex_waiter
+{
+    futex_key_t fw_key;
+    ktqueue_t fw_queue;
+    list_link_t fw_link; /* on its bucket, until woken up */
+} futex_waiter_t;
+
+static list_t futex_hash[FUTEX_HASH_SIZE];
+
+void futex_init(void)
+{
+    for (size_t i = 0; i < FUTEX_HASH_SIZE; i++)
+    {
+        list_init(&futex_hash[i]);
+    }
+}
+
+static list_t *futex_bucket(futex_key_t *key)
+{
+    uintptr_t h = (uintptr_t)key->fk_base ^ (key->fk_off >> 2);
+    h ^= h >> FUTEX_HASH_BITS ^ h >> (2 * FUTEX_HASH_BITS);
+    return &futex_hash[h & (FUTEX_HASH_SIZE - 1)];
+}
+
+static long futex_key_eq(futex_key_t *a, futex_key_t *b)
+{
+    return a->fk_base == b->fk_base && a->fk_off == b->fk_off;
+}
+
+static long futex_get_key(int *uaddr, futex_key_t *key)
+{
+    if ((uintptr_t)uaddr & (sizeof(int) - 1))
+    {
+        return -EINVAL;
+    }
+    vmarea_t *vma = vmmap_lookup(curproc->p_vmmap, ADDR_TO_PN(uaddr));
+    if (!vma)
+    {
+        return -EFAULT;
+    }
+    if (vma->vma_flags & MAP_SHARED)
+    {
+        key->fk_base = vma->vma_obj;
+        key->fk_off = (uintptr_t)PN_TO_ADDR(vma->vma_off + ADDR_TO_PN(uaddr) -
+                                            vma->vma_start) +
+                      PAGE_OFFSET(uaddr);
+        key->fk_shared = 1;
+        mobj_ref(vma->vma_obj);
+    }
+    else
+    {
+        key->fk_base = curproc->p_vmmap;
+        key->fk_off = (uintptr_t)uaddr;
+        key->fk_shared = 0;
+    }
+    return 0;
+}
+
+static void futex_put_key(futex_key_t *key)
+{
+    if (key->fk_shared)
+    {
+        mobj_t *obj = key->fk_base;
+        mobj_put(&obj);
+    }
+}
+
+static long futex_wait(int *uaddr, int val)
+{
+    futex_waiter_t waiter;
+    long ret = futex_get_key(uaddr, &waiter.fw_key);
+    if (ret)
+    {
+        return ret;
+    }
+
+    /*
+     * Nothing can wake us up between this check and going to sleep: the
+     * kernel is not preemptive, and nothing below blocks before then.
+     */
+    int cur;
+    ret = copy_from_user(&cur, uaddr, sizeof(cur));
+    if (!ret && cur != val)
+    {
+        ret = -EAGAIN;
+    }
+    if (!ret)
+    {
+        sched_queue_init(&waiter.fw_queue);
+        list_insert_tail(futex_bucket(&waiter.fw_key), &waiter.fw_link);
+        ret = sched_cancellable_sleep_on(&waiter.fw_queue);
+        if (list_link_is_linked(&waiter.fw_link))
+        {
+            /* cancelled before anybody woke us up */
+            list_remove(&waiter.fw_link);
+        }
+        else
+        {
+            ret = 0;
+        }
+    }
+    futex_put_key(&waiter.fw_key);
+    return ret;
+}
+
+/*
+ * Wake up at most nwake threads waiting on key, then move at most nrequeue of
+ * the rest to wait on requeue (if not NULL). Returns the number of threads
+ * woken up and moved.
+ */
+static long futex_wake_requeue(futex_key_t *key, int nwake,
+                               futex_key_t *requeue, int nrequeue)
+{
+    long count = 0;
+    list_iterate(futex_bucket(key), waiter, futex_waiter_t, fw_link)
+    {
+        if (!futex_key_eq(&waiter->fw_key, key))
+        {
+            continue;
+        }
+        if (nwake > 0)
+        {
+            nwake--;
+            list_remove(&waiter->fw_link);
+            sched_wakeup_on(&waiter->fw_queue, NULL);
+        }
+        else if (requeue && nrequeue > 0)
+        {
+            nrequeue--;
+            list_remove(&waiter->fw_link);
+            if (requeue->fk_shared)
+            {
+                mobj_ref(requeue->fk_base);
+            }
+            futex_put_key(&waiter->fw_key);
+            waiter->fw_key = *requeue;
+            list_insert_tail(futex_bucket(requeue), &waiter->fw_link);
+        }
+        else
+        {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+long do_futex(int *uaddr, int op, int val, int *uaddr2, int val2)
+{
+    futex_key_t key, key2;
+    long ret;
+    switch (op)
+    {
+    case FUTEX_WAIT:
+        return futex_wait(uaddr, val);
+    case FUTEX_WAKE:
+        if ((ret = futex_get_key(uaddr, &key)))
+        {
+            return ret;
+        }
+        ret = futex_wake_requeue(&key, val, NULL, 0);
+        futex_put_key(&key);
+        return ret;
+    case FUTEX_REQUEUE:
+        if ((ret = futex_get_key(uaddr, &key)))
+        {
+            return ret;
+        }
+        if ((ret = futex_get_key(uaddr2, &key2)))
+        {
+            futex_put_key(&key);
+            return ret;
+        }
+        ret = futex_wake_requeue(&key, val, &key2, val2);
+        futex_put_key(&key2);
+        futex_put_key(&key);
+        return ret;
+    default:
+        return -EINVAL;
+    }
+}
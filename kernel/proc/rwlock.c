@@ -0,0 +1,58 @@
+#include "proc/rwlock.h"
+#include "globals.h"
+#include "util/debug.h"
+
+/*
+ * Like kmutex_t, these locks rely on the kernel being non-preemptive: nothing
+ * can change the lock between checking it and going to sleep on rw_waitq.
+ * Every release wakes all waiters, and each rechecks whether it can proceed,
+ * so readers released by a writer all get in together.
+ */
+
+void rwlock_init(rwlock_t *rw)
+{
+    sched_queue_init(&rw->rw_waitq);
+    rw->rw_writer = NULL;
+    rw->rw_readers = 0;
+    rw->rw_waiting_writers = 0;
+}
+
+void rwlock_lock_read(rwlock_t *rw)
+{
+    KASSERT(curthr && rw->rw_writer != curthr);
+    while (rw->rw_writer || rw->rw_waiting_writers)
+    {
+        sched_sleep_on(&rw->rw_waitq);
+    }
+    rw->rw_readers++;
+}
+
+void rwlock_unlock_read(rwlock_t *rw)
+{
+    KASSERT(rw->rw_readers && !rw->rw_writer);
+    if (!--rw->rw_readers)
+    {
+        sched_broadcast_on(&rw->rw_waitq);
+    }
+}
+
+void rwlock_lock_write(rwlock_t *rw)
+{
+    KASSERT(curthr && rw->rw_writer != curthr);
+    rw->rw_waiting_writers++;
+    while (rw->rw_writer || rw->rw_readers)
+    {
+        sched_sleep_on(&rw->rw_waitq);
+    }
+    rw->rw_waiting_writers--;
+    rw->rw_writer = curthr;
+}
+
+void rwlock_unlock_write(rwlock_t *rw)
+{
+    KASSERT(rw->rw_writer == curthr && !rw->rw_readers);
+    rw->rw_writer = NULL;
+    sched_broadcast_on(&rw->rw_waitq);
+}
+
+long rwlock_owns_write(rwlock_t *rw) { return curthr && rw->rw_writer == curthr; }
@@ -0,0 +1,379 @@
+//
+// Tests the asynchronous block I/O interface against a small device backed by
+// memory, whose operations record every command they are given
+//
+
+#include "errno.h"
+#include "globals.h"
+
+#include "test/usertest.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#include "drivers/bio.h"
+#include "drivers/blockdev.h"
+#include "mm/page.h"
+
+#define BIOTEST_BLOCKS 64
+#define BIOTEST_BAD_BLOCK 50 // commands touching this block fail with EIO
+#define BIOTEST_MAX_CMDS 32
+#define BIOTEST_NREQS 8 // requests test_bio_many() keeps in flight
+
+// A command the test device was given
+typedef struct biotest_cmd
+{
+    int dir;
+    blocknum_t loc;
+    size_t count;
+} biotest_cmd_t;
+
+static char *biotest_disk;
+static biotest_cmd_t biotest_cmds[BIOTEST_MAX_CMDS];
+static size_t biotest_ncmds;
+
+static long biotest_rw(int dir, char *buf, blocknum_t loc, size_t count)
+{
+    if (biotest_ncmds < BIOTEST_MAX_CMDS)
+    {
+        biotest_cmds[biotest_ncmds++] = (biotest_cmd_t){dir, loc, count};
+    }
+    if (loc >= BIOTEST_BLOCKS || count > BIOTEST_BLOCKS - loc)
+    {
+        return -EINVAL;
+    }
+    if (loc <= BIOTEST_BAD_BLOCK && BIOTEST_BAD_BLOCK < loc + count)
+    {
+        return -EIO;
+    }
+
+    char *disk = biotest_disk + loc * BLOCK_SIZE;
+    if (dir == BIO_READ)
+    {
+        memcpy(buf, disk, count * BLOCK_SIZE);
+    }
+    else
+    {
+        memcpy(disk, buf, count * BLOCK_SIZE);
+    }
+    return 0;
+}
+
+static long biotest_read_block(blockdev_t *bdev, char *buf, blocknum_t loc,
+                               size_t block_count)
+{
+    return biotest_rw(BIO_READ, buf, loc, block_count);
+}
+
+static long biotest_write_block(blockdev_t *bdev, const char *buf,
+                                blocknum_t loc, size_t block_count)
+{
+    return biotest_rw(BIO_WRITE, (char *)buf, loc, block_count);
+}
+
+static blockdev_ops_t biotest_ops = {
+    .read_block = biotest_read_block,
+    .write_block = biotest_write_block,
+};
+
+// Not in the block device list, only known to the bio layer through its queue
+static blockdev_t biotest_bdev = {.bd_ops = &biotest_ops};
+static blockdev_queue_t biotest_queue;
+
+// Queues cannot be unregistered, so the test device's is registered on the
+// first run and reused after that.
+static void biotest_reset()
+{
+    if (!biotest_disk)
+    {
+        biotest_disk = page_alloc_n(BIOTEST_BLOCKS);
+        KASSERT(biotest_disk && "Unable to allocate the test disk");
+        biotest_queue.bq_bdev = &biotest_bdev;
+        biotest_queue.bq_submit = NULL;
+        biotest_queue.bq_rw_pages = NULL;
+        blockdev_queue_register(&biotest_queue);
+    }
+    memset(biotest_disk, 0, BIOTEST_BLOCKS * BLOCK_SIZE);
+    biotest_ncmds = 0;
+    biotest_queue.bq_head = 0;
+}
+
+static long biotest_cmd_is(size_t i, int dir, blocknum_t loc, size_t count)
+{
+    return i < biotest_ncmds && biotest_cmds[i].dir == dir &&
+           biotest_cmds[i].loc == loc && biotest_cmds[i].count == count;
+}
+
+static long biotest_block_is(blocknum_t loc, char c)
+{
+    char *block = biotest_disk + loc * BLOCK_SIZE;
+    return block[0] == c && !memcmp(block, block + 1, BLOCK_SIZE - 1);
+}
+
+static void biotest_done(bio_t *bio) { (*(long *)bio->bio_private)++; }
+
+long test_bio_rw()
+{
+    biotest_reset();
+    char *page = page_alloc();
+    char *back = page_alloc();
+    KASSERT(page && back && "Unable to allocate pages");
+    memset(page, 'a', BLOCK_SIZE);
+
+    long done = 0;
+    bio_t bio;
+    bio_init_request(&bio, &biotest_bdev, BIO_WRITE, 3, 1, (void **)&page);
+    bio.bio_done = biotest_done;
+    bio.bio_private = &done;
+    bio_submit(&bio);
+    long ret = bio_wait(&bio);
+    test_assert(!ret, "write returned %ld", ret);
+    test_assert(bio.bio_complete && !bio.bio_error,
+                "write not marked complete and successful");
+    test_assert(done == 1, "completion callback ran %ld times", done);
+    test_assert(biotest_block_is(3, 'a'), "written block has the wrong data");
+
+    bio_init_request(&bio, &biotest_bdev, BIO_READ, 3, 1, (void **)&back);
+    bio_submit(&bio);
+    ret = bio_wait(&bio);
+    test_assert(!ret, "read returned %ld", ret);
+    test_assert(!memcmp(page, back, BLOCK_SIZE), "read back the wrong data");
+
+    // Waiting again for a finished request returns at once
+    test_assert(!bio_wait(&bio), "second wait did not return the result");
+
+    page_free(page);
+    page_free(back);
+    return 0;
+}
+
+long test_bio_error()
+{
+    biotest_reset();
+    char *page = page_alloc();
+    KASSERT(page && "Unable to allocate a page");
+    memset(page, 'b', BLOCK_SIZE);
+
+    long done = 0;
+    bio_t bio;
+    bio_init_request(&bio, &biotest_bdev, BIO_WRITE, BIOTEST_BAD_BLOCK, 1,
+                     (void **)&page);
+    bio.bio_done = biotest_done;
+    bio.bio_private = &done;
+    bio_submit(&bio);
+    long ret = bio_wait(&bio);
+    test_assert(ret == -EIO, "write to a bad block returned %ld", ret);
+    test_assert(bio.bio_error == -EIO, "bio_error is %ld", bio.bio_error);
+    test_assert(done == 1, "completion callback ran %ld times on failure",
+                done);
+
+    bio_init_request(&bio, &biotest_bdev, BIO_READ, BIOTEST_BLOCKS, 1,
+                     (void **)&page);
+    bio_submit(&bio);
+    ret = bio_wait(&bio);
+    test_assert(ret == -EINVAL, "read past the end returned %ld", ret);
+
+    page_free(page);
+    return 0;
+}
+
+// Several requests in flight at once, waited for in the opposite order
+long test_bio_many()
+{
+    biotest_reset();
+    size_t n = BIOTEST_NREQS;
+    char *pages = page_alloc_n(n);
+    KASSERT(pages && "Unable to allocate pages");
+
+    bio_t bios[BIOTEST_NREQS];
+    void *bufs[BIOTEST_NREQS];
+    for (size_t i = 0; i < n; i++)
+    {
+        bufs[i] = pages + i * BLOCK_SIZE;
+        memset(bufs[i], 'c' + (int)i, BLOCK_SIZE);
+        // every other block, so that no two requests are merged
+        bio_init_request(&bios[i], &biotest_bdev, BIO_WRITE, 2 * i, 1,
+                         &bufs[i]);
+        bio_submit(&bios[i]);
+    }
+    for (size_t i = n; i--;)
+    {
+        long ret = bio_wait(&bios[i]);
+        test_assert(!ret, "write %lu returned %ld", i, ret);
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        test_assert(biotest_block_is(2 * i, 'c' + (char)i),
+                    "block %lu has the wrong data", 2 * i);
+    }
+
+    page_free_n(pages, n);
+    return 0;
+}
+
+/*
+ * Submits one single-block request per entry of locs, each with its own page,
+ * and waits for all of them. The requests are only dispatched once this
+ * thread blocks, so they are all pending together.
+ */
+static void biotest_submit_all(bio_t *bios, int dir, blocknum_t *locs,
+                               size_t n, char *pages, void **bufs)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        bufs[i] = pages + i * BLOCK_SIZE;
+        bio_init_request(&bios[i], &biotest_bdev, dir, locs[i], 1, &bufs[i]);
+        bio_submit(&bios[i]);
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        bio_wait(&bios[i]);
+    }
+}
+
+// Requests are served in one-way elevator order from where the last one ended
+long test_bio_elevator()
+{
+    biotest_reset();
+    char *pages = page_alloc_n(BIOTEST_NREQS);
+    KASSERT(pages && "Unable to allocate pages");
+    bio_t bios[BIOTEST_NREQS];
+    void *bufs[BIOTEST_NREQS];
+
+    blocknum_t first[] = {20, 5, 40, 10};
+    biotest_submit_all(bios, BIO_WRITE, first, 4, pages, bufs);
+    test_assert(biotest_ncmds == 4, "%lu commands for 4 requests",
+                biotest_ncmds);
+    test_assert(biotest_cmd_is(0, BIO_WRITE, 5, 1) &&
+                    biotest_cmd_is(1, BIO_WRITE, 10, 1) &&
+                    biotest_cmd_is(2, BIO_WRITE, 20, 1) &&
+                    biotest_cmd_is(3, BIO_WRITE, 40, 1),
+                "requests not served in ascending order");
+
+    // The head is now past 40: 45 comes first, then it wraps around
+    biotest_ncmds = 0;
+    blocknum_t second[] = {10, 45, 35};
+    biotest_submit_all(bios, BIO_WRITE, second, 3, pages, bufs);
+    test_assert(biotest_cmd_is(0, BIO_WRITE, 45, 1) &&
+                    biotest_cmd_is(1, BIO_WRITE, 10, 1) &&
+                    biotest_cmd_is(2, BIO_WRITE, 35, 1),
+                "elevator did not continue from the head and wrap around");
+
+    page_free_n(pages, BIOTEST_NREQS);
+    return 0;
+}
+
+long test_bio_merge()
+{
+    biotest_reset();
+    char *pages = page_alloc_n(BIOTEST_NREQS);
+    KASSERT(pages && "Unable to allocate pages");
+    bio_t bios[BIOTEST_NREQS];
+    void *bufs[BIOTEST_NREQS];
+
+    // Adjacent requests submitted out of order, so that their pages are not
+    // in block order and the merged command has to be staged
+    size_t merged = biotest_queue.bq_merged;
+    blocknum_t locs[] = {10, 8, 9};
+    for (size_t i = 0; i < 3; i++)
+    {
+        memset(pages + i * BLOCK_SIZE, 'x' + (int)i, BLOCK_SIZE);
+    }
+    biotest_submit_all(bios, BIO_WRITE, locs, 3, pages, bufs);
+    test_assert(biotest_ncmds == 1 && biotest_cmd_is(0, BIO_WRITE, 8, 3),
+                "adjacent requests not merged into one command");
+    test_assert(biotest_queue.bq_merged == merged + 2,
+                "%lu requests counted as merged",
+                biotest_queue.bq_merged - merged);
+    for (size_t i = 0; i < 3; i++)
+    {
+        test_assert(!bios[i].bio_error, "merged write %lu failed", i);
+    }
+    test_assert(biotest_block_is(8, 'y') && biotest_block_is(9, 'z') &&
+                    biotest_block_is(10, 'x'),
+                "merged command wrote the wrong data");
+
+    // Reads and writes are never merged with each other
+    biotest_reset();
+    for (size_t i = 0; i < 3; i++)
+    {
+        bufs[i] = pages + i * BLOCK_SIZE;
+        bio_init_request(&bios[i], &biotest_bdev, i == 2 ? BIO_READ : BIO_WRITE,
+                         10 + i, 1, &bufs[i]);
+        bio_submit(&bios[i]);
+    }
+    for (size_t i = 0; i < 3; i++)
+    {
+        bio_wait(&bios[i]);
+    }
+    test_assert(biotest_ncmds == 2 && biotest_cmd_is(0, BIO_WRITE, 10, 2) &&
+                    biotest_cmd_is(1, BIO_READ, 12, 1),
+                "read merged with adjacent writes");
+
+    page_free_n(pages, BIOTEST_NREQS);
+    return 0;
+}
+
+// Commands are capped at BIO_MAX_MERGE blocks
+long test_bio_merge_limit()
+{
+    biotest_reset();
+    const size_t n = BIO_MAX_MERGE + 4;
+    char *pages = page_alloc_n(n);
+    KASSERT(pages && "Unable to allocate pages");
+    bio_t bios[BIO_MAX_MERGE + 4];
+    void *bufs[BIO_MAX_MERGE + 4];
+    blocknum_t locs[BIO_MAX_MERGE + 4];
+    for (size_t i = 0; i < n; i++)
+    {
+        locs[i] = 20 + i;
+    }
+
+    biotest_submit_all(bios, BIO_WRITE, locs, n, pages, bufs);
+    test_assert(biotest_ncmds == 2 &&
+                    biotest_cmd_is(0, BIO_WRITE, 20, BIO_MAX_MERGE) &&
+                    biotest_cmd_is(1, BIO_WRITE, 20 + BIO_MAX_MERGE, 4),
+                "%lu blocks not split into commands of at most %d",
+                n, BIO_MAX_MERGE);
+
+    page_free_n(pages, n);
+    return 0;
+}
+
+// When a merged command fails, every request in it fails
+long test_bio_merge_error()
+{
+    biotest_reset();
+    char *pages = page_alloc_n(2);
+    KASSERT(pages && "Unable to allocate pages");
+    bio_t bios[2];
+    void *bufs[2];
+
+    blocknum_t locs[] = {BIOTEST_BAD_BLOCK - 1, BIOTEST_BAD_BLOCK};
+    biotest_submit_all(bios, BIO_WRITE, locs, 2, pages, bufs);
+    test_assert(biotest_ncmds == 1, "%lu commands for 2 adjacent requests",
+                biotest_ncmds);
+    test_assert(bios[0].bio_error == -EIO && bios[1].bio_error == -EIO,
+                "requests of a failed command returned %ld and %ld",
+                bios[0].bio_error, bios[1].bio_error);
+
+    page_free_n(pages, 2);
+    return 0;
+}
+
+long biotest_main(long arg1, void *arg2)
+{
+    dbg(DBG_TEST, "\nStarting block I/O tests\n");
+    test_init();
+
+    test_bio_rw();
+    test_bio_error();
+    test_bio_many();
+    test_bio_elevator();
+    test_bio_merge();
+    test_bio_merge_limit();
+    test_bio_merge_error();
+
+    test_fini();
+    return 0;
+}
@@ -0,0 +1,292 @@
+//
+// Tests epoll_create, epoll_ctl and epoll_wait on pipes and on the kshell's
+// tty. The threads that make files ready while the test sleeps in
+// epoll_wait() run in processes of their own, which share its descriptors.
+//
+
+#include "errno.h"
+#include "globals.h"
+
+#include "test/usertest.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+#include "util/time.h"
+
+#include "drivers/dev.h"
+#include "drivers/tty/tty.h"
+#include "fs/epoll.h"
+#include "fs/file.h"
+#include "fs/pipe.h"
+#include "fs/stat.h"
+#include "fs/vfs_syscall.h"
+#include "fs/vnode.h"
+#include "main/interrupt.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#define EPOLLTEST_TIMEOUT 20 // ms
+
+static long epolltest_ret;
+
+// Starts func in a new process with a copy of the test's descriptors
+static kthread_t *epolltest_spawn(kthread_func_t func, long arg1, void *arg2)
+{
+    proc_t *proc = proc_create("epolltest");
+    KASSERT(proc);
+    for (int i = 0; i < NFILES; i++)
+    {
+        proc->p_files[i] = curproc->p_files[i];
+        if (proc->p_files[i])
+        {
+            fref(proc->p_files[i]);
+        }
+    }
+    kthread_t *thr = kthread_create(proc, func, arg1, arg2);
+    KASSERT(thr);
+    sched_make_runnable(thr);
+    return thr;
+}
+
+static void epolltest_reap()
+{
+    while (do_waitpid(-1, NULL, 0) != -ECHILD)
+        ;
+}
+
+static long epolltest_add(int epfd, int fd, uint32_t events, uint32_t data)
+{
+    struct epoll_event event = {.events = events, .data.u32 = data};
+    return do_epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+long test_epoll_errors()
+{
+    long epfd = do_epoll_create();
+    test_assert(epfd >= 0, "epoll_create returned %ld", epfd);
+    int pfds[2];
+    KASSERT(!do_pipe(pfds));
+
+    long ret = epolltest_add(pfds[0], pfds[1], EPOLLIN, 0);
+    test_assert(ret == -EINVAL, "ctl on a pipe returned %ld", ret);
+    ret = epolltest_add(epfd, epfd, EPOLLIN, 0);
+    test_assert(ret == -EINVAL, "instance watching itself returned %ld", ret);
+    ret = epolltest_add(epfd, -1, EPOLLIN, 0);
+    test_assert(ret == -EBADF, "ctl on a bad fd returned %ld", ret);
+
+    struct epoll_event event = {.events = EPOLLIN};
+    ret = do_epoll_ctl(epfd, EPOLL_CTL_MOD, pfds[0], &event);
+    test_assert(ret == -ENOENT, "MOD of a missing entry returned %ld", ret);
+    ret = do_epoll_ctl(epfd, EPOLL_CTL_DEL, pfds[0], NULL);
+    test_assert(ret == -ENOENT, "DEL of a missing entry returned %ld", ret);
+    ret = epolltest_add(epfd, pfds[0], EPOLLIN, 0);
+    test_assert(!ret, "ADD returned %ld", ret);
+    ret = epolltest_add(epfd, pfds[0], EPOLLIN, 0);
+    test_assert(ret == -EEXIST, "second ADD returned %ld", ret);
+    ret = do_epoll_ctl(epfd, 0, pfds[0], &event);
+    test_assert(ret == -EINVAL, "unknown operation returned %ld", ret);
+
+    ret = do_epoll_wait(epfd, &event, 0, 0);
+    test_assert(ret == -EINVAL, "wait for no events returned %ld", ret);
+    ret = do_epoll_wait(pfds[0], &event, 1, 0);
+    test_assert(ret == -EINVAL, "wait on a pipe returned %ld", ret);
+    ret = do_epoll_wait(-1, &event, 1, 0);
+    test_assert(ret == -EBADF, "wait on a bad fd returned %ld", ret);
+
+    do_close(pfds[0]);
+    do_close(pfds[1]);
+    do_close(epfd);
+    return 0;
+}
+
+long test_epoll_pipe()
+{
+    long epfd = do_epoll_create();
+    KASSERT(epfd >= 0);
+    int pfds[2];
+    KASSERT(!do_pipe(pfds));
+    KASSERT(!epolltest_add(epfd, pfds[0], EPOLLIN, 0));
+    KASSERT(!epolltest_add(epfd, pfds[1], EPOLLOUT, 1));
+
+    struct epoll_event events[2];
+    long ret = do_epoll_wait(epfd, events, 2, 0);
+    test_assert(ret == 1 && events[0].data.u32 == 1 &&
+                    events[0].events == EPOLLOUT,
+                "empty pipe not just writable");
+
+    char c = 'a';
+    KASSERT(do_write(pfds[1], &c, 1) == 1);
+    ret = do_epoll_wait(epfd, events, 2, 0);
+    test_assert(ret == 2 && events[0].data.u32 == 0 &&
+                    events[0].events == EPOLLIN,
+                "pipe with data not readable");
+    ret = do_epoll_wait(epfd, events, 1, 0);
+    test_assert(ret == 1, "maxevents 1 returned %ld events", ret);
+
+    struct epoll_event event = {.events = 0, .data.u32 = 1};
+    KASSERT(!do_epoll_ctl(epfd, EPOLL_CTL_MOD, pfds[1], &event));
+    KASSERT(!do_epoll_ctl(epfd, EPOLL_CTL_DEL, pfds[0], NULL));
+    ret = do_epoll_wait(epfd, events, 2, 0);
+    test_assert(ret == 0, "%ld events after MOD and DEL", ret);
+
+    // The read end gets EPOLLHUP once the write end is gone, even though it
+    // was only registered for EPOLLIN
+    KASSERT(!do_epoll_ctl(epfd, EPOLL_CTL_DEL, pfds[1], NULL));
+    KASSERT(do_read(pfds[0], &c, 1) == 1);
+    KASSERT(!epolltest_add(epfd, pfds[0], EPOLLIN, 0));
+    do_close(pfds[1]);
+    ret = do_epoll_wait(epfd, events, 2, 0);
+    test_assert(ret == 1 && events[0].events == EPOLLHUP,
+                "closed write end not reported");
+
+    do_close(pfds[0]);
+    do_close(epfd);
+    return 0;
+}
+
+long test_epoll_timeout()
+{
+    long epfd = do_epoll_create();
+    KASSERT(epfd >= 0);
+    int pfds[2];
+    KASSERT(!do_pipe(pfds));
+    KASSERT(!epolltest_add(epfd, pfds[0], EPOLLIN, 0));
+
+    struct epoll_event event;
+    uint64_t start = time_now_ns();
+    long ret = do_epoll_wait(epfd, &event, 1, EPOLLTEST_TIMEOUT);
+    uint64_t elapsed = time_now_ns() - start;
+    test_assert(ret == 0, "wait on an empty pipe returned %ld", ret);
+    test_assert(elapsed >= EPOLLTEST_TIMEOUT * NSEC_PER_MSEC,
+                "timed out after %lu ns", elapsed);
+
+    do_close(pfds[0]);
+    do_close(pfds[1]);
+    do_close(epfd);
+    return 0;
+}
+
+static void *epolltest_writer(long fd, void *arg2)
+{
+    char c = 'w';
+    epolltest_ret = do_write((int)fd, &c, 1);
+    return NULL;
+}
+
+static void *epolltest_waiter(long epfd, void *arg2)
+{
+    struct epoll_event event;
+    epolltest_ret = do_epoll_wait((int)epfd, &event, 1, -1);
+    return NULL;
+}
+
+// A write from another process wakes up epoll_wait(), and cancelling the
+// thread in it makes it return EINTR
+long test_epoll_wakeup()
+{
+    long epfd = do_epoll_create();
+    KASSERT(epfd >= 0);
+    int pfds[2];
+    KASSERT(!do_pipe(pfds));
+    KASSERT(!epolltest_add(epfd, pfds[0], EPOLLIN, 7));
+
+    epolltest_spawn(epolltest_writer, pfds[1], NULL);
+    struct epoll_event event;
+    long ret = do_epoll_wait(epfd, &event, 1, -1);
+    test_assert(ret == 1 && event.data.u32 == 7 && event.events == EPOLLIN,
+                "woke up with %ld events", ret);
+    epolltest_reap();
+    test_assert(epolltest_ret == 1, "writer returned %ld", epolltest_ret);
+
+    char c;
+    KASSERT(do_read(pfds[0], &c, 1) == 1);
+    kthread_t *thr = epolltest_spawn(epolltest_waiter, epfd, NULL);
+    sched_yield();
+    kthread_cancel(thr, NULL);
+    epolltest_reap();
+    test_assert(epolltest_ret == -EINTR, "cancelled wait returned %ld",
+                epolltest_ret);
+
+    do_close(pfds[0]);
+    do_close(pfds[1]);
+    do_close(epfd);
+    return 0;
+}
+
+static void *epolltest_typist(long arg1, void *ldisc)
+{
+    const char *line = "epoll\n";
+    for (const char *c = line; *c; c++)
+    {
+        // as the keyboard interrupt handler would
+        uint8_t ipl = intr_setipl(IPL_HIGH);
+        ldisc_key_pressed(ldisc, *c);
+        intr_setipl(ipl);
+    }
+    return NULL;
+}
+
+// A line typed on a tty wakes up epoll_wait(). The test types it on the
+// kshell's own tty, and reads it back so that the kshell never sees it.
+long test_epoll_tty()
+{
+    int fd;
+    file_t *file = NULL;
+    for (fd = 0; fd < NFILES; fd++)
+    {
+        file = curproc->p_files[fd];
+        if (file && S_ISCHR(file->f_vnode->vn_mode) &&
+            MAJOR(file->f_vnode->vn_devid) == TTY_MAJOR &&
+            file->f_vnode->vn_dev.chardev)
+        {
+            break;
+        }
+    }
+    if (fd == NFILES)
+    {
+        dbg(DBG_TEST, "no tty open, skipping\n");
+        return 0;
+    }
+
+    long epfd = do_epoll_create();
+    KASSERT(epfd >= 0);
+    KASSERT(!epolltest_add(epfd, fd, EPOLLIN, 0));
+    struct epoll_event event;
+    if (do_epoll_wait(epfd, &event, 1, 0))
+    {
+        dbg(DBG_TEST, "tty already has input, skipping\n");
+        do_close(epfd);
+        return 0;
+    }
+
+    tty_t *tty = cd_to_tty(file->f_vnode->vn_dev.chardev);
+    epolltest_spawn(epolltest_typist, 0, &tty->tty_ldisc);
+    long ret = do_epoll_wait(epfd, &event, 1, -1);
+    test_assert(ret == 1 && event.events == EPOLLIN,
+                "typed line woke up epoll_wait() with %ld events", ret);
+    epolltest_reap();
+
+    char buf[16];
+    ret = do_read(fd, buf, sizeof(buf));
+    test_assert(ret == 6 && !memcmp(buf, "epoll\n", 6), "read %ld bytes back",
+                ret);
+
+    do_close(epfd);
+    return 0;
+}
+
+long epolltest_main(long arg1, void *arg2)
+{
+    dbg(DBG_TEST, "\nStarting epoll tests\n");
+    test_init();
+
+    test_epoll_errors();
+    test_epoll_pipe();
+    test_epoll_timeout();
+    test_epoll_wakeup();
+    test_epoll_tty();
+
+    test_fini();
+    return 0;
+}
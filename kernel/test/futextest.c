@@ -0,0 +1,195 @@
+//
+// Tests the futex syscall. The waiters are kernel processes of their own that
+// map the same file MAP_SHARED as the test, so their futex words are found by
+// the file's memory object and offset rather than by their addresses.
+//
+
+#include "errno.h"
+#include "globals.h"
+
+#include "test/usertest.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#include "api/access.h"
+#include "api/syscall.h"
+#include "fs/fcntl.h"
+#include "fs/open.h"
+#include "fs/vfs_syscall.h"
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "mm/page.h"
+#include "proc/futex.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+#include "vm/mmap.h"
+
+#define FUTEXTEST_FILE "futextest"
+#define FUTEXTEST_WAITERS 3
+
+static long futextest_ret[FUTEXTEST_WAITERS];
+static size_t futextest_asleep;
+
+// Maps the first page of the test file shared, read/write
+static int *futextest_map(int *fdp)
+{
+    long fd = do_open(FUTEXTEST_FILE, O_RDWR);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    void *addr;
+    if (do_mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0,
+                &addr))
+    {
+        do_close(fd);
+        return NULL;
+    }
+    *fdp = fd;
+    return addr;
+}
+
+static void futextest_unmap(int *word, int fd)
+{
+    do_munmap(word, PAGE_SIZE);
+    do_close(fd);
+}
+
+// Waits on the first word of the file for as long as it is still 0
+static void *futextest_waiter(long i, void *arg2)
+{
+    int fd;
+    int *word = futextest_map(&fd);
+    int val;
+    if (!word || copy_from_user(&val, word, sizeof(val)))
+    {
+        futextest_ret[i] = -EFAULT;
+        futextest_asleep++;
+        return NULL;
+    }
+
+    // The word is mapped now, so nothing blocks before the waiter sleeps
+    futextest_asleep++;
+    futextest_ret[i] = do_futex(word, FUTEX_WAIT, val, NULL, 0);
+
+    futextest_unmap(word, fd);
+    return NULL;
+}
+
+// Starts waiters [0, n) and returns once they are all asleep
+static void futextest_spawn(size_t n, kthread_t **thrs)
+{
+    futextest_asleep = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        futextest_ret[i] = 1;
+        proc_t *proc = proc_create("futextest");
+        KASSERT(proc);
+        kthread_t *thr = kthread_create(proc, futextest_waiter, i, NULL);
+        KASSERT(thr);
+        if (thrs)
+        {
+            thrs[i] = thr;
+        }
+        sched_make_runnable(thr);
+    }
+    while (futextest_asleep < n)
+    {
+        sched_yield();
+    }
+}
+
+long test_futex_errors(int *word)
+{
+    long ret = do_futex(word, FUTEX_WAIT, 1, NULL, 0);
+    test_assert(ret == -EAGAIN, "wait on a changed word returned %ld", ret);
+    ret = do_futex(word, FUTEX_WAKE, 1, NULL, 0);
+    test_assert(ret == 0, "wake with no waiters returned %ld", ret);
+
+    ret = do_futex((int *)((char *)word + 1), FUTEX_WAKE, 1, NULL, 0);
+    test_assert(ret == -EINVAL, "misaligned word returned %ld", ret);
+    ret = do_futex(word, 2, 1, NULL, 0);
+    test_assert(ret == -EINVAL, "unknown operation returned %ld", ret);
+
+    // The test process maps nothing else
+    int *unmapped = (int *)USER_MEM_LOW;
+    ret = do_futex(unmapped, FUTEX_WAIT, 0, NULL, 0);
+    test_assert(ret == -EFAULT, "wait on an unmapped word returned %ld", ret);
+    ret = do_futex(word, FUTEX_REQUEUE, 1, unmapped, 1);
+    test_assert(ret == -EFAULT, "requeue to an unmapped word returned %ld",
+                ret);
+    return 0;
+}
+
+long test_futex_wake(int *word)
+{
+    futextest_spawn(FUTEXTEST_WAITERS, NULL);
+
+    long ret = do_futex(word, FUTEX_WAKE, 1, NULL, 0);
+    test_assert(ret == 1, "woke up %ld of one waiter", ret);
+    // One of the two left is woken up, the other moved to the next word
+    ret = do_futex(word, FUTEX_REQUEUE, 1, word + 1, 1);
+    test_assert(ret == 2, "requeue woke up and moved %ld waiters", ret);
+    ret = do_futex(word, FUTEX_WAKE, FUTEXTEST_WAITERS, NULL, 0);
+    test_assert(ret == 0, "%ld waiters left on the word after requeue", ret);
+    ret = do_futex(word + 1, FUTEX_WAKE, FUTEXTEST_WAITERS, NULL, 0);
+    test_assert(ret == 1, "woke up %ld waiters on the requeue target", ret);
+
+    while (do_waitpid(-1, NULL, 0) != -ECHILD)
+        ;
+    for (size_t i = 0; i < FUTEXTEST_WAITERS; i++)
+    {
+        test_assert(futextest_ret[i] == 0, "waiter %lu returned %ld", i,
+                    futextest_ret[i]);
+    }
+    return 0;
+}
+
+// A cancelled waiter returns EINTR and is no longer found by wake ups
+long test_futex_cancel(int *word)
+{
+    kthread_t *thr;
+    futextest_spawn(1, &thr);
+    kthread_cancel(thr, NULL);
+    while (do_waitpid(-1, NULL, 0) != -ECHILD)
+        ;
+    test_assert(futextest_ret[0] == -EINTR, "cancelled waiter returned %ld",
+                futextest_ret[0]);
+
+    long ret = do_futex(word, FUTEX_WAKE, 1, NULL, 0);
+    test_assert(ret == 0, "woke up %ld waiters after cancel", ret);
+    return 0;
+}
+
+long futextest_main(long arg1, void *arg2)
+{
+    dbg(DBG_TEST, "\nStarting futex tests\n");
+    test_init();
+
+    long fd = do_open(FUTEXTEST_FILE, O_RDWR | O_CREAT);
+    KASSERT(fd >= 0);
+    char *zero = page_alloc();
+    KASSERT(zero && "Unable to allocate a page");
+    memset(zero, 0, PAGE_SIZE);
+    long ret = do_write(fd, zero, PAGE_SIZE);
+    KASSERT(ret == PAGE_SIZE);
+    page_free(zero);
+    do_close(fd);
+
+    int mapfd;
+    int *word = futextest_map(&mapfd);
+    test_assert(word != NULL, "unable to map %s", FUTEXTEST_FILE);
+    if (word)
+    {
+        test_futex_errors(word);
+        test_futex_wake(word);
+        test_futex_cancel(word);
+        futextest_unmap(word, mapfd);
+    }
+    do_unlink(FUTEXTEST_FILE);
+
+    test_fini();
+    return 0;
+}
@@ -13,6 +13,15 @@
 
 #include "test/kshell/io.h"
 
+#ifdef __DRIVERS__
+#include "drivers/bio.h"
+#endif
+
+#ifdef __VM__
+#include "vm/shadow.h"
+#include "vm/swap.h"
+#endif
+
 #include "util/debug.h"
 #include "util/string.h"
 
@@ -402,3 +411,117 @@ long kshell_s5fstest(kshell_t *ksh, size_t argc, char **argv)
 }
 
 #endif
+
+#ifdef __VM__
+
+long kshell_shadows(kshell_t *ksh, size_t argc, char **argv)
+{
+    char buf[512];
+    shadow_info(NULL, buf, sizeof(buf));
+    kprintf(ksh, "%s", buf);
+    return 0;
+}
+
+long kshell_swap(kshell_t *ksh, size_t argc, char **argv)
+{
+    char buf[128];
+    swap_info(NULL, buf, sizeof(buf));
+    kprintf(ksh, "%s", buf);
+    return 0;
+}
+
+long vmtest_main(long, void *);
+
+long kshell_vmtest(kshell_t *ksh, size_t argc, char **argv)
+{
+    kprintf(ksh, "TEST VM: Testing... Please wait.\n");
+
+    long ret = vmtest_main(1, NULL);
+
+    kprintf(ksh, "TEST VM: testing complete, check console for results\n");
+
+    return ret;
+}
+
+long futextest_main(long, void *);
+
+long kshell_futextest(kshell_t *ksh, size_t argc, char **argv)
+{
+    kprintf(ksh, "TEST FUTEX: Testing... Please wait.\n");
+
+    long ret = futextest_main(1, NULL);
+
+    kprintf(ksh, "TEST FUTEX: testing complete, check console for results\n");
+
+    return ret;
+}
+
+long syscalltest_main(long, void *);
+
+long kshell_syscalltest(kshell_t *ksh, size_t argc, char **argv)
+{
+    kprintf(ksh, "TEST SYSCALL: Testing... Please wait.\n");
+
+    long ret = syscalltest_main(1, NULL);
+
+    kprintf(ksh, "TEST SYSCALL: testing complete, check console for results\n");
+
+    return ret;
+}
+
+#endif
+
+#ifdef __DRIVERS__
+
+long kshell_iostat(kshell_t *ksh, size_t argc, char **argv)
+{
+    char buf[1024];
+    bio_info(NULL, buf, sizeof(buf));
+    kprintf(ksh, "%s", buf);
+    return 0;
+}
+
+long biotest_main(long, void *);
+
+long kshell_biotest(kshell_t *ksh, size_t argc, char **argv)
+{
+    kprintf(ksh, "TEST BIO: Testing... Please wait.\n");
+
+    long ret = biotest_main(1, NULL);
+
+    kprintf(ksh, "TEST BIO: testing complete, check console for results\n");
+
+    return ret;
+}
+
+long ramdisktest_main(long, void *);
+
+long kshell_ramdisktest(kshell_t *ksh, size_t argc, char **argv)
+{
+    kprintf(ksh, "TEST RAMDISK: Testing... Please wait.\n");
+
+    long ret = ramdisktest_main(1, NULL);
+
+    kprintf(ksh, "TEST RAMDISK: testing complete, check console for results\n");
+
+    return ret;
+}
+
+#endif
+
+#ifdef __PIPES__
+
+long epolltest_main(long, void *);
+
+long kshell_epolltest(kshell_t *ksh, size_t argc, char **argv)
+{
+    kprintf(ksh, "TEST EPOLL: Testing... Please wait.\n");
+
+    long ret = epolltest_main(1, NULL);
+
+    kprintf(ksh, "TEST EPOLL: testing complete, check console for results\n");
+
+    return ret;
+}
+
+#endif
@@ -30,3 +30,22 @@ KSHELL_CMD(vfs_test);
 #ifdef __S5FS__
 KSHELL_CMD(s5fstest);
 #endif
+
+#ifdef __VM__
+KSHELL_CMD(shadows);
+KSHELL_CMD(swap);
+KSHELL_CMD(vmtest);
+KSHELL_CMD(futextest);
+KSHELL_CMD(syscalltest);
+#endif
+
+#ifdef __DRIVERS__
+KSHELL_CMD(iostat);
+KSHELL_CMD(biotest);
+KSHELL_CMD(ramdisktest);
+#endif
+
+#ifdef __PIPES__
+KSHELL_CMD(pipes_test);
+KSHELL_CMD(epolltest);
+#endif
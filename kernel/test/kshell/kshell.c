@@ -64,6 +64,28 @@ void kshell_init() {
   kshell_add_command("s5fstest", kshell_s5fstest, "runs S5FS tests");
 #endif
 
+#ifdef __VM__
+  kshell_add_command("shadows", kshell_shadows,
+                     "display shadow object chain statistics");
+  kshell_add_command("swap", kshell_swap, "display swap space usage");
+  kshell_add_command("vmtest", kshell_vmtest, "runs VM tests");
+  kshell_add_command("futextest", kshell_futextest, "runs futex tests");
+  kshell_add_command("syscalltest", kshell_syscalltest,
+                     "runs batched system call tests");
+#endif
+
+#ifdef __DRIVERS__
+  kshell_add_command("iostat", kshell_iostat,
+                     "display block I/O queue statistics");
+  kshell_add_command("biotest", kshell_biotest, "runs block I/O tests");
+  kshell_add_command("ramdisktest", kshell_ramdisktest, "runs RAM disk tests");
+#endif
+
+#ifdef __PIPES__
+  kshell_add_command("pipestest", kshell_pipes_test, "runs pipe tests");
+  kshell_add_command("epolltest", kshell_epolltest, "runs epoll tests");
+#endif
+
   kshell_add_command("halt", kshell_halt, "halts the systems");
   kshell_add_command("exit", kshell_exit, "exits the shell");
 }
@@ -100,7 +100,7 @@ out:
     return NULL;
 }
 
-static int test_pipes(kshell_t *ksh, int argc, char **argv)
+long kshell_pipes_test(kshell_t *ksh, size_t argc, char **argv)
 {
     int pfds[2];
     int err = do_pipe(pfds);
@@ -122,12 +122,3 @@ static int test_pipes(kshell_t *ksh, int argc, char **argv)
     do_waitpid(-1, 0, 0);
     return 0;
 }
-
-#ifdef __PIPES__
-static __attribute__((unused)) void test_pipes_init()
-{
-    kshell_add_command("test_pipes", test_pipes, "run pipe tests");
-}
-init_func(test_pipes_init);
-init_depends(kshell_init);
-#endif /* __PIPES__ */
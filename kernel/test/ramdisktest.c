@@ -0,0 +1,190 @@
+//
+// Tests the RAM disk driver through both its synchronous operations and the
+// asynchronous interface. The disk may hold a mounted file system, so the
+// tests only use blocks at its end and put back whatever they overwrite.
+//
+
+#include "errno.h"
+#include "globals.h"
+
+#include "test/usertest.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#include "drivers/bio.h"
+#include "drivers/dev.h"
+#include "drivers/ramdisk.h"
+#include "mm/page.h"
+
+// More than BIO_MAX_MERGE, so that the synchronous operations split the
+// transfer into several batches
+#define RAMDISKTEST_BLOCKS (BIO_MAX_MERGE + 4)
+
+static blockdev_t *ramdisktest_bdev;
+static size_t ramdisktest_nblocks;
+
+static long ramdisktest_filled(const char *block, char c)
+{
+    return block[0] == c && !memcmp(block, block + 1, BLOCK_SIZE - 1);
+}
+
+long test_ramdisk_size()
+{
+    test_assert(ramdisktest_nblocks == __RAMDISK_BLOCKS__,
+                "RAM disk has %lu blocks", ramdisktest_nblocks);
+
+    blockdev_t *disk = blockdev_lookup(MKDEVID(DISK_MAJOR, 0));
+    if (disk)
+    {
+        test_assert(!ramdisk_nblocks(disk), "disk0 taken for a RAM disk");
+    }
+    return 0;
+}
+
+// A block that was never written reads as zeroes
+long test_ramdisk_zero()
+{
+    ramdisk_t *rd = CONTAINER_OF(ramdisktest_bdev, ramdisk_t, rd_bdev);
+    blocknum_t loc = ramdisktest_nblocks;
+    while (loc-- && rd->rd_pages[loc])
+        ;
+    if (loc >= ramdisktest_nblocks)
+    {
+        dbg(DBG_TEST, "every block has been written, skipping\n");
+        return 0;
+    }
+
+    char *buf = page_alloc();
+    KASSERT(buf && "Unable to allocate a page");
+    memset(buf, 'z', BLOCK_SIZE);
+    long ret = ramdisktest_bdev->bd_ops->read_block(ramdisktest_bdev, buf, loc,
+                                                    1);
+    test_assert(!ret, "read of unwritten block %u returned %ld", loc, ret);
+    test_assert(ramdisktest_filled(buf, 0),
+                "unwritten block %u did not read as zeroes", loc);
+    test_assert(!rd->rd_pages[loc], "reading block %u allocated its page",
+                loc);
+
+    page_free(buf);
+    return 0;
+}
+
+long test_ramdisk_rw()
+{
+    blocknum_t loc = ramdisktest_nblocks - RAMDISKTEST_BLOCKS;
+    char *buf = page_alloc_n(RAMDISKTEST_BLOCKS);
+    char *back = page_alloc_n(RAMDISKTEST_BLOCKS);
+    KASSERT(buf && back && "Unable to allocate pages");
+    for (size_t i = 0; i < RAMDISKTEST_BLOCKS; i++)
+    {
+        memset(buf + i * BLOCK_SIZE, 'a' + (int)i, BLOCK_SIZE);
+    }
+
+    blockdev_ops_t *ops = ramdisktest_bdev->bd_ops;
+    long ret = ops->write_block(ramdisktest_bdev, buf, loc, RAMDISKTEST_BLOCKS);
+    test_assert(!ret, "write of %d blocks returned %ld", RAMDISKTEST_BLOCKS,
+                ret);
+    ret = ops->read_block(ramdisktest_bdev, back, loc, RAMDISKTEST_BLOCKS);
+    test_assert(!ret, "read of %d blocks returned %ld", RAMDISKTEST_BLOCKS,
+                ret);
+    test_assert(!memcmp(buf, back, RAMDISKTEST_BLOCKS * BLOCK_SIZE),
+                "read back the wrong data");
+
+    page_free_n(buf, RAMDISKTEST_BLOCKS);
+    page_free_n(back, RAMDISKTEST_BLOCKS);
+    return 0;
+}
+
+long test_ramdisk_range()
+{
+    char *buf = page_alloc_n(2);
+    KASSERT(buf && "Unable to allocate pages");
+    blockdev_ops_t *ops = ramdisktest_bdev->bd_ops;
+
+    long ret = ops->read_block(ramdisktest_bdev, buf, ramdisktest_nblocks, 1);
+    test_assert(ret == -EINVAL, "read past the end returned %ld", ret);
+    ret = ops->write_block(ramdisktest_bdev, buf, ramdisktest_nblocks - 1, 2);
+    test_assert(ret == -EINVAL, "write across the end returned %ld", ret);
+
+    void *pages[] = {buf};
+    bio_t bio;
+    bio_init_request(&bio, ramdisktest_bdev, BIO_READ, ramdisktest_nblocks, 1,
+                     pages);
+    bio_submit(&bio);
+    ret = bio_wait(&bio);
+    test_assert(ret == -EINVAL, "request past the end returned %ld", ret);
+
+    page_free_n(buf, 2);
+    return 0;
+}
+
+// Requests are carried out before bio_submit() returns
+long test_ramdisk_bio()
+{
+    blocknum_t loc = ramdisktest_nblocks - 2;
+    char *buf = page_alloc();
+    char *back = page_alloc();
+    KASSERT(buf && back && "Unable to allocate pages");
+    memset(buf, 'q', BLOCK_SIZE);
+    memset(back, 'r', BLOCK_SIZE);
+
+    // One page per block, which need not be adjacent
+    void *pages[] = {buf, back};
+    bio_t bio;
+    bio_init_request(&bio, ramdisktest_bdev, BIO_WRITE, loc, 2, pages);
+    bio_submit(&bio);
+    test_assert(bio.bio_complete, "write not complete after bio_submit()");
+    test_assert(!bio_wait(&bio), "write returned %ld", bio.bio_error);
+
+    memset(buf, 0, BLOCK_SIZE);
+    memset(back, 0, BLOCK_SIZE);
+    bio_init_request(&bio, ramdisktest_bdev, BIO_READ, loc, 2, pages);
+    bio_submit(&bio);
+    test_assert(bio.bio_complete, "read not complete after bio_submit()");
+    test_assert(!bio_wait(&bio), "read returned %ld", bio.bio_error);
+    test_assert(ramdisktest_filled(buf, 'q') && ramdisktest_filled(back, 'r'),
+                "read back the wrong data");
+
+    page_free(buf);
+    page_free(back);
+    return 0;
+}
+
+long ramdisktest_main(long arg1, void *arg2)
+{
+    dbg(DBG_TEST, "\nStarting RAM disk tests\n");
+    test_init();
+
+    ramdisktest_bdev = blockdev_lookup(MKDEVID(RAMDISK_MAJOR, 0));
+    if (!ramdisktest_bdev)
+    {
+        dbg(DBG_TEST, "no RAM disk, skipping\n");
+        test_fini();
+        return 0;
+    }
+    ramdisktest_nblocks = ramdisk_nblocks(ramdisktest_bdev);
+
+    // Save the blocks the tests write to
+    blocknum_t saved_loc = ramdisktest_nblocks - RAMDISKTEST_BLOCKS;
+    char *saved = page_alloc_n(RAMDISKTEST_BLOCKS);
+    KASSERT(saved && "Unable to allocate pages");
+    long ret = ramdisktest_bdev->bd_ops->read_block(ramdisktest_bdev, saved,
+                                                    saved_loc,
+                                                    RAMDISKTEST_BLOCKS);
+    KASSERT(!ret);
+
+    test_ramdisk_size();
+    test_ramdisk_zero();
+    test_ramdisk_rw();
+    test_ramdisk_range();
+    test_ramdisk_bio();
+
+    ret = ramdisktest_bdev->bd_ops->write_block(ramdisktest_bdev, saved,
+                                                saved_loc, RAMDISKTEST_BLOCKS);
+    KASSERT(!ret);
+    page_free_n(saved, RAMDISKTEST_BLOCKS);
+
+    test_fini();
+    return 0;
+}
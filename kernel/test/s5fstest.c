@@ -220,6 +220,110 @@ static int test_sparseness_indirect_blocks()
     return 0;
 }
 
+// Write n bytes of c at pos
+static long fill_range(int fd, off_t pos, size_t n, char c)
+{
+    char buf[BUFSIZE];
+    memset(buf, c, sizeof(buf));
+    if (do_lseek(fd, pos, SEEK_SET) != pos)
+    {
+        return 0;
+    }
+    for (size_t done = 0; done < n;)
+    {
+        long res = do_write(fd, buf, MIN(BUFSIZE, n - done));
+        if (res <= 0)
+        {
+            return 0;
+        }
+        done += res;
+    }
+    return 1;
+}
+
+// Check that the n bytes at pos are all c
+static long range_is(int fd, off_t pos, size_t n, char c)
+{
+    char buf[BUFSIZE];
+    if (do_lseek(fd, pos, SEEK_SET) != pos)
+    {
+        return 0;
+    }
+    for (size_t done = 0; done < n;)
+    {
+        long res = do_read(fd, buf, MIN(BUFSIZE, n - done));
+        if (res <= 0)
+        {
+            return 0;
+        }
+        for (long i = 0; i < res; i++)
+        {
+            if (buf[i] != c)
+            {
+                dbg(DBG_TESTFAIL, "byte %lu is %d, not %d\n", pos + done + i,
+                    buf[i], c);
+                return 0;
+            }
+        }
+        done += res;
+    }
+    return 1;
+}
+
+// Clone a file and make sure writes to either copy don't show in the other.
+static void test_clone_file_range()
+{
+    const size_t len = 3 * S5_BLOCK_SIZE + 100;
+    int src = (int)do_open("clonesrc", O_RDWR | O_CREAT);
+    int dst = (int)do_open("clonedst", O_RDWR | O_CREAT);
+    test_assert(src >= 0 && dst >= 0, "couldnt create files");
+    for (size_t i = 0; i < 4; i++)
+    {
+        test_assert(fill_range(src, i * S5_BLOCK_SIZE,
+                               MIN(S5_BLOCK_SIZE, len - i * S5_BLOCK_SIZE),
+                               (char)('a' + i)),
+                    "couldnt write source");
+    }
+
+    test_assert(do_clone_file_range(src, 1, dst, 0, 0) == -EINVAL,
+                "cloned from an unaligned offset");
+    test_assert(do_clone_file_range(src, 0, src, S5_BLOCK_SIZE,
+                                    2 * S5_BLOCK_SIZE) == -EINVAL,
+                "cloned overlapping ranges");
+    test_assert(do_clone_file_range(src, 0, dst, 0, 0) == 0,
+                "couldnt clone file");
+    test_assert(do_lseek(dst, 0, SEEK_END) == (off_t)len,
+                "clone has the wrong size");
+    for (size_t i = 0; i < 4; i++)
+    {
+        test_assert(range_is(dst, i * S5_BLOCK_SIZE,
+                             MIN(S5_BLOCK_SIZE, len - i * S5_BLOCK_SIZE),
+                             (char)('a' + i)),
+                    "clone has the wrong contents");
+    }
+
+    // writes break the sharing of just the blocks written to
+    test_assert(fill_range(src, S5_BLOCK_SIZE + 10, 10, 'x'),
+                "couldnt write source");
+    test_assert(fill_range(dst, 10, 10, 'y'), "couldnt write clone");
+    test_assert(range_is(dst, S5_BLOCK_SIZE, S5_BLOCK_SIZE, 'b'),
+                "write to source showed in clone");
+    test_assert(range_is(src, 0, 10, 'a') && range_is(src, 10, 10, 'a'),
+                "write to clone showed in source");
+    test_assert(range_is(src, S5_BLOCK_SIZE + 10, 10, 'x') &&
+                    range_is(dst, 10, 10, 'y'),
+                "writes got lost");
+
+    // the clone keeps the blocks it shares after the source is gone
+    test_assert(do_close(src) == 0, "couldnt close source");
+    test_assert(do_unlink("clonesrc") == 0, "couldnt unlink source");
+    test_assert(range_is(dst, 2 * S5_BLOCK_SIZE, S5_BLOCK_SIZE, 'c'),
+                "clone lost its contents");
+
+    test_assert(do_close(dst) == 0, "couldnt close clone");
+    test_assert(do_unlink("clonedst") == 0, "couldnt unlink clone");
+}
+
 long s5fstest_main(int arg0, void *arg1)
 {
     dbg(DBG_TEST, "\nStarting S5FS test\n");
@@ -234,6 +338,8 @@ long s5fstest_main(int arg0, void *arg1)
     test_sparseness_direct_blocks();
     dbg(DBG_TEST, "Testing sparseness for indirect blocks\n");
     test_sparseness_indirect_blocks();
+    dbg(DBG_TEST, "Testing cloning files\n");
+    test_clone_file_range();
 
     dbg(DBG_TEST, "Testing running out of inodes\n");
     test_running_out_of_inodes();
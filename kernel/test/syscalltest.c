@@ -0,0 +1,415 @@
+//
+// Tests ring_enter and multicall, which batch other system calls. The test
+// traps into them from the kernel the way userland does, with their arguments
+// in a page of user memory mapped into the test process, and checks the
+// results copied back.
+//
+
+#include "errno.h"
+#include "globals.h"
+
+#include "test/usertest.h"
+
+#include "util/debug.h"
+#include "util/string.h"
+
+#include "api/access.h"
+#include "api/syscall.h"
+#include "fs/fcntl.h"
+#include "fs/stat.h"
+#include "fs/vfs_syscall.h"
+#include "mm/mm.h"
+#include "mm/mman.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+#include "vm/mmap.h"
+
+#define SYSCALLTEST_FILE "syscalltest"
+#define SYSCALLTEST_RING 4
+#define SYSCALLTEST_DIR "syscalltest_dir"
+#define SYSCALLTEST_CALLS 4
+#define SYSCALLTEST_UNRUN 0x5a5a // ret of a multicall entry that did not run
+
+// Everything the calls read and write, laid out in the user page
+typedef struct syscalltest_area
+{
+    ring_enter_args_t ring_args;
+    io_ring_t ring;
+    io_sqe_t sqes[SYSCALLTEST_RING];
+    io_cqe_t cqes[SYSCALLTEST_RING];
+    char path[sizeof(SYSCALLTEST_FILE)];
+    char data[64];
+    char back[64];
+    stat_t stat;
+    multicall_args_t mc_args;
+    multicall_entry_t calls[SYSCALLTEST_CALLS];
+    usleep_args_t usleep_args;
+    mkdir_args_t mkdir_args;
+    char dir[sizeof(SYSCALLTEST_DIR)];
+} syscalltest_area_t;
+
+// The user page, and the kernel's copy of it that the tests fill in
+static syscalltest_area_t *syscalltest_user;
+static syscalltest_area_t syscalltest_area;
+
+// Make a system call through the syscall interrupt, as userland would
+static long syscalltest_trap(int sysnum, void *args)
+{
+    long ret;
+    __asm__ volatile("int %1"
+                     : "=a"(ret)
+                     : "i"(INTR_SYSCALL), "a"((long)sysnum), "d"(args)
+                     : "memory");
+    return ret;
+}
+
+static void syscalltest_copy_out()
+{
+    long ret = copy_to_user(syscalltest_user, &syscalltest_area,
+                            sizeof(syscalltest_area));
+    KASSERT(!ret);
+}
+
+static void syscalltest_copy_in()
+{
+    long ret = copy_from_user(&syscalltest_area, syscalltest_user,
+                              sizeof(syscalltest_area));
+    KASSERT(!ret);
+}
+
+// Set up an empty ring, with entries in the user page unless cqes says
+// otherwise
+static void ring_reset(io_cqe_t *cqes)
+{
+    syscalltest_area_t *a = &syscalltest_area;
+    memset(&a->ring, 0, sizeof(a->ring));
+    memset(a->sqes, 0, sizeof(a->sqes));
+    memset(a->cqes, 0, sizeof(a->cqes));
+    a->ring.sq_entries = a->ring.cq_entries = SYSCALLTEST_RING;
+    a->ring.sqes = syscalltest_user->sqes;
+    a->ring.cqes = cqes ? cqes : syscalltest_user->cqes;
+    a->ring_args.ring = &syscalltest_user->ring;
+}
+
+// Queue an entry on the ring
+static io_sqe_t *ring_push(int opcode, int fd, uint64_t user_data)
+{
+    io_ring_t *ring = &syscalltest_area.ring;
+    io_sqe_t *sqe =
+        &syscalltest_area.sqes[ring->sq_tail++ % SYSCALLTEST_RING];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = -1;
+    sqe->user_data = user_data;
+    return sqe;
+}
+
+// Submit to_submit entries, and return what ring_enter returned
+static long ring_enter(unsigned int to_submit)
+{
+    syscalltest_area.ring_args.to_submit = to_submit;
+    syscalltest_copy_out();
+    long ret = syscalltest_trap(SYS_ring_enter, &syscalltest_user->ring_args);
+    syscalltest_copy_in();
+    return ret;
+}
+
+static long ring_cqe_is(uint32_t i, uint64_t user_data, long res)
+{
+    io_cqe_t *cqe = &syscalltest_area.cqes[i % SYSCALLTEST_RING];
+    return cqe->user_data == user_data && cqe->res == res;
+}
+
+long test_ring_file()
+{
+    syscalltest_area_t *a = &syscalltest_area;
+    io_ring_t *ring = &a->ring;
+    ring_reset(NULL);
+    memcpy(a->path, SYSCALLTEST_FILE, sizeof(a->path));
+    io_sqe_t *sqe = ring_push(IORING_OP_OPEN, 0, 1);
+    sqe->addr = syscalltest_user->path;
+    sqe->len = strlen(SYSCALLTEST_FILE);
+    sqe->flags = O_RDWR | O_CREAT | O_TRUNC;
+    long ret = ring_enter(1);
+    test_assert(ret == 1, "ring_enter returned %ld", ret);
+    long fd = a->cqes[0].res;
+    test_assert(fd >= 0 && a->cqes[0].user_data == 1, "open returned %ld",
+                fd);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    // Start at the last entry of the queues, so that the entries wrap around
+    ring_reset(NULL);
+    ring->sq_head = ring->sq_tail = ring->cq_head = ring->cq_tail = 3;
+    memset(a->data, 'r', sizeof(a->data));
+    sqe = ring_push(IORING_OP_WRITE, fd, 2);
+    sqe->addr = syscalltest_user->data;
+    sqe->len = sizeof(a->data);
+    sqe = ring_push(IORING_OP_READ, fd, 3);
+    sqe->addr = syscalltest_user->back;
+    sqe->len = sizeof(a->back);
+    sqe->off = 0;
+    sqe = ring_push(IORING_OP_STAT, 0, 4);
+    sqe->addr = syscalltest_user->path;
+    sqe->len = strlen(SYSCALLTEST_FILE);
+    sqe->buf = &syscalltest_user->stat;
+    ring_push(IORING_OP_CLOSE, fd, 5);
+    ret = ring_enter(4);
+    test_assert(ret == 4, "ring_enter returned %ld", ret);
+    test_assert(ring->sq_head == 7 && ring->cq_tail == 7,
+                "ring advanced to sq_head %u, cq_tail %u", ring->sq_head,
+                ring->cq_tail);
+    test_assert(ring_cqe_is(3, 2, sizeof(a->data)), "write returned %ld",
+                a->cqes[3].res);
+    test_assert(ring_cqe_is(4, 3, sizeof(a->back)), "read returned %ld",
+                a->cqes[0].res);
+    test_assert(!memcmp(a->data, a->back, sizeof(a->data)),
+                "read back the wrong data");
+    test_assert(ring_cqe_is(5, 4, 0) && a->stat.st_size == sizeof(a->data),
+                "stat returned %ld", a->cqes[1].res);
+    test_assert(ring_cqe_is(6, 5, 0), "close returned %ld", a->cqes[2].res);
+
+    do_unlink(SYSCALLTEST_FILE);
+    return 0;
+}
+
+long test_ring_errors()
+{
+    syscalltest_area_t *a = &syscalltest_area;
+    io_ring_t *ring = &a->ring;
+
+    ring_reset(NULL);
+    ring->sq_entries = 3;
+    ring_push(IORING_OP_NOP, 0, 0);
+    long ret = ring_enter(1);
+    test_assert(ret == -1 && curthr->kt_errno == EINVAL,
+                "ring of 3 entries returned %ld, errno %ld", ret,
+                curthr->kt_errno);
+
+    ret = syscalltest_trap(SYS_ring_enter, (void *)USER_MEM_LOW);
+    test_assert(ret == -1 && curthr->kt_errno == EFAULT,
+                "unmapped arguments returned %ld, errno %ld", ret,
+                curthr->kt_errno);
+
+    // A failed entry still completes
+    ring_reset(NULL);
+    ring_push(-1, 0, 1);
+    io_sqe_t *sqe = ring_push(IORING_OP_READ, 0, 2);
+    sqe->addr = (void *)USER_MEM_LOW;
+    sqe->len = 1;
+    sqe->fd = -1;
+    ring_push(IORING_OP_CLOSE, -1, 3);
+    ret = ring_enter(3);
+    test_assert(ret == 3, "ring_enter returned %ld", ret);
+    test_assert(ring_cqe_is(0, 1, -EINVAL), "unknown opcode returned %ld",
+                a->cqes[0].res);
+    test_assert(ring_cqe_is(1, 2, -EBADF), "read of a bad fd returned %ld",
+                a->cqes[1].res);
+    test_assert(ring_cqe_is(2, 3, -EBADF), "close of a bad fd returned %ld",
+                a->cqes[2].res);
+
+    // Nothing runs while the completion queue is full
+    ring_reset(NULL);
+    ring->cq_tail = SYSCALLTEST_RING;
+    ring_push(IORING_OP_NOP, 0, 0);
+    ret = ring_enter(1);
+    test_assert(ret == 0 && ring->sq_head == 0,
+                "full completion queue returned %ld", ret);
+
+    // Entries whose completions cannot be copied out are still consumed, so
+    // that they never run twice
+    ring_reset((io_cqe_t *)USER_MEM_LOW);
+    ring_push(IORING_OP_NOP, 0, 0);
+    ring_push(IORING_OP_NOP, 0, 0);
+    ret = ring_enter(2);
+    test_assert(ret == 2, "ring_enter returned %ld", ret);
+    test_assert(ring->sq_head == 2 && ring->cq_tail == 2,
+                "ring advanced to sq_head %u, cq_tail %u", ring->sq_head,
+                ring->cq_tail);
+    return 0;
+}
+
+// Queue a call for multicall_run()
+static void multicall_push(int sysnum, void *args)
+{
+    multicall_args_t *mc_args = &syscalltest_area.mc_args;
+    KASSERT(mc_args->ncalls < SYSCALLTEST_CALLS);
+    multicall_entry_t *call = &syscalltest_area.calls[mc_args->ncalls++];
+    call->sysnum = sysnum;
+    call->args = args;
+    call->ret = SYSCALLTEST_UNRUN;
+}
+
+// Run the queued calls, and return what multicall returned
+static long multicall_run(int flags)
+{
+    multicall_args_t *mc_args = &syscalltest_area.mc_args;
+    mc_args->calls = syscalltest_user->calls;
+    mc_args->flags = flags;
+    syscalltest_copy_out();
+    long ret = syscalltest_trap(SYS_multicall, &syscalltest_user->mc_args);
+    syscalltest_copy_in();
+    mc_args->ncalls = 0;
+    return ret;
+}
+
+// A failed call sets errno, which later calls see and which is left as the
+// last failure set it
+long test_multicall_errno()
+{
+    multicall_entry_t *calls = syscalltest_area.calls;
+    curthr->kt_errno = 0;
+    multicall_push(SYS_close, (void *)-1);
+    multicall_push(SYS_errno, NULL);
+    multicall_push(SYS_getpid, NULL);
+    long ret = multicall_run(MULTICALL_CONTINUE);
+    test_assert(ret == 3, "multicall returned %ld", ret);
+    test_assert(calls[0].ret == -EBADF, "close of a bad fd returned %ld",
+                calls[0].ret);
+    test_assert(calls[1].ret == EBADF, "errno after a failed call is %ld",
+                calls[1].ret);
+    test_assert(calls[2].ret == curproc->p_pid, "getpid returned %ld",
+                calls[2].ret);
+    test_assert(curthr->kt_errno == EBADF,
+                "errno after the batch is %ld, not the failed call's",
+                curthr->kt_errno);
+
+    // Without MULTICALL_CONTINUE the batch stops at the failed call
+    curthr->kt_errno = 0;
+    multicall_push(SYS_getpid, NULL);
+    multicall_push(SYS_close, (void *)-1);
+    multicall_push(SYS_getpid, NULL);
+    ret = multicall_run(0);
+    test_assert(ret == 2, "multicall returned %ld", ret);
+    test_assert(calls[1].ret == -EBADF && calls[2].ret == SYSCALLTEST_UNRUN,
+                "batch did not stop at the failed call");
+    test_assert(curthr->kt_errno == EBADF, "errno after the batch is %ld",
+                curthr->kt_errno);
+    return 0;
+}
+
+long test_multicall_errors()
+{
+    multicall_entry_t *calls = syscalltest_area.calls;
+    multicall_args_t *mc_args = &syscalltest_area.mc_args;
+
+    mc_args->ncalls = MULTICALL_MAX + 1;
+    long ret = multicall_run(0);
+    test_assert(ret == -1 && curthr->kt_errno == EINVAL,
+                "%d calls returned %ld, errno %ld", MULTICALL_MAX + 1, ret,
+                curthr->kt_errno);
+    multicall_push(SYS_getpid, NULL);
+    ret = multicall_run(~MULTICALL_CONTINUE);
+    test_assert(ret == -1 && curthr->kt_errno == EINVAL,
+                "unknown flags returned %ld, errno %ld", ret,
+                curthr->kt_errno);
+    ret = multicall_run(0);
+    test_assert(ret == 0, "empty batch returned %ld", ret);
+    ret = syscalltest_trap(SYS_multicall, (void *)USER_MEM_LOW);
+    test_assert(ret == -1 && curthr->kt_errno == EFAULT,
+                "unmapped arguments returned %ld, errno %ld", ret,
+                curthr->kt_errno);
+
+    // Calls that do not return the usual way are refused, not run
+    multicall_push(SYS_exit, NULL);
+    multicall_push(SYS_multicall, NULL);
+    multicall_push(SYS_getpid, NULL);
+    ret = multicall_run(MULTICALL_CONTINUE);
+    test_assert(ret == 3, "multicall returned %ld", ret);
+    test_assert(calls[0].ret == -EINVAL && calls[1].ret == -EINVAL,
+                "exit and multicall returned %ld and %ld", calls[0].ret,
+                calls[1].ret);
+    test_assert(calls[2].ret == curproc->p_pid, "getpid returned %ld",
+                calls[2].ret);
+    return 0;
+}
+
+static long multicall_sleeping;
+
+/*
+ * Sleep, then make a directory, in one batch. The page is mapped at the same
+ * address as the test's, so the helpers above work unchanged while the test
+ * waits for this process.
+ */
+static void *multicall_sleeper(long arg1, void *arg2)
+{
+    if (do_mmap(syscalltest_user, sizeof(syscalltest_area_t),
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1,
+                0, NULL))
+    {
+        multicall_sleeping = -1;
+        return NULL;
+    }
+    syscalltest_area_t *a = &syscalltest_area;
+    memcpy(a->dir, SYSCALLTEST_DIR, sizeof(a->dir));
+    a->mkdir_args.path.as_str = syscalltest_user->dir;
+    a->mkdir_args.path.as_len = strlen(SYSCALLTEST_DIR);
+    a->usleep_args.usec = 1000000;
+    multicall_push(SYS_usleep, &syscalltest_user->usleep_args);
+    multicall_push(SYS_mkdir, &syscalltest_user->mkdir_args);
+
+    // The page is mapped once it has been written, so nothing blocks
+    // between here and the sleep
+    syscalltest_copy_out();
+    multicall_sleeping = 1;
+    multicall_run(MULTICALL_CONTINUE);
+    return NULL;
+}
+
+// A cancelled thread stops before the next call of its batch
+long test_multicall_cancel()
+{
+    multicall_sleeping = 0;
+    proc_t *proc = proc_create("syscalltest");
+    KASSERT(proc);
+    kthread_t *thr = kthread_create(proc, multicall_sleeper, 0, NULL);
+    KASSERT(thr);
+    sched_make_runnable(thr);
+    while (!multicall_sleeping)
+    {
+        sched_yield();
+    }
+    kthread_cancel(thr, NULL);
+    while (do_waitpid(-1, NULL, 0) != -ECHILD)
+        ;
+    syscalltest_area.mc_args.ncalls = 0;
+
+    test_assert(multicall_sleeping == 1, "unable to map the sleeper's page");
+    stat_t stat;
+    long ret = do_stat(SYSCALLTEST_DIR, &stat);
+    test_assert(ret == -ENOENT, "call after the cancellation ran");
+    if (!ret)
+    {
+        do_rmdir(SYSCALLTEST_DIR);
+    }
+    return 0;
+}
+
+long syscalltest_main(long arg1, void *arg2)
+{
+    dbg(DBG_TEST, "\nStarting batched system call tests\n");
+    test_init();
+
+    void *addr;
+    long ret = do_mmap(NULL, sizeof(syscalltest_area_t),
+                       PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0,
+                       &addr);
+    test_assert(!ret, "mmap returned %ld", ret);
+    if (!ret)
+    {
+        syscalltest_user = addr;
+        test_ring_file();
+        test_ring_errors();
+        test_multicall_errno();
+        test_multicall_errors();
+        test_multicall_cancel();
+        do_munmap(addr, sizeof(syscalltest_area_t));
+    }
+
+    test_fini();
+    return 0;
+}
@@ -12,12 +12,15 @@
 
 #include "proc/kthread.h"
 #include "proc/proc.h"
+#include "proc/sched.h"
 
 #include "fs/dirent.h"
 #include "fs/fcntl.h"
+#include "fs/file.h"
 #include "fs/lseek.h"
 #include "fs/stat.h"
 #include "fs/vfs_syscall.h"
+#include "fs/vnode.h"
 #include "mm/kmalloc.h"
 #include "mm/mman.h"
 
@@ -671,6 +674,92 @@ static void vfstest_write(void)
     syscall_success(rmdir("write"));
 }
 
+#ifdef __KERNEL__
+/* set by vfstest_locker() once it holds the vnode */
+static int vfstest_locked;
+
+/* Lock the vnode arg2 exclusively if arg1 is set, else shared, and let go. */
+static void *vfstest_locker(long arg1, void *arg2)
+{
+    vnode_t *vn = arg2;
+    if (arg1)
+    {
+        vlock(vn);
+    }
+    else
+    {
+        vlock_shared(vn);
+    }
+    vfstest_locked = 1;
+    if (arg1)
+    {
+        vunlock(vn);
+    }
+    else
+    {
+        vunlock_shared(vn);
+    }
+    return NULL;
+}
+
+/*
+ * Start vfstest_locker() on vn in a process of its own and let it run until
+ * it is done or blocks. Returns whether it got the lock.
+ */
+static int vfstest_try_lock(vnode_t *vn, long exclusive)
+{
+    vfstest_locked = 0;
+    proc_t *proc = proc_create("vfstest_locker");
+    KASSERT(proc && "Unable to create a process");
+    kthread_t *thr = kthread_create(proc, vfstest_locker, exclusive, vn);
+    KASSERT(thr && "Unable to create a thread");
+    sched_make_runnable(thr);
+    sched_yield();
+    return vfstest_locked;
+}
+
+/*
+ * Tests the vnode locks that reads (vlock_shared) and writes (vlock) take
+ *      - Readers share a vnode
+ *      - A writer waits for the readers, and readers wait for a writer
+ *      - Whoever waited gets the vnode once it is let go
+ */
+static void vfstest_rwlock(void)
+{
+    int fd, status;
+
+    syscall_success(mkdir("rwlock", 0));
+    syscall_success(chdir("rwlock"));
+    create_file("file");
+    syscall_success(fd = open("file", O_RDWR, 0));
+    vnode_t *vn = curproc->p_files[fd]->f_vnode;
+
+    vlock_shared(vn);
+    test_assert(vfstest_try_lock(vn, 0), "a reader waited for another reader");
+    test_assert(0 < do_waitpid(-1, &status, 0), "reader did not exit");
+    test_assert(!vfstest_try_lock(vn, 1), "a writer did not wait for a reader");
+    vunlock_shared(vn);
+    test_assert(0 < do_waitpid(-1, &status, 0), "writer did not exit");
+    test_assert(vfstest_locked, "writer never got the vnode");
+
+    vlock(vn);
+    test_assert(!vfstest_try_lock(vn, 0), "a reader did not wait for a writer");
+    vunlock(vn);
+    test_assert(0 < do_waitpid(-1, &status, 0), "reader did not exit");
+    test_assert(vfstest_locked, "reader never got the vnode");
+
+    /* the file is still usable by both kinds of access */
+    syscall_success(write(fd, SHORTSTR, strlen(SHORTSTR)));
+    syscall_success(lseek(fd, 0, SEEK_SET));
+    read_fd(fd, strlen(SHORTSTR), SHORTSTR);
+
+    syscall_success(close(fd));
+    syscall_success(unlink("file"));
+    syscall_success(chdir(".."));
+    syscall_success(rmdir("rwlock"));
+}
+#endif
+
 /* These operations should run for a long time and halt when the file
  * descriptor overflows. */
 static void vfstest_infinite(void)
@@ -695,6 +784,52 @@ static void vfstest_infinite(void)
     syscall_success(close(fd));
 }
 
+/*
+ * Tests openat(), mkdirat(), fstatat(), unlinkat() and renameat()
+ *      - Relative paths start at dirfd, or at the cwd for AT_FDCWD
+ *      - dirfd must be a valid file descriptor of a directory
+ *      - unlinkat() removes directories only with AT_REMOVEDIR
+ */
+static void vfstest_at(void)
+{
+    int dirfd, fd;
+    stat_t s;
+
+    syscall_success(mkdir("at", 0777));
+    syscall_success(dirfd = open("at", O_RDONLY, 0));
+
+    /* paths are relative to dirfd */
+    syscall_success(mkdirat(dirfd, "dir", 0777));
+    syscall_success(fd = openat(dirfd, "dir/file", O_RDWR | O_CREAT, 0));
+    syscall_success(write(fd, "foobar", 6));
+    syscall_success(close(fd));
+    syscall_success(fstatat(dirfd, "dir/file", &s, 0));
+    test_assert(s.st_size == 6, "unexpected file size");
+    syscall_success(stat("at/dir/file", &s));
+    test_assert(s.st_size == 6, "unexpected file size");
+
+    /* or to the cwd for AT_FDCWD */
+    syscall_success(renameat(dirfd, "dir/file", AT_FDCWD, "at/file"));
+    syscall_fail(fstatat(dirfd, "dir/file", &s, 0), ENOENT);
+    syscall_success(fstatat(AT_FDCWD, "at/file", &s, 0));
+    test_assert(S_ISREG(s.st_mode), NULL);
+
+    /* error cases */
+    syscall_success(fd = openat(dirfd, "file", O_RDONLY, 0));
+    syscall_fail(openat(fd, "file", O_RDONLY, 0), ENOTDIR);
+    syscall_fail(mkdirat(fd, "dir", 0777), ENOTDIR);
+    syscall_success(close(fd));
+    syscall_fail(fstatat(BAD_FD, "file", &s, 0), EBADF);
+    syscall_fail(unlinkat(BAD_FD, "file", 0), EBADF);
+    syscall_fail(unlinkat(dirfd, "dir", 0), EPERM);
+    syscall_fail(unlinkat(dirfd, "file", AT_REMOVEDIR), ENOTDIR);
+
+    syscall_success(unlinkat(dirfd, "file", 0));
+    syscall_success(unlinkat(dirfd, "dir", AT_REMOVEDIR));
+    syscall_success(close(dirfd));
+    syscall_success(rmdir("at"));
+}
+
 /*
  * Tests open(), close(), and unlink()
  *      - Accepts only valid combinations of flags
@@ -1152,6 +1287,7 @@ int vfstest_main(int argc, char **argv)
     vfstest_stat();
     vfstest_chdir();
     vfstest_mkdir();
+    vfstest_at();
     vfstest_paths();
     vfstest_fd();
     vfstest_open();
@@ -1159,6 +1295,9 @@ int vfstest_main(int argc, char **argv)
     vfstest_getdents();
     vfstest_memdev();
     vfstest_write();
+#ifdef __KERNEL__
+    vfstest_rwlock();
+#endif
 
 #ifdef __VM__
     vfstest_s5fs_vm();
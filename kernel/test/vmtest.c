@@ -8,12 +8,25 @@
 #include "util/printf.h"
 #include "util/string.h"
 
+#include "api/access.h"
+#include "fs/fcntl.h"
+#include "fs/lseek.h"
+#include "fs/open.h"
+#include "fs/vfs_syscall.h"
 #include "mm/kmalloc.h"
 #include "mm/mm.h"
+#include "mm/mman.h"
 #include "mm/page.h"
+#include "mm/pframe.h"
 #include "mm/slab.h"
+#include "vm/anon.h"
+#include "vm/mmap.h"
+#include "vm/shadow.h"
 #include "vm/vmmap.h"
 
+/* more than enough objects to run into SHADOW_MAX_DEPTH a couple of times */
+#define SHADOW_TEST_DEPTH (3 * SHADOW_MAX_DEPTH)
+
 long test_vmmap()
 {
     vmmap_t *map = curproc->p_vmmap;
@@ -67,10 +80,227 @@ long test_vmmap()
     return 0;
 }
 
+// Fill page pagenum of the locked object o with c.
+static void shadow_test_write(mobj_t *o, size_t pagenum, char c)
+{
+    pframe_t *pf;
+    long ret = mobj_get_pframe(o, pagenum, 1, &pf);
+    test_assert(!ret, "mobj_get_pframe for writing returned %ld", ret);
+    if (!ret)
+    {
+        memset(pf->pf_addr, c, PAGE_SIZE);
+        pframe_release(&pf);
+    }
+}
+
+// Return 1 if every byte of page pagenum of the locked object o is c.
+static long shadow_test_page_is(mobj_t *o, size_t pagenum, char c)
+{
+    pframe_t *pf;
+    if (mobj_get_pframe(o, pagenum, 0, &pf))
+    {
+        return 0;
+    }
+    char *addr = pf->pf_addr;
+    long ret = addr[0] == c && !memcmp(addr, addr + 1, PAGE_SIZE - 1);
+    pframe_release(&pf);
+    return ret;
+}
+
+// Check the view of the i'th object built by test_shadow_chain(): page 0 was
+// last written by it, pages 1 to i by the objects below it, and the rest never.
+static long shadow_test_view_is(mobj_t *o, size_t i)
+{
+    if (!shadow_test_page_is(o, 0, (char)(i + 1)))
+    {
+        return 0;
+    }
+    for (size_t j = 1; j <= i; j++)
+    {
+        if (!shadow_test_page_is(o, j, (char)(j + 1)))
+        {
+            return 0;
+        }
+    }
+    return shadow_test_page_is(o, i + 1, 0);
+}
+
+long test_shadow_chain()
+{
+    // Build a chain the way repeated forks do, keeping every object alive so
+    // that nothing can be collapsed and shadow_create() has to flatten.
+    mobj_t *chain[SHADOW_TEST_DEPTH + 1];
+    chain[0] = anon_create();
+    KASSERT(chain[0] && "Unable to create the bottom object");
+    shadow_test_write(chain[0], 0, 1);
+    for (size_t i = 1; i <= SHADOW_TEST_DEPTH; i++)
+    {
+        chain[i] = shadow_create(chain[i - 1]);
+        KASSERT(chain[i] && "Unable to create a shadow object");
+        mobj_unlock(chain[i - 1]);
+        test_assert(shadow_depth(chain[i]) <= SHADOW_MAX_DEPTH,
+                    "chain of depth %lu exceeds the cap",
+                    shadow_depth(chain[i]));
+        shadow_test_write(chain[i], 0, (char)(i + 1));
+        shadow_test_write(chain[i], i, (char)(i + 1));
+    }
+
+    mobj_t *top = chain[SHADOW_TEST_DEPTH];
+    test_assert(shadow_test_view_is(top, SHADOW_TEST_DEPTH),
+                "top object lost pages while the chain was flattened");
+    mobj_unlock(top);
+    for (size_t i = 1; i < SHADOW_TEST_DEPTH; i++)
+    {
+        mobj_lock(chain[i]);
+        test_assert(shadow_test_view_is(chain[i], i),
+                    "object %lu lost pages while the chain was flattened", i);
+        mobj_unlock(chain[i]);
+    }
+
+    // Now only the top object holds the chain, so it can collapse completely.
+    for (size_t i = 0; i < SHADOW_TEST_DEPTH; i++)
+    {
+        mobj_put(&chain[i]);
+    }
+    mobj_lock(top);
+    shadow_collapse(top);
+    test_assert(shadow_depth(top) == 1, "chain of depth %lu after collapse",
+                shadow_depth(top));
+    test_assert(shadow_test_view_is(top, SHADOW_TEST_DEPTH),
+                "top object lost pages while the chain was collapsed");
+    mobj_put_locked(&top);
+
+    // A pframe left in the upper object by a failed fill must not hide the
+    // page below it when the chain collapses.
+    mobj_t *bottom = anon_create();
+    KASSERT(bottom && "Unable to create the bottom object");
+    mobj_t *lower = shadow_create(bottom);
+    KASSERT(lower && "Unable to create a shadow object");
+    mobj_put_locked(&bottom);
+    shadow_test_write(lower, 0, 'x');
+    mobj_t *upper = shadow_create(lower);
+    KASSERT(upper && "Unable to create a shadow object");
+    mobj_put_locked(&lower);
+
+    pframe_t *pf;
+    mobj_create_pframe(upper, 0, 0, &pf);
+    KASSERT(pf && "Unable to create a pframe");
+    pframe_release(&pf);
+    shadow_collapse(upper);
+    test_assert(shadow_depth(upper) == 1, "chain of depth %lu after collapse",
+                shadow_depth(upper));
+    test_assert(shadow_test_page_is(upper, 0, 'x'),
+                "placeholder pframe hid the collapsed object's page");
+    mobj_put_locked(&upper);
+
+    return 0;
+}
+
+#define MMAP_TEST_FILE "vmtest_mmap"
+
+// Write a page of c to fd at its current position.
+static long mmap_test_write(int fd, char c)
+{
+    char *page = page_alloc();
+    KASSERT(page && "Unable to allocate a page");
+    memset(page, c, PAGE_SIZE);
+    long ret = do_write(fd, page, PAGE_SIZE);
+    page_free(page);
+    return ret;
+}
+
+// Return 1 if every byte of the page mapped at uaddr is c.
+static long mmap_test_page_is(const void *uaddr, char c)
+{
+    char *page = page_alloc();
+    KASSERT(page && "Unable to allocate a page");
+    long ret = !copy_from_user(page, uaddr, PAGE_SIZE) && page[0] == c &&
+               !memcmp(page, page + 1, PAGE_SIZE - 1);
+    page_free(page);
+    return ret;
+}
+
+// A shared mapping, read() and write() all see the same page.
+long test_mmap_shared()
+{
+    long fd = do_open(MMAP_TEST_FILE, O_RDWR | O_CREAT | O_TRUNC);
+    KASSERT(fd >= 0);
+    test_assert(mmap_test_write(fd, 'a') == PAGE_SIZE, "write failed");
+
+    void *addr;
+    long ret = do_mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       0, &addr);
+    test_assert(!ret, "mmap returned %ld", ret);
+    if (ret)
+    {
+        do_close(fd);
+        return 0;
+    }
+    test_assert(mmap_test_page_is(addr, 'a'), "mapping missed earlier write");
+
+    char c = 'b';
+    ret = copy_to_user((char *)addr + PAGE_SIZE - 1, &c, 1);
+    test_assert(!ret, "store through the mapping returned %ld", ret);
+    do_lseek(fd, PAGE_SIZE - 1, SEEK_SET);
+    c = 0;
+    test_assert(do_read(fd, &c, 1) == 1 && c == 'b',
+                "read() missed a store through the mapping");
+
+    do_lseek(fd, 0, SEEK_SET);
+    test_assert(mmap_test_write(fd, 'c') == PAGE_SIZE, "write failed");
+    test_assert(mmap_test_page_is(addr, 'c'), "mapping missed a later write");
+
+    // Truncating frees the page, after which the mapping sees a hole
+    long fd2 = do_open(MMAP_TEST_FILE, O_RDWR | O_TRUNC);
+    KASSERT(fd2 >= 0);
+    do_close(fd2);
+    test_assert(mmap_test_page_is(addr, 0),
+                "mapping kept the page of a truncated file");
+
+    do_munmap(addr, PAGE_SIZE);
+    do_close(fd);
+    do_unlink(MMAP_TEST_FILE);
+    return 0;
+}
+
+// A private mapping of a hole maps the zero page, which must not outlive the
+// hole being written.
+long test_mmap_hole()
+{
+    long fd = do_open(MMAP_TEST_FILE, O_RDWR | O_CREAT | O_TRUNC);
+    KASSERT(fd >= 0);
+    // pages 0 and 1 are holes
+    do_lseek(fd, 2 * PAGE_SIZE, SEEK_SET);
+    test_assert(mmap_test_write(fd, 'd') == PAGE_SIZE, "write failed");
+
+    void *addr;
+    long ret = do_mmap(NULL, PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0, &addr);
+    test_assert(!ret, "mmap returned %ld", ret);
+    if (ret)
+    {
+        do_close(fd);
+        return 0;
+    }
+    test_assert(mmap_test_page_is(addr, 0), "hole not mapped as zeroes");
+
+    do_lseek(fd, 0, SEEK_SET);
+    test_assert(mmap_test_write(fd, 'e') == PAGE_SIZE, "write failed");
+    test_assert(mmap_test_page_is(addr, 'e'),
+                "private mapping still maps the zero page after a write");
+
+    do_munmap(addr, PAGE_SIZE);
+    do_close(fd);
+    do_unlink(MMAP_TEST_FILE);
+    return 0;
+}
+
 long vmtest_main(long arg1, void *arg2)
 {
     test_init();
     test_vmmap();
+    test_shadow_chain();
+    test_mmap_shared();
+    test_mmap_hole();
 
     // Write your own tests here!
 
@@ -1,14 +1,30 @@
 #include "util/time.h"
 #include "drivers/cmos.h"
+#include "errno.h"
 #include "main/apic.h"
+#include "main/cpuid.h"
 #include "proc/sched.h"
 #include "util/printf.h"
 #include "util/timer.h"
 #include <drivers/screen.h>
 
-#define TIME_APIC_TICK_FREQUENCY 16
-// this is pretty wrong...
-#define MICROSECONDS_PER_APIC_TICK (16 * 1000 / TIME_APIC_TICK_FREQUENCY)
+/* While a thread is running, its core takes a timer interrupt this often */
+#define TIME_TICK_NS 1000000UL
+/* An idle core with no timers due sleeps at most this long */
+#define TIME_MAX_IDLE_NS 1000000000UL
+
+/*
+ * The monotonic clock counts nanoseconds since time_init() using the TSC,
+ * converted with tsc_mult, the length of a TSC tick in nanoseconds as a
+ * 32.32 fixed-point number.
+ */
+static uint64_t tsc_base;
+static uint64_t tsc_mult;
+/* CLOCK_REALTIME minus CLOCK_MONOTONIC, from the RTC on first use */
+static uint64_t realtime_offset;
+
+/* When the current core's next timer interrupt is due, on the clock above */
+static uint64_t time_next_event CORE_SPECIFIC_DATA;
 
 volatile uint64_t jiffies;
 uint64_t timer_tickcount CORE_SPECIFIC_DATA;
@@ -17,7 +33,47 @@ uint64_t user_preempted_count CORE_SPECIFIC_DATA;
 uint64_t not_preempted_count CORE_SPECIFIC_DATA;
 uint64_t idle_count CORE_SPECIFIC_DATA;
 
-// (freq / 16) interrupts per millisecond
+uint64_t time_now_ns()
+{
+    uint64_t delta = rdtsc() - tsc_base;
+    return (uint64_t)(((unsigned __int128)delta * tsc_mult) >> 32);
+}
+
+/*
+ * Programs the current core's next timer interrupt: when its next timer
+ * expires, but no later than TIME_TICK_NS from now while a thread is running
+ * or TIME_MAX_IDLE_NS while the core is idle, so idle cores skip the ticks
+ * in between. Must be called with interrupts masked.
+ */
+static void time_program_next()
+{
+    uint64_t now = time_now_ns();
+    uint64_t limit = curthr ? TIME_TICK_NS : TIME_MAX_IDLE_NS;
+    uint64_t next = now + limit;
+
+    /* An expiry in the past belongs to a timer that could not run yet (see
+     * __timers_fire); the next tick retries it. */
+    uint64_t expiry = timer_next_expiry(limit / NSEC_PER_JIFFY + 1);
+    if (expiry != (uint64_t)-1 && expiry * NSEC_PER_JIFFY > now)
+    {
+        next = MIN(next, expiry * NSEC_PER_JIFFY);
+    }
+
+    time_next_event = next;
+    apic_set_oneshot_timer(next - now);
+}
+
+void time_timer_added(uint64_t expires)
+{
+    uint64_t when = expires * NSEC_PER_JIFFY;
+    if (when < time_next_event)
+    {
+        uint64_t now = time_now_ns();
+        time_next_event = when;
+        apic_set_oneshot_timer(when > now ? when - now : 0);
+    }
+}
+
 static long timer_tick_handler(regs_t *regs)
 {
     timer_tickcount++;
@@ -27,11 +83,9 @@ static long timer_tick_handler(regs_t *regs)
         screen_flush();
 #endif
 
-    if (curcore.kc_id == 0)
-    {
-        jiffies = timer_tickcount;
-        __timers_fire();
-    }
+    jiffies = time_now_ns() / NSEC_PER_JIFFY;
+    __timers_fire();
+    time_program_next();
 
 #ifdef __KPREEMPT__ // if (preemption_enabled()) {
     (regs->r_cs & 0x3) ? user_preempted_count++ : kernel_preempted_count++;
@@ -53,16 +107,29 @@ static long timer_tick_handler(regs_t *regs)
 void time_init()
 {
     timer_tickcount = 0;
+    if (!tsc_mult)
+    {
+        uint64_t tsc_freq = apic_tsc_frequency();
+        if (!tsc_freq)
+        {
+            panic("could not calibrate the TSC\n");
+        }
+        tsc_mult = (NSEC_PER_SEC << 32) / tsc_freq;
+        tsc_base = rdtsc();
+    }
+    timer_wheel_init();
     intr_register(INTR_APICTIMER, timer_tick_handler);
-    apic_enable_periodic_timer(TIME_APIC_TICK_FREQUENCY);
+
+    uint8_t ipl = intr_setipl(IPL_HIGH);
+    time_program_next();
+    intr_setipl(ipl);
 }
 
 void time_spin(uint64_t ms)
 {
-    uint64_t ticks_to_wait = ms * TIME_APIC_TICK_FREQUENCY / 16;
-    uint64_t target = timer_tickcount + ticks_to_wait;
-    dbg(DBG_SCHED, "spinning for %lu ms (%lu APIC ticks)\n", ms, ticks_to_wait);
-    while (timer_tickcount < target)
+    uint64_t target = time_now_ns() + ms * NSEC_PER_MSEC;
+    dbg(DBG_SCHED, "spinning for %lu ms\n", ms);
+    while (time_now_ns() < target)
         ;
 }
 
@@ -72,10 +139,7 @@ void time_sleep(uint64_t ms)
     time_spin(ms);
 }
 
-inline time_t core_uptime()
-{
-    return (MICROSECONDS_PER_APIC_TICK * timer_tickcount) / 1000;
-}
+inline time_t core_uptime() { return time_now_ns() / NSEC_PER_MSEC; }
 
 static int mdays[] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
 
@@ -102,6 +166,28 @@ time_t do_time()
     return unix_time;
 }
 
+long do_clock_gettime(clockid_t clock, struct timespec *tp)
+{
+    uint64_t ns = time_now_ns();
+    switch (clock)
+    {
+    case CLOCK_MONOTONIC:
+        break;
+    case CLOCK_REALTIME:
+        if (!realtime_offset)
+        {
+            realtime_offset = do_time() * NSEC_PER_SEC - ns;
+        }
+        ns += realtime_offset;
+        break;
+    default:
+        return -EINVAL;
+    }
+    tp->tv_sec = ns / NSEC_PER_SEC;
+    tp->tv_nsec = ns % NSEC_PER_SEC;
+    return 0;
+}
+
 static size_t human_readable_format(char *buf, size_t size, uint64_t ticks)
 {
     uint64_t milliseconds = core_uptime();
@@ -185,7 +271,8 @@ long do_usleep(useconds_t usec)
     timer_init(&timer);
     timer.function = do_wakeup;
     timer.data = (uint64_t)curthr;
-    timer.expires = jiffies + (usec / MICROSECONDS_PER_APIC_TICK);
+    timer.expires = (time_now_ns() + usec * NSEC_PER_USEC + NSEC_PER_JIFFY - 1) /
+                    NSEC_PER_JIFFY;
 
     timer_add(&timer);
     long ret = sched_cancellable_sleep_on(&waitq);
@@ -1,53 +1,165 @@
 #include "util/timer.h"
+#include "globals.h"
+#include "main/interrupt.h"
+#include "mm/page.h"
+#include "proc/sched.h"
 #include "proc/spinlock.h"
+#include "util/debug.h"
 #include "util/time.h"
 
-static timer_t *timer_running = NULL;
-static uint64_t timer_next_expiry = -1;
-static list_t timers_primary = LIST_INITIALIZER(timers_primary);
-static list_t timers_secondary = LIST_INITIALIZER(timers_secondary);
-static int timers_firing = 0;
+/*
+ * Each core keeps its timers on a hierarchical timing wheel. Level 0 has a
+ * slot for each of the next TIMER_WHEEL_SIZE jiffies, and each slot of level
+ * n covers TIMER_WHEEL_SIZE^n jiffies. A timer goes into the lowest level
+ * whose range covers its expiry, so adding and deleting one is O(1). Each
+ * time level 0 wraps around, the next slot of level 1 is cascaded down by
+ * re-adding its timers (and likewise up the levels), so a timer moves at most
+ * TIMER_WHEEL_LEVELS - 1 times before it fires.
+ */
+#define TIMER_WHEEL_BITS 5
+#define TIMER_WHEEL_SIZE (1UL << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 5
 
-void timer_init(timer_t *timer)
+/* Timers further out than this wait in the top level until they are closer */
+#define TIMER_WHEEL_RANGE (1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+typedef struct timer_wheel
 {
-    timer->expires = -1;
-    list_link_init(&timer->link);
+    spinlock_t tw_lock;
+    uint64_t tw_clock;   /* the next jiffy to process */
+    size_t tw_pending;   /* timers on the wheel */
+    timer_t *tw_running; /* the timer whose function is running, if any */
+    list_t tw_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+} timer_wheel_t;
+
+static timer_wheel_t *timer_wheel CORE_SPECIFIC_DATA;
+
+void timer_wheel_init()
+{
+    KASSERT(sizeof(timer_wheel_t) <= PAGE_SIZE);
+    timer_wheel_t *tw = page_alloc();
+    KASSERT(tw);
+
+    spinlock_init(&tw->tw_lock);
+    tw->tw_clock = jiffies;
+    tw->tw_pending = 0;
+    tw->tw_running = NULL;
+    for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        for (size_t slot = 0; slot < TIMER_WHEEL_SIZE; slot++)
+        {
+            list_init(&tw->tw_slots[level][slot]);
+        }
+    }
+    timer_wheel = tw;
 }
 
-void timer_add(timer_t *timer) { timer_mod(timer, timer->expires); }
+/* Both take the lock with interrupts masked, see main/smp.h */
+static uint8_t timer_wheel_lock(timer_wheel_t *tw)
+{
+    uint8_t ipl = intr_setipl(IPL_HIGH);
+    spinlock_lock(&tw->tw_lock);
+    return ipl;
+}
+
+static void timer_wheel_unlock(timer_wheel_t *tw, uint8_t ipl)
+{
+    spinlock_unlock(&tw->tw_lock);
+    intr_setipl(ipl);
+}
+
+/*
+ * Puts a timer in the slot that covers its expiry. Timers that are already
+ * due go into the slot of the next jiffy to be processed.
+ */
+static void __timer_enqueue(timer_wheel_t *tw, timer_t *timer)
+{
+    uint64_t expires = MAX(timer->expires, tw->tw_clock);
+    uint64_t delta = expires - tw->tw_clock;
+    if (delta >= TIMER_WHEEL_RANGE)
+    {
+        delta = TIMER_WHEEL_RANGE - 1;
+        expires = tw->tw_clock + delta;
+    }
 
-int __timer_del(timer_t *timer)
+    size_t level = 0;
+    while (delta >= 1UL << (TIMER_WHEEL_BITS * (level + 1)))
+    {
+        level++;
+    }
+    size_t slot = (expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    list_insert_tail(&tw->tw_slots[level][slot], &timer->link);
+}
+
+static int __timer_del(timer_wheel_t *tw, timer_t *timer)
 {
     int ret = 0;
     if (list_link_is_linked(&timer->link))
     {
         list_remove(&timer->link);
+        tw->tw_pending--;
         ret = 1;
     }
     return ret;
 }
 
-int timer_del(timer_t *timer)
+/*
+ * Locks the wheel a timer is on, making sure it did not move to another one
+ * in the meantime. Returns NULL if the timer was never added.
+ */
+static timer_wheel_t *timer_lock_base(timer_t *timer, uint8_t *ipl)
 {
-    int ret = __timer_del(timer);
+    while (1)
+    {
+        timer_wheel_t *tw = timer->base;
+        if (!tw)
+        {
+            return NULL;
+        }
+        *ipl = timer_wheel_lock(tw);
+        if (tw == timer->base)
+        {
+            return tw;
+        }
+        timer_wheel_unlock(tw, *ipl);
+    }
+}
 
-    return ret;
+void timer_init(timer_t *timer)
+{
+    timer->expires = -1;
+    list_link_init(&timer->link);
+    timer->base = NULL;
 }
 
-void __timer_add(timer_t *timer)
+void timer_add(timer_t *timer) { timer_mod(timer, timer->expires); }
+
+int timer_del(timer_t *timer)
 {
-    KASSERT(!list_link_is_linked(&timer->link));
-    list_t *list = timers_firing ? &timers_secondary : &timers_primary;
-    list_insert_head(list, &timer->link);
+    uint8_t ipl;
+    timer_wheel_t *tw = timer_lock_base(timer, &ipl);
+    if (!tw)
+    {
+        return 0;
+    }
+    int ret = __timer_del(tw, timer);
+    timer_wheel_unlock(tw, ipl);
+    return ret;
 }
 
-int timer_mod(timer_t *timer, int expires)
+int timer_mod(timer_t *timer, uint64_t expires)
 {
+    int ret = timer_del(timer);
 
+    timer_wheel_t *tw = timer_wheel;
+    uint8_t ipl = timer_wheel_lock(tw);
     timer->expires = expires;
-    int ret = __timer_del(timer);
-    __timer_add(timer);
-    timer_next_expiry = MIN(timer_next_expiry, timer->expires);
+    timer->base = tw;
+    __timer_enqueue(tw, timer);
+    tw->tw_pending++;
+    time_timer_added(expires);
+    timer_wheel_unlock(tw, ipl);
 
     return ret;
 }
@@ -60,21 +172,87 @@ int timer_pending(timer_t *timer)
 
 int timer_del_sync(timer_t *timer)
 {
-    /* Not great performance wise... */
-    while (timer_running == timer)
+    timer_wheel_t *tw = timer->base;
+    while (tw && tw->tw_running == timer)
     {
         sched_yield();
     }
+    return timer_del(timer);
+}
 
-    int ret = __timer_del(timer);
+/*
+ * Returns the first jiffy from tw_clock on, and at most horizon jiffies after
+ * it, at which the wheel has work to do: a level 0 slot with timers to fire,
+ * or a slot of a higher level to cascade. Returns -1 if there is none.
+ */
+static uint64_t timer_wheel_next(timer_wheel_t *tw, uint64_t horizon)
+{
+    uint64_t clock = tw->tw_clock;
+    uint64_t next = -1;
+    for (size_t level = 0; tw->tw_pending && level < TIMER_WHEEL_LEVELS;
+         level++)
+    {
+        /* Level 0 slots hold timers due at that jiffy. The current slot of
+         * the other levels has already been cascaded, so timers in it are a
+         * whole turn of the level away, and the others are cascaded when the
+         * clock reaches the start of their range. */
+        size_t shift = TIMER_WHEEL_BITS * level;
+        size_t last = level ? TIMER_WHEEL_SIZE : TIMER_WHEEL_SIZE - 1;
+        for (size_t i = level ? 1 : 0; i <= last; i++)
+        {
+            uint64_t when = ((clock >> shift) + i) << shift;
+            if (when - clock > horizon || when >= next)
+            {
+                break;
+            }
+            if (!list_empty(
+                    &tw->tw_slots[level][(when >> shift) & TIMER_WHEEL_MASK]))
+            {
+                next = when;
+                break;
+            }
+        }
+    }
+    return next;
+}
 
-    return ret;
+uint64_t timer_next_expiry(uint64_t horizon)
+{
+    timer_wheel_t *tw = timer_wheel;
+    if (!tw)
+    {
+        return -1;
+    }
+
+    uint8_t ipl = timer_wheel_lock(tw);
+    uint64_t next = timer_wheel_next(tw, horizon);
+    timer_wheel_unlock(tw, ipl);
+    return next;
 }
 
-/* Note: using a linked-list rather than some priority is terribly inefficient
- * Also this implementation is just bad. Sorry.
+/*
+ * Re-adds the timers of a slot above level 0, which now fall into lower
+ * levels.
  */
-int ready = 0;
+static void timer_wheel_cascade(timer_wheel_t *tw, size_t level, size_t slot)
+{
+    list_t *list = &tw->tw_slots[level][slot];
+    list_t moved;
+    list_init(&moved);
+    while (!list_empty(list))
+    {
+        list_link_t *link = list->l_next;
+        list_remove(link);
+        list_insert_tail(&moved, link);
+    }
+    while (!list_empty(&moved))
+    {
+        timer_t *timer = list_head(&moved, timer_t, link);
+        list_remove(&timer->link);
+        __timer_enqueue(tw, timer);
+    }
+}
+
 void __timers_fire()
 {
     if (curthr && !preemption_enabled())
@@ -82,40 +260,59 @@ void __timers_fire()
         return;
     }
 
-    timers_firing = 1;
-
-    //dbg(DBG_PRINT, "next expiry: %d\n", timer_next_expiry);
-    if (jiffies < timer_next_expiry)
+    timer_wheel_t *tw = timer_wheel;
+    if (!tw)
     {
-        timers_firing = 0;
         return;
     }
 
-    uint64_t min_expiry = 0;
-
-    list_iterate(&timers_primary, timer, timer_t, link)
+    uint8_t ipl = timer_wheel_lock(tw);
+    while (tw->tw_clock <= jiffies)
     {
-        if (jiffies >= timer->expires)
+        /* Skip the jiffies with nothing to fire or cascade, rather than
+         * stepping through them one at a time with interrupts masked */
+        uint64_t next = timer_wheel_next(tw, jiffies - tw->tw_clock);
+        if (next > jiffies)
         {
-            list_remove(&timer->link);
-            timer_running = timer;
-            timer->function(timer->data);
-            timer_running = NULL;
+            tw->tw_clock = jiffies + 1;
+            break;
+        }
+        tw->tw_clock = next;
+
+        for (size_t level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            size_t shift = TIMER_WHEEL_BITS * level;
+            if ((tw->tw_clock >> (shift - TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK)
+            {
+                break;
+            }
+            timer_wheel_cascade(tw, level,
+                                (tw->tw_clock >> shift) & TIMER_WHEEL_MASK);
         }
-        else
+
+        /* Take the slot off the wheel before advancing the clock, so that
+         * timers added by the functions below land in a later slot */
+        list_t *list = &tw->tw_slots[0][tw->tw_clock & TIMER_WHEEL_MASK];
+        list_t expired;
+        list_init(&expired);
+        while (!list_empty(list))
         {
-            min_expiry = MIN(min_expiry, timer->expires);
+            list_link_t *link = list->l_next;
+            list_remove(link);
+            list_insert_tail(&expired, link);
         }
-    }
+        tw->tw_clock++;
 
-    /* migrate from the backup list to the primary list */
-    list_iterate(&timers_secondary, timer, timer_t, link)
-    {
-        min_expiry = MIN(min_expiry, timer->expires);
-        list_remove(&timer->link);
-        list_insert_head(&timers_primary, &timer->link);
+        while (!list_empty(&expired))
+        {
+            timer_t *timer = list_head(&expired, timer_t, link);
+            __timer_del(tw, timer);
+            tw->tw_running = timer;
+            timer_wheel_unlock(tw, ipl);
+            timer->function(timer->data);
+            ipl = timer_wheel_lock(tw);
+            tw->tw_running = NULL;
+        }
     }
-
-    timer_next_expiry = min_expiry;
-    timers_firing = 0;
+    timer_wheel_unlock(tw, ipl);
 }
@@ -1,3 +1,5 @@
+#include "errno.h"
+
 #include "mm/mobj.h"
 #include "mm/page.h"
 #include "mm/pframe.h"
@@ -5,19 +7,23 @@
 
 #include "util/debug.h"
 #include "util/string.h"
+#include "vm/swap.h"
 
 /* for debugging/verification purposes */
 int anon_count = 0;
 
 static slab_allocator_t *anon_allocator;
 
+static long anon_get_pframe(mobj_t *o, uint64_t pagenum, long forwrite,
+                            pframe_t **pfp);
+
 static long anon_fill_pframe(mobj_t *o, pframe_t *pf);
 
 static long anon_flush_pframe(mobj_t *o, pframe_t *pf);
 
 static void anon_destructor(mobj_t *o);
 
-static mobj_ops_t anon_mobj_ops = {.get_pframe = NULL,
+static mobj_ops_t anon_mobj_ops = {.get_pframe = anon_get_pframe,
                                    .fill_pframe = anon_fill_pframe,
                                    .flush_pframe = anon_flush_pframe,
                                    .destructor = anon_destructor};
@@ -27,7 +33,8 @@ static mobj_ops_t anon_mobj_ops = {.get_pframe = NULL,
  */
 void anon_init()
 {
-    NOT_YET_IMPLEMENTED("VM: anon_init");
+    anon_allocator = slab_allocator_create("anon", sizeof(mobj_t));
+    KASSERT(anon_allocator);
 }
 
 /*
@@ -40,21 +47,68 @@ void anon_init()
  */
 mobj_t *anon_create()
 {
-    NOT_YET_IMPLEMENTED("VM: anon_create");
-    return NULL;
+    mobj_t *o = slab_obj_alloc(anon_allocator);
+    if (!o)
+    {
+        return NULL;
+    }
+    mobj_init(o, MOBJ_ANON, &anon_mobj_ops);
+    mobj_lock(o);
+    anon_count++;
+    return o;
+}
+
+/*
+ * Anonymous memory that has never been written to reads as zeroes, so a read
+ * of a missing page is satisfied with the shared zero page rather than a fresh
+ * page that would have to be allocated and cleared. Writes go through
+ * mobj_default_get_pframe(), which gives the pframe a page of its own.
+ */
+static long anon_get_pframe(mobj_t *o, uint64_t pagenum, long forwrite,
+                            pframe_t **pfp)
+{
+    if (forwrite)
+    {
+        return mobj_default_get_pframe(o, pagenum, forwrite, pfp);
+    }
+
+    mobj_find_pframe(o, pagenum, pfp);
+    if (*pfp && !(*pfp)->pf_addr && (*pfp)->pf_loc)
+    {
+        /* paged out */
+        pframe_release(pfp);
+        return mobj_default_get_pframe(o, pagenum, forwrite, pfp);
+    }
+    if (!*pfp)
+    {
+        mobj_create_pframe(o, pagenum, 0, pfp);
+    }
+    if (!*pfp)
+    {
+        return -ENOMEM;
+    }
+    if (!(*pfp)->pf_addr)
+    {
+        (*pfp)->pf_addr = pframe_zero_page;
+    }
+    return 0;
 }
 
-/* 
- * This function is not complicated -- think about what the pframe should look
- * like for an anonymous object 
+/*
+ * Bring a paged out page back in from swap; otherwise this is the first write
+ * to the page, so zero-fill it.
  */
 static long anon_fill_pframe(mobj_t *o, pframe_t *pf)
 {
-    NOT_YET_IMPLEMENTED("VM: anon_fill_pframe");
+    if (pf->pf_loc)
+    {
+        return swap_in(pf);
+    }
+    memset(pf->pf_addr, 0, PAGE_SIZE);
     return 0;
 }
 
-static long anon_flush_pframe(mobj_t *o, pframe_t *pf) { return 0; }
+static long anon_flush_pframe(mobj_t *o, pframe_t *pf) { return swap_out(pf); }
 
 /*
  * Release all resources associated with an anonymous object.
@@ -65,5 +119,8 @@ static long anon_flush_pframe(mobj_t *o, pframe_t *pf) { return 0; }
  */
 static void anon_destructor(mobj_t *o)
 {
-    NOT_YET_IMPLEMENTED("VM: anon_destructor");
+    swap_discard(o);
+    mobj_default_destructor(o);
+    anon_count--;
+    slab_obj_free(anon_allocator, o);
 }
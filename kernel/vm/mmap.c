@@ -6,8 +6,13 @@
 #include "globals.h"
 #include "mm/mm.h"
 #include "mm/mman.h"
+#include "mm/mobj.h"
+#include "mm/pagetable.h"
+#include "mm/pframe.h"
 #include "mm/tlb.h"
 #include "util/debug.h"
+#include "vm/shadow.h"
+#include "vm/vmmap.h"
 
 /*
  * This function implements the mmap(2) syscall: Add a mapping to the current
@@ -55,8 +60,77 @@
 long do_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off,
              void **ret)
 {
-    NOT_YET_IMPLEMENTED("VM: do_mmap");
-    return -1;
+    if ((flags & MAP_TYPE) != MAP_SHARED && (flags & MAP_TYPE) != MAP_PRIVATE)
+    {
+        return -EINVAL;
+    }
+    if (!len || off < 0 || !PAGE_ALIGNED(off) ||
+        len > USER_MEM_HIGH - USER_MEM_LOW)
+    {
+        return -EINVAL;
+    }
+    if ((flags & MAP_FIXED) &&
+        (!PAGE_ALIGNED(addr) || (uintptr_t)addr < USER_MEM_LOW ||
+         len > USER_MEM_HIGH - (uintptr_t)addr))
+    {
+        return -EINVAL;
+    }
+
+    vnode_t *vnode = NULL;
+    file_t *file = NULL;
+    if (!(flags & MAP_ANON))
+    {
+        file = fget(fd);
+        if (!file)
+        {
+            return -EBADF;
+        }
+        long err = 0;
+        if (!(file->f_mode & FMODE_READ))
+        {
+            err = -EACCES;
+        }
+        else if ((flags & MAP_SHARED) && (prot & PROT_WRITE) &&
+                 !(file->f_mode & FMODE_WRITE))
+        {
+            err = -EACCES;
+        }
+        else if ((prot & PROT_WRITE) && (file->f_mode & FMODE_APPEND))
+        {
+            err = -EACCES;
+        }
+        else if (!file->f_vnode->vn_ops->mmap)
+        {
+            err = -ENODEV;
+        }
+        if (err)
+        {
+            fput(&file);
+            return err;
+        }
+        vnode = file->f_vnode;
+    }
+
+    size_t npages = ADDR_TO_PN(PAGE_ALIGN_UP(len));
+    size_t lopage = (flags & MAP_FIXED) ? ADDR_TO_PN(addr) : 0;
+    vmarea_t *vma;
+    long err = vmmap_map(curproc->p_vmmap, vnode, lopage, npages, prot, flags,
+                         off, VMMAP_DIR_HILO, &vma);
+    if (file)
+    {
+        fput(&file);
+    }
+    if (err)
+    {
+        return err;
+    }
+
+    tlb_flush_range((uintptr_t)PN_TO_ADDR(vma->vma_start), npages);
+    if (ret)
+    {
+        *ret = PN_TO_ADDR(vma->vma_start);
+    }
+    return 0;
 }
 
 /*
@@ -78,6 +152,128 @@ long do_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off,
  */
 long do_munmap(void *addr, size_t len)
 {
-    NOT_YET_IMPLEMENTED("VM: do_munmap");
-    return -1;
-}
\ No newline at end of file
+    if (!PAGE_ALIGNED(addr) || !len || (uintptr_t)addr < USER_MEM_LOW ||
+        len > USER_MEM_HIGH - (uintptr_t)addr)
+    {
+        return -EINVAL;
+    }
+    return vmmap_remove(curproc->p_vmmap, ADDR_TO_PN(addr),
+                        ADDR_TO_PN(PAGE_ALIGN_UP(len)));
+}
+
+/*
+ * Release pages [lo, hi) of vma. A private mapping gets a fresh copy of the
+ * object its chain was made from over the range, which drops this process's
+ * copies of the pages, swap slots included, along with any older ones that
+ * the chain shares with other processes since fork. The next access sees
+ * the file, or zeros for anonymous memory. Shared mappings keep their
+ * contents, only the page table entries go.
+ *
+ * Returns 0 on success, or -errno if the new mapping could not be set up.
+ */
+static long madvise_dontneed(vmarea_t *vma, size_t lo, size_t hi)
+{
+    mobj_t *obj = vma->vma_obj;
+    if ((vma->vma_flags & MAP_SHARED) || obj->mo_type != MOBJ_SHADOW)
+    {
+        uintptr_t vaddr = (uintptr_t)PN_TO_ADDR(lo);
+        pt_unmap_range(curproc->p_pml4, vaddr, (uintptr_t)PN_TO_ADDR(hi));
+        tlb_flush_range(vaddr, hi - lo);
+        return 0;
+    }
+
+    /* vma is replaced over [lo, hi) and may be gone afterwards */
+    mobj_t *bottom = shadow_bottom(obj);
+    vnode_t *file = NULL;
+    off_t off = 0;
+    if (bottom->mo_type == MOBJ_VNODE)
+    {
+        file = CONTAINER_OF(bottom, vnode_t, vn_mobj);
+        off = (off_t)PN_TO_ADDR(vma->vma_off + (lo - vma->vma_start));
+    }
+    int advice = vma->vma_advice;
+    vmarea_t *fresh;
+    long ret = vmmap_map(curproc->p_vmmap, file, lo, hi - lo, vma->vma_prot,
+                         vma->vma_flags | MAP_FIXED, off, VMMAP_DIR_HILO,
+                         &fresh);
+    if (!ret)
+    {
+        fresh->vma_advice = advice;
+    }
+    return ret;
+}
+
+/*
+ * This function implements the madvise(2) syscall: act on advice about how
+ * the current process will use the pages in [addr, addr + len).
+ *
+ *  MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL - Set how much handle_pagefault()
+ *    reads ahead in each vmarea the range touches. Areas are not split, so
+ *    the advice covers the whole area.
+ *  MADV_WILLNEED - Bring the pages into memory now, without mapping them.
+ *  MADV_DONTNEED, MADV_FREE - Release the pages now (see madvise_dontneed()).
+ *
+ * Return 0 on success, or:
+ *  - EINVAL:
+ *     - addr is not aligned on a page boundary
+ *     - the range is out of range of the user address space
+ *     - advice is not one of the above
+ *  - ENOMEM: part of the range is not mapped, or could not be released. The
+ *    advice is still applied to the rest.
+ */
+long do_madvise(void *addr, size_t len, int advice)
+{
+    if (!PAGE_ALIGNED(addr) || (uintptr_t)addr < USER_MEM_LOW ||
+        len > USER_MEM_HIGH - (uintptr_t)addr)
+    {
+        return -EINVAL;
+    }
+    switch (advice)
+    {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+    case MADV_WILLNEED:
+    case MADV_DONTNEED:
+    case MADV_FREE:
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    size_t lopage = ADDR_TO_PN(addr);
+    size_t hipage = ADDR_TO_PN(PAGE_ALIGN_UP((uintptr_t)addr + len));
+    size_t advised = 0;
+    long ret = 0;
+    list_iterate(&curproc->p_vmmap->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        size_t lo = MAX(lopage, vma->vma_start);
+        size_t hi = MIN(hipage, vma->vma_end);
+        if (lo >= hi)
+        {
+            continue;
+        }
+        advised += hi - lo;
+
+        switch (advice)
+        {
+        case MADV_WILLNEED:
+            vmarea_prefetch(vma, lo, hi - lo);
+            break;
+        case MADV_DONTNEED:
+        case MADV_FREE:
+            if (madvise_dontneed(vma, lo, hi))
+            {
+                ret = -ENOMEM;
+            }
+            break;
+        default:
+            vma->vma_advice = advice;
+            break;
+        }
+    }
+
+    dbg(DBG_VM, "advice %d for 0x%p-0x%p, %lu pages mapped\n", advice, addr,
+        PN_TO_ADDR(hipage), advised);
+    return advised == hipage - lopage ? ret : -ENOMEM;
+}
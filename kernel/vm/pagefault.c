@@ -5,9 +5,12 @@
 #include "mm/mman.h"
 #include "mm/mobj.h"
 #include "mm/pframe.h"
+#include "mm/pagetable.h"
 #include "mm/tlb.h"
 #include "types.h"
+#include "fs/vnode.h"
 #include "util/debug.h"
+#include "vm/vmmap.h"
 
 /*
  * Respond to a user mode pagefault by setting up the desired page.
@@ -46,8 +49,117 @@
  *    do_exit(EFAULT).
  */
 void handle_pagefault(uintptr_t vaddr, uintptr_t cause)
+{
+    KASSERT(cause & FAULT_USER);
+    if (resolve_pagefault(vaddr, cause))
+    {
+        do_exit(EFAULT);
+    }
+}
+
+/*
+ * Does the work of handle_pagefault(), but returns -EFAULT instead of killing
+ * the process, for faults the kernel takes on user memory while copying to or
+ * from it (see _pt_fault_handler()). Returns 0 once vaddr is mapped.
+ */
+long resolve_pagefault(uintptr_t vaddr, uintptr_t cause)
 {
     dbg(DBG_VM, "vaddr = 0x%p (0x%p), cause = %lu\n", (void *)vaddr,
         PAGE_ALIGN_DOWN(vaddr), cause);
-    NOT_YET_IMPLEMENTED("VM: PAGE_ALIGN_DOWN");
+
+    size_t vfn = ADDR_TO_PN(vaddr);
+    vmarea_t *vma = vmmap_lookup(curproc->p_vmmap, vfn);
+    if (!vma)
+    {
+        return -EFAULT;
+    }
+
+    long forwrite = cause & FAULT_WRITE;
+    if (forwrite)
+    {
+        if (!(vma->vma_prot & PROT_WRITE))
+        {
+            return -EFAULT;
+        }
+    }
+    else if (cause & FAULT_EXEC)
+    {
+        if (!(vma->vma_prot & PROT_EXEC))
+        {
+            return -EFAULT;
+        }
+    }
+    else if (!(vma->vma_prot & PROT_READ))
+    {
+        return -EFAULT;
+    }
+
+    mobj_t *obj = vma->vma_obj;
+    size_t pagenum = vma->vma_off + (vfn - vma->vma_start);
+    pframe_t *pf;
+
+    /*
+     * A fault on a mapping of a file reads its pages like read(2) does, so it
+     * locks the vnode shared before the object (see vnode_t's vn_rwlock).
+     * Faults the kernel takes copying user memory do not: the system call
+     * making the copy may already hold this very vnode (see do_prwv_user()).
+     */
+    vnode_t *vn = (cause & FAULT_USER) ? vmarea_vnode(vma) : NULL;
+    if (vn)
+    {
+        vlock_shared(vn);
+    }
+    mobj_lock(obj);
+    long ret = mobj_get_pframe(obj, pagenum, forwrite, &pf);
+    if (ret)
+    {
+        mobj_unlock(obj);
+        if (vn)
+        {
+            vunlock_shared(vn);
+        }
+        return -EFAULT;
+    }
+
+    /*
+     * The zero page must never become writable through a user mapping. A
+     * write fault on it, in this or any address space sharing the object,
+     * gets the object a page of its own, and the object's get_pframe removes
+     * the zero page's stale mappings, which pf_zero_mapped records exist.
+     */
+    uint32_t ptflags = PT_PRESENT | PT_USER;
+    if (pframe_is_zero_page(pf))
+    {
+        pf->pf_zero_mapped = 1;
+    }
+    else if (forwrite)
+    {
+        ptflags |= PT_WRITE;
+    }
+    uintptr_t paddr = pt_virt_to_phys((uintptr_t)pf->pf_addr);
+    ret = pt_map(curproc->p_pml4, paddr, (uintptr_t)PAGE_ALIGN_DOWN(vaddr),
+                 PT_PRESENT | PT_WRITE | PT_USER, ptflags);
+    pframe_release(&pf);
+    mobj_unlock(obj);
+    if (vn)
+    {
+        vunlock_shared(vn);
+    }
+    if (ret)
+    {
+        return -EFAULT;
+    }
+
+    tlb_flush((uintptr_t)PAGE_ALIGN_DOWN(vaddr));
+
+    /*
+     * In an area advised MADV_SEQUENTIAL, every VMMAP_READAHEAD_PAGES'th page
+     * faulted in brings in the VMMAP_READAHEAD_PAGES pages after it.
+     */
+    if (vma->vma_advice == MADV_SEQUENTIAL &&
+        !((vfn - vma->vma_start) % VMMAP_READAHEAD_PAGES))
+    {
+        vmarea_prefetch(vma, vfn + 1, VMMAP_READAHEAD_PAGES);
+    }
+    return 0;
 }
@@ -1,12 +1,18 @@
 #include "vm/shadow.h"
+#include "errno.h"
 #include "mm/page.h"
 #include "mm/pframe.h"
 #include "mm/slab.h"
 #include "util/debug.h"
+#include "util/printf.h"
 #include "util/string.h"
+#include "vm/swap.h"
 
 #define SHADOW_SINGLETON_THRESHOLD 5
 
+/* depth histogram buckets reported by shadow_info() */
+#define SHADOW_DEPTH_BUCKETS SHADOW_MAX_DEPTH
+
 typedef struct mobj_shadow
 {
     // the mobj parts of this shadow object
@@ -19,12 +25,26 @@ typedef struct mobj_shadow
     // this should NEVER be a shadow object (i.e. it should have some type other
     // than MOBJ_SHADOW)
     mobj_t *bottom_mobj;
+    // link on shadow_list, so that shadowd can find every shadow object
+    list_link_t link;
 } mobj_shadow_t;
 
 #define MOBJ_TO_SO(o) CONTAINER_OF(o, mobj_shadow_t, mobj)
 
+/* for debugging/verification purposes */
+int shadow_count = 0;
+
 static slab_allocator_t *shadow_allocator;
 
+static list_t shadow_list = LIST_INITIALIZER(shadow_list);
+
+/* chain statistics, see shadow_info() */
+static size_t shadow_collapsed;
+static size_t shadow_migrated;
+static size_t shadow_flattened;
+static size_t shadow_copied;
+static size_t shadow_depth_highwater;
+
 static long shadow_get_pframe(mobj_t *o, size_t pagenum, long forwrite,
                               pframe_t **pfp);
 static long shadow_fill_pframe(mobj_t *o, pframe_t *pf);
@@ -41,7 +61,58 @@ static mobj_ops_t shadow_mobj_ops = {.get_pframe = shadow_get_pframe,
  */
 void shadow_init()
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_init");
+    shadow_allocator = slab_allocator_create("shadow", sizeof(mobj_shadow_t));
+    KASSERT(shadow_allocator);
+}
+
+/*
+ * Return the number of shadow objects in o's chain, counting o itself, or 0 if
+ * o is not a shadow object.
+ */
+size_t shadow_depth(mobj_t *o)
+{
+    size_t depth = 0;
+    while (o->mo_type == MOBJ_SHADOW)
+    {
+        depth++;
+        o = MOBJ_TO_SO(o)->shadowed;
+    }
+    return depth;
+}
+
+/*
+ * Return 1 if target is o or one of the objects o's chain is built on.
+ */
+long shadow_chain_contains(mobj_t *o, mobj_t *target)
+{
+    while (o != target)
+    {
+        if (o->mo_type != MOBJ_SHADOW)
+        {
+            return 0;
+        }
+        o = MOBJ_TO_SO(o)->shadowed;
+    }
+    return 1;
+}
+
+/*
+ * Return the object at the bottom of the chain of the shadow object o.
+ */
+mobj_t *shadow_bottom(mobj_t *o)
+{
+    KASSERT(o->mo_type == MOBJ_SHADOW);
+    return MOBJ_TO_SO(o)->bottom_mobj;
+}
+
+/*
+ * A shadow object's pframe holds a copy of the page if it is resident or
+ * paged out. Otherwise it is left over from a failed fill and the page must
+ * still come from further down the chain.
+ */
+static inline long shadow_has_copy(pframe_t *pf)
+{
+    return pf->pf_addr || pf->pf_loc;
 }
 
 /*
@@ -61,8 +132,49 @@ void shadow_init()
  */
 mobj_t *shadow_create(mobj_t *shadowed)
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_create");
-    return NULL;
+    KASSERT(kmutex_owns_mutex(&shadowed->mo_mutex));
+
+    /*
+     * The new object goes on top of shadowed's chain, so keep that chain
+     * under SHADOW_MAX_DEPTH first. A failure here only means the chain
+     * grows past the cap.
+     */
+    if (shadowed->mo_type == MOBJ_SHADOW && shadow_bound_depth(shadowed))
+    {
+        dbg(DBG_VMMAP, "could not bound shadow chain of 0x%p\n", shadowed);
+    }
+
+    mobj_shadow_t *so = slab_obj_alloc(shadow_allocator);
+    if (!so)
+    {
+        return NULL;
+    }
+    mobj_init(&so->mobj, MOBJ_SHADOW, &shadow_mobj_ops);
+
+    mobj_ref(shadowed);
+    so->shadowed = shadowed;
+    if (shadowed->mo_type == MOBJ_SHADOW)
+    {
+        so->bottom_mobj = MOBJ_TO_SO(shadowed)->bottom_mobj;
+    }
+    else
+    {
+        so->bottom_mobj = shadowed;
+    }
+    mobj_ref(so->bottom_mobj);
+
+    list_link_init(&so->link);
+    list_insert_tail(&shadow_list, &so->link);
+    shadow_count++;
+
+    size_t depth = shadow_depth(&so->mobj);
+    if (depth > shadow_depth_highwater)
+    {
+        shadow_depth_highwater = depth;
+    }
+
+    mobj_lock(&so->mobj);
+    return &so->mobj;
 }
 
 /*
@@ -86,7 +198,295 @@ mobj_t *shadow_create(mobj_t *shadowed)
  */
 void shadow_collapse(mobj_t *o)
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_collapse");
+    KASSERT(kmutex_owns_mutex(&o->mo_mutex));
+    mobj_shadow_t *so = MOBJ_TO_SO(o);
+
+    while (so->shadowed->mo_type == MOBJ_SHADOW &&
+           so->shadowed->mo_refcount == 1)
+    {
+        mobj_t *dead = so->shadowed;
+        mobj_lock(dead);
+        if (dead->mo_refcount != 1)
+        {
+            /* picked up by someone else while we slept on the lock */
+            mobj_unlock(dead);
+            return;
+        }
+
+        list_iterate(&dead->mo_pframes, pf, pframe_t, pf_link)
+        {
+            if (!shadow_has_copy(pf))
+            {
+                continue;
+            }
+            pframe_t *mine;
+            mobj_find_pframe(o, pf->pf_pagenum, &mine);
+            if (mine && shadow_has_copy(mine))
+            {
+                /* o's copy hides this one; it goes away with dead */
+                pframe_release(&mine);
+                continue;
+            }
+            if (mine)
+            {
+                /* left over from a failed fill, dead's page takes its place */
+                mobj_free_pframe(o, &mine);
+            }
+            kmutex_lock(&pf->pf_mutex);
+            list_remove(&pf->pf_link);
+            btree_delete(&dead->mo_btree, pf->pf_pagenum);
+            list_insert_tail(&o->mo_pframes, &pf->pf_link);
+            btree_insert(&o->mo_btree, pf->pf_pagenum, pf);
+            pf->pf_obj = o;
+            kmutex_unlock(&pf->pf_mutex);
+            shadow_migrated++;
+        }
+
+        so->shadowed = MOBJ_TO_SO(dead)->shadowed;
+        mobj_ref(so->shadowed);
+        mobj_unlock(dead);
+        mobj_put(&dead);
+        shadow_collapsed++;
+    }
+}
+
+/*
+ * Make room for one more object on top of o within the chain depth cap (see
+ * shadow_create): collapse o's chain, and if it is still SHADOW_MAX_DEPTH
+ * objects deep, copy every page that is visible through the intermediate
+ * objects into o and point o straight at the bottom object. The intermediate
+ * objects may be shared with other chains, so their pages are copied rather
+ * than moved.
+ *
+ * o must be a locked shadow object. Returns 0 on success or -ENOMEM.
+ */
+long shadow_bound_depth(mobj_t *o)
+{
+    KASSERT(kmutex_owns_mutex(&o->mo_mutex));
+    mobj_shadow_t *so = MOBJ_TO_SO(o);
+
+    shadow_collapse(o);
+    if (shadow_depth(o) < SHADOW_MAX_DEPTH)
+    {
+        return 0;
+    }
+
+    long ret = 0;
+    mobj_t *cur = o;
+    mobj_t *next = so->shadowed;
+    while (!ret && next->mo_type == MOBJ_SHADOW)
+    {
+        mobj_lock(next);
+        if (cur != o)
+        {
+            mobj_unlock(cur);
+        }
+        cur = next;
+
+        list_iterate(&cur->mo_pframes, pf, pframe_t, pf_link)
+        {
+            if (!shadow_has_copy(pf))
+            {
+                continue;
+            }
+            pframe_t *mine;
+            mobj_find_pframe(o, pf->pf_pagenum, &mine);
+            if (mine && shadow_has_copy(mine))
+            {
+                pframe_release(&mine);
+                continue;
+            }
+            if (!mine)
+            {
+                mobj_create_pframe(o, pf->pf_pagenum, 0, &mine);
+            }
+            if (!mine)
+            {
+                ret = -ENOMEM;
+                break;
+            }
+            /* a pframe left over from a failed fill is filled here instead */
+            mine->pf_addr = page_alloc();
+            if (!mine->pf_addr)
+            {
+                mobj_free_pframe(o, &mine);
+                ret = -ENOMEM;
+                break;
+            }
+            /* brings the source back in if it was paged out */
+            pframe_t *src;
+            ret = mobj_default_get_pframe(cur, pf->pf_pagenum, 0, &src);
+            if (ret)
+            {
+                mobj_free_pframe(o, &mine);
+                break;
+            }
+            memcpy(mine->pf_addr, src->pf_addr, PAGE_SIZE);
+            pframe_release(&src);
+            mine->pf_dirty = 1;
+            pframe_lru_touch(mine);
+            pframe_release(&mine);
+            shadow_copied++;
+        }
+        next = MOBJ_TO_SO(cur)->shadowed;
+    }
+    if (cur != o)
+    {
+        mobj_unlock(cur);
+    }
+    if (ret)
+    {
+        /* the pages copied so far are still valid, just redundant */
+        return ret;
+    }
+
+    mobj_t *old = so->shadowed;
+    so->shadowed = so->bottom_mobj;
+    mobj_ref(so->shadowed);
+    mobj_put(&old);
+    shadow_flattened++;
+    return 0;
+}
+
+/*
+ * Collapse the chain below every live shadow object. This is the body of
+ * shadowd, but can be called from anywhere that may block.
+ *
+ * Each object is referenced while it is being worked on so that it cannot be
+ * destroyed under us, and so that its successor on shadow_list stays put.
+ */
+void shadow_collapse_all()
+{
+    mobj_t *cur = NULL;
+    list_link_t *link = shadow_list.l_next;
+    while (1)
+    {
+        mobj_t *next = NULL;
+        for (; link != &shadow_list; link = link->l_next)
+        {
+            mobj_shadow_t *so = list_item(link, mobj_shadow_t, link);
+            if (atomic_inc_not_zero(&so->mobj.mo_refcount))
+            {
+                next = &so->mobj;
+                break;
+            }
+        }
+        if (cur)
+        {
+            mobj_put(&cur);
+        }
+        if (!next)
+        {
+            return;
+        }
+
+        mobj_lock(next);
+        shadow_collapse(next);
+        mobj_unlock(next);
+
+        cur = next;
+        link = MOBJ_TO_SO(cur)->link.l_next;
+    }
+}
+
+/*
+ * Format shadow chain statistics into buf, in the style of
+ * vmmap_mapping_info(). Returns the number of bytes written.
+ */
+size_t shadow_info(const void *arg, char *buf, size_t osize)
+{
+    KASSERT(0 < osize);
+    KASSERT(NULL != buf);
+
+    size_t hist[SHADOW_DEPTH_BUCKETS + 1] = {0};
+    size_t total = 0;
+    size_t deepest = 0;
+    list_iterate(&shadow_list, so, mobj_shadow_t, link)
+    {
+        size_t depth = shadow_depth(&so->mobj);
+        hist[MIN(depth, SHADOW_DEPTH_BUCKETS)]++;
+        total += depth;
+        deepest = MAX(deepest, depth);
+    }
+
+    size_t size = osize;
+    int len = snprintf(buf, size,
+                       "shadow objects: %d, chain depth avg %lu max %lu "
+                       "(highwater %lu, cap %d)\n"
+                       "collapsed: %lu (%lu pages migrated), "
+                       "flattened: %lu (%lu pages copied)\n",
+                       shadow_count, shadow_count ? total / shadow_count : 0,
+                       deepest, shadow_depth_highwater, SHADOW_MAX_DEPTH,
+                       shadow_collapsed, shadow_migrated, shadow_flattened,
+                       shadow_copied);
+    for (size_t i = 1; i <= SHADOW_DEPTH_BUCKETS && (size_t)len < size; i++)
+    {
+        size -= len;
+        buf += len;
+        len = snprintf(buf, size, "depth %s%2lu: %lu\n",
+                       i == SHADOW_DEPTH_BUCKETS ? ">=" : "  ", i, hist[i]);
+    }
+    if ((size_t)len >= size)
+    {
+        buf[size - 1] = '\0';
+        len = size - 1;
+    }
+    return osize - size + len;
+}
+
+/*
+ * Find pagenum in the objects below the locked shadow object o: the nearest
+ * shadow object that has a copy wins, otherwise the bottom object supplies it.
+ * Locks are taken hand-over-hand down the chain, so a concurrent collapse
+ * cannot free an object out from under us. On success *pfp is locked.
+ */
+static long shadow_chain_get_pframe(mobj_t *o, size_t pagenum, pframe_t **pfp)
+{
+    KASSERT(kmutex_owns_mutex(&o->mo_mutex));
+    *pfp = NULL;
+
+    mobj_t *cur = o;
+    mobj_t *next = MOBJ_TO_SO(o)->shadowed;
+    while (next->mo_type == MOBJ_SHADOW)
+    {
+        mobj_lock(next);
+        if (cur != o)
+        {
+            mobj_unlock(cur);
+        }
+        cur = next;
+        mobj_find_pframe(cur, pagenum, pfp);
+        if (*pfp && !shadow_has_copy(*pfp))
+        {
+            pframe_release(pfp);
+        }
+        if (*pfp)
+        {
+            long ret = 0;
+            if (!(*pfp)->pf_addr)
+            {
+                /* paged out */
+                pframe_release(pfp);
+                ret = mobj_default_get_pframe(cur, pagenum, 0, pfp);
+            }
+            if (cur != o)
+            {
+                mobj_unlock(cur);
+            }
+            return ret;
+        }
+        next = MOBJ_TO_SO(cur)->shadowed;
+    }
+
+    KASSERT(next == MOBJ_TO_SO(o)->bottom_mobj);
+    mobj_lock(next);
+    if (cur != o)
+    {
+        mobj_unlock(cur);
+    }
+    long ret = mobj_get_pframe(next, pagenum, 0, pfp);
+    mobj_unlock(next);
+    return ret;
 }
 
 /*
@@ -117,8 +517,25 @@ void shadow_collapse(mobj_t *o)
 static long shadow_get_pframe(mobj_t *o, size_t pagenum, long forwrite,
                               pframe_t **pfp)
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_get_pframe");
-    return 0;
+    if (forwrite)
+    {
+        return mobj_default_get_pframe(o, pagenum, forwrite, pfp);
+    }
+    mobj_find_pframe(o, pagenum, pfp);
+    if (*pfp && (*pfp)->pf_addr)
+    {
+        return 0;
+    }
+    if (*pfp)
+    {
+        long paged_out = shadow_has_copy(*pfp);
+        pframe_release(pfp);
+        if (paged_out)
+        {
+            return mobj_default_get_pframe(o, pagenum, 0, pfp);
+        }
+    }
+    return shadow_chain_get_pframe(o, pagenum, pfp);
 }
 
 /*
@@ -144,23 +561,31 @@ static long shadow_get_pframe(mobj_t *o, size_t pagenum, long forwrite,
  */
 static long shadow_fill_pframe(mobj_t *o, pframe_t *pf)
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_fill_pframe");
-    return -1;
+    if (pf->pf_loc)
+    {
+        return swap_in(pf);
+    }
+
+    pframe_t *src;
+    long ret = shadow_chain_get_pframe(o, pf->pf_pagenum, &src);
+    if (ret)
+    {
+        return ret;
+    }
+    memcpy(pf->pf_addr, src->pf_addr, PAGE_SIZE);
+    pframe_release(&src);
+    return 0;
 }
 
 /*
- * Flush a shadow object's pframe to disk.
+ * Flush a shadow object's pframe to disk. Shadow objects are backed by swap,
+ * so this pages the frame out (see vm/swap.c).
  *
  * Return 0 on success.
- *
- * Hint:
- *  - Are shadow objects backed to disk? Do you actually need to do anything
- *    here?
  */
 static long shadow_flush_pframe(mobj_t *o, pframe_t *pf)
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_flush_pframe");
-    return -1;
+    return swap_out(pf);
 }
 
 /*
@@ -175,5 +600,14 @@ static long shadow_flush_pframe(mobj_t *o, pframe_t *pf)
  */
 static void shadow_destructor(mobj_t *o)
 {
-    NOT_YET_IMPLEMENTED("VM: shadow_destructor");
+    swap_discard(o);
+    mobj_default_destructor(o);
+
+    mobj_shadow_t *so = MOBJ_TO_SO(o);
+    list_remove(&so->link);
+    shadow_count--;
+
+    mobj_put(&so->shadowed);
+    mobj_put(&so->bottom_mobj);
+    slab_obj_free(shadow_allocator, so);
 }
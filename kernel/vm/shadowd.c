@@ -0,0 +1,45 @@
+#include "vm/shadowd.h"
+#include "globals.h"
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+#include "util/debug.h"
+#include "util/time.h"
+#include "vm/shadow.h"
+
+/* how long shadowd sleeps between passes over the shadow objects */
+#define SHADOWD_INTERVAL_USEC 1000000
+
+/*
+ * shadowd periodically collapses every shadow chain in the system, so that
+ * objects left behind by exited children are folded into their survivors
+ * instead of being walked on every page fault that misses the top object.
+ * It exits when cancelled (e.g. by proc_kill_all()).
+ */
+static void *shadowd_run(long arg1, void *arg2)
+{
+    while (!do_usleep(SHADOWD_INTERVAL_USEC))
+    {
+        int before = shadow_count;
+        shadow_collapse_all();
+        if (shadow_count != before)
+        {
+            dbg(DBG_VM, "shadowd: %d -> %d shadow objects\n", before,
+                shadow_count);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Start shadowd. Must be called from the idle process's context, so that the
+ * daemon is not a child that init would wait for.
+ */
+void shadowd_init()
+{
+    proc_t *proc = proc_create("shadowd");
+    KASSERT(proc);
+    kthread_t *thread = kthread_create(proc, shadowd_run, 0, NULL);
+    KASSERT(thread);
+    sched_make_runnable(thread);
+}
@@ -0,0 +1,394 @@
+#include "vm/swap.h"
+#include "errno.h"
+#include "globals.h"
+
+#include "drivers/bio.h"
+#include "drivers/blockdev.h"
+#include "drivers/dev.h"
+
+#include "mm/kmalloc.h"
+#include "mm/mobj.h"
+#include "mm/page.h"
+#include "mm/pframe.h"
+
+#include "proc/kthread.h"
+#include "proc/proc.h"
+#include "proc/sched.h"
+
+#include "util/debug.h"
+#include "util/printf.h"
+#include "util/string.h"
+
+#include "vm/vmmap.h"
+
+/*
+ * Anonymous and shadow pages are paged out to the last disk, one page per
+ * block. A pframe that has been paged out stays on its object's list with
+ * pf_addr == NULL and pf_loc set to its swap slot; the object's fill_pframe
+ * brings it back in. Slot 0 is never handed out, so pf_loc == 0 means the
+ * pframe has no copy in swap.
+ */
+
+#if __NDISKS__ > 1
+#define SWAP_DEVID MKDEVID(DISK_MAJOR, __NDISKS__ - 1)
+#endif
+
+#ifndef __SWAP_BLOCKS__
+#define __SWAP_BLOCKS__ 0
+#endif
+
+#define SWAP_MAP_BITS (sizeof(uint64_t) * 8)
+
+static blockdev_t *swap_dev;
+
+static uint64_t *swap_map; /* one bit per slot, set if in use */
+static size_t swap_nslots;
+static size_t swap_nfree;
+static size_t swap_next; /* where the next slot search starts */
+
+static size_t swap_pageouts;
+static size_t swap_pageins;
+
+void swap_init()
+{
+#ifdef SWAP_DEVID
+    swap_dev = blockdev_lookup(SWAP_DEVID);
+#endif
+    if (!swap_dev || __SWAP_BLOCKS__ < 2)
+    {
+        swap_dev = NULL;
+        dbg(DBG_VM, "no swap device, anonymous memory stays resident\n");
+        return;
+    }
+
+    swap_nslots = __SWAP_BLOCKS__;
+    size_t nwords = (swap_nslots + SWAP_MAP_BITS - 1) / SWAP_MAP_BITS;
+    swap_map = kmalloc(nwords * sizeof(uint64_t));
+    KASSERT(swap_map);
+    memset(swap_map, 0, nwords * sizeof(uint64_t));
+
+    swap_map[0] = 1; /* slot 0 means "no slot" */
+    swap_nfree = swap_nslots - 1;
+    swap_next = 1;
+    dbg(DBG_VM, "swapping to device 0x%x, %lu slots\n", swap_dev->bd_id,
+        swap_nslots);
+}
+
+static inline long swap_slot_used(size_t slot)
+{
+    return (swap_map[slot / SWAP_MAP_BITS] >> (slot % SWAP_MAP_BITS)) & 1;
+}
+
+/*
+ * Returns a free slot, or 0 if swap is full.
+ */
+static size_t swap_alloc_slot()
+{
+    if (!swap_nfree)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < swap_nslots; i++)
+    {
+        size_t slot = (swap_next + i) % swap_nslots;
+        if (!swap_slot_used(slot))
+        {
+            swap_map[slot / SWAP_MAP_BITS] |= 1UL << (slot % SWAP_MAP_BITS);
+            swap_nfree--;
+            swap_next = slot + 1;
+            return slot;
+        }
+    }
+    panic("swap_nfree is %lu but every slot is in use\n", swap_nfree);
+}
+
+static void swap_free_slot(pframe_t *pf)
+{
+    size_t slot = pf->pf_loc;
+    KASSERT(slot && slot < swap_nslots && swap_slot_used(slot));
+    swap_map[slot / SWAP_MAP_BITS] &= ~(1UL << (slot % SWAP_MAP_BITS));
+    swap_nfree++;
+    pf->pf_loc = 0;
+}
+
+/*
+ * Read a paged out pframe's contents back from its slot. The slot is kept, so
+ * that a page which is not written to again can be dropped without another
+ * write.
+ */
+long swap_in(pframe_t *pf)
+{
+    KASSERT(swap_dev && pf->pf_loc && pf->pf_addr);
+    swap_pageins++;
+    return swap_dev->bd_ops->read_block(swap_dev, pf->pf_addr, pf->pf_loc, 1);
+}
+
+/*
+ * Write a pframe's contents to its slot, allocating one if it has none.
+ */
+long swap_out(pframe_t *pf)
+{
+    KASSERT(pf->pf_addr && !pframe_is_zero_page(pf));
+    if (!swap_dev)
+    {
+        return -ENOSPC;
+    }
+    if (!pf->pf_loc)
+    {
+        pf->pf_loc = swap_alloc_slot();
+        if (!pf->pf_loc)
+        {
+            return -ENOSPC;
+        }
+    }
+    swap_pageouts++;
+    return swap_dev->bd_ops->write_block(swap_dev, pf->pf_addr, pf->pf_loc, 1);
+}
+
+/*
+ * Drop pf's copy in swap, if it has one, because pf is being freed.
+ */
+void swap_release(pframe_t *pf)
+{
+    if (pf->pf_loc)
+    {
+        swap_free_slot(pf);
+    }
+}
+
+/*
+ * Called by the anonymous and shadow object destructors before their pframes
+ * are freed: the contents are dead, so drop their swap slots and make sure
+ * nothing gets written out on the way.
+ */
+void swap_discard(mobj_t *o)
+{
+    mobj_lock(o);
+    list_iterate(&o->mo_pframes, pf, pframe_t, pf_link)
+    {
+        kmutex_lock(&pf->pf_mutex);
+        pf->pf_dirty = 0;
+        swap_release(pf);
+        kmutex_unlock(&pf->pf_mutex);
+    }
+    mobj_unlock(o);
+}
+
+/*
+ * Throw away page pagenum of an anonymous or shadow object, along with its
+ * copy in swap, if any (see mobj_delete_pframe()). The caller must hold o's
+ * lock and have removed the page's user mappings.
+ */
+void swap_delete_pframe(mobj_t *o, size_t pagenum)
+{
+    KASSERT(kmutex_owns_mutex(&o->mo_mutex));
+    mobj_delete_pframe(o, pagenum);
+}
+
+/*
+ * Only swapd inspects the mutexes here. It holds no locks of its own other than
+ * those of the pages it is paging out, and threads are not preempted in the
+ * kernel, so an unheld mutex seen here can be taken without blocking. That
+ * keeps swapd from waiting on a lock held by a thread that is itself waiting
+ * for swapd to free memory.
+ */
+static long swap_can_reclaim(pframe_t *pf)
+{
+    mobj_t *o = pf->pf_obj;
+    return !pf->pf_mutex.km_holder && o->mo_refcount &&
+           (!o->mo_mutex.km_holder || kmutex_owns_mutex(&o->mo_mutex));
+}
+
+/* A page swapd is paging out, and the write taking it to its slot */
+typedef struct swap_victim
+{
+    pframe_t *sv_pf;
+    long sv_write; /* whether sv_bio was submitted */
+    bio_t sv_bio;
+} swap_victim_t;
+
+static swap_victim_t swap_victims[SWAP_RECLAIM_BATCH];
+
+/*
+ * Page out up to SWAP_RECLAIM_BATCH of the least recently used anonymous and
+ * shadow pages and free their memory. The writes are all submitted before any
+ * of them is waited for, so that the block layer can merge them. Returns the
+ * number of pages freed, which is 0 when swap is full or everything is in use.
+ */
+static size_t swap_reclaim()
+{
+    size_t n = 0;
+    list_iterate_reverse(&pframe_lru, pf, pframe_t, pf_lru_link)
+    {
+        if (n == SWAP_RECLAIM_BATCH)
+        {
+            break;
+        }
+        if (!swap_can_reclaim(pf))
+        {
+            continue;
+        }
+        /* without a slot, the only copy of the contents is in memory */
+        long fresh = !pf->pf_loc;
+        if (fresh && !(pf->pf_loc = swap_alloc_slot()))
+        {
+            break;
+        }
+
+        mobj_t *o = pf->pf_obj;
+        if (!kmutex_owns_mutex(&o->mo_mutex))
+        {
+            mobj_lock(o);
+        }
+        kmutex_lock(&pf->pf_mutex);
+        vmmap_unmap_object(o, pf->pf_pagenum, 1);
+
+        swap_victim_t *sv = &swap_victims[n++];
+        sv->sv_pf = pf;
+        sv->sv_write = fresh || pf->pf_dirty;
+        if (sv->sv_write)
+        {
+            bio_init_request(&sv->sv_bio, swap_dev, BIO_WRITE,
+                             (blocknum_t)pf->pf_loc, 1, &pf->pf_addr);
+            bio_submit(&sv->sv_bio);
+        }
+    }
+
+    size_t freed = 0;
+    while (n--)
+    {
+        swap_victim_t *sv = &swap_victims[n];
+        pframe_t *pf = sv->sv_pf;
+        mobj_t *o = pf->pf_obj;
+        long ret = sv->sv_write ? bio_wait(&sv->sv_bio) : 0;
+        if (ret)
+        {
+            dbg(DBG_VM, "could not page out: %ld\n", ret);
+            pf->pf_dirty = 1;
+        }
+        else
+        {
+            if (sv->sv_write)
+            {
+                swap_pageouts++;
+            }
+            pf->pf_dirty = 0;
+            pframe_free_page(pf);
+            freed++;
+        }
+        kmutex_unlock(&pf->pf_mutex);
+
+        /* unlock each object with its first victim, the last one handled */
+        long first = 1;
+        for (size_t i = 0; i < n && first; i++)
+        {
+            first = swap_victims[i].sv_pf->pf_obj != o;
+        }
+        if (first)
+        {
+            mobj_unlock(o);
+        }
+    }
+
+    dbg(DBG_VM, "reclaimed %lu pages, %lu swap slots free\n", freed,
+        swap_nfree);
+    return freed;
+}
+
+/* swapd, where it sleeps, and where allocators wait for it */
+static kthread_t *swapd_thread;
+static ktqueue_t swapd_waitq;
+static ktqueue_t swapd_doneq;
+
+static size_t swapd_started; /* passes begun */
+static size_t swapd_done;    /* passes finished */
+static size_t swapd_wanted;  /* the pass allocators are waiting for */
+static size_t swapd_freed;   /* pages freed by the last pass */
+
+/*
+ * Called when page_alloc() fails: wakes swapd and waits until it has made a
+ * pass over memory that started after this call. Returns the number of pages
+ * that pass freed, or 0 if there is no swapd to ask (including when called by
+ * swapd itself). Callers may hold locks; swapd never waits for those.
+ */
+size_t swap_wait_reclaim()
+{
+    if (!swapd_thread || curthr == swapd_thread)
+    {
+        return 0;
+    }
+
+    size_t pass = swapd_started + 1;
+    swapd_wanted = pass;
+    sched_wakeup_on(&swapd_waitq, NULL);
+    while (swapd_thread && swapd_done < pass)
+    {
+        sched_sleep_on(&swapd_doneq);
+    }
+    return swapd_done >= pass ? swapd_freed : 0;
+}
+
+/*
+ * swapd pages memory out on behalf of threads that could not allocate a page,
+ * so that the page-out runs without any of the locks they hold. It exits when
+ * cancelled (e.g. by proc_kill_all()), after which allocations just fail.
+ */
+static void *swapd_run(long arg1, void *arg2)
+{
+    while (1)
+    {
+        if (swapd_done < swapd_wanted)
+        {
+            swapd_started++;
+            swapd_freed = swap_reclaim();
+            swapd_done = swapd_started;
+            sched_broadcast_on(&swapd_doneq);
+        }
+        else if (sched_cancellable_sleep_on(&swapd_waitq))
+        {
+            break;
+        }
+    }
+
+    swapd_thread = NULL;
+    sched_broadcast_on(&swapd_doneq);
+    return NULL;
+}
+
+/*
+ * Start swapd, if there is a swap device. Like shadowd_init(), must be called
+ * from the idle process's context.
+ */
+void swapd_init()
+{
+    if (!swap_dev)
+    {
+        return;
+    }
+    sched_queue_init(&swapd_waitq);
+    sched_queue_init(&swapd_doneq);
+
+    proc_t *proc = proc_create("swapd");
+    KASSERT(proc);
+    swapd_thread = kthread_create(proc, swapd_run, 0, NULL);
+    KASSERT(swapd_thread);
+    sched_make_runnable(swapd_thread);
+}
+
+/*
+ * Format swap usage into buf, in the style of vmmap_mapping_info(). Returns
+ * the number of bytes written.
+ */
+size_t swap_info(const void *arg, char *buf, size_t osize)
+{
+    KASSERT(0 < osize);
+    KASSERT(NULL != buf);
+
+    int len = snprintf(buf, osize,
+                       "swap: %lu of %lu slots in use, %lu page-outs, "
+                       "%lu page-ins\n",
+                       swap_nslots ? swap_nslots - 1 - swap_nfree : 0,
+                       swap_nslots ? swap_nslots - 1 : 0, swap_pageouts,
+                       swap_pageins);
+    return MIN((size_t)len, osize - 1);
+}
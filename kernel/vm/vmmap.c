@@ -15,7 +15,10 @@
 
 #include "mm/mm.h"
 #include "mm/mman.h"
+#include "mm/pagetable.h"
+#include "mm/pframe.h"
 #include "mm/slab.h"
+#include "mm/tlb.h"
 
 static slab_allocator_t *vmmap_allocator;
 static slab_allocator_t *vmarea_allocator;
@@ -32,8 +35,14 @@ void vmmap_init(void)
  */
 vmarea_t *vmarea_alloc(void)
 {
-    NOT_YET_IMPLEMENTED("VM: vmarea_alloc");
-    return NULL;
+    vmarea_t *vma = slab_obj_alloc(vmarea_allocator);
+    if (!vma)
+    {
+        return NULL;
+    }
+    memset(vma, 0, sizeof(vmarea_t));
+    list_link_init(&vma->vma_plink);
+    return vma;
 }
 
 /*
@@ -42,7 +51,15 @@ vmarea_t *vmarea_alloc(void)
  */
 void vmarea_free(vmarea_t *vma)
 {
-    NOT_YET_IMPLEMENTED("VM: vmarea_free");
+    if (list_link_is_linked(&vma->vma_plink))
+    {
+        list_remove(&vma->vma_plink);
+    }
+    if (vma->vma_obj)
+    {
+        mobj_put(&vma->vma_obj);
+    }
+    slab_obj_free(vmarea_allocator, vma);
 }
 
 /*
@@ -50,8 +67,14 @@ void vmarea_free(vmarea_t *vma)
  */
 vmmap_t *vmmap_create(void)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_create");
-    return NULL;
+    vmmap_t *map = slab_obj_alloc(vmmap_allocator);
+    if (!map)
+    {
+        return NULL;
+    }
+    list_init(&map->vmm_list);
+    map->vmm_proc = NULL;
+    return map;
 }
 
 /*
@@ -60,7 +83,13 @@ vmmap_t *vmmap_create(void)
  */
 void vmmap_destroy(vmmap_t **mapp)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_destroy");
+    vmmap_t *map = *mapp;
+    list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        vmarea_free(vma);
+    }
+    slab_obj_free(vmmap_allocator, map);
+    *mapp = NULL;
 }
 
 /*
@@ -76,7 +105,22 @@ void vmmap_destroy(vmmap_t **mapp)
  */
 void vmmap_insert(vmmap_t *map, vmarea_t *new_vma)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_insert");
+    KASSERT(new_vma->vma_start < new_vma->vma_end);
+    KASSERT(ADDR_TO_PN(USER_MEM_LOW) <= new_vma->vma_start);
+    KASSERT(new_vma->vma_end <= ADDR_TO_PN(USER_MEM_HIGH));
+
+    new_vma->vma_vmmap = map;
+    list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        if (new_vma->vma_start < vma->vma_start)
+        {
+            KASSERT(new_vma->vma_end <= vma->vma_start);
+            list_insert_before(&vma->vma_plink, &new_vma->vma_plink);
+            return;
+        }
+        KASSERT(vma->vma_end <= new_vma->vma_start);
+    }
+    list_insert_tail(&map->vmm_list, &new_vma->vma_plink);
 }
 
 /*
@@ -96,8 +140,32 @@ void vmmap_insert(vmmap_t *map, vmarea_t *new_vma)
  */
 ssize_t vmmap_find_range(vmmap_t *map, size_t npages, int dir)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_find_range");
-    return -1;
+    KASSERT(dir == VMMAP_DIR_LOHI || dir == VMMAP_DIR_HILO);
+    size_t lo = ADDR_TO_PN(USER_MEM_LOW);
+    size_t hi = ADDR_TO_PN(USER_MEM_HIGH);
+
+    if (dir == VMMAP_DIR_LOHI)
+    {
+        list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+        {
+            if (vma->vma_start >= lo + npages)
+            {
+                return lo;
+            }
+            lo = MAX(lo, vma->vma_end);
+        }
+        return hi >= lo + npages ? (ssize_t)lo : -1;
+    }
+
+    list_iterate_reverse(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        if (hi >= vma->vma_end + npages)
+        {
+            return hi - npages;
+        }
+        hi = MIN(hi, vma->vma_start);
+    }
+    return hi >= lo + npages ? (ssize_t)(hi - npages) : -1;
 }
 
 /*
@@ -106,7 +174,13 @@ ssize_t vmmap_find_range(vmmap_t *map, size_t npages, int dir)
  */
 vmarea_t *vmmap_lookup(vmmap_t *map, size_t vfn)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_lookup");
+    list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        if (vfn >= vma->vma_start && vfn < vma->vma_end)
+        {
+            return vma;
+        }
+    }
     return NULL;
 }
 
@@ -148,7 +222,64 @@ void vmmap_collapse(vmmap_t *map)
  */
 vmmap_t *vmmap_clone(vmmap_t *map)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_clone");
+    vmmap_collapse(map);
+
+    vmmap_t *new_map = vmmap_create();
+    if (!new_map)
+    {
+        return NULL;
+    }
+
+    list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        vmarea_t *new_vma = vmarea_alloc();
+        if (!new_vma)
+        {
+            goto error;
+        }
+        new_vma->vma_start = vma->vma_start;
+        new_vma->vma_end = vma->vma_end;
+        new_vma->vma_off = vma->vma_off;
+        new_vma->vma_prot = vma->vma_prot;
+        new_vma->vma_flags = vma->vma_flags;
+        new_vma->vma_advice = vma->vma_advice;
+
+        mobj_t *obj = vma->vma_obj;
+        mobj_lock(obj);
+        if (vma->vma_flags & MAP_SHARED)
+        {
+            mobj_ref(obj);
+            mobj_unlock(obj);
+            new_vma->vma_obj = obj;
+            vmmap_insert(new_map, new_vma);
+            continue;
+        }
+
+        mobj_t *parent_shadow = shadow_create(obj);
+        mobj_t *child_shadow = parent_shadow ? shadow_create(obj) : NULL;
+        if (!child_shadow)
+        {
+            if (parent_shadow)
+            {
+                mobj_put_locked(&parent_shadow);
+            }
+            mobj_unlock(obj);
+            vmarea_free(new_vma);
+            goto error;
+        }
+        mobj_unlock(parent_shadow);
+        mobj_unlock(child_shadow);
+
+        vma->vma_obj = parent_shadow;
+        new_vma->vma_obj = child_shadow;
+        mobj_put_locked(&obj);
+
+        vmmap_insert(new_map, new_vma);
+    }
+    return new_map;
+
+error:
+    vmmap_destroy(&new_map);
     return NULL;
 }
 
@@ -190,8 +321,95 @@ vmmap_t *vmmap_clone(vmmap_t *map)
 long vmmap_map(vmmap_t *map, vnode_t *file, size_t lopage, size_t npages,
                int prot, int flags, off_t off, int dir, vmarea_t **new_vma)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_map");
-    return -1;
+    KASSERT(npages && PAGE_ALIGNED(off));
+    KASSERT((flags & MAP_TYPE) == MAP_SHARED ||
+            (flags & MAP_TYPE) == MAP_PRIVATE);
+
+    if (!lopage)
+    {
+        ssize_t start = vmmap_find_range(map, npages, dir);
+        if (start < 0)
+        {
+            return -ENOMEM;
+        }
+        lopage = (size_t)start;
+    }
+
+    vmarea_t *vma = vmarea_alloc();
+    if (!vma)
+    {
+        return -ENOMEM;
+    }
+
+    /*
+     * A file hands out the object its read() and write() go through (for a
+     * regular file, the vnode's own page cache), so a shared mapping sees
+     * and makes the same changes as they do.
+     */
+    mobj_t *obj;
+    if (file)
+    {
+        /* before the object, see vnode_t's vn_rwlock */
+        vlock_shared(file);
+        long ret = file->vn_ops->mmap(file, &obj);
+        if (ret)
+        {
+            vunlock_shared(file);
+            vmarea_free(vma);
+            return ret;
+        }
+        mobj_lock(obj);
+    }
+    else if (!(obj = anon_create()))
+    {
+        vmarea_free(vma);
+        return -ENOMEM;
+    }
+
+    if (flags & MAP_PRIVATE)
+    {
+        mobj_t *shadow = shadow_create(obj);
+        mobj_put_locked(&obj);
+        obj = shadow;
+    }
+    if (obj)
+    {
+        mobj_unlock(obj);
+    }
+    if (file)
+    {
+        vunlock_shared(file);
+    }
+    if (!obj)
+    {
+        vmarea_free(vma);
+        return -ENOMEM;
+    }
+
+    if ((flags & MAP_FIXED) && !vmmap_is_range_empty(map, lopage, npages))
+    {
+        long ret = vmmap_remove(map, lopage, npages);
+        if (ret)
+        {
+            mobj_put(&obj);
+            vmarea_free(vma);
+            return ret;
+        }
+    }
+
+    vma->vma_start = lopage;
+    vma->vma_end = lopage + npages;
+    vma->vma_off = ADDR_TO_PN(off);
+    vma->vma_prot = prot;
+    vma->vma_flags = flags;
+    vma->vma_advice = MADV_NORMAL;
+    vma->vma_obj = obj;
+    vmmap_insert(map, vma);
+    if (new_vma)
+    {
+        *new_vma = vma;
+    }
+    return 0;
 }
 
 /*
@@ -228,8 +446,66 @@ long vmmap_map(vmmap_t *map, vnode_t *file, size_t lopage, size_t npages,
  */
 long vmmap_remove(vmmap_t *map, size_t lopage, size_t npages)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_remove");
-    return -1;
+    size_t hipage = lopage + npages;
+    list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        if (vma->vma_end <= lopage || hipage <= vma->vma_start)
+        {
+            continue;
+        }
+
+        if (vma->vma_start < lopage && hipage < vma->vma_end)
+        {
+            /* case 1: the rest of the area after the hole needs its own */
+            vmarea_t *tail = vmarea_alloc();
+            if (!tail)
+            {
+                return -ENOMEM;
+            }
+            tail->vma_start = hipage;
+            tail->vma_end = vma->vma_end;
+            tail->vma_off = vma->vma_off + (hipage - vma->vma_start);
+            tail->vma_prot = vma->vma_prot;
+            tail->vma_flags = vma->vma_flags;
+            tail->vma_advice = vma->vma_advice;
+            tail->vma_obj = vma->vma_obj;
+            mobj_lock(tail->vma_obj);
+            mobj_ref(tail->vma_obj);
+            mobj_unlock(tail->vma_obj);
+
+            vma->vma_end = lopage;
+            vmmap_insert(map, tail);
+            break;
+        }
+        else if (vma->vma_start < lopage)
+        {
+            /* case 2 */
+            vma->vma_end = lopage;
+        }
+        else if (hipage < vma->vma_end)
+        {
+            /* case 3 */
+            vma->vma_off += hipage - vma->vma_start;
+            vma->vma_start = hipage;
+        }
+        else
+        {
+            /* case 4 */
+            vmarea_free(vma);
+        }
+    }
+
+    proc_t *proc = map->vmm_proc;
+    if (proc && proc->p_pml4)
+    {
+        uintptr_t vaddr = (uintptr_t)PN_TO_ADDR(lopage);
+        pt_unmap_range(proc->p_pml4, vaddr, (uintptr_t)PN_TO_ADDR(hipage));
+        if (proc == curproc)
+        {
+            tlb_flush_range(vaddr, npages);
+        }
+    }
+    return 0;
 }
 
 /*
@@ -238,8 +514,15 @@ long vmmap_remove(vmmap_t *map, size_t lopage, size_t npages)
  */
 long vmmap_is_range_empty(vmmap_t *map, size_t startvfn, size_t npages)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_is_range_empty");
-    return 0;
+    size_t endvfn = startvfn + npages;
+    list_iterate(&map->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        if (vma->vma_start < endvfn && startvfn < vma->vma_end)
+        {
+            return 0;
+        }
+    }
+    return 1;
 }
 
 /*
@@ -255,11 +538,36 @@ long vmmap_is_range_empty(vmmap_t *map, size_t startvfn, size_t npages)
  *  5) You may assume/assert that all areas exist.
  * 
  * Return 0 on success, -errno on error (propagate from the routines called).
- * This routine will be used within copy_from_user(). 
+ * copy_from_user() accesses the current address space directly, so this is
+ * for reading another process's memory.
  */
 long vmmap_read(vmmap_t *map, const void *vaddr, void *buf, size_t count)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_read");
+    while (count)
+    {
+        size_t vfn = ADDR_TO_PN(vaddr);
+        vmarea_t *vma = vmmap_lookup(map, vfn);
+        KASSERT(vma);
+
+        pframe_t *pf;
+        mobj_lock(vma->vma_obj);
+        long ret = mobj_get_pframe(
+            vma->vma_obj, vma->vma_off + (vfn - vma->vma_start), 0, &pf);
+        mobj_unlock(vma->vma_obj);
+        if (ret)
+        {
+            return ret;
+        }
+
+        size_t off = PAGE_OFFSET(vaddr);
+        size_t n = MIN(count, PAGE_SIZE - off);
+        memcpy(buf, (char *)pf->pf_addr + off, n);
+        pframe_release(&pf);
+
+        vaddr = (const char *)vaddr + n;
+        buf = (char *)buf + n;
+        count -= n;
+    }
     return 0;
 }
 
@@ -277,14 +585,155 @@ long vmmap_read(vmmap_t *map, const void *vaddr, void *buf, size_t count)
  *  6) Remember to dirty the pages that you write to. 
  * 
  * Returns 0 on success, -errno on error (propagate from the routines called).
- * This routine will be used within copy_to_user(). 
+ * copy_to_user() accesses the current address space directly, so this is
+ * for writing to an address space that is not running, such as the one exec
+ * is building.
  */
 long vmmap_write(vmmap_t *map, void *vaddr, const void *buf, size_t count)
 {
-    NOT_YET_IMPLEMENTED("VM: vmmap_write");
+    while (count)
+    {
+        size_t vfn = ADDR_TO_PN(vaddr);
+        vmarea_t *vma = vmmap_lookup(map, vfn);
+        KASSERT(vma);
+
+        pframe_t *pf;
+        mobj_lock(vma->vma_obj);
+        long ret = mobj_get_pframe(
+            vma->vma_obj, vma->vma_off + (vfn - vma->vma_start), 1, &pf);
+        mobj_unlock(vma->vma_obj);
+        if (ret)
+        {
+            return ret;
+        }
+
+        /*
+         * Writing may have given the page a private copy, so drop any
+         * mapping of the page it was copied from.
+         */
+        proc_t *proc = map->vmm_proc;
+        if (proc && proc->p_pml4)
+        {
+            pt_unmap(proc->p_pml4, (uintptr_t)PN_TO_ADDR(vfn));
+            if (proc == curproc)
+            {
+                tlb_flush((uintptr_t)PN_TO_ADDR(vfn));
+            }
+        }
+
+        size_t off = PAGE_OFFSET(vaddr);
+        size_t n = MIN(count, PAGE_SIZE - off);
+        memcpy((char *)pf->pf_addr + off, buf, n);
+        pframe_release(&pf);
+
+        vaddr = (char *)vaddr + n;
+        buf = (const char *)buf + n;
+        count -= n;
+    }
     return 0;
 }
 
+/*
+ * Return the vnode whose pages vma maps, directly or beneath the shadow
+ * objects of a private mapping, or NULL if it maps anonymous memory or a
+ * device.
+ */
+vnode_t *vmarea_vnode(vmarea_t *vma)
+{
+    mobj_t *obj = vma->vma_obj;
+    if (obj->mo_type == MOBJ_SHADOW)
+    {
+        obj = shadow_bottom(obj);
+    }
+    return obj->mo_type == MOBJ_VNODE ? CONTAINER_OF(obj, vnode_t, vn_mobj)
+                                      : NULL;
+}
+
+/*
+ * Bring pages [vfn, vfn + npages) of vma into its memory object without
+ * mapping them, so that faulting them in later does not wait for the disk or
+ * the swap device. Pages past the end of vma are ignored, and so are errors:
+ * this is only ever a hint.
+ */
+void vmarea_prefetch(vmarea_t *vma, size_t vfn, size_t npages)
+{
+    size_t end = MIN(vfn + npages, vma->vma_end);
+    mobj_t *obj = vma->vma_obj;
+
+    mobj_lock(obj);
+    for (; vfn < end; vfn++)
+    {
+        pframe_t *pf;
+        if (mobj_get_pframe(obj, vma->vma_off + (vfn - vma->vma_start), 0,
+                            &pf))
+        {
+            break;
+        }
+        pframe_release(&pf);
+    }
+    mobj_unlock(obj);
+}
+
+/*
+ * Remove the user mappings of pages [lopage, lopage + npages) of o from the
+ * page tables of proc, whether o is a vmarea's object or somewhere beneath it
+ * in a shadow chain.
+ */
+static void vmmap_unmap_object_proc(proc_t *proc, mobj_t *o, size_t lopage,
+                                    size_t npages)
+{
+    list_iterate(&proc->p_vmmap->vmm_list, vma, vmarea_t, vma_plink)
+    {
+        size_t lo = MAX(lopage, vma->vma_off);
+        size_t hi =
+            MIN(lopage + npages, vma->vma_off + (vma->vma_end - vma->vma_start));
+        if (lo >= hi || !shadow_chain_contains(vma->vma_obj, o))
+        {
+            continue;
+        }
+        uintptr_t vaddr =
+            (uintptr_t)PN_TO_ADDR(vma->vma_start + (lo - vma->vma_off));
+        pt_unmap_range(proc->p_pml4, vaddr, vaddr + (hi - lo) * PAGE_SIZE);
+        if (proc == curproc)
+        {
+            tlb_flush_range(vaddr, hi - lo);
+        }
+    }
+}
+
+/*
+ * There is no reverse map from pframes to page table entries, so remove the
+ * mappings of pages of o from every address space that can see them by
+ * walking the whole process tree (iteratively, it can be deep).
+ */
+void vmmap_unmap_object(mobj_t *o, size_t lopage, size_t npages)
+{
+    proc_t *proc = &idleproc;
+    while (1)
+    {
+        if (proc->p_state != PROC_DEAD && proc->p_vmmap && proc->p_pml4)
+        {
+            vmmap_unmap_object_proc(proc, o, lopage, npages);
+        }
+
+        if (!list_empty(&proc->p_children))
+        {
+            proc = list_head(&proc->p_children, proc_t, p_child_link);
+            continue;
+        }
+        while (proc != &idleproc &&
+               proc->p_child_link.l_next == &proc->p_pproc->p_children)
+        {
+            proc = proc->p_pproc;
+        }
+        if (proc == &idleproc)
+        {
+            return;
+        }
+        proc = list_item(proc->p_child_link.l_next, proc_t, p_child_link);
+    }
+}
+
 size_t vmmap_mapping_info(const void *vmmap, char *buf, size_t osize)
 {
     return vmmap_mapping_info_helper(vmmap, buf, osize, "");
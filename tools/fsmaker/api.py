@@ -7,6 +7,8 @@ S5_CURRENT_VERSION = 3
 S5_BLOCK_SIZE = 4096
 
 S5_NBLKS_PER_FNODE = 30
+S5_REFCOUNT_NBLOCKS = 16
+S5_REFCOUNTS_PER_BLOCK = S5_BLOCK_SIZE
 S5_NDIRECT_BLOCKS = 28
 S5_MAX_FILE_BLOCKS = S5_NDIRECT_BLOCKS + math.floor(S5_BLOCK_SIZE / 4)
 S5_MAX_FILE_SIZE = S5_MAX_FILE_BLOCKS * S5_BLOCK_SIZE
@@ -68,6 +70,15 @@ class Block:
             self._simdisk._simfile.write(b'\0')
 
     def free(self):
+        # a block shared by several files only loses a reference
+        refblockno = self._simdisk.get_refcount_block(math.floor(self._blockno / S5_REFCOUNTS_PER_BLOCK))
+        if (refblockno != 0):
+            refblock = self._simdisk.get_block(refblockno)
+            offset = self._blockno % S5_REFCOUNTS_PER_BLOCK
+            count = struct.unpack("B", refblock.read(offset, 1))[0]
+            if (count > 0):
+                refblock.write(offset, struct.pack("B", count - 1))
+                return
         if (self._simdisk.get_nfree() < S5_NBLKS_PER_FNODE - 1):
             self._simdisk.set_free_block(self._simdisk.get_nfree(), self._blockno)
             self._simdisk.set_nfree(self._simdisk.get_nfree() + 1)
@@ -539,6 +550,13 @@ class Simdisk:
         self._simfile.seek(20 + 4 * S5_NBLKS_PER_FNODE)
         self._simfile.write(struct.pack("I", val))
 
+    def get_refcount_block(self, index):
+        if (index < S5_REFCOUNT_NBLOCKS):
+            self._simfile.seek(24 + 4 * S5_NBLKS_PER_FNODE + 4 * index)
+            return struct.unpack("I", self._simfile.read(4))[0]
+        else:
+            return 0
+
     def get_super_block_summary(self):
         res = ""
         res += "magic:      0x{0:04x} ({1})\n".format(self.get_magic(), "VALID" if self.get_magic() == S5_MAGIC else "INVALID")
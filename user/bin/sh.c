@@ -938,6 +938,24 @@ static int do_cp(ioenv_t *io, const char *cmd, const char *in_file, int in_fd,
         out_fd = io->io_map_fd[out_fd];
     }
 
+    /* have the kernel move the data if it can, without copying it here */
+    ssize_t nsent;
+    int sent = 0;
+    while ((nsent = sendfile(out_fd, in_fd, NULL, buffer_sz)) > 0)
+    {
+        sent = 1;
+    }
+    if (!nsent)
+    {
+        return 1;
+    }
+    if (sent)
+    {
+        fprintf(stderr, "%s: unable to copy %s to %s: %s\n", cmd, in_file,
+                out_file, strerror(errno));
+        return 0;
+    }
+
     while ((nbytes_in = read(in_fd, buffer, buffer_sz)) > 0)
     {
         if ((nbytes_out = write(out_fd, buffer, nbytes_in)) < 0)
@@ -1,12 +1,34 @@
 #pragma once
 
 struct pthread;
-struct pthread_cond;
-struct pthread_mutex;
 
 typedef struct pthread *pthread_t;
-typedef struct pthread_mutex *pthread_mutex_t;
-typedef struct pthread_cond *pthread_cond_t;
+
+/*
+ * Mutexes and condition variables are words in user memory, and only enter
+ * the kernel (see futex() in unistd.h) when a thread has to wait or a waiting
+ * thread has to be woken up. Put them in a MAP_SHARED mapping to use them
+ * between processes.
+ */
+typedef struct pthread_mutex
+{
+    int m_state; /* 0 unlocked, 1 locked, 2 locked with waiters */
+} pthread_mutex_t;
+
+typedef struct pthread_cond
+{
+    int c_seq;                  /* bumped by every signal and broadcast */
+    pthread_mutex_t *c_mutex;   /* the mutex of the last waiter */
+} pthread_cond_t;
+
+#define PTHREAD_MUTEX_INITIALIZER \
+    {                             \
+        .m_state = 0              \
+    }
+#define PTHREAD_COND_INITIALIZER      \
+    {                                 \
+        .c_seq = 0, .c_mutex = 0      \
+    }
 
 /* Attributes NYI */
 typedef int pthread_attr_t;
@@ -46,6 +68,8 @@ int pthread_mutex_trylock(pthread_mutex_t *mtx);
 
 int pthread_mutex_unlock(pthread_mutex_t *mtx);
 
+int pthread_mutex_destroy(pthread_mutex_t *mtx);
+
 void pthread_yield(void);
 
 int pthread_cancel(pthread_t thr);
@@ -71,7 +95,6 @@ int             pthread_mutexattr_init(pthread_mutexattr_t *);
 int             pthread_mutexattr_destroy(pthread_mutexattr_t *);
 int             pthread_mutexattr_gettype(pthread_mutexattr_t *, int *);
 int             pthread_mutexattr_settype(pthread_mutexattr_t *, int);
-int             pthread_mutex_destroy(pthread_mutex_t *);
 int             pthread_attr_getstacksize(const pthread_attr_t *, size_t *);
 int             pthread_attr_getstackaddr(const pthread_attr_t *, void **);
 int             pthread_attr_getguardsize(const pthread_attr_t *, size_t *);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "sys/types.h"
+
+#define EPOLLIN 0x001  /* can be read without blocking */
+#define EPOLLOUT 0x004 /* can be written without blocking */
+#define EPOLLERR 0x008 /* the other end is gone (writing fails) */
+#define EPOLLHUP 0x010 /* the other end is gone (reading hits the end) */
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+/* most events epoll_wait(2) returns at once */
+#define EPOLL_MAX_EVENTS 64
+
+typedef union epoll_data {
+    void *ptr;
+    int fd;
+    uint32_t u32;
+    uint64_t u64;
+} epoll_data_t;
+
+struct epoll_event
+{
+    uint32_t events;
+    epoll_data_t data;
+};
+
+int epoll_create(int size);
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+               int timeout);
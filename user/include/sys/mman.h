@@ -23,3 +23,12 @@
  */
 #define MAP_FIXED 4
 #define MAP_ANON 8
+
+/* Advice for madvise().
+ */
+#define MADV_NORMAL 0     /* No special treatment. */
+#define MADV_RANDOM 1     /* Expect random references, don't read ahead. */
+#define MADV_SEQUENTIAL 2 /* Expect sequential references, read ahead. */
+#define MADV_WILLNEED 3   /* Bring the pages in now. */
+#define MADV_DONTNEED 4   /* Release the pages now. */
+#define MADV_FREE 8       /* Contents may be discarded. */
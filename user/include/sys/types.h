@@ -28,4 +28,11 @@ typedef uint32_t ino_t;
 typedef uint32_t devid_t;
 
 typedef uint64_t time_t;
-typedef uint64_t useconds_t;
\ No newline at end of file
+typedef uint64_t useconds_t;
+typedef int32_t clockid_t;
+
+struct timespec
+{
+    time_t tv_sec;
+    long tv_nsec;
+};
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "sys/types.h"
+
+/* most buffers readv(2) and friends take at once */
+#define IOV_MAX 64
+
+/* A buffer of a vectored read or write */
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
@@ -47,34 +47,59 @@ size_t get_free_mem(void);
 /* VFS-related */
 int open(const char *filename, int flags, int mode);
 
+int openat(int dirfd, const char *filename, int flags, int mode);
+
 int close(int fd);
 
 ssize_t read(int fd, void *buf, size_t count);
 
 ssize_t write(int fd, const void *buf, size_t count);
 
+ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+               size_t len);
+
+int clone_file_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+                     size_t len);
+
 off_t lseek(int fd, off_t offset, int whence);
 
+int posix_fadvise(int fd, off_t offset, off_t len, int advice);
+
 int dup(int fd);
 
 int dup2(int ofd, int nfd);
 
 int mkdir(const char *path, int mode);
 
+int mkdirat(int dirfd, const char *path, int mode);
+
 int rmdir(const char *path);
 
 int unlink(const char *path);
 
+int unlinkat(int dirfd, const char *path, int flags);
+
 int link(const char *oldpath, const char *newpath);
 
 int rename(const char *oldpath, const char *newpath);
 
+int renameat(int olddirfd, const char *oldpath, int newdirfd,
+             const char *newpath);
+
 int chdir(const char *path);
 
 int getdents(int fd, struct dirent *dir, size_t size);
 
 int stat(const char *path, struct stat *buf);
 
+int fstatat(int dirfd, const char *path, struct stat *buf, int flags);
+
 int pipe(int pipefd[2]);
 
 /* VM-related */
@@ -82,6 +107,8 @@ void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
 
 int munmap(void *addr, size_t len);
 
+int madvise(void *addr, size_t len, int advice);
+
 int brk(void *addr);
 
 void *sbrk(intptr_t incr);
@@ -96,6 +123,28 @@ time_t time(time_t *tloc);
 
 long usleep(useconds_t usec);
 
+#define CLOCK_REALTIME 0
+#define CLOCK_MONOTONIC 1
+
+int clock_gettime(clockid_t clock, struct timespec *tp);
+
+/* op is one of the FUTEX_* operations in weenix/syscall.h */
+int futex(int *uaddr, int op, int val, int *uaddr2, int val2);
+
+/*
+ * Runs up to to_submit entries of ring's submission queue and posts their
+ * completions (see io_ring_t in weenix/syscall.h). Returns how many it ran.
+ */
+struct io_ring;
+int ring_enter(struct io_ring *ring, unsigned int to_submit);
+
+/*
+ * Runs ncalls system calls in one trap and fills in each one's result (see
+ * multicall_entry_t in weenix/syscall.h). Returns how many it ran.
+ */
+struct multicall_entry;
+int multicall(struct multicall_entry *calls, int ncalls, int flags);
+
 #define STDIN_FILENO 0
 #define STDOUT_FILENO 1
 #define STDERR_FILENO 2
@@ -66,7 +66,7 @@ static int fdzero;
         if ((fdzero = _open("/dev/zero", O_RDWR, 0000)) == -1) \
             wrterror("open of /dev/zero");                     \
     }
-#define MADV_FREE MADV_DONTNEED
+#define HAS_MADVISE
 
 /*
  * No user serviceable parts behind this point.
@@ -191,7 +191,7 @@ static int suicide;
 static int malloc_realloc;
 
 /* pass the kernel a hint on free pages ?  */
-static int malloc_hint = 0;
+static int malloc_hint = 1;
 
 /* xmalloc behaviour ?  */
 static int malloc_xmalloc;
@@ -0,0 +1,121 @@
+#include "pthread/pthread.h"
+#include "errno.h"
+#include "limits.h"
+#include "unistd.h"
+#include "weenix/syscall.h"
+
+/*
+ * Mutexes follow Drepper's "Futexes Are Tricky": m_state is 0 when unlocked,
+ * 1 when locked, and 2 when locked and a thread may be waiting. Only taking a
+ * contended mutex or releasing one in state 2 enters the kernel.
+ */
+
+static int cmpxchg(int *p, int old, int new)
+{
+    __atomic_compare_exchange_n(p, &old, new, 0, __ATOMIC_ACQUIRE,
+                                __ATOMIC_RELAXED);
+    return old;
+}
+
+static int xchg(int *p, int new)
+{
+    return __atomic_exchange_n(p, new, __ATOMIC_ACQUIRE);
+}
+
+int pthread_mutex_init(pthread_mutex_t *mtx, const pthread_mutexattr_t *attr)
+{
+    mtx->m_state = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mtx)
+{
+    return mtx->m_state ? EBUSY : 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mtx)
+{
+    int c = cmpxchg(&mtx->m_state, 0, 1);
+    if (!c)
+    {
+        return 0;
+    }
+    if (c != 2)
+    {
+        c = xchg(&mtx->m_state, 2);
+    }
+    while (c)
+    {
+        futex(&mtx->m_state, FUTEX_WAIT, 2, NULL, 0);
+        c = xchg(&mtx->m_state, 2);
+    }
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mtx)
+{
+    return cmpxchg(&mtx->m_state, 0, 1) ? EBUSY : 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mtx)
+{
+    if (__atomic_fetch_sub(&mtx->m_state, 1, __ATOMIC_RELEASE) != 1)
+    {
+        __atomic_store_n(&mtx->m_state, 0, __ATOMIC_RELEASE);
+        futex(&mtx->m_state, FUTEX_WAKE, 1, NULL, 0);
+    }
+    return 0;
+}
+
+/*
+ * A waiter sleeps until c_seq moves past the value it saw before unlocking
+ * the mutex, so a signal sent in between is not lost. Broadcasts wake up one
+ * waiter and move the rest onto the mutex, where they are woken up one at a
+ * time as it is unlocked instead of all racing for it at once.
+ */
+
+int pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+    cond->c_seq = 0;
+    cond->c_mutex = NULL;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond) { return 0; }
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mtx)
+{
+    cond->c_mutex = mtx;
+    int seq = __atomic_load_n(&cond->c_seq, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(mtx);
+    futex(&cond->c_seq, FUTEX_WAIT, seq, NULL, 0);
+
+    /* we may have been moved onto the mutex, so it must be left contended */
+    while (xchg(&mtx->m_state, 2))
+    {
+        futex(&mtx->m_state, FUTEX_WAIT, 2, NULL, 0);
+    }
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+    __atomic_fetch_add(&cond->c_seq, 1, __ATOMIC_RELEASE);
+    futex(&cond->c_seq, FUTEX_WAKE, 1, NULL, 0);
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+    __atomic_fetch_add(&cond->c_seq, 1, __ATOMIC_RELEASE);
+    if (cond->c_mutex)
+    {
+        futex(&cond->c_seq, FUTEX_REQUEUE, 1, &cond->c_mutex->m_state,
+              INT_MAX);
+    }
+    else
+    {
+        futex(&cond->c_seq, FUTEX_WAKE, INT_MAX, NULL, 0);
+    }
+    return 0;
+}
@@ -8,6 +8,8 @@
 #include "weenix/trap.h"
 
 #include "dirent.h"
+#include "sys/epoll.h"
+#include "sys/uio.h"
 
 static void *__curbrk = NULL;
 #define MAX_EXIT_HANDLERS 32
@@ -154,6 +156,17 @@ int munmap(void *addr, size_t len)
     return (int)trap(SYS_munmap, (uintptr_t)&args);
 }
 
+int madvise(void *addr, size_t len, int advice)
+{
+    madvise_args_t args;
+
+    args.addr = addr;
+    args.len = len;
+    args.advice = advice;
+
+    return (int)trap(SYS_madvise, (uintptr_t)&args);
+}
+
 int debug(const char *str)
 {
     argstr_t argstr;
@@ -176,6 +189,19 @@ int open(const char *filename, int flags, int mode)
     return (int)trap(SYS_open, (uintptr_t)&args);
 }
 
+int openat(int dirfd, const char *filename, int flags, int mode)
+{
+    openat_args_t args;
+
+    args.dirfd = dirfd;
+    args.filename.as_len = strlen(filename);
+    args.filename.as_str = filename;
+    args.flags = flags;
+    args.mode = mode;
+
+    return (int)trap(SYS_openat, (uintptr_t)&args);
+}
+
 off_t lseek(int fd, off_t offset, int whence)
 {
     lseek_args_t args;
@@ -187,6 +213,19 @@ off_t lseek(int fd, off_t offset, int whence)
     return (int)trap(SYS_lseek, (uintptr_t)&args);
 }
 
+/* Returns an error number rather than -1 and errno, as POSIX specifies */
+int posix_fadvise(int fd, off_t offset, off_t len, int advice)
+{
+    fadvise_args_t args;
+
+    args.fd = fd;
+    args.offset = offset;
+    args.len = len;
+    args.advice = advice;
+
+    return trap(SYS_fadvise, (uintptr_t)&args) < 0 ? errno : 0;
+}
+
 ssize_t read(int fd, void *buf, size_t nbytes)
 {
     read_args_t args;
@@ -209,6 +248,160 @@ ssize_t write(int fd, const void *buf, size_t nbytes)
     return trap(SYS_write, (uintptr_t)&args);
 }
 
+ssize_t pread(int fd, void *buf, size_t nbytes, off_t offset)
+{
+    pread_args_t args;
+
+    args.fd = fd;
+    args.buf = buf;
+    args.nbytes = nbytes;
+    args.offset = offset;
+
+    return trap(SYS_pread, (uintptr_t)&args);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t nbytes, off_t offset)
+{
+    pwrite_args_t args;
+
+    args.fd = fd;
+    args.buf = (void *)buf;
+    args.nbytes = nbytes;
+    args.offset = offset;
+
+    return trap(SYS_pwrite, (uintptr_t)&args);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    sendfile_args_t args;
+
+    args.out_fd = out_fd;
+    args.in_fd = in_fd;
+    args.offset = offset;
+    args.count = count;
+
+    return trap(SYS_sendfile, (uintptr_t)&args);
+}
+
+ssize_t splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+               size_t len)
+{
+    splice_args_t args;
+
+    args.fd_in = fd_in;
+    args.off_in = off_in;
+    args.fd_out = fd_out;
+    args.off_out = off_out;
+    args.len = len;
+
+    return trap(SYS_splice, (uintptr_t)&args);
+}
+
+int clone_file_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+                     size_t len)
+{
+    clone_file_range_args_t args;
+
+    args.src_fd = src_fd;
+    args.src_off = src_off;
+    args.dst_fd = dst_fd;
+    args.dst_off = dst_off;
+    args.len = len;
+
+    return (int)trap(SYS_clone_file_range, (uintptr_t)&args);
+}
+
+/* size is only a hint, and is ignored as long as it is positive */
+int epoll_create(int size)
+{
+    if (size <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return (int)trap(SYS_epoll_create, 0);
+}
+
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    epoll_ctl_args_t args;
+
+    args.epfd = epfd;
+    args.op = op;
+    args.fd = fd;
+    args.event = event;
+
+    return (int)trap(SYS_epoll_ctl, (uintptr_t)&args);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+               int timeout)
+{
+    epoll_wait_args_t args;
+
+    args.epfd = epfd;
+    args.events = events;
+    args.maxevents = maxevents;
+    args.timeout = timeout;
+
+    return (int)trap(SYS_epoll_wait, (uintptr_t)&args);
+}
+
+int ring_enter(struct io_ring *ring, unsigned int to_submit)
+{
+    ring_enter_args_t args;
+
+    args.ring = ring;
+    args.to_submit = to_submit;
+
+    return (int)trap(SYS_ring_enter, (uintptr_t)&args);
+}
+
+int multicall(struct multicall_entry *calls, int ncalls, int flags)
+{
+    multicall_args_t args;
+
+    args.calls = calls;
+    args.ncalls = ncalls;
+    args.flags = flags;
+
+    return (int)trap(SYS_multicall, (uintptr_t)&args);
+}
+
+static ssize_t iov_trap(int sysnum, int fd, const struct iovec *iov,
+                        int iovcnt, off_t offset)
+{
+    iov_args_t args;
+
+    args.fd = fd;
+    args.iov = iov;
+    args.iovcnt = iovcnt;
+    args.offset = offset;
+
+    return trap(sysnum, (uintptr_t)&args);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    return iov_trap(SYS_readv, fd, iov, iovcnt, 0);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return iov_trap(SYS_writev, fd, iov, iovcnt, 0);
+}
+
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    return iov_trap(SYS_preadv, fd, iov, iovcnt, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{
+    return iov_trap(SYS_pwritev, fd, iov, iovcnt, offset);
+}
+
 int close(int fd) { return (int)trap(SYS_close, (ssize_t)fd); }
 
 int dup(int fd) { return (int)trap(SYS_dup, (ssize_t)fd); }
@@ -234,6 +427,18 @@ int mkdir(const char *path, int mode)
     return (int)trap(SYS_mkdir, (uintptr_t)&args);
 }
 
+int mkdirat(int dirfd, const char *path, int mode)
+{
+    mkdirat_args_t args;
+
+    args.dirfd = dirfd;
+    args.path.as_len = strlen(path);
+    args.path.as_str = path;
+    args.mode = mode;
+
+    return (int)trap(SYS_mkdirat, (uintptr_t)&args);
+}
+
 int rmdir(const char *path)
 {
     argstr_t args;
@@ -250,6 +455,18 @@ int unlink(const char *path)
     return (int)trap(SYS_unlink, (uintptr_t)&args);
 }
 
+int unlinkat(int dirfd, const char *path, int flags)
+{
+    unlinkat_args_t args;
+
+    args.dirfd = dirfd;
+    args.path.as_len = strlen(path);
+    args.path.as_str = path;
+    args.flags = flags;
+
+    return (int)trap(SYS_unlinkat, (uintptr_t)&args);
+}
+
 int link(const char *from, const char *to)
 {
     link_args_t args;
@@ -274,6 +491,21 @@ int rename(const char *oldpath, const char *newpath)
     return (int)trap(SYS_rename, (uintptr_t)&args);
 }
 
+int renameat(int olddirfd, const char *oldpath, int newdirfd,
+             const char *newpath)
+{
+    renameat_args_t args;
+
+    args.olddirfd = olddirfd;
+    args.oldpath.as_len = strlen(oldpath);
+    args.oldpath.as_str = oldpath;
+    args.newdirfd = newdirfd;
+    args.newpath.as_len = strlen(newpath);
+    args.newpath.as_str = newpath;
+
+    return (int)trap(SYS_renameat, (uintptr_t)&args);
+}
+
 int chdir(const char *path)
 {
     argstr_t args;
@@ -377,6 +609,19 @@ int stat(const char *path, stat_t *buf)
     return (int)trap(SYS_stat, (uintptr_t)&args);
 }
 
+int fstatat(int dirfd, const char *path, stat_t *buf, int flags)
+{
+    fstatat_args_t args;
+
+    args.dirfd = dirfd;
+    args.path.as_len = strlen(path);
+    args.path.as_str = path;
+    args.buf = buf;
+    args.flags = flags;
+
+    return (int)trap(SYS_fstatat, (uintptr_t)&args);
+}
+
 int pipe(int pipefd[2]) { return (int)trap(SYS_pipe, (uintptr_t)pipefd); }
 
 int uname(struct utsname *buf) { return (int)trap(SYS_uname, (uintptr_t)buf); }
@@ -388,4 +633,12 @@ long usleep(useconds_t usec)
     usleep_args_t args;
     args.usec = usec;
     return (long)trap(SYS_usleep, (uintptr_t)&args);
+}
+
+int clock_gettime(clockid_t clock, struct timespec *tp)
+{
+    clock_gettime_args_t args;
+    args.clock = clock;
+    args.tp = tp;
+    return (int)trap(SYS_clock_gettime, (uintptr_t)&args);
 }
\ No newline at end of file
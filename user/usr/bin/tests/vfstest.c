@@ -37,6 +37,7 @@
 #include <stdio.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <weenix/syscall.h>
 
@@ -670,6 +671,84 @@ static void vfstest_write(void)
     syscall_success(rmdir("write"));
 }
 
+/*
+ * Tests writev(), readv(), pwritev() and preadv() with a vector bigger than
+ * the buffer the kernel copies it through (64KB)
+ *      - The whole vector is written and read back in one call
+ *      - Positions advance by what was moved, offsets leave them alone
+ *      - A read that runs past the end of the file stops there
+ */
+static void vfstest_rwv(void)
+{
+#define RWV_SEGS 3
+#define RWV_SEG_SIZE (40 * 1024)
+#define RWV_SIZE (RWV_SEGS * RWV_SEG_SIZE)
+    int fd, i, res;
+    struct iovec iov[RWV_SEGS];
+
+    char *buf = malloc(RWV_SIZE);
+    test_assert(NULL != buf, "malloc of %d bytes failed", RWV_SIZE);
+    if (NULL == buf)
+    {
+        return;
+    }
+    for (i = 0; i < RWV_SEGS; i++)
+    {
+        iov[i].iov_base = buf + i * RWV_SEG_SIZE;
+        iov[i].iov_len = RWV_SEG_SIZE;
+    }
+    for (i = 0; i < RWV_SIZE; i++)
+    {
+        buf[i] = (char)(i % 251);
+    }
+
+    syscall_success(mkdir("rwv", 0));
+    syscall_success(chdir("rwv"));
+
+    create_file("file");
+    syscall_success(fd = open("file", O_RDWR, 0));
+    syscall_success(res = writev(fd, iov, RWV_SEGS));
+    test_assert(RWV_SIZE == res, "writev of %d bytes returned %d", RWV_SIZE,
+                res);
+    test_assert(RWV_SIZE == lseek(fd, 0, SEEK_CUR),
+                "writev did not advance the position");
+
+    memset(buf, 0, RWV_SIZE);
+    syscall_success(res = preadv(fd, iov, RWV_SEGS, 0));
+    test_assert(RWV_SIZE == res, "preadv of %d bytes returned %d", RWV_SIZE,
+                res);
+    for (i = 0; i < RWV_SIZE && buf[i] == (char)(i % 251); i++)
+        ;
+    test_assert(RWV_SIZE == i, "preadv data incorrect at byte %d", i);
+    test_assert(RWV_SIZE == lseek(fd, 0, SEEK_CUR),
+                "preadv moved the position");
+
+    syscall_success(res = pwritev(fd, iov, RWV_SEGS, RWV_SEG_SIZE));
+    test_assert(RWV_SIZE == res, "pwritev of %d bytes returned %d", RWV_SIZE,
+                res);
+    test_assert(RWV_SIZE + RWV_SEG_SIZE == lseek(fd, 0, SEEK_END),
+                "pwritev did not extend the file");
+
+    syscall_success(lseek(fd, 2 * RWV_SEG_SIZE, SEEK_SET));
+    memset(buf, 0, RWV_SIZE);
+    syscall_success(res = readv(fd, iov, RWV_SEGS));
+    test_assert(2 * RWV_SEG_SIZE == res, "readv at the end returned %d", res);
+    for (i = 0; i < 2 * RWV_SEG_SIZE &&
+                buf[i] == (char)((i + RWV_SEG_SIZE) % 251);
+         i++)
+        ;
+    test_assert(2 * RWV_SEG_SIZE == i, "readv data incorrect at byte %d", i);
+    test_assert(RWV_SIZE + RWV_SEG_SIZE == lseek(fd, 0, SEEK_CUR),
+                "readv did not advance the position");
+
+    syscall_success(close(fd));
+    syscall_success(unlink("file"));
+    free(buf);
+
+    syscall_success(chdir(".."));
+    syscall_success(rmdir("rwv"));
+}
+
 /* These operations should run for a long time and halt when the file
  * descriptor overflows. */
 static void vfstest_infinite(void)
@@ -1158,6 +1237,7 @@ int vfstest_main(int argc, char **argv)
     vfstest_getdents();
     vfstest_memdev();
     vfstest_write();
+    vfstest_rwv();
 
 #ifdef __VM__
     vfstest_s5fs_vm();